@@ -0,0 +1,410 @@
+#ifndef KANAVAL_ARROW_HPP
+#define KANAVAL_ARROW_HPP
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @file arrow.hpp
+ *
+ * @brief Minimal writer for the Arrow IPC streaming format.
+ */
+
+namespace kanaval {
+
+namespace arrow {
+
+namespace flatbuf {
+
+// Minimal FlatBuffers builder, sufficient for the Arrow IPC metadata.
+// Like the reference implementation, the buffer is built back-to-front so that children are always written before their parents;
+// offsets to objects are reported as their distance from the end of the buffer.
+// Bytes are stored in reverse order in `rev`, so the final buffer is obtained by reversing it in `finish()`.
+class Builder {
+public:
+    typedef uint32_t Offset;
+
+    void start_table() {
+        fields.clear();
+        table_start = rev.size();
+    }
+
+    template<typename T>
+    void add_scalar(int id, T value) {
+        align(sizeof(T));
+        push(value);
+        fields.emplace_back(id, rev.size());
+    }
+
+    void add_offset(int id, Offset target) {
+        align(4);
+        push(static_cast<uint32_t>(rev.size() + 4 - target));
+        fields.emplace_back(id, rev.size());
+    }
+
+    Offset end_table() {
+        align(4);
+        push(static_cast<int32_t>(0));
+        Offset table = rev.size();
+
+        int nfields = 0;
+        for (const auto& f : fields) {
+            nfields = std::max(nfields, f.first + 1);
+        }
+        std::vector<uint16_t> entries(nfields);
+        for (const auto& f : fields) {
+            entries[f.first] = table - f.second;
+        }
+
+        for (int i = nfields; i > 0; --i) {
+            push(entries[i - 1]);
+        }
+        push(static_cast<uint16_t>(table - table_start));
+        push(static_cast<uint16_t>(4 + 2 * nfields));
+
+        // The vtable lies before the table, so the signed offset from the table to its vtable is positive.
+        patch(table, static_cast<int32_t>(rev.size() - table));
+        return table;
+    }
+
+    Offset create_string(const std::string& x) {
+        pre_align(x.size() + 1, 4);
+        rev.push_back(0);
+        for (size_t i = x.size(); i > 0; --i) {
+            rev.push_back(x[i - 1]);
+        }
+        push(static_cast<uint32_t>(x.size()));
+        return rev.size();
+    }
+
+    Offset create_offset_vector(const std::vector<Offset>& targets) {
+        pre_align(targets.size() * 4, 4);
+        for (size_t i = targets.size(); i > 0; --i) {
+            push(static_cast<uint32_t>(rev.size() + 4 - targets[i - 1]));
+        }
+        push(static_cast<uint32_t>(targets.size()));
+        return rev.size();
+    }
+
+    // Vector of structs containing two 64-bit integers, i.e., Arrow's `FieldNode` and `Buffer`.
+    Offset create_pair_vector(const std::vector<std::pair<int64_t, int64_t> >& values) {
+        pre_align(values.size() * 16, 8);
+        for (size_t i = values.size(); i > 0; --i) {
+            push(values[i - 1].second);
+            push(values[i - 1].first);
+        }
+        push(static_cast<uint32_t>(values.size()));
+        return rev.size();
+    }
+
+    std::vector<unsigned char> finish(Offset root) {
+        pre_align(4, 8);
+        push(static_cast<uint32_t>(rev.size() + 4 - root));
+        return std::vector<unsigned char>(rev.rbegin(), rev.rend());
+    }
+
+private:
+    std::vector<unsigned char> rev;
+    std::vector<std::pair<int, Offset> > fields;
+    Offset table_start = 0;
+
+    // Values are written in little-endian order; as the buffer is reversed, the most significant byte is pushed first.
+    template<typename T>
+    void push(T value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (size_t b = sizeof(T); b > 0; --b) {
+            rev.push_back(bytes[b - 1]);
+        }
+    }
+
+    void patch(Offset position, int32_t value) {
+        unsigned char bytes[4];
+        std::memcpy(bytes, &value, 4);
+        for (size_t b = 0; b < 4; ++b) {
+            rev[position - 1 - b] = bytes[b];
+        }
+    }
+
+    // The final buffer has a length that is a multiple of 8, so an object is aligned if its distance from the end is aligned.
+    void pre_align(size_t len, size_t alignment) {
+        while ((rev.size() + len) % alignment) {
+            rev.push_back(0);
+        }
+    }
+
+    void align(size_t alignment) {
+        pre_align(0, alignment);
+    }
+};
+
+}
+
+/**
+ * Supported column types.
+ */
+enum class Type {
+    BOOL,
+    INT32,
+    FLOAT64
+};
+
+/**
+ * @brief Description of a column in the schema.
+ */
+struct Field {
+    /**
+     * Name of the column.
+     */
+    std::string name;
+
+    /**
+     * Type of the column.
+     */
+    Type type;
+
+    /**
+     * Whether the column may contain nulls.
+     */
+    bool nullable = false;
+};
+
+/**
+ * @brief Contents of a column in a record batch, in the Arrow memory layout.
+ */
+struct Column {
+    /**
+     * Bit-packed values for `Type::BOOL`, otherwise little-endian values.
+     */
+    std::vector<unsigned char> values;
+
+    /**
+     * Bit-packed validity bitmap, where set bits indicate non-null values.
+     * This may be empty if `null_count` is zero.
+     */
+    std::vector<unsigned char> validity;
+
+    /**
+     * Number of nulls in the column.
+     */
+    size_t null_count = 0;
+};
+
+/**
+ * Pack an array of flags into an Arrow bitmap, i.e., least significant bit first.
+ *
+ * @param flags Pointer to an array of flags, where any non-zero value is treated as true.
+ * @param n Length of the array.
+ * @param[out] output Vector to store the bitmap.
+ * On output, this has length equal to the number of bytes required to store `n` bits.
+ */
+inline void pack_bits(const unsigned char* flags, size_t n, std::vector<unsigned char>& output) {
+    output.assign((n + 7) / 8, 0);
+    for (size_t i = 0; i < n; ++i) {
+        output[i / 8] |= static_cast<unsigned char>(flags[i] != 0) << (i % 8);
+    }
+}
+
+// Arrow buffers are little-endian, so we need to know whether values must be byte-swapped.
+// This is usually folded into a constant by the compiler.
+inline bool big_endian_host() {
+    uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 0;
+}
+
+/**
+ * Copy values into the data buffer of a column, in little-endian order.
+ * On big-endian hosts, the bytes of each value are reversed during the copy.
+ *
+ * @tparam T Type of the values, i.e., `int32_t` or `double`.
+ * @param values Pointer to an array of values.
+ * @param n Length of the array.
+ * @param[out] column Column to store the values.
+ */
+template<typename T>
+void fill_values(const T* values, size_t n, Column& column) {
+    column.values.resize(n * sizeof(T));
+    if (n) {
+        std::memcpy(column.values.data(), values, n * sizeof(T));
+        if (big_endian_host()) {
+            for (size_t i = 0; i < n; ++i) {
+                auto start = column.values.begin() + i * sizeof(T);
+                std::reverse(start, start + sizeof(T));
+            }
+        }
+    }
+}
+
+/**
+ * @brief Write record batches in the Arrow IPC streaming format.
+ *
+ * The schema is written upon construction, and each call to `write()` appends a record batch.
+ * The end-of-stream marker is written by `close()`.
+ * The output can be read by any Arrow implementation, e.g., with `pyarrow.ipc.open_stream()`.
+ * Only uncompressed batches of `Type` columns are supported.
+ */
+class StreamWriter {
+public:
+    /**
+     * @param stream Output stream, opened in binary mode.
+     * @param fields Description of the columns.
+     */
+    StreamWriter(std::ostream& stream, std::vector<Field> fields) : stream(stream), fields(std::move(fields)) {
+        flatbuf::Builder builder;
+
+        std::vector<flatbuf::Builder::Offset> children;
+        for (const auto& f : this->fields) {
+            auto name = builder.create_string(f.name);
+
+            uint8_t type_id;
+            builder.start_table();
+            if (f.type == Type::INT32) {
+                builder.add_scalar<int32_t>(0, 32); // bitWidth
+                builder.add_scalar<uint8_t>(1, 1); // is_signed
+                type_id = 2;
+            } else if (f.type == Type::FLOAT64) {
+                builder.add_scalar<int16_t>(0, 2); // precision = DOUBLE
+                type_id = 3;
+            } else {
+                type_id = 6;
+            }
+            auto type = builder.end_table();
+
+            auto grandchildren = builder.create_offset_vector({});
+
+            builder.start_table();
+            builder.add_offset(0, name);
+            builder.add_scalar<uint8_t>(1, f.nullable);
+            builder.add_scalar<uint8_t>(2, type_id);
+            builder.add_offset(3, type);
+            builder.add_offset(5, grandchildren);
+            children.push_back(builder.end_table());
+        }
+        auto vec = builder.create_offset_vector(children);
+
+        builder.start_table();
+        builder.add_scalar<int16_t>(0, 0); // endianness = Little
+        builder.add_offset(1, vec);
+        auto schema = builder.end_table();
+
+        write_message(builder, 1, schema, 0);
+    }
+
+    /**
+     * @param num_rows Number of rows in the batch.
+     * @param columns Contents of each column, in the same order as the fields used in the constructor.
+     */
+    void write(size_t num_rows, const std::vector<Column>& columns) {
+        if (columns.size() != fields.size()) {
+            throw std::runtime_error("number of columns should be equal to the number of fields");
+        }
+
+        std::vector<std::pair<int64_t, int64_t> > nodes, buffers;
+        int64_t offset = 0;
+        auto add_buffer = [&](size_t len) -> void {
+            buffers.emplace_back(offset, len);
+            offset += padded(len);
+        };
+
+        for (size_t c = 0; c < columns.size(); ++c) {
+            const auto& col = columns[c];
+            size_t expected = (fields[c].type == Type::BOOL ? (num_rows + 7) / 8 : num_rows * width(fields[c].type));
+            if (col.values.size() != expected) {
+                throw std::runtime_error("unexpected size of the values for column '" + fields[c].name + "'");
+            }
+            if (col.null_count && col.validity.size() != (num_rows + 7) / 8) {
+                throw std::runtime_error("unexpected size of the validity bitmap for column '" + fields[c].name + "'");
+            }
+
+            nodes.emplace_back(num_rows, col.null_count);
+            add_buffer(col.null_count ? col.validity.size() : 0);
+            add_buffer(col.values.size());
+        }
+
+        flatbuf::Builder builder;
+        auto bvec = builder.create_pair_vector(buffers);
+        auto nvec = builder.create_pair_vector(nodes);
+        builder.start_table();
+        builder.add_scalar<int64_t>(0, num_rows);
+        builder.add_offset(1, nvec);
+        builder.add_offset(2, bvec);
+        auto batch = builder.end_table();
+
+        write_message(builder, 3, batch, offset);
+
+        for (const auto& col : columns) {
+            if (col.null_count) {
+                write_padded(col.validity);
+            }
+            write_padded(col.values);
+        }
+    }
+
+    /**
+     * Write the end-of-stream marker.
+     */
+    void close() {
+        write_u32(0xFFFFFFFFu);
+        write_u32(0);
+        stream.flush();
+        if (!stream) {
+            throw std::runtime_error("failed to write the Arrow stream");
+        }
+    }
+
+private:
+    std::ostream& stream;
+    std::vector<Field> fields;
+
+    static size_t width(Type type) {
+        return (type == Type::INT32 ? 4 : 8);
+    }
+
+    static size_t padded(size_t len) {
+        return (len + 7) / 8 * 8;
+    }
+
+    void write_u32(uint32_t value) {
+        unsigned char bytes[4];
+        for (int b = 0; b < 4; ++b) {
+            bytes[b] = (value >> (8 * b)) & 0xFF;
+        }
+        stream.write(reinterpret_cast<const char*>(bytes), 4);
+    }
+
+    void write_padded(const std::vector<unsigned char>& bytes) {
+        stream.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        static const char zeros[8] = { 0 };
+        stream.write(zeros, padded(bytes.size()) - bytes.size());
+    }
+
+    // Each message is prefixed by a continuation marker and the length of the metadata,
+    // which is padded so that the body starts on an 8-byte boundary.
+    void write_message(flatbuf::Builder& builder, uint8_t header_type, flatbuf::Builder::Offset header, int64_t body_length) {
+        builder.start_table();
+        builder.add_scalar<int64_t>(3, body_length);
+        builder.add_offset(2, header);
+        builder.add_scalar<int16_t>(0, 4); // version = V5
+        builder.add_scalar<uint8_t>(1, header_type);
+        auto message = builder.finish(builder.end_table());
+
+        std::vector<unsigned char> meta(message.begin(), message.end());
+        meta.resize(padded(meta.size() + 8) - 8, 0);
+        write_u32(0xFFFFFFFFu);
+        write_u32(meta.size());
+        stream.write(reinterpret_cast<const char*>(meta.data()), meta.size());
+    }
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef KANAVAL_BITVECTOR_HPP
+#define KANAVAL_BITVECTOR_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @file bitvector.hpp
+ *
+ * @brief Succinct bitvector with rank and select.
+ */
+
+namespace kanaval {
+
+/**
+ * @brief Bitvector with constant-time rank and select.
+ *
+ * Bits are appended with `push_back()` and the rank/select directories are built by `finish()`.
+ * The directories store the cumulative number of set bits for every 512 bits,
+ * and the position of every 512th set bit, so the overhead is about 0.25 bits per entry on top of the bits themselves.
+ * Rank then involves one directory lookup and at most 8 popcounts,
+ * while select involves one sampled lookup, a binary search of the directory between consecutive samples, and at most 8 popcounts.
+ */
+class BitVector {
+public:
+    /**
+     * @param value Value of the bit to append.
+     */
+    void push_back(bool value) {
+        if (len % 64 == 0) {
+            words.push_back(0);
+        }
+        words.back() |= static_cast<uint64_t>(value) << (len % 64);
+        ++len;
+    }
+
+    /**
+     * @param n Number of bits to append.
+     * @param value Value of the bits.
+     */
+    void append(size_t n, bool value) {
+        for (size_t i = 0; i < n; ++i) {
+            push_back(value);
+        }
+    }
+
+    /**
+     * Build the rank/select directories.
+     * This should be called after all bits are appended and before calling `rank()` or `select()`.
+     */
+    void finish() {
+        size_t nblocks = words.size() / words_per_block + 1;
+        blocks.assign(nblocks + 1, 0);
+        samples.clear();
+
+        uint64_t total = 0;
+        for (size_t w = 0; w < words.size(); ++w) {
+            if (w % words_per_block == 0) {
+                blocks[w / words_per_block] = total;
+            }
+
+            // Recording the word containing every 'sample_rate'-th set bit.
+            total += popcount(words[w]);
+            while (samples.size() * sample_rate < total) {
+                samples.push_back(w);
+            }
+        }
+
+        for (size_t b = (words.size() + words_per_block - 1) / words_per_block; b < blocks.size(); ++b) {
+            blocks[b] = total;
+        }
+        ones = total;
+    }
+
+    /**
+     * @return Number of bits.
+     */
+    size_t size() const {
+        return len;
+    }
+
+    /**
+     * @return Number of set bits.
+     * Only available after `finish()`.
+     */
+    size_t count() const {
+        return ones;
+    }
+
+    /**
+     * @param i Position of the bit.
+     * @return Value of the bit.
+     */
+    bool get(size_t i) const {
+        return (words[i / 64] >> (i % 64)) & 1u;
+    }
+
+    /**
+     * @param i Position in the bitvector, no greater than `size()`.
+     * @return Number of set bits in `[0, i)`.
+     */
+    size_t rank(size_t i) const {
+        size_t w = i / 64;
+        size_t b = w / words_per_block;
+        uint64_t output = blocks[b];
+        for (size_t x = b * words_per_block; x < w; ++x) {
+            output += popcount(words[x]);
+        }
+        size_t remainder = i % 64;
+        if (remainder) {
+            output += popcount(words[w] & ((static_cast<uint64_t>(1) << remainder) - 1));
+        }
+        return output;
+    }
+
+    /**
+     * @param j Index of the set bit, less than `count()`.
+     * @return Position of the `j`-th set bit (zero-based).
+     */
+    size_t select(size_t j) const {
+        if (j >= ones) {
+            throw std::out_of_range("select index exceeds the number of set bits");
+        }
+
+        // Searching the directory between the words containing the flanking sampled set bits,
+        // to find the last block that starts with no more than 'j' set bits before it.
+        size_t s = j / sample_rate;
+        size_t w = samples[s];
+        auto first = blocks.begin() + w / words_per_block;
+        auto last = (s + 1 < samples.size() ? blocks.begin() + samples[s + 1] / words_per_block + 1 : blocks.end());
+        size_t b = (std::upper_bound(first, last, static_cast<uint64_t>(j)) - blocks.begin()) - 1;
+
+        w = std::max(w, b * words_per_block);
+        uint64_t seen = rank(w * 64);
+        while (true) {
+            uint64_t current = popcount(words[w]);
+            if (seen + current > j) {
+                break;
+            }
+            seen += current;
+            ++w;
+        }
+
+        uint64_t word = words[w];
+        for (size_t k = j - seen; k > 0; --k) {
+            word &= word - 1; // clear the lowest set bit.
+        }
+        return w * 64 + ctz(word);
+    }
+
+private:
+    static constexpr size_t words_per_block = 8;
+    static constexpr size_t sample_rate = 512;
+
+    std::vector<uint64_t> words;
+    size_t len = 0;
+    uint64_t ones = 0;
+    std::vector<uint64_t> blocks;
+    std::vector<size_t> samples;
+
+    static uint64_t popcount(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(x);
+#else
+        x = x - ((x >> 1) & 0x5555555555555555ull);
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return (x * 0x0101010101010101ull) >> 56;
+#endif
+    }
+
+    static size_t ctz(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(x);
+#else
+        size_t n = 0;
+        while (!(x & 1u)) {
+            x >>= 1;
+            ++n;
+        }
+        return n;
+#endif
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,794 @@
+#ifndef KANAVAL_CONTAINER_HPP
+#define KANAVAL_CONTAINER_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include "v2/inputs.hpp"
+#include "v3/inputs.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#define KANAVAL_HAS_POSIX_IO 1
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+/**
+ * @file container.hpp
+ *
+ * @brief Pack the state file and input files into a `.kana` file, and unpack them again.
+ */
+
+namespace kanaval {
+
+namespace container {
+
+/**
+ * Format type for `.kana` files where the input files are embedded after the state file.
+ */
+inline constexpr uint64_t EMBEDDED = 0;
+
+/**
+ * Format type for `.kana` files where the input files are linked, i.e., stored elsewhere.
+ */
+inline constexpr uint64_t LINKED = 1;
+
+/**
+ * Size of the header at the start of each `.kana` file.
+ */
+inline constexpr size_t header_size = 24;
+
+/**
+ * @brief Header of a `.kana` file.
+ */
+struct Header {
+    /**
+     * Format type, i.e., `EMBEDDED` or `LINKED`.
+     */
+    uint64_t format_type = EMBEDDED;
+
+    /**
+     * Version of the kana file.
+     */
+    uint64_t version = 0;
+
+    /**
+     * Size of the HDF5 state file in bytes.
+     */
+    uint64_t state_nbytes = 0;
+};
+
+/**
+ * @param header Header of a `.kana` file.
+ * @param[out] buffer Array of length `header_size`, to store the little-endian encoding of the header.
+ */
+inline void encode_header(const Header& header, unsigned char* buffer) {
+    uint64_t fields[3] = { header.format_type, header.version, header.state_nbytes };
+    for (int f = 0; f < 3; ++f) {
+        for (int b = 0; b < 8; ++b) {
+            buffer[f * 8 + b] = (fields[f] >> (8 * b)) & 0xFF;
+        }
+    }
+}
+
+/**
+ * @param buffer Array of length `header_size`, containing the first bytes of a `.kana` file.
+ * @return The decoded header.
+ */
+inline Header decode_header(const unsigned char* buffer) {
+    uint64_t fields[3] = { 0, 0, 0 };
+    for (int f = 0; f < 3; ++f) {
+        for (int b = 8; b > 0; --b) {
+            fields[f] = (fields[f] << 8) | buffer[f * 8 + b - 1];
+        }
+    }
+
+    Header output;
+    output.format_type = fields[0];
+    output.version = fields[1];
+    output.state_nbytes = fields[2];
+    return output;
+}
+
+/**
+ * @param handle Open handle to a HDF5 state file.
+ * @return Groups describing each input file, in the order in which the files should be embedded.
+ * For v3 files, this is `inputs/parameters/datasets/<d>/files/<f>` for each dataset `d` and file `f`;
+ * for earlier versions, this is `inputs/parameters/files/<f>`.
+ */
+inline std::vector<H5::Group> list_file_groups(const H5::H5File& handle) {
+    auto phandle = utils::check_and_open_group(utils::check_and_open_group(handle, "inputs"), "parameters");
+    std::vector<H5::Group> output;
+
+    auto add_files = [&](const H5::Group& fhandle) -> void {
+        size_t nfiles = fhandle.getNumObjs();
+        for (size_t f = 0; f < nfiles; ++f) {
+            output.push_back(utils::check_and_open_group(fhandle, std::to_string(f)));
+        }
+    };
+
+    if (phandle.exists("datasets")) {
+        auto dhandle = utils::check_and_open_group(phandle, "datasets");
+        size_t ndatasets = dhandle.getNumObjs();
+        for (size_t d = 0; d < ndatasets; ++d) {
+            auto curdhandle = utils::check_and_open_group(dhandle, std::to_string(d));
+            add_files(utils::check_and_open_group(curdhandle, "files"));
+        }
+    } else {
+        add_files(utils::check_and_open_group(phandle, "files"));
+    }
+
+    return output;
+}
+
+// Sink for the packed file.
+// On POSIX systems, the contents of input files are transferred by the kernel where possible,
+// i.e., with `copy_file_range()` (which may share extents on filesystems like Btrfs and XFS) or `sendfile()` on Linux.
+// If neither is supported for a given pair of files, or on other systems, we fall back to buffered copies.
+class Output {
+public:
+    Output(const std::string& path) : path(path) {
+#ifdef KANAVAL_HAS_POSIX_IO
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open '" + path + "' for writing");
+        }
+#else
+        stream.open(path, std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            throw std::runtime_error("failed to open '" + path + "' for writing");
+        }
+#endif
+    }
+
+    ~Output() {
+#ifdef KANAVAL_HAS_POSIX_IO
+        if (fd >= 0) {
+            ::close(fd);
+        }
+#endif
+    }
+
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    void write(const unsigned char* buffer, size_t n) {
+#ifdef KANAVAL_HAS_POSIX_IO
+        while (n) {
+            auto written = ::write(fd, buffer, n);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("failed to write to '" + path + "'");
+            }
+            buffer += written;
+            n -= written;
+        }
+#else
+        stream.write(reinterpret_cast<const char*>(buffer), n);
+        if (!stream) {
+            throw std::runtime_error("failed to write to '" + path + "'");
+        }
+#endif
+    }
+
+    // Append the first `n` bytes of the file at `input`, which should have exactly `n` bytes.
+    void append(const std::string& input, uint64_t n) {
+#ifdef KANAVAL_HAS_POSIX_IO
+        int in = ::open(input.c_str(), O_RDONLY);
+        if (in < 0) {
+            throw std::runtime_error("failed to open '" + input + "' for reading");
+        }
+
+        try {
+            struct stat info;
+            if (::fstat(in, &info) != 0 || static_cast<uint64_t>(info.st_size) != n) {
+                throw std::runtime_error("size of '" + input + "' changed during packing");
+            }
+            uint64_t remaining = n;
+
+#ifdef __linux__
+            // Trying a kernel-side copy first. Both calls advance the file offsets, so any remainder can be handled by the next method.
+            while (remaining && use_copy_file_range) {
+                auto copied = ::copy_file_range(in, NULL, fd, NULL, remaining, 0);
+                if (copied > 0) {
+                    remaining -= copied;
+                } else if (copied < 0 && errno == EINTR) {
+                    continue;
+                } else if (copied < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP || errno == EBADF)) {
+                    use_copy_file_range = false;
+                } else {
+                    break;
+                }
+            }
+
+            while (remaining && use_sendfile) {
+                auto copied = ::sendfile(fd, in, NULL, remaining);
+                if (copied > 0) {
+                    remaining -= copied;
+                } else if (copied < 0 && errno == EINTR) {
+                    continue;
+                } else if (copied < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                    use_sendfile = false;
+                } else {
+                    break;
+                }
+            }
+#endif
+
+            std::vector<unsigned char> buffer;
+            while (remaining) {
+                buffer.resize(std::min(remaining, buffer_size));
+                auto nread = ::read(in, buffer.data(), buffer.size());
+                if (nread < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (nread <= 0) {
+                    throw std::runtime_error("failed to read from '" + input + "'");
+                }
+                write(buffer.data(), nread);
+                remaining -= nread;
+            }
+
+        } catch (...) {
+            ::close(in);
+            throw;
+        }
+        ::close(in);
+
+#else
+        std::ifstream in(input, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("failed to open '" + input + "' for reading");
+        }
+        std::vector<char> buffer;
+        uint64_t remaining = n;
+        while (remaining) {
+            buffer.resize(std::min(remaining, buffer_size));
+            in.read(buffer.data(), buffer.size());
+            if (static_cast<size_t>(in.gcount()) != buffer.size()) {
+                throw std::runtime_error("size of '" + input + "' changed during packing");
+            }
+            write(reinterpret_cast<const unsigned char*>(buffer.data()), buffer.size());
+            remaining -= buffer.size();
+        }
+#endif
+    }
+
+    void close() {
+#ifdef KANAVAL_HAS_POSIX_IO
+        int status = ::close(fd);
+        fd = -1;
+        if (status != 0) {
+            throw std::runtime_error("failed to close '" + path + "'");
+        }
+#else
+        stream.close();
+        if (!stream) {
+            throw std::runtime_error("failed to close '" + path + "'");
+        }
+#endif
+    }
+
+private:
+    std::string path;
+    static constexpr uint64_t buffer_size = 1048576;
+#ifdef KANAVAL_HAS_POSIX_IO
+    int fd = -1;
+    bool use_copy_file_range = true, use_sendfile = true;
+#else
+    std::ofstream stream;
+#endif
+};
+
+inline uint64_t file_size(const std::string& path) {
+#ifdef KANAVAL_HAS_POSIX_IO
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        throw std::runtime_error("failed to inspect '" + path + "'");
+    }
+    return info.st_size;
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        throw std::runtime_error("failed to inspect '" + path + "'");
+    }
+    return in.tellg();
+#endif
+}
+
+/**
+ * Record the offset and size of each embedded input file in the state file.
+ * Any existing `offset` and `size` datasets are replaced with 64-bit unsigned integers.
+ *
+ * @param handle Handle to a HDF5 state file, opened for writing.
+ * @param sizes Size of each input file in bytes, in the order of `list_file_groups()`.
+ */
+inline void set_offsets(const H5::H5File& handle, const std::vector<uint64_t>& sizes) {
+    auto groups = list_file_groups(handle);
+    if (groups.size() != sizes.size()) {
+        throw std::runtime_error("number of input files (" + std::to_string(sizes.size()) + ") is not equal to the number of files in the state (" + std::to_string(groups.size()) + ")");
+    }
+
+    hsize_t offset = 0;
+    for (size_t f = 0; f < groups.size(); ++f) {
+        auto& fhandle = groups[f];
+        hsize_t values[2] = { offset, sizes[f] };
+        const char* names[2] = { "offset", "size" };
+        for (int i = 0; i < 2; ++i) {
+            if (fhandle.exists(names[i])) {
+                fhandle.unlink(names[i]);
+            }
+            auto dhandle = fhandle.createDataSet(names[i], H5::PredType::NATIVE_HSIZE, H5::DataSpace());
+            dhandle.write(values + i, H5::PredType::NATIVE_HSIZE);
+        }
+        offset += sizes[f];
+    }
+}
+
+/**
+ * Pack a state file and its input files into an embedded `.kana` file.
+ * The offset and size of each input file are first written into the state file with `set_offsets()`.
+ * The header, the state file and the input files are then streamed to `output` without loading any file into memory.
+ * On Linux, the input files are copied by the kernel with `copy_file_range()` or `sendfile()`, so large files like H5AD inputs are not copied through user space.
+ *
+ * @param state Path to the HDF5 state file.
+ * This is modified in place to contain the offsets and sizes of the input files.
+ * It should not be open elsewhere.
+ * @param inputs Paths to the input files, in the order of `list_file_groups()`.
+ * @param output Path to the output `.kana` file.
+ * @param version Version of the kana file.
+ *
+ * @return Header of the packed file.
+ */
+inline Header pack(const std::string& state, const std::vector<std::string>& inputs, const std::string& output, uint64_t version) {
+    std::vector<uint64_t> sizes;
+    sizes.reserve(inputs.size());
+    for (const auto& i : inputs) {
+        sizes.push_back(file_size(i));
+    }
+
+    {
+        H5::H5File handle(state, H5F_ACC_RDWR);
+        set_offsets(handle, sizes);
+    }
+
+    Header header;
+    header.format_type = EMBEDDED;
+    header.version = version;
+    header.state_nbytes = file_size(state);
+
+    Output sink(output);
+    unsigned char buffer[header_size];
+    encode_header(header, buffer);
+    sink.write(buffer, header_size);
+
+    sink.append(state, header.state_nbytes);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        sink.append(inputs[i], sizes[i]);
+    }
+
+    sink.close();
+    return header;
+}
+
+
+/**
+ * @brief Read-only view of a byte range in a `.kana` file.
+ *
+ * The bytes are either mapped directly from the file or held in an internal buffer if memory mapping is not supported on this platform.
+ * In both cases, the view shares ownership of its storage, so it can be cheaply copied and remains valid after the `Reader` is destroyed.
+ */
+class FileView {
+public:
+    /**
+     * @return Pointer to the first byte.
+     */
+    const unsigned char* data() const {
+        return ptr;
+    }
+
+    /**
+     * @return Number of bytes.
+     */
+    uint64_t size() const {
+        return len;
+    }
+
+    /**
+     * @return Offset of the first byte from the start of the `.kana` file.
+     * This can be used with `pread()` or similar if the caller prefers to use their own file descriptor.
+     */
+    uint64_t offset() const {
+        return start;
+    }
+
+    /**
+     * @return Whether the bytes are mapped directly from the file.
+     */
+    bool is_mapped() const {
+        return mapped;
+    }
+
+private:
+    std::shared_ptr<const void> storage;
+    bool mapped = false;
+    const unsigned char* ptr = nullptr;
+    uint64_t len = 0;
+    uint64_t start = 0;
+
+    friend FileView view_range(const std::string&, uint64_t, uint64_t);
+};
+
+/**
+ * @param path Path to a `.kana` file.
+ * @param offset Offset of the start of the range.
+ * @param size Size of the range in bytes.
+ *
+ * @return View of the requested range.
+ * On POSIX systems, only the pages overlapping the range are mapped, so the cost is independent of the size of the file.
+ */
+inline FileView view_range(const std::string& path, uint64_t offset, uint64_t size) {
+    FileView output;
+    output.start = offset;
+    output.len = size;
+    if (size == 0) {
+        return output;
+    }
+
+#ifdef KANAVAL_HAS_POSIX_IO
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open '" + path + "' for reading");
+    }
+
+    uint64_t page = ::sysconf(_SC_PAGESIZE);
+    uint64_t aligned = offset / page * page;
+    size_t length = size + (offset - aligned);
+    void* mptr = ::mmap(NULL, length, PROT_READ, MAP_SHARED, fd, aligned);
+    ::close(fd);
+    if (mptr == MAP_FAILED) {
+        throw std::runtime_error("failed to map bytes " + std::to_string(offset) + " to " + std::to_string(offset + size) + " of '" + path + "'");
+    }
+
+    output.storage = std::shared_ptr<const void>(mptr, [length](const void* p) -> void { ::munmap(const_cast<void*>(p), length); });
+    output.mapped = true;
+    output.ptr = static_cast<const unsigned char*>(mptr) + (offset - aligned);
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("failed to open '" + path + "' for reading");
+    }
+    auto buffer = std::make_shared<std::vector<unsigned char> >(size);
+    in.seekg(offset);
+    in.read(reinterpret_cast<char*>(buffer->data()), size);
+    if (static_cast<uint64_t>(in.gcount()) != size) {
+        throw std::runtime_error("failed to read bytes " + std::to_string(offset) + " to " + std::to_string(offset + size) + " of '" + path + "'");
+    }
+    output.ptr = buffer->data();
+    output.storage = std::move(buffer);
+#endif
+
+    return output;
+}
+
+// Callbacks for opening a read-only HDF5 file image without copying it.
+// HDF5 normally copies the image into the property list and again into the core driver;
+// here, every "allocation" just returns the view's buffer, and every copy is a no-op.
+// The user data holds a reference to the view's storage, and is shared by all copies of the property list and by the open file.
+// It is only released once the property lists are closed and the core driver has released the image.
+struct ImageData {
+    FileView view;
+    int plist_refs = 0;
+    bool file_open = false;
+};
+
+inline void* image_malloc(size_t size, H5FD_file_image_op_t op, void* udata) {
+    auto ptr = static_cast<ImageData*>(udata);
+    if (size != ptr->view.size()) {
+        return NULL;
+    }
+    if (op == H5FD_FILE_IMAGE_OP_FILE_OPEN) {
+        ptr->file_open = true;
+    }
+    return const_cast<unsigned char*>(ptr->view.data());
+}
+
+inline void* image_memcpy(void* dest, const void* src, size_t, H5FD_file_image_op_t, void*) {
+    if (dest != src) {
+        return NULL;
+    }
+    return dest;
+}
+
+inline void* image_realloc(void*, size_t, H5FD_file_image_op_t, void*) {
+    return NULL;
+}
+
+inline herr_t image_free(void*, H5FD_file_image_op_t op, void* udata) {
+    auto ptr = static_cast<ImageData*>(udata);
+    if (op == H5FD_FILE_IMAGE_OP_FILE_CLOSE) {
+        ptr->file_open = false;
+        if (ptr->plist_refs == 0) {
+            delete ptr;
+        }
+    }
+    return 0;
+}
+
+inline void* image_udata_copy(void* udata) {
+    ++(static_cast<ImageData*>(udata)->plist_refs);
+    return udata;
+}
+
+inline herr_t image_udata_free(void* udata) {
+    auto ptr = static_cast<ImageData*>(udata);
+    --(ptr->plist_refs);
+    if (ptr->plist_refs == 0 && !ptr->file_open) {
+        delete ptr;
+    }
+    return 0;
+}
+
+/**
+ * Open a view as a read-only HDF5 file image, e.g., for the state file or for embedded 10X HDF5 and H5AD files.
+ * The contents of the view are used directly by HDF5's core driver, without any copies.
+ *
+ * @param view View of a HDF5 file.
+ * @return Handle to the file.
+ * This holds a reference to the view's storage, so the view itself does not need to be kept alive.
+ */
+inline H5::H5File open_image(const FileView& view) {
+    H5::FileAccPropList fapl;
+    auto fid = fapl.getId();
+    if (H5Pset_fapl_core(fid, 1048576, false) < 0) {
+        throw std::runtime_error("failed to set the core driver for the file image");
+    }
+
+    // Ownership of 'udata' is transferred to the property list once the callbacks are set.
+    auto udata = new ImageData;
+    udata->view = view;
+    H5FD_file_image_callbacks_t callbacks = { image_malloc, image_memcpy, image_realloc, image_free, image_udata_copy, image_udata_free, udata };
+    if (H5Pset_file_image_callbacks(fid, &callbacks) < 0) {
+        delete udata;
+        throw std::runtime_error("failed to set the file image callbacks");
+    }
+    if (H5Pset_file_image(fid, const_cast<unsigned char*>(view.data()), view.size()) < 0) {
+        throw std::runtime_error("failed to set the file image");
+    }
+
+    // Unique name, as the core driver considers files with the same name to be the same file.
+    static std::atomic<uint64_t> counter(0);
+    std::string name = "kanaval_image_" + std::to_string(counter++);
+    return H5::H5File(name, H5F_ACC_RDONLY, H5::FileCreatPropList::DEFAULT, fapl);
+}
+
+/**
+ * @brief Details of an embedded input file.
+ */
+struct Entry {
+    /**
+     * Name of the dataset containing this file.
+     * For v2 state files with a single matrix, this is an empty string.
+     */
+    std::string dataset;
+
+    /**
+     * Format of the dataset containing this file, e.g., `"MatrixMarket"`, `"10X"`, `"H5AD"`.
+     */
+    std::string format;
+
+    /**
+     * Type of the file, e.g., `"h5"`, `"mtx"`, `"genes"`.
+     */
+    std::string type;
+
+    /**
+     * Original name of the file.
+     */
+    std::string name;
+
+    /**
+     * Offset of the file from the start of the embedded payload, i.e., the end of the state file.
+     * Only used for embedded files.
+     */
+    uint64_t offset = 0;
+
+    /**
+     * Size of the file in bytes.
+     * Only used for embedded files.
+     */
+    uint64_t size = 0;
+
+    /**
+     * Identifier of the file, e.g., in a `store::Store`.
+     * Only used for linked files.
+     */
+    std::string id;
+};
+
+/**
+ * @brief Random access to the contents of a `.kana` file.
+ *
+ * Only the header and the state file are read on construction, along with the table of embedded files in `inputs/parameters`.
+ * Each embedded file is then mapped on request, so extracting a single input from a large multi-dataset `.kana` file does not touch the other inputs.
+ */
+class Reader {
+public:
+    /**
+     * @param path Path to a `.kana` file.
+     * The version in its header is used to determine the layout of the state file.
+     */
+    Reader(std::string path) : path(std::move(path)) {
+        uint64_t fsize = file_size(this->path);
+        if (fsize < header_size) {
+            throw std::runtime_error("'" + this->path + "' is too small to contain a header");
+        }
+
+        auto hview = view_range(this->path, 0, header_size);
+        head = decode_header(hview.data());
+        if (head.state_nbytes > fsize - header_size) {
+            throw std::runtime_error("state file extends past the end of '" + this->path + "'");
+        }
+        payload_start = header_size + head.state_nbytes;
+        payload_nbytes = fsize - payload_start;
+
+        auto handle = open_image(state());
+        int version = head.version;
+        bool embedded = (head.format_type == EMBEDDED);
+        auto ihandle = utils::check_and_open_group(handle, "inputs");
+        auto phandle = utils::check_and_open_group(ihandle, "parameters");
+
+        try {
+            if (version >= 3000000) {
+                v3::inputs::check_datasets(phandle, embedded);
+            } else {
+                v2::inputs::validate_parameters(ihandle, embedded, version);
+            }
+        } catch (std::exception& e) {
+            throw utils::combine_errors(e, "failed to validate the table of input files");
+        }
+
+        auto add_files = [&](const H5::Group& fhandle, const std::string& dataset, const std::string& format, size_t first, size_t last) -> void {
+            for (size_t f = first; f < last; ++f) {
+                auto curfhandle = utils::check_and_open_group(fhandle, std::to_string(f));
+                Entry current;
+                current.dataset = dataset;
+                current.format = format;
+                current.type = utils::load_string(curfhandle, "type");
+                current.name = utils::load_string(curfhandle, "name");
+                if (embedded) {
+                    current.offset = utils::load_integer_scalar<long long>(curfhandle, "offset");
+                    current.size = utils::load_integer_scalar<long long>(curfhandle, "size");
+                    if (current.size > payload_nbytes || current.offset > payload_nbytes - current.size) {
+                        throw std::runtime_error("embedded file '" + current.name + "' extends past the end of '" + this->path + "'");
+                    }
+                } else {
+                    current.id = utils::load_string(curfhandle, "id");
+                }
+                files.push_back(std::move(current));
+            }
+        };
+
+        if (version >= 3000000) {
+            auto dhandle = utils::check_and_open_group(phandle, "datasets");
+            size_t ndatasets = dhandle.getNumObjs();
+            for (size_t d = 0; d < ndatasets; ++d) {
+                auto curdhandle = utils::check_and_open_group(dhandle, std::to_string(d));
+                auto fhandle = utils::check_and_open_group(curdhandle, "files");
+                add_files(fhandle, utils::load_string(curdhandle, "name"), utils::load_string(curdhandle, "format"), 0, fhandle.getNumObjs());
+            }
+        } else {
+            auto fhandle = utils::check_and_open_group(phandle, "files");
+            std::vector<std::string> formats;
+            auto fohandle = phandle.openDataSet("format");
+            if (fohandle.getSpace().getSimpleExtentNdims() == 0) {
+                formats.push_back(utils::load_string(fohandle));
+            } else {
+                formats = utils::load_string_vector(fohandle);
+            }
+            if (phandle.exists("sample_groups")) {
+                auto runs = utils::load_integer_vector(phandle, "sample_groups");
+                auto names = utils::load_string_vector(phandle, "sample_names");
+                size_t sofar = 0;
+                for (size_t r = 0; r < runs.size(); ++r) {
+                    add_files(fhandle, names[r], formats[r], sofar, sofar + runs[r]);
+                    sofar += runs[r];
+                }
+            } else {
+                add_files(fhandle, "", formats.front(), 0, fhandle.getNumObjs());
+            }
+        }
+    }
+
+    /**
+     * @return Header of the `.kana` file.
+     */
+    const Header& header() const {
+        return head;
+    }
+
+    /**
+     * @return View of the HDF5 state file.
+     */
+    FileView state() const {
+        return view_range(path, header_size, head.state_nbytes);
+    }
+
+    /**
+     * @return Handle to the state file, opened directly from the mapped `.kana` file.
+     */
+    H5::H5File open_state() const {
+        return open_image(state());
+    }
+
+    /**
+     * @return Details of all input files, in the order in which they are embedded.
+     */
+    const std::vector<Entry>& entries() const {
+        return files;
+    }
+
+    /**
+     * @param dataset Name of the dataset, see `Entry::dataset`.
+     * @param type Type of the file, e.g., `"h5"`.
+     * @return Details of the matching input file.
+     * An error is raised if no file matches.
+     */
+    const Entry& find(const std::string& dataset, const std::string& type) const {
+        for (const auto& f : files) {
+            if (f.dataset == dataset && f.type == type) {
+                return f;
+            }
+        }
+        throw std::runtime_error("no file of type '" + type + "' for dataset '" + dataset + "'");
+    }
+
+    /**
+     * @param entry Details of an input file, typically from `entries()` or `find()`.
+     * @return View of the input file's contents.
+     * An error is raised if the `.kana` file does not embed its input files.
+     */
+    FileView view(const Entry& entry) const {
+        if (head.format_type != EMBEDDED) {
+            throw std::runtime_error("input files are not embedded in '" + path + "'");
+        }
+        return view_range(path, payload_start + entry.offset, entry.size);
+    }
+
+    /**
+     * @param dataset Name of the dataset, see `Entry::dataset`.
+     * @param type Type of the file, e.g., `"h5"`.
+     * @return View of the matching input file.
+     */
+    FileView view(const std::string& dataset, const std::string& type) const {
+        return view(find(dataset, type));
+    }
+
+private:
+    std::string path;
+    Header head;
+    uint64_t payload_start = 0, payload_nbytes = 0;
+    std::vector<Entry> files;
+};
+}
+
+}
+
+#endif
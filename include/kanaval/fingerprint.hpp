@@ -0,0 +1,187 @@
+#ifndef KANAVAL_FINGERPRINT_HPP
+#define KANAVAL_FINGERPRINT_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @file fingerprint.hpp
+ *
+ * @brief Cheap fingerprints of the contents of a HDF5 group.
+ */
+
+namespace kanaval {
+
+namespace fingerprint {
+
+/**
+ * @brief 64-bit FNV-1a hash.
+ */
+class Hasher {
+public:
+    /**
+     * @param data Pointer to the bytes to be added.
+     * @param n Number of bytes.
+     */
+    void add(const void* data, size_t n) {
+        auto ptr = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < n; ++i) {
+            state ^= ptr[i];
+            state *= 1099511628211ull;
+        }
+    }
+
+    /**
+     * @param value Value to be added.
+     */
+    template<typename T>
+    void add_value(T value) {
+        add(&value, sizeof(T));
+    }
+
+    /**
+     * @param value String to be added, including its length.
+     */
+    void add_string(const std::string& value) {
+        add_value<uint64_t>(value.size());
+        add(value.data(), value.size());
+    }
+
+    /**
+     * @return The current hash.
+     */
+    uint64_t get() const {
+        return state;
+    }
+
+private:
+    uint64_t state = 14695981039346656037ull;
+};
+
+/**
+ * Add the location of an object in the file to the hash.
+ * This changes whenever the object is deleted and re-created.
+ *
+ * @param id Identifier for the HDF5 object.
+ * @param hasher Hasher for the fingerprint.
+ */
+inline void add_location(hid_t id, Hasher& hasher) {
+#if H5_VERSION_GE(1, 12, 0)
+    H5O_info2_t info;
+    if (H5Oget_info3(id, &info, H5O_INFO_BASIC) >= 0) {
+        hasher.add(&info.token, sizeof(info.token));
+    }
+#else
+    H5O_info_t info;
+    if (H5Oget_info2(id, &info, H5O_INFO_BASIC) >= 0) {
+        hasher.add_value(info.addr);
+    }
+#endif
+}
+
+/**
+ * Add a dataset to the hash.
+ * This considers the location, storage size, dimensions and type of the dataset,
+ * as well as the contents of small datasets (typically scalar parameters) that might be modified in place.
+ *
+ * @param dhandle Handle to a HDF5 dataset.
+ * @param content_limit Maximum storage size of a dataset for which the contents are hashed.
+ * @param hasher Hasher for the fingerprint.
+ */
+inline void add_dataset(const H5::DataSet& dhandle, hsize_t content_limit, Hasher& hasher) {
+    add_location(dhandle.getId(), hasher);
+    hasher.add_value<uint64_t>(H5Dget_offset(dhandle.getId()));
+
+    hsize_t storage = dhandle.getStorageSize();
+    hasher.add_value<uint64_t>(storage);
+
+    auto dims = utils::load_dataset_dimensions(dhandle);
+    hasher.add_value<uint64_t>(dims.size());
+    for (auto d : dims) {
+        hasher.add_value<uint64_t>(d);
+    }
+
+    auto dtype = dhandle.getDataType();
+    auto tclass = dtype.getClass();
+    hasher.add_value<int>(tclass);
+    hasher.add_value<uint64_t>(dtype.getSize());
+
+    if (storage > content_limit || dims.size() > 1) {
+        return;
+    }
+
+    if (tclass == H5T_STRING) {
+        if (dims.empty()) {
+            hasher.add_string(utils::load_string(dhandle));
+        } else {
+            for (const auto& x : utils::load_string_vector(dhandle)) {
+                hasher.add_string(x);
+            }
+        }
+    } else if (tclass == H5T_INTEGER || tclass == H5T_FLOAT) {
+        size_t len = (dims.empty() ? 1 : dims[0]);
+        std::vector<unsigned char> buffer(len * dtype.getSize());
+        if (!buffer.empty()) {
+            dhandle.read(buffer.data(), dtype);
+            hasher.add(buffer.data(), buffer.size());
+        }
+    }
+}
+
+/**
+ * Add a group and all of its children to the hash.
+ *
+ * @param ghandle Handle to a HDF5 group.
+ * @param content_limit Maximum storage size of a dataset for which the contents are hashed.
+ * @param hasher Hasher for the fingerprint.
+ */
+inline void add_group(const H5::Group& ghandle, hsize_t content_limit, Hasher& hasher) {
+    add_location(ghandle.getId(), hasher);
+
+    hsize_t nchildren = ghandle.getNumObjs();
+    hasher.add_value<uint64_t>(nchildren);
+
+    for (hsize_t i = 0; i < nchildren; ++i) {
+        auto name = ghandle.getObjnameByIdx(i);
+        hasher.add_string(name);
+
+        auto type = ghandle.childObjType(name);
+        hasher.add_value<int>(type);
+        if (type == H5O_TYPE_GROUP) {
+            add_group(ghandle.openGroup(name), content_limit, hasher);
+        } else if (type == H5O_TYPE_DATASET) {
+            add_dataset(ghandle.openDataSet(name), content_limit, hasher);
+        }
+    }
+}
+
+/**
+ * Compute a fingerprint for a group in the state file, typically corresponding to an analysis step.
+ * This is cheap as it only uses the metadata for most datasets,
+ * but it will still change if the group's contents are replaced or if its parameters are modified in place.
+ *
+ * @param handle Handle to the parent of the group.
+ * @param name Name of the group.
+ * @param content_limit Maximum storage size of a dataset for which the contents are hashed.
+ *
+ * @return The fingerprint, or zero if the group does not exist.
+ */
+template<class Object>
+uint64_t compute(const Object& handle, const std::string& name, hsize_t content_limit = 1024) {
+    if (!handle.exists(name) || handle.childObjType(name) != H5O_TYPE_GROUP) {
+        return 0;
+    }
+
+    Hasher hasher;
+    add_group(handle.openGroup(name), content_limit, hasher);
+    return hasher.get();
+}
+
+}
+
+}
+
+#endif
@@ -23,12 +23,13 @@ namespace kanaval{
  * @param handle Open handle to a HDF5 file.
  * @param embedded Whether the data files are embedded.
  * @param version Version of the kana file.
+ * @param options Options for validation, e.g., to enable deep checks of the dataset contents.
  */
-inline void validate(const H5::H5File& handle, bool embedded, int version) {
+inline void validate(const H5::H5File& handle, bool embedded, int version, const Options& options = Options()) {
     if (version < 3000000) {
-        v2::validate(handle, embedded, version);
+        v2::validate(handle, embedded, version, options);
     } else {
-        v3::validate(handle, embedded, version);
+        v3::validate(handle, embedded, version, options);
     }
 }
 
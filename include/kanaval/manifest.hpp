@@ -0,0 +1,250 @@
+#ifndef KANAVAL_MANIFEST_HPP
+#define KANAVAL_MANIFEST_HPP
+
+#include "H5Cpp.h"
+#include "v2/_validate.hpp"
+#include "v3/_validate.hpp"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+
+/**
+ * @file manifest.hpp
+ *
+ * @brief Summarize the shape of a state file for cataloguing.
+ */
+
+namespace kanaval {
+
+/**
+ * @brief Shape facts for a state file, e.g., for indexing a large collection of analyses.
+ */
+struct Manifest {
+    /**
+     * Version of the kana file.
+     */
+    int format_version = 0;
+
+    /**
+     * Number of cells after subsetting but before filtering.
+     */
+    int num_cells = 0;
+
+    /**
+     * Number of cells after filtering.
+     */
+    int filtered_cells = 0;
+
+    /**
+     * Number of blocks (samples) in the dataset.
+     */
+    int num_blocks = 0;
+
+    /**
+     * Name and number of features for each modality, with RNA, ADT and CRISPR reported first.
+     */
+    std::vector<std::pair<std::string, int> > num_features;
+
+    /**
+     * Name and number of PCs for each modality, in the same order as `num_features`.
+     */
+    std::vector<std::pair<std::string, int> > num_pcs;
+
+    /**
+     * Chosen clustering method.
+     */
+    std::string cluster_method;
+
+    /**
+     * Number of cells in each cluster for the chosen clustering method.
+     */
+    std::vector<int> cluster_sizes;
+
+    /**
+     * Name and number of cells for each custom selection.
+     */
+    std::vector<std::pair<std::string, int> > selections;
+
+    /**
+     * Names of the references used for cell labelling.
+     */
+    std::vector<std::string> references;
+
+    /**
+     * Name of the application that created the file.
+     * This is empty for v2 files, which do not have a `_metadata` group.
+     */
+    std::string application_name;
+
+    /**
+     * Version of the application that created the file.
+     * This is empty for v2 files, which do not have a `_metadata` group.
+     */
+    std::string application_version;
+};
+
+namespace manifest {
+
+inline std::vector<std::pair<std::string, int> > order_modalities(const std::unordered_map<std::string, int>& values) {
+    std::vector<std::pair<std::string, int> > output(values.begin(), values.end());
+    auto rank = [](const std::string& x) -> int {
+        if (x == "RNA") {
+            return 0;
+        } else if (x == "ADT") {
+            return 1;
+        } else if (x == "CRISPR") {
+            return 2;
+        } else {
+            return 3;
+        }
+    };
+    std::sort(output.begin(), output.end(), [&](const auto& left, const auto& right) -> bool {
+        auto lrank = rank(left.first), rrank = rank(right.first);
+        return (lrank == rrank ? left.first < right.first : lrank < rrank);
+    });
+    return output;
+}
+
+inline void append_string(const std::string& x, std::string& output) {
+    output += '"';
+    for (char c : x) {
+        if (c == '"' || c == '\\') {
+            output += '\\';
+            output += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned char>(c));
+            output += buffer;
+        } else {
+            output += c;
+        }
+    }
+    output += '"';
+}
+
+inline void append_pairs(const std::vector<std::pair<std::string, int> >& values, std::string& output) {
+    output += '{';
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i) {
+            output += ',';
+        }
+        append_string(values[i].first, output);
+        output += ':';
+        output += std::to_string(values[i].second);
+    }
+    output += '}';
+}
+
+}
+
+/**
+ * Validate a state file at the structural tier, i.e., without deep checks of the dataset contents, and collect its shape facts.
+ * All facts are taken from the summary of the validation, so creating the manifest costs no more than validation itself.
+ *
+ * @param handle Open handle to a HDF5 file.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file.
+ *
+ * @return Manifest for the file.
+ * An error is raised if the file is not valid.
+ */
+inline Manifest create_manifest(const H5::H5File& handle, bool embedded, int version) {
+    Manifest output;
+    output.format_version = version;
+
+    if (version < 3000000) {
+        auto summary = v2::validate(handle, embedded, version);
+        output.num_cells = summary.inputs.num_cells;
+        output.filtered_cells = summary.filtered_cells;
+        output.num_blocks = summary.inputs.num_samples;
+
+        std::unordered_map<std::string, int> features;
+        for (size_t m = 0; m < summary.inputs.modalities.size(); ++m) {
+            features[summary.inputs.modalities[m]] = summary.inputs.num_features[m];
+        }
+        output.num_features = manifest::order_modalities(features);
+        output.num_pcs = manifest::order_modalities(summary.num_pcs);
+
+        output.cluster_method = summary.cluster_method;
+        output.cluster_sizes = std::move(summary.cluster_sizes);
+        output.selections = std::move(summary.selections);
+        output.references = std::move(summary.references);
+
+    } else {
+        auto summary = v3::validate(handle, embedded, version);
+        output.num_cells = summary.inputs.num_cells;
+        output.filtered_cells = summary.filtered_cells;
+        output.num_blocks = summary.inputs.num_blocks;
+        output.num_features = manifest::order_modalities(summary.inputs.num_features);
+        output.num_pcs = manifest::order_modalities(summary.num_pcs);
+
+        output.cluster_method = summary.cluster_method;
+        output.cluster_sizes = std::move(summary.cluster_sizes);
+        output.selections = std::move(summary.selections);
+        output.references = std::move(summary.references);
+        output.application_name = std::move(summary.application_name);
+        output.application_version = std::move(summary.application_version);
+    }
+
+    return output;
+}
+
+/**
+ * @param manifest Manifest for a state file, typically created by `create_manifest()`.
+ * @return Compact JSON representation of the manifest.
+ * The application details are reported as `null` if they are not available.
+ */
+inline std::string to_json(const Manifest& manifest) {
+    std::string output = "{\"format_version\":" + std::to_string(manifest.format_version);
+    output += ",\"num_cells\":" + std::to_string(manifest.num_cells);
+    output += ",\"filtered_cells\":" + std::to_string(manifest.filtered_cells);
+    output += ",\"num_blocks\":" + std::to_string(manifest.num_blocks);
+
+    output += ",\"num_features\":";
+    manifest::append_pairs(manifest.num_features, output);
+    output += ",\"num_pcs\":";
+    manifest::append_pairs(manifest.num_pcs, output);
+
+    output += ",\"clustering\":{\"method\":";
+    manifest::append_string(manifest.cluster_method, output);
+    output += ",\"sizes\":[";
+    for (size_t c = 0; c < manifest.cluster_sizes.size(); ++c) {
+        if (c) {
+            output += ',';
+        }
+        output += std::to_string(manifest.cluster_sizes[c]);
+    }
+    output += "]}";
+
+    output += ",\"selections\":";
+    manifest::append_pairs(manifest.selections, output);
+
+    output += ",\"references\":[";
+    for (size_t r = 0; r < manifest.references.size(); ++r) {
+        if (r) {
+            output += ',';
+        }
+        manifest::append_string(manifest.references[r], output);
+    }
+    output += ']';
+
+    output += ",\"application\":";
+    if (manifest.application_name.empty() && manifest.application_version.empty()) {
+        output += "null";
+    } else {
+        output += "{\"name\":";
+        manifest::append_string(manifest.application_name, output);
+        output += ",\"version\":";
+        manifest::append_string(manifest.application_version, output);
+        output += '}';
+    }
+
+    output += '}';
+    return output;
+}
+
+}
+
+#endif
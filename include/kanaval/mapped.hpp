@@ -0,0 +1,198 @@
+#ifndef KANAVAL_MAPPED_HPP
+#define KANAVAL_MAPPED_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define KANAVAL_HAS_MMAP 1
+#endif
+
+/**
+ * @file mapped.hpp
+ *
+ * @brief Zero-copy access to contiguous datasets.
+ */
+
+namespace kanaval {
+
+namespace mapped {
+
+/**
+ * @brief Read-only view of the contents of a dataset.
+ *
+ * @tparam T Type of the values.
+ *
+ * The values are either mapped directly from the file or held in an internal buffer,
+ * depending on how the dataset is stored; see `open()` for details.
+ * In both cases, the span shares ownership of its storage, so it can be cheaply copied and remains valid after the HDF5 file is closed.
+ */
+template<typename T>
+class Span {
+public:
+    /**
+     * @return Pointer to the first value.
+     */
+    const T* data() const {
+        return ptr;
+    }
+
+    /**
+     * @return Number of values.
+     */
+    size_t size() const {
+        return len;
+    }
+
+    /**
+     * @return Pointer to the first value.
+     */
+    const T* begin() const {
+        return ptr;
+    }
+
+    /**
+     * @return Pointer to one past the last value.
+     */
+    const T* end() const {
+        return ptr + len;
+    }
+
+    /**
+     * @param i Index of the value.
+     * @return The value at `i`.
+     */
+    const T& operator[](size_t i) const {
+        return ptr[i];
+    }
+
+    /**
+     * @return Whether the values are mapped directly from the file.
+     */
+    bool is_mapped() const {
+        return mapped;
+    }
+
+private:
+    std::shared_ptr<const void> storage;
+    bool mapped = false;
+    const T* ptr = nullptr;
+    size_t len = 0;
+
+    template<typename U>
+    friend Span<U> open(const H5::DataSet&, const std::string&, hsize_t);
+};
+
+/**
+ * Check whether a dataset can be mapped directly from its file.
+ * This requires contiguous storage that has already been allocated, no filters, and a file type that is identical to the native type `T`.
+ *
+ * @tparam T Type of the values.
+ * @param dhandle Handle to the dataset.
+ *
+ * @return Offset of the dataset's contents in its HDF5 file, or `HADDR_UNDEF` if the dataset cannot be mapped.
+ */
+template<typename T>
+haddr_t contiguous_offset(const H5::DataSet& dhandle) {
+    auto plist = dhandle.getCreatePlist();
+    auto pid = plist.getId();
+    if (H5Pget_layout(pid) != H5D_CONTIGUOUS || H5Pget_nfilters(pid) != 0 || H5Pget_external_count(pid) != 0) {
+        return HADDR_UNDEF;
+    }
+
+    auto ftype = dhandle.getDataType();
+    if (H5Tequal(ftype.getId(), utils::native_type<T>().getId()) <= 0) {
+        return HADDR_UNDEF;
+    }
+
+    return H5Dget_offset(dhandle.getId());
+}
+
+/**
+ * Obtain the contents of a dataset, typically one of the larger results like the PCs or t-SNE coordinates.
+ * If `contiguous_offset()` reports that the dataset can be mapped and its contents are suitably aligned,
+ * the span refers directly to a read-only memory mapping of `path` so that the contents are served from the page cache without any copies.
+ * Otherwise, or if memory mapping is not supported on this platform, the contents are read into a buffer with `H5Dread()`.
+ *
+ * @tparam T Type of the values.
+ * @param dhandle Handle to the dataset.
+ * @param path Path to the file containing the HDF5 file.
+ * This may be a container like a `.kana` file, in which case the HDF5 file should start at `base_offset`.
+ * @param base_offset Offset of the start of the HDF5 file in `path`.
+ *
+ * @return Span containing the dataset contents in row-major order.
+ * The file should not be modified while the span is in use.
+ */
+template<typename T>
+Span<T> open(const H5::DataSet& dhandle, const std::string& path, hsize_t base_offset = 0) {
+    Span<T> output;
+
+    auto space = dhandle.getSpace();
+    size_t n = space.getSimpleExtentNpoints();
+    output.len = n;
+    if (n == 0) {
+        return output;
+    }
+
+#ifdef KANAVAL_HAS_MMAP
+    auto offset = contiguous_offset<T>(dhandle);
+    if (offset != HADDR_UNDEF) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            size_t start = base_offset + offset;
+            size_t bytes = n * sizeof(T);
+
+            struct stat info;
+            bool ok = (start % alignof(T) == 0 && ::fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= start + bytes);
+            if (ok) {
+                size_t page = ::sysconf(_SC_PAGESIZE);
+                size_t aligned = start / page * page;
+                size_t length = bytes + (start - aligned);
+                void* ptr = ::mmap(NULL, length, PROT_READ, MAP_SHARED, fd, aligned);
+
+                if (ptr != MAP_FAILED) {
+                    ::close(fd);
+                    output.storage = std::shared_ptr<const void>(ptr, [length](const void* p) -> void { ::munmap(const_cast<void*>(p), length); });
+                    output.mapped = true;
+                    output.ptr = reinterpret_cast<const T*>(static_cast<const unsigned char*>(ptr) + (start - aligned));
+                    return output;
+                }
+            }
+            ::close(fd);
+        }
+    }
+#endif
+
+    auto buffer = std::make_shared<std::vector<T> >(n);
+    dhandle.read(buffer->data(), utils::native_type<T>());
+    output.ptr = buffer->data();
+    output.storage = std::move(buffer);
+    return output;
+}
+
+/**
+ * Overload of `open()` that maps the file containing the dataset.
+ *
+ * @tparam T Type of the values.
+ * @param dhandle Handle to the dataset.
+ *
+ * @return Span containing the dataset contents in row-major order.
+ */
+template<typename T>
+Span<T> open(const H5::DataSet& dhandle) {
+    return open<T>(dhandle, dhandle.getFileName(), 0);
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef KANAVAL_MIGRATE_HPP
+#define KANAVAL_MIGRATE_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include "options.hpp"
+#include "writer.hpp"
+#include "container.hpp"
+#include "v2/_validate.hpp"
+#include "v3/_validate.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+/**
+ * @file migrate.hpp
+ *
+ * @brief Migrate v2 state files to the v3 layout.
+ */
+
+namespace kanaval {
+
+namespace migrate {
+
+/**
+ * Copy an object and all of its children with `H5Ocopy()`.
+ * Chunks are copied as-is, without being decompressed or converted, so the cost depends on the size of the object on disk and not on its contents.
+ *
+ * @param from Group containing the object.
+ * @param name Name of the object in `from`.
+ * @param to Group in which to create the copy.
+ * @param dest Name of the copy in `to`.
+ */
+inline void copy(const H5::Group& from, const std::string& name, const H5::Group& to, const std::string& dest) {
+    if (H5Ocopy(from.getId(), name.c_str(), to.getId(), dest.c_str(), H5P_DEFAULT, H5P_DEFAULT) < 0) {
+        throw std::runtime_error("failed to copy '" + name + "' to '" + dest + "'");
+    }
+}
+
+inline void copy_children(const H5::Group& from, const H5::Group& to, const std::vector<std::string>& exclude) {
+    hsize_t nchildren = from.getNumObjs();
+    for (hsize_t i = 0; i < nchildren; ++i) {
+        auto name = from.getObjnameByIdx(i);
+        if (std::find(exclude.begin(), exclude.end(), name) == exclude.end()) {
+            copy(from, name, to, name);
+        }
+    }
+}
+
+// Copy a step to a new group, except for the parameters in `exclude`.
+// The new parameters group is returned so that replacements can be added by the caller.
+inline H5::Group copy_step(const H5::H5File& input, const std::string& from, const H5::H5File& output, const std::string& to, const std::vector<std::string>& exclude) {
+    auto ihandle = input.openGroup(from);
+    auto xhandle = output.createGroup(to);
+    copy_children(ihandle, xhandle, { "parameters" });
+    auto phandle = xhandle.createGroup("parameters");
+    copy_children(ihandle.openGroup("parameters"), phandle, exclude);
+    return phandle;
+}
+
+inline void add_empty_step(const H5::H5File& output, const std::string& step) {
+    auto xhandle = output.createGroup(step);
+    xhandle.createGroup("parameters");
+    xhandle.createGroup("results");
+}
+
+inline void migrate_inputs(const H5::H5File& input, const H5::H5File& output) {
+    auto iphandle = input.openGroup("inputs/parameters");
+    auto xhandle = output.createGroup("inputs");
+    auto phandle = xhandle.createGroup("parameters");
+
+    std::vector<std::string> formats;
+    bool multi_matrix;
+    {
+        auto fohandle = iphandle.openDataSet("format");
+        multi_matrix = (fohandle.getSpace().getSimpleExtentNdims() != 0);
+        if (multi_matrix) {
+            formats = utils::load_string_vector(fohandle);
+        } else {
+            formats.push_back(utils::load_string(fohandle));
+        }
+    }
+
+    // Each run of files in a v2 multi-matrix file becomes its own dataset.
+    auto ifhandle = iphandle.openGroup("files");
+    std::vector<int> runs;
+    std::vector<std::string> names;
+    if (multi_matrix) {
+        runs = utils::load_integer_vector(iphandle, "sample_groups");
+        names = utils::load_string_vector(iphandle, "sample_names");
+    } else {
+        runs.push_back(ifhandle.getNumObjs());
+        names.push_back("default");
+    }
+
+    auto dhandle = phandle.createGroup("datasets");
+    int sofar = 0;
+    for (size_t r = 0; r < runs.size(); ++r) {
+        auto curdhandle = dhandle.createGroup(std::to_string(r));
+        writer::write_string(curdhandle, "format", formats[r]);
+        writer::write_string(curdhandle, "name", names[r]);
+        auto fhandle = curdhandle.createGroup("files");
+        for (int f = 0; f < runs[r]; ++f, ++sofar) {
+            copy(ifhandle, std::to_string(sofar), fhandle, std::to_string(f));
+        }
+    }
+
+    if (iphandle.exists("subset")) {
+        copy(iphandle, "subset", phandle, "subset");
+    }
+    if (!multi_matrix && iphandle.exists("sample_factor")) {
+        copy(iphandle, "sample_factor", phandle, "block_factor");
+    }
+
+    auto irhandle = input.openGroup("inputs/results");
+    auto rhandle = xhandle.createGroup("results");
+    copy(irhandle, "num_cells", rhandle, "num_cells");
+    if (irhandle.exists("num_samples")) {
+        copy(irhandle, "num_samples", rhandle, "num_blocks");
+    } else {
+        writer::write_scalar(rhandle, "num_blocks", 1);
+    }
+    copy(irhandle, "identities", rhandle, "feature_identities");
+}
+
+// The 'skip' parameter is replaced by the 'use_*' parameters of 'cell_filtering' in v3.
+// All metrics are required for available modalities in v3, so we can't migrate a skipped step that didn't compute them.
+inline bool migrate_quality_control(const H5::H5File& input, const std::string& from, const H5::H5File& output, const std::string& to, bool in_use) {
+    auto phandle = copy_step(input, from, output, to, { "skip" });
+
+    bool skip = false;
+    auto iphandle = input.openGroup(from + "/parameters");
+    if (iphandle.exists("skip")) {
+        skip = utils::load_integer_scalar(iphandle, "skip");
+    }
+
+    if (skip && in_use) {
+        auto rhandle = input.openGroup(from + "/results");
+        for (auto required : { "metrics", "thresholds", "discards" }) {
+            if (!rhandle.exists(required)) {
+                throw std::runtime_error("cannot migrate skipped '" + from + "' without '" + std::string(required) + "'");
+            }
+        }
+    }
+
+    return skip;
+}
+
+inline void migrate_combine_embeddings(const H5::H5File& input, const H5::H5File& output) {
+    auto phandle = copy_step(input, "combine_embeddings", output, "combine_embeddings", { "weights" });
+
+    // An empty 'weights' group in v2 means that all modalities are equally weighted.
+    auto whandle = input.openGroup("combine_embeddings/parameters/weights");
+    auto get_weight = [&](const std::string& modality) -> double {
+        return (whandle.exists(modality) ? utils::load_float_scalar(whandle, modality) : 1.0);
+    };
+
+    writer::write_scalar(phandle, "rna_weight", get_weight("RNA"));
+    writer::write_scalar(phandle, "adt_weight", get_weight("ADT"));
+    writer::write_scalar(phandle, "crispr_weight", 1.0);
+}
+
+inline void migrate_snn_graph_cluster(const H5::H5File& input, const H5::H5File& output) {
+    auto phandle = copy_step(input, "snn_graph_cluster", output, "snn_graph_cluster", { "resolution" });
+    copy(input.openGroup("snn_graph_cluster/parameters"), "resolution", phandle, "multilevel_resolution");
+    writer::write_string(phandle, "algorithm", "multilevel");
+    writer::write_scalar(phandle, "leiden_resolution", 1.0);
+    writer::write_scalar(phandle, "walktrap_steps", 4);
+}
+
+// AUCs were always computed in v2, without any log-fold change threshold.
+inline void migrate_markers(const H5::H5File& input, const H5::H5File& output, const std::string& step) {
+    auto phandle = copy_step(input, step, output, step, {});
+    if (!phandle.exists("compute_auc")) {
+        writer::write_scalar(phandle, "compute_auc", 1);
+    }
+    if (!phandle.exists("lfc_threshold")) {
+        writer::write_scalar(phandle, "lfc_threshold", 0.0);
+    }
+}
+
+/**
+ * Migrate a v2 state file to the v3 layout.
+ * Steps that are unchanged in v3 are copied directly with `H5Ocopy()`, as are the parameters and results of renamed or modified steps,
+ * so no large dataset is ever decoded and re-encoded; only the small parameters that differ between versions are written.
+ * Steps that are new in v3, i.e., for CRISPR data, are added with default parameters and no results.
+ *
+ * The input file is validated with `v2::validate()` before migration, and the output file is validated with `v3::validate()` afterwards.
+ * Only files from version 2.0 or later can be migrated, as earlier versions have a different layout for the `inputs`.
+ *
+ * @param input Open handle to a v2 state file.
+ * @param output Path to the output state file.
+ * Any existing file is overwritten.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file for `input`.
+ * @param application_name Name of the application, to be stored in the `_metadata`.
+ * @param application_version Version of the application, to be stored in the `_metadata`.
+ * @param options Options for validating the output file.
+ *
+ * @return Summary of the output file from `v3::validate()`.
+ */
+inline v3::Summary migrate_state(
+    const H5::H5File& input,
+    const std::string& output,
+    bool embedded,
+    int version,
+    const std::string& application_name = "kana",
+    const std::string& application_version = "unknown",
+    const Options& options = Options())
+{
+    if (version < 2000000 || version >= 3000000) {
+        throw std::runtime_error("only state files from version 2 can be migrated");
+    }
+
+    v2::Summary details;
+    try {
+        details = v2::validate(input, embedded, version);
+    } catch (std::exception& e) {
+        throw utils::combine_errors(e, "failed to validate the input state file");
+    }
+
+    const auto& modalities = details.inputs.modalities;
+    bool rna_in_use = std::find(modalities.begin(), modalities.end(), std::string("RNA")) != modalities.end();
+    bool adt_in_use = std::find(modalities.begin(), modalities.end(), std::string("ADT")) != modalities.end();
+    constexpr int target = 3000000;
+
+    {
+        auto handle = writer::create_file(output);
+        migrate_inputs(input, handle);
+
+        bool rna_skip = migrate_quality_control(input, "quality_control", handle, "rna_quality_control", rna_in_use);
+        bool adt_skip = migrate_quality_control(input, "adt_quality_control", handle, "adt_quality_control", adt_in_use);
+        {
+            auto xhandle = handle.createGroup("crispr_quality_control");
+            auto phandle = xhandle.createGroup("parameters");
+            writer::write_scalar(phandle, "nmads", 3.0);
+            xhandle.createGroup("results");
+        }
+        {
+            auto phandle = copy_step(input, "cell_filtering", handle, "cell_filtering", {});
+            writer::write_scalar(phandle, "use_rna", static_cast<int>(!rna_skip));
+            writer::write_scalar(phandle, "use_adt", static_cast<int>(!adt_skip));
+            writer::write_scalar(phandle, "use_crispr", 1);
+        }
+
+        copy(input, "normalization", handle, "rna_normalization");
+        copy(input, "adt_normalization", handle, "adt_normalization");
+        add_empty_step(handle, "crispr_normalization");
+
+        copy(input, "feature_selection", handle, "feature_selection");
+
+        copy(input, "pca", handle, "rna_pca");
+        copy(input, "adt_pca", handle, "adt_pca");
+        {
+            auto xhandle = handle.createGroup("crispr_pca");
+            auto phandle = xhandle.createGroup("parameters");
+            writer::write_scalar(phandle, "num_pcs", 20);
+            writer::write_string(phandle, "block_method", "none");
+            xhandle.createGroup("results");
+        }
+        migrate_combine_embeddings(input, handle);
+        copy(input, "batch_correction", handle, "batch_correction");
+
+        copy(input, "neighbor_index", handle, "neighbor_index");
+
+        copy(input, "choose_clustering", handle, "choose_clustering");
+        copy(input, "kmeans_cluster", handle, "kmeans_cluster");
+        migrate_snn_graph_cluster(input, handle);
+
+        copy(input, "tsne", handle, "tsne");
+        copy(input, "umap", handle, "umap");
+
+        migrate_markers(input, handle, "marker_detection");
+        migrate_markers(input, handle, "custom_selections");
+        copy(input, "cell_labelling", handle, "cell_labelling");
+
+        auto mhandle = handle.createGroup("_metadata");
+        writer::write_scalar(mhandle, "format_version", target);
+        writer::write_string(mhandle, "application_name", application_name);
+        writer::write_string(mhandle, "application_version", application_version);
+    }
+
+    H5::H5File handle(output, H5F_ACC_RDONLY);
+    try {
+        return v3::validate(handle, embedded, target, options);
+    } catch (std::exception& e) {
+        throw utils::combine_errors(e, "failed to validate the migrated state file");
+    }
+}
+
+/**
+ * Migrate a v2 `.kana` file to v3.
+ * The state file is migrated with `migrate_state()` and any embedded input files are transferred to the output file without modification,
+ * as their offsets and sizes are unchanged by the migration.
+ *
+ * @param input Path to a v2 `.kana` file.
+ * @param output Path to the output `.kana` file.
+ * @param application_name Name of the application, to be stored in the `_metadata`.
+ * @param application_version Version of the application, to be stored in the `_metadata`.
+ * @param options Options for validating the migrated state file.
+ *
+ * @return Summary of the migrated state file from `v3::validate()`.
+ */
+inline v3::Summary migrate(
+    const std::string& input,
+    const std::string& output,
+    const std::string& application_name = "kana",
+    const std::string& application_version = "unknown",
+    const Options& options = Options())
+{
+    container::Reader reader(input);
+    const auto& original = reader.header();
+    bool embedded = (original.format_type == container::EMBEDDED);
+
+    auto tmp = output + ".state.h5";
+    v3::Summary summary;
+    try {
+        {
+            auto handle = reader.open_state();
+            summary = migrate_state(handle, tmp, embedded, original.version, application_name, application_version, options);
+        }
+
+        container::Header header;
+        header.format_type = original.format_type;
+        header.version = 3000000;
+        header.state_nbytes = container::file_size(tmp);
+
+        container::Output sink(output);
+        unsigned char buffer[container::header_size];
+        container::encode_header(header, buffer);
+        sink.write(buffer, container::header_size);
+        sink.append(tmp, header.state_nbytes);
+
+        if (embedded) {
+            uint64_t start = container::header_size + original.state_nbytes;
+            auto rest = container::view_range(input, start, container::file_size(input) - start);
+            sink.write(rest.data(), rest.size());
+        }
+        sink.close();
+
+    } catch (...) {
+        std::filesystem::remove(tmp);
+        throw;
+    }
+    std::filesystem::remove(tmp);
+
+    return summary;
+}
+
+}
+
+}
+
+#endif
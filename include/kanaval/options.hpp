@@ -0,0 +1,44 @@
+#ifndef KANAVAL_OPTIONS_HPP
+#define KANAVAL_OPTIONS_HPP
+
+#include "H5Cpp.h"
+
+/**
+ * @file options.hpp
+ *
+ * @brief Options for validation.
+ */
+
+namespace kanaval {
+
+/**
+ * @brief Options for validation.
+ *
+ * By default, validation only checks the structure of the state file, i.e., the presence, types and dimensions of each dataset.
+ * Deep validation also streams through the contents of the larger datasets to check their values.
+ */
+struct Options {
+    /**
+     * Whether to perform deep validation of dataset contents.
+     */
+    bool deep = false;
+
+    /**
+     * Number of threads to use for deep validation.
+     * All HDF5 calls are serialized as the HDF5 library is not guaranteed to be thread-safe.
+     * Contiguous datasets in read-only files are read in parallel without the HDF5 library on POSIX systems,
+     * as are deflate-compressed chunks if `KANAVAL_USE_ZLIB` is defined;
+     * otherwise, only the checks on the loaded values are performed in parallel.
+     */
+    int num_threads = 1;
+
+    /**
+     * Number of values to load at a time during deep validation.
+     * Larger values reduce the number of HDF5 calls at the cost of memory usage, which scales with `block_size * num_threads`.
+     */
+    hsize_t block_size = 1048576;
+};
+
+}
+
+#endif
@@ -0,0 +1,591 @@
+#ifndef KANAVAL_PROFILE_HPP
+#define KANAVAL_PROFILE_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include "manifest.hpp"
+#include "repack.hpp"
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <sstream>
+#include <iomanip>
+
+/**
+ * @file profile.hpp
+ *
+ * @brief Profile the storage footprint and layout of each step in a state file.
+ */
+
+namespace kanaval {
+
+namespace profile {
+
+/**
+ * @brief Options for profiling.
+ */
+struct Options {
+    /**
+     * Chunks smaller than this number of bytes are flagged as tiny, as each chunk requires a separate read and index lookup.
+     */
+    hsize_t min_chunk_bytes = 4096;
+
+    /**
+     * Datasets with at least this number of logical bytes are flagged if they are not compressed.
+     */
+    hsize_t large_bytes = 1048576;
+
+    /**
+     * Cost of each separate read from the file, in units of bytes read.
+     */
+    double seek_cost = 65536;
+
+    /**
+     * Cost of decompressing each logical byte of a filtered dataset, in units of bytes read.
+     */
+    double decompress_cost = 0.5;
+};
+
+/**
+ * @brief Storage profile of a single dataset.
+ */
+struct Dataset {
+    /**
+     * Path to the dataset in the file.
+     */
+    std::string path;
+
+    /**
+     * Type of the dataset, e.g., `"float64"`, `"uint8"`, `"string[10]"` for fixed-length strings or `"string"` for variable-length strings.
+     */
+    std::string dtype;
+
+    /**
+     * Dimensions of the dataset, empty for scalars.
+     */
+    std::vector<hsize_t> dims;
+
+    /**
+     * Storage layout, one of `"compact"`, `"contiguous"`, `"chunked"` or `"virtual"`.
+     */
+    std::string layout;
+
+    /**
+     * Chunk dimensions, empty if the dataset is not chunked.
+     */
+    std::vector<hsize_t> chunk_dims;
+
+    /**
+     * Names of the filters in the pipeline, in the order in which they are applied.
+     */
+    std::vector<std::string> filters;
+
+    /**
+     * Size of the uncompressed contents in bytes.
+     * For variable-length strings, this is set to `storage_bytes` as the actual lengths cannot be obtained without reading the dataset.
+     */
+    uint64_t logical_bytes = 0;
+
+    /**
+     * Size of the (possibly compressed) contents on disk in bytes.
+     */
+    uint64_t storage_bytes = 0;
+
+    /**
+     * Size of the object header and chunk index in bytes.
+     */
+    uint64_t metadata_bytes = 0;
+
+    /**
+     * Number of allocated chunks, zero if the dataset is not chunked.
+     */
+    uint64_t num_chunks = 0;
+
+    /**
+     * Ratio of `logical_bytes` to `storage_bytes`, or zero if no storage is allocated.
+     */
+    double compression_ratio = 0;
+
+    /**
+     * Estimated cost of reading the entire dataset, see `Options` for details.
+     */
+    double read_cost = 0;
+
+    /**
+     * Descriptions of pathological layouts.
+     */
+    std::vector<std::string> warnings;
+};
+
+/**
+ * @brief Storage profile of an analysis step.
+ */
+struct Step {
+    /**
+     * Name of the step.
+     */
+    std::string name;
+
+    /**
+     * Total logical size of all datasets in the step.
+     */
+    uint64_t logical_bytes = 0;
+
+    /**
+     * Total size of all datasets on disk.
+     */
+    uint64_t storage_bytes = 0;
+
+    /**
+     * Total size of the object headers, chunk indices and link storage of all groups and datasets in the step.
+     */
+    uint64_t metadata_bytes = 0;
+
+    /**
+     * Total estimated cost of reading all datasets in the step.
+     */
+    double read_cost = 0;
+
+    /**
+     * Profiles for each dataset in the step.
+     */
+    std::vector<Dataset> datasets;
+};
+
+/**
+ * @brief Storage profile of a state file.
+ */
+struct Profile {
+    /**
+     * Size of the file in bytes.
+     */
+    uint64_t file_bytes = 0;
+
+    /**
+     * Unused space in the file, in bytes.
+     */
+    uint64_t free_bytes = 0;
+
+    /**
+     * Size of the object header and link storage of the root group.
+     */
+    uint64_t metadata_bytes = 0;
+
+    /**
+     * Profiles for each step, in the order in which they are used.
+     */
+    std::vector<Step> steps;
+
+    /**
+     * Total number of warnings across all datasets.
+     */
+    size_t num_warnings = 0;
+};
+
+// Size of the object header, plus the B-trees and heaps for links, attributes or chunks.
+inline uint64_t metadata_size(hid_t id) {
+#if H5_VERSION_GE(1, 12, 0)
+    H5O_native_info_t info;
+    if (H5Oget_native_info(id, &info, H5O_NATIVE_INFO_HDR | H5O_NATIVE_INFO_META_SIZE) < 0) {
+        return 0;
+    }
+#else
+    H5O_info_t info;
+    if (H5Oget_info2(id, &info, H5O_INFO_HDR | H5O_INFO_META_SIZE) < 0) {
+        return 0;
+    }
+#endif
+    return info.hdr.space.total + info.meta_size.obj.index_size + info.meta_size.obj.heap_size + info.meta_size.attr.index_size + info.meta_size.attr.heap_size;
+}
+
+inline std::string describe_type(const H5::DataSet& dhandle) {
+    auto cls = dhandle.getTypeClass();
+    if (cls == H5T_INTEGER) {
+        auto itype = dhandle.getIntType();
+        return std::string(itype.getSign() == H5T_SGN_NONE ? "uint" : "int") + std::to_string(itype.getSize() * 8);
+    } else if (cls == H5T_FLOAT) {
+        return "float" + std::to_string(dhandle.getFloatType().getSize() * 8);
+    } else if (cls == H5T_STRING) {
+        auto stype = dhandle.getStrType();
+        if (stype.isVariableStr()) {
+            return "string";
+        }
+        return "string[" + std::to_string(stype.getSize()) + "]";
+    }
+    return "other";
+}
+
+inline std::string describe_filter(H5Z_filter_t filter) {
+    switch (filter) {
+        case H5Z_FILTER_DEFLATE:
+            return "deflate";
+        case H5Z_FILTER_SHUFFLE:
+            return "shuffle";
+        case H5Z_FILTER_FLETCHER32:
+            return "fletcher32";
+        case H5Z_FILTER_SZIP:
+            return "szip";
+        case H5Z_FILTER_NBIT:
+            return "nbit";
+        case H5Z_FILTER_SCALEOFFSET:
+            return "scaleoffset";
+    }
+    return "filter" + std::to_string(filter);
+}
+
+/**
+ * Profile a single dataset from its metadata, without reading its contents.
+ *
+ * @param dhandle Handle to the dataset.
+ * @param path Path to the dataset in the file.
+ * @param options Options for profiling.
+ *
+ * @return Profile of the dataset.
+ */
+inline Dataset profile_dataset(const H5::DataSet& dhandle, const std::string& path, const Options& options) {
+    Dataset output;
+    output.path = path;
+    output.dtype = describe_type(dhandle);
+    output.dims = utils::load_dataset_dimensions(dhandle);
+
+    auto dtype = dhandle.getDataType();
+    hsize_t npoints = 1;
+    for (auto d : output.dims) {
+        npoints *= d;
+    }
+    output.storage_bytes = dhandle.getStorageSize();
+    output.logical_bytes = (dtype.isVariableStr() ? output.storage_bytes : npoints * dtype.getSize());
+    output.metadata_bytes = metadata_size(dhandle.getId());
+    if (output.storage_bytes) {
+        output.compression_ratio = static_cast<double>(output.logical_bytes) / output.storage_bytes;
+    }
+
+    auto plist = dhandle.getCreatePlist();
+    auto layout = plist.getLayout();
+    bool compressed = false;
+    double reads = 0;
+
+    if (layout == H5D_COMPACT) {
+        output.layout = "compact"; // stored in the object header, so it is read along with the metadata.
+    } else if (layout == H5D_CONTIGUOUS) {
+        output.layout = "contiguous";
+        reads = (output.storage_bytes > 0);
+    } else if (layout == H5D_CHUNKED) {
+        output.layout = "chunked";
+        output.chunk_dims.resize(output.dims.size());
+        plist.getChunk(output.chunk_dims.size(), output.chunk_dims.data());
+
+        int nfilters = plist.getNfilters();
+        for (int f = 0; f < nfilters; ++f) {
+            unsigned int flags, cd_values[8], config;
+            size_t cd_nelmts = 8;
+            auto filter = H5Pget_filter2(plist.getId(), f, &flags, &cd_nelmts, cd_values, 0, NULL, &config);
+            output.filters.push_back(describe_filter(filter));
+            if (filter != H5Z_FILTER_SHUFFLE && filter != H5Z_FILTER_FLETCHER32) {
+                compressed = true;
+            }
+        }
+
+        hsize_t expected = 1, chunk_bytes = dtype.getSize();
+        for (size_t d = 0; d < output.dims.size(); ++d) {
+            expected *= output.dims[d] / output.chunk_dims[d] + (output.dims[d] % output.chunk_dims[d] > 0);
+            chunk_bytes *= output.chunk_dims[d];
+        }
+#if H5_VERSION_GE(1, 10, 5)
+        hsize_t allocated = 0;
+        auto fspace = dhandle.getSpace();
+        if (H5Dget_num_chunks(dhandle.getId(), fspace.getId(), &allocated) >= 0) {
+            expected = allocated;
+        }
+#endif
+        output.num_chunks = expected;
+        reads = output.num_chunks;
+
+        if (output.num_chunks > 1 && chunk_bytes < options.min_chunk_bytes) {
+            output.warnings.push_back("tiny chunks of " + std::to_string(chunk_bytes) + " bytes");
+        }
+
+        // kana reads contiguous blocks of rows (i.e., cells), so each chunk should contain whole rows.
+        if (output.dims.size() == 2 && output.chunk_dims[1] < output.dims[1]) {
+            output.warnings.push_back("chunks do not span whole rows");
+        }
+    } else {
+        output.layout = "virtual";
+    }
+
+    if (!compressed && output.layout != "compact" && output.logical_bytes >= options.large_bytes) {
+        output.warnings.push_back("large dataset without compression");
+    }
+
+    output.read_cost = output.storage_bytes + reads * options.seek_cost;
+    if (compressed) {
+        output.read_cost += options.decompress_cost * output.logical_bytes;
+    }
+    return output;
+}
+
+inline void profile_group(const H5::H5File& handle, const std::string& path, Step& step, const Options& options) {
+    auto ghandle = handle.openGroup(path);
+    step.metadata_bytes += metadata_size(ghandle.getId());
+
+    hsize_t nchildren = ghandle.getNumObjs();
+    for (hsize_t i = 0; i < nchildren; ++i) {
+        auto name = ghandle.getObjnameByIdx(i);
+        auto child = path + "/" + name;
+        if (ghandle.childObjType(name) == H5O_TYPE_GROUP) {
+            profile_group(handle, child, step, options);
+            continue;
+        }
+
+        auto dhandle = ghandle.openDataSet(name);
+        step.datasets.push_back(profile_dataset(dhandle, child, options));
+        const auto& current = step.datasets.back();
+        step.logical_bytes += current.logical_bytes;
+        step.storage_bytes += current.storage_bytes;
+        step.metadata_bytes += current.metadata_bytes;
+        step.read_cost += current.read_cost;
+    }
+}
+
+/**
+ * Profile the storage footprint and layout of a state file.
+ * Only the metadata of each dataset is inspected, so this is cheap enough to run on every upload;
+ * the file should be validated separately, e.g., with `kanaval::validate()`.
+ *
+ * @param handle Handle to a HDF5 file.
+ * @param version Version of the kana file, used to order the steps.
+ * @param options Options for profiling.
+ *
+ * @return Profile of the file.
+ * Datasets at the root of the file are reported as steps with a single dataset.
+ */
+inline Profile profile(const H5::H5File& handle, int version, const Options& options = Options()) {
+    Profile output;
+    output.file_bytes = handle.getFileSize();
+    output.free_bytes = handle.getFreeSpace();
+    output.metadata_bytes = metadata_size(handle.openGroup("/").getId());
+
+    for (const auto& name : repack::step_order(handle, version)) {
+        output.steps.emplace_back();
+        auto& step = output.steps.back();
+        step.name = name;
+
+        if (handle.childObjType(name) == H5O_TYPE_GROUP) {
+            profile_group(handle, name, step, options);
+        } else {
+            step.datasets.push_back(profile_dataset(handle.openDataSet(name), name, options));
+            const auto& current = step.datasets.back();
+            step.logical_bytes = current.logical_bytes;
+            step.storage_bytes = current.storage_bytes;
+            step.metadata_bytes = current.metadata_bytes;
+            step.read_cost = current.read_cost;
+        }
+
+        for (const auto& d : step.datasets) {
+            output.num_warnings += d.warnings.size();
+        }
+    }
+
+    return output;
+}
+
+inline void append_number(double x, std::string& output) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.6g", x);
+    output += buffer;
+}
+
+inline void append_dims(const std::vector<hsize_t>& dims, std::string& output) {
+    output += '[';
+    for (size_t d = 0; d < dims.size(); ++d) {
+        if (d) {
+            output += ',';
+        }
+        output += std::to_string(dims[d]);
+    }
+    output += ']';
+}
+
+inline void append_strings(const std::vector<std::string>& values, std::string& output) {
+    output += '[';
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i) {
+            output += ',';
+        }
+        manifest::append_string(values[i], output);
+    }
+    output += ']';
+}
+
+/**
+ * @param profile Profile of a state file, typically created by `profile()`.
+ * @return Compact JSON representation of the profile.
+ * Chunk dimensions are reported as `null` for datasets that are not chunked.
+ */
+inline std::string to_json(const Profile& profile) {
+    std::string output = "{\"file_bytes\":" + std::to_string(profile.file_bytes);
+    output += ",\"free_bytes\":" + std::to_string(profile.free_bytes);
+    output += ",\"metadata_bytes\":" + std::to_string(profile.metadata_bytes);
+    output += ",\"num_warnings\":" + std::to_string(profile.num_warnings);
+
+    output += ",\"steps\":[";
+    for (size_t s = 0; s < profile.steps.size(); ++s) {
+        const auto& step = profile.steps[s];
+        if (s) {
+            output += ',';
+        }
+
+        output += "{\"name\":";
+        manifest::append_string(step.name, output);
+        output += ",\"logical_bytes\":" + std::to_string(step.logical_bytes);
+        output += ",\"storage_bytes\":" + std::to_string(step.storage_bytes);
+        output += ",\"metadata_bytes\":" + std::to_string(step.metadata_bytes);
+        output += ",\"read_cost\":";
+        append_number(step.read_cost, output);
+
+        output += ",\"datasets\":[";
+        for (size_t d = 0; d < step.datasets.size(); ++d) {
+            const auto& dataset = step.datasets[d];
+            if (d) {
+                output += ',';
+            }
+
+            output += "{\"path\":";
+            manifest::append_string(dataset.path, output);
+            output += ",\"dtype\":";
+            manifest::append_string(dataset.dtype, output);
+            output += ",\"dims\":";
+            append_dims(dataset.dims, output);
+            output += ",\"layout\":";
+            manifest::append_string(dataset.layout, output);
+            output += ",\"chunk_dims\":";
+            if (dataset.layout == "chunked") {
+                append_dims(dataset.chunk_dims, output);
+            } else {
+                output += "null";
+            }
+            output += ",\"filters\":";
+            append_strings(dataset.filters, output);
+            output += ",\"logical_bytes\":" + std::to_string(dataset.logical_bytes);
+            output += ",\"storage_bytes\":" + std::to_string(dataset.storage_bytes);
+            output += ",\"metadata_bytes\":" + std::to_string(dataset.metadata_bytes);
+            output += ",\"num_chunks\":" + std::to_string(dataset.num_chunks);
+            output += ",\"compression_ratio\":";
+            append_number(dataset.compression_ratio, output);
+            output += ",\"read_cost\":";
+            append_number(dataset.read_cost, output);
+            output += ",\"warnings\":";
+            append_strings(dataset.warnings, output);
+            output += '}';
+        }
+        output += "]}";
+    }
+    output += "]}";
+    return output;
+}
+
+inline std::string format_bytes(uint64_t x) {
+    const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+    double value = x;
+    int u = 0;
+    while (value >= 1024 && u < 4) {
+        value /= 1024;
+        ++u;
+    }
+
+    char buffer[32];
+    if (u == 0) {
+        std::snprintf(buffer, sizeof(buffer), "%d B", static_cast<int>(x));
+    } else {
+        std::snprintf(buffer, sizeof(buffer), "%.1f %s", value, units[u]);
+    }
+    return buffer;
+}
+
+inline std::string format_dims(const std::vector<hsize_t>& dims) {
+    if (dims.empty()) {
+        return "scalar";
+    }
+    std::string output;
+    for (size_t d = 0; d < dims.size(); ++d) {
+        if (d) {
+            output += 'x';
+        }
+        output += std::to_string(dims[d]);
+    }
+    return output;
+}
+
+/**
+ * @param profile Profile of a state file, typically created by `profile()`.
+ * @return Human-readable table of the profile, with one row per step followed by one row per dataset in that step.
+ * Warnings are listed under the affected datasets.
+ */
+inline std::string to_table(const Profile& profile) {
+    std::ostringstream output;
+    output << "file: " << format_bytes(profile.file_bytes)
+        << ", free: " << format_bytes(profile.free_bytes)
+        << ", root metadata: " << format_bytes(profile.metadata_bytes)
+        << ", warnings: " << profile.num_warnings << "\n\n";
+
+    // Cells are padded to the column widths but never truncated, so long paths just push the rest of the row along.
+    auto add_row = [&](const std::string& indent, const std::string& name, const std::string& dtype, const std::string& dims, const std::string& layout,
+        const std::string& chunks, const std::string& filters, const std::string& logical, const std::string& stored, const std::string& metadata, const std::string& ratio) -> void
+    {
+        output << indent << std::left << std::setw(48 - indent.size()) << name
+            << ' ' << std::setw(12) << dtype
+            << ' ' << std::setw(12) << dims
+            << ' ' << std::setw(10) << layout
+            << ' ' << std::setw(10) << chunks
+            << ' ' << std::setw(16) << filters
+            << std::right
+            << ' ' << std::setw(10) << logical
+            << ' ' << std::setw(10) << stored
+            << ' ' << std::setw(10) << metadata
+            << ' ' << std::setw(7) << ratio << '\n';
+    };
+
+    add_row("", "path", "dtype", "dims", "layout", "chunks", "filters", "logical", "stored", "metadata", "ratio");
+
+    for (const auto& step : profile.steps) {
+        add_row("", step.name, "", "", "", "", "", format_bytes(step.logical_bytes), format_bytes(step.storage_bytes), format_bytes(step.metadata_bytes), "");
+
+        for (const auto& dataset : step.datasets) {
+            std::string filters;
+            for (size_t f = 0; f < dataset.filters.size(); ++f) {
+                if (f) {
+                    filters += ',';
+                }
+                filters += dataset.filters[f];
+            }
+
+            std::ostringstream ratio;
+            ratio << std::fixed << std::setprecision(2) << dataset.compression_ratio;
+
+            add_row("  ",
+                dataset.path,
+                dataset.dtype,
+                format_dims(dataset.dims),
+                dataset.layout,
+                (dataset.layout == "chunked" ? format_dims(dataset.chunk_dims) : "-"),
+                (filters.empty() ? "-" : filters),
+                format_bytes(dataset.logical_bytes),
+                format_bytes(dataset.storage_bytes),
+                format_bytes(dataset.metadata_bytes),
+                ratio.str()
+            );
+
+            for (const auto& w : dataset.warnings) {
+                output << "    ! " << w << "\n";
+            }
+        }
+    }
+
+    return output.str();
+}
+
+}
+
+}
+
+#endif
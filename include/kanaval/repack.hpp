@@ -0,0 +1,426 @@
+#ifndef KANAVAL_REPACK_HPP
+#define KANAVAL_REPACK_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include "options.hpp"
+#include "writer.hpp"
+#include "kanaval.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+
+/**
+ * @file repack.hpp
+ *
+ * @brief Rewrite state files with a layout that is optimized for reading.
+ */
+
+namespace kanaval {
+
+namespace repack {
+
+/**
+ * @brief Summary of the changes from repacking a state file.
+ */
+struct Report {
+    /**
+     * Size of the input file in bytes.
+     */
+    uint64_t input_bytes = 0;
+
+    /**
+     * Size of the output file in bytes.
+     */
+    uint64_t output_bytes = 0;
+
+    /**
+     * Time taken to read all datasets in the input file, in seconds.
+     */
+    double input_load_time = 0;
+
+    /**
+     * Time taken to read all datasets in the output file, in seconds.
+     */
+    double output_load_time = 0;
+
+    /**
+     * Number of datasets that were rewritten with a new layout.
+     */
+    size_t rewritten = 0;
+
+    /**
+     * Number of datasets that were copied verbatim, e.g., variable-length strings.
+     */
+    size_t copied = 0;
+};
+
+// Native type with the same class, size and sign as a numeric dataset, so that its values can be loaded without any loss of precision.
+inline const H5::PredType& native_numeric(const H5::DataSet& dhandle) {
+    if (dhandle.getTypeClass() == H5T_FLOAT) {
+        return (dhandle.getFloatType().getSize() <= 4 ? H5::PredType::NATIVE_FLOAT : H5::PredType::NATIVE_DOUBLE);
+    }
+
+    auto itype = dhandle.getIntType();
+    bool is_signed = (itype.getSign() != H5T_SGN_NONE);
+    switch (itype.getSize()) {
+        case 1:
+            return (is_signed ? H5::PredType::NATIVE_INT8 : H5::PredType::NATIVE_UINT8);
+        case 2:
+            return (is_signed ? H5::PredType::NATIVE_INT16 : H5::PredType::NATIVE_UINT16);
+        case 4:
+            return (is_signed ? H5::PredType::NATIVE_INT32 : H5::PredType::NATIVE_UINT32);
+        default:
+            return (is_signed ? H5::PredType::NATIVE_INT64 : H5::PredType::NATIVE_UINT64);
+    }
+}
+
+// Only numeric and fixed-length string datasets with up to 2 dimensions are rewritten.
+// Anything else is rare in state files and is copied verbatim.
+inline bool is_rewritable(const H5::DataSet& dhandle) {
+    auto cls = dhandle.getTypeClass();
+    if (cls == H5T_STRING) {
+        if (dhandle.getStrType().isVariableStr()) {
+            return false;
+        }
+    } else if (cls != H5T_INTEGER && cls != H5T_FLOAT) {
+        return false;
+    }
+    return dhandle.getSpace().getSimpleExtentNdims() <= 2;
+}
+
+// Steps in the order in which they are used, so that the datasets for each step are stored together.
+inline std::vector<std::string> step_order(const H5::H5File& handle, int version) {
+    std::vector<std::string> known;
+    if (version >= 3000000) {
+        for (const auto& s : v3::steps::graph) {
+            known.push_back(s.name);
+        }
+    } else {
+        known = {
+            "inputs",
+            "quality_control",
+            "adt_quality_control",
+            "cell_filtering",
+            "normalization",
+            "adt_normalization",
+            "feature_selection",
+            "pca",
+            "adt_pca",
+            "combine_embeddings",
+            "batch_correction",
+            "neighbor_index",
+            "choose_clustering",
+            "snn_graph_cluster",
+            "kmeans_cluster",
+            "tsne",
+            "umap",
+            "marker_detection",
+            "custom_selections",
+            "cell_labelling"
+        };
+    }
+
+    std::vector<std::string> output;
+    for (const auto& k : known) {
+        if (handle.exists(k)) {
+            output.push_back(k);
+        }
+    }
+
+    // Any unknown steps are stored at the end.
+    hsize_t nchildren = handle.getNumObjs();
+    for (hsize_t i = 0; i < nchildren; ++i) {
+        auto name = handle.getObjnameByIdx(i);
+        if (std::find(known.begin(), known.end(), name) == known.end()) {
+            output.push_back(name);
+        }
+    }
+
+    return output;
+}
+
+// Create all groups under `path` in the output file, and collect the paths of all datasets in the order in which they should be written.
+inline void plan(const H5::H5File& input, const H5::H5File& output, const std::string& path, std::vector<std::string>& datasets) {
+    if (input.childObjType(path) != H5O_TYPE_GROUP) {
+        datasets.push_back(path);
+        return;
+    }
+
+    auto ohandle = output.createGroup(path);
+    auto ghandle = input.openGroup(path);
+    writer::copy_attributes(ghandle, ohandle);
+    hsize_t nchildren = ghandle.getNumObjs();
+    for (hsize_t i = 0; i < nchildren; ++i) {
+        plan(input, output, path + "/" + ghandle.getObjnameByIdx(i), datasets);
+    }
+}
+
+inline std::pair<std::string, std::string> split_path(const std::string& path) {
+    auto pos = path.rfind('/');
+    if (pos == std::string::npos) {
+        return std::make_pair(std::string("/"), path);
+    }
+    return std::make_pair(path.substr(0, pos), path.substr(pos + 1));
+}
+
+// A dataset that has been loaded into memory, and possibly compressed, in preparation for being written.
+struct Pending {
+    std::string path;
+    bool rewrite = false;
+    H5::DataType dtype;
+    size_t type_size = 0;
+    std::vector<hsize_t> dims;
+    std::vector<unsigned char> buffer;
+#ifdef KANAVAL_USE_ZLIB
+    hsize_t rows_per_chunk = 0;
+    std::vector<writer::Chunk> chunks;
+#endif
+};
+
+// Load a dataset under the HDF5 lock. If `KANAVAL_USE_ZLIB` is defined, small chunked datasets are also compressed here,
+// outside of the lock, so that multiple datasets can be compressed in parallel; large datasets are instead compressed in parallel by `commit()`.
+inline void prepare(const H5::H5File& input, Pending& current, [[maybe_unused]] const writer::Options& options) {
+    {
+        std::lock_guard<std::mutex> lck(utils::hdf5_mutex());
+        auto dhandle = input.openDataSet(current.path);
+        current.rewrite = is_rewritable(dhandle);
+        if (!current.rewrite) {
+            return;
+        }
+
+        if (dhandle.getTypeClass() == H5T_STRING) {
+            current.dtype = dhandle.getStrType();
+        } else {
+            current.dtype = native_numeric(dhandle);
+        }
+
+        current.type_size = current.dtype.getSize();
+        current.dims = utils::load_dataset_dimensions(dhandle);
+        if (current.dims.size() == 2 && current.dims[1] == 0) { // can't be represented by write_bytes().
+            current.rewrite = false;
+            return;
+        }
+
+        hsize_t total = 1;
+        for (auto d : current.dims) {
+            total *= d;
+        }
+        current.buffer.resize(total * current.type_size);
+        if (total) {
+            dhandle.read(current.buffer.data(), current.dtype);
+        }
+    }
+
+#ifdef KANAVAL_USE_ZLIB
+    if (current.dims.empty()) {
+        return;
+    }
+    hsize_t nrow = current.dims[0], ncol = (current.dims.size() > 1 ? current.dims[1] : 0);
+    current.rows_per_chunk = writer::array_chunk_rows(nrow, ncol, current.type_size, options);
+    if (current.rows_per_chunk == 0) {
+        return;
+    }
+
+    hsize_t nchunks = nrow / current.rows_per_chunk + (nrow % current.rows_per_chunk > 0);
+    if (nchunks >= static_cast<hsize_t>(std::max(1, options.num_threads))) {
+        return;
+    }
+
+    hsize_t row_bytes = (ncol ? ncol : 1) * current.type_size;
+    current.chunks.resize(nchunks);
+    std::vector<unsigned char> padded, shuffled;
+    for (hsize_t c = 0; c < nchunks; ++c) {
+        writer::compress_chunk(current.buffer.data(), nrow, row_bytes, current.type_size, current.rows_per_chunk, c, options, padded, shuffled, current.chunks[c]);
+    }
+#endif
+}
+
+// Write a prepared dataset in the calling thread.
+inline void commit(const H5::H5File& input, const H5::H5File& output, Pending& current, const writer::Options& options) {
+    auto parts = split_path(current.path);
+    auto parent = output.openGroup(parts.first);
+
+    if (!current.rewrite) {
+        if (H5Ocopy(input.getId(), current.path.c_str(), parent.getId(), parts.second.c_str(), H5P_DEFAULT, H5P_DEFAULT) < 0) {
+            throw std::runtime_error("failed to copy the dataset");
+        }
+        return;
+    }
+
+    H5::DataSet dhandle;
+    if (current.dims.empty()) {
+        dhandle = parent.createDataSet(parts.second, current.dtype, H5::DataSpace(), writer::compact_plist());
+        dhandle.write(current.buffer.data(), current.dtype);
+
+    } else {
+        hsize_t nrow = current.dims[0], ncol = (current.dims.size() > 1 ? current.dims[1] : 0);
+        bool written = false;
+
+#ifdef KANAVAL_USE_ZLIB
+        if (!current.chunks.empty()) {
+            hsize_t dims[2] = { nrow, ncol };
+            H5::DataSpace space(ncol ? 2 : 1, dims);
+            hsize_t rows_per_chunk;
+            auto plist = writer::array_plist(nrow, ncol, current.type_size, options, rows_per_chunk);
+            dhandle = parent.createDataSet(parts.second, current.dtype, space, plist);
+            for (size_t c = 0; c < current.chunks.size(); ++c) {
+                writer::write_chunk(dhandle, c * rows_per_chunk, current.chunks[c]);
+            }
+            written = true;
+        }
+#endif
+
+        if (!written) {
+            dhandle = writer::write_bytes(parent, parts.second, current.dtype, current.buffer.data(), nrow, ncol, options);
+        }
+    }
+
+    // Attributes are not preserved by rewriting, unlike `H5Ocopy()`.
+    writer::copy_attributes(input.openDataSet(current.path), dhandle);
+}
+
+/**
+ * @param handle Handle to a HDF5 file.
+ * @return Time taken to read every dataset in the file into memory, in seconds.
+ * Variable-length strings are not read.
+ */
+inline double load_time(const H5::H5File& handle) {
+    std::vector<std::string> datasets;
+    std::vector<std::string> stack { "/" };
+    while (!stack.empty()) {
+        auto current = stack.back();
+        stack.pop_back();
+        auto ghandle = handle.openGroup(current);
+        hsize_t nchildren = ghandle.getNumObjs();
+        for (hsize_t i = 0; i < nchildren; ++i) {
+            auto child = (current == "/" ? "" : current) + "/" + ghandle.getObjnameByIdx(i);
+            if (ghandle.childObjType(ghandle.getObjnameByIdx(i)) == H5O_TYPE_GROUP) {
+                stack.push_back(child);
+            } else {
+                datasets.push_back(child);
+            }
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned char> buffer;
+    for (const auto& d : datasets) {
+        auto dhandle = handle.openDataSet(d);
+        if (!is_rewritable(dhandle)) {
+            continue;
+        }
+        H5::DataType dtype;
+        if (dhandle.getTypeClass() == H5T_STRING) {
+            dtype = dhandle.getStrType();
+        } else {
+            dtype = native_numeric(dhandle);
+        }
+        buffer.resize(dhandle.getSpace().getSimpleExtentNpoints() * dtype.getSize());
+        if (!buffer.empty()) {
+            dhandle.read(buffer.data(), dtype);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/**
+ * Rewrite a state file with a layout that is optimized for reading by kana and the validators.
+ * Every numeric and fixed-length string dataset is loaded and rewritten with the storage of `writer::write_array()`, i.e.,
+ * small datasets are compact, while larger datasets are split into chunks of whole rows with the same number of values in each chunk, and are optionally compressed.
+ * The file is created with the latest HDF5 format, so groups use compact or indexed link storage instead of the old symbol tables, and it contains no free space.
+ * The steps are written in the order in which they are used, with all datasets of each step stored together.
+ * Attributes on all groups and datasets are preserved.
+ *
+ * If `KANAVAL_USE_ZLIB` is defined, datasets are loaded and compressed in parallel, with up to `4 * options.num_threads` datasets in memory at any time;
+ * large datasets are compressed one at a time, with their chunks compressed in parallel.
+ * Datasets are always written to the file in order.
+ *
+ * Both the input and output files are validated.
+ *
+ * @param input Path to the input state file.
+ * @param output Path to the output state file.
+ * Any existing file is overwritten.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file.
+ * @param options Options for writing datasets.
+ * @param validation Options for validating the input and output files.
+ *
+ * @return Report of the changes in size and load time.
+ * Load times are measured after validation, so they mostly reflect decompression and HDF5 overhead rather than disk access.
+ */
+inline Report repack(const std::string& input, const std::string& output, bool embedded, int version, const writer::Options& options = writer::Options(), const Options& validation = Options()) {
+    Report report;
+    H5::H5File ihandle(input, H5F_ACC_RDONLY);
+    try {
+        kanaval::validate(ihandle, embedded, version, validation);
+    } catch (std::exception& e) {
+        throw utils::combine_errors(e, "failed to validate the input state file");
+    }
+
+    {
+        auto ohandle = writer::create_file(output);
+        writer::copy_attributes(ihandle.openGroup("/"), ohandle.openGroup("/"));
+        std::vector<std::string> datasets;
+        for (const auto& step : step_order(ihandle, version)) {
+            plan(ihandle, ohandle, step, datasets);
+        }
+
+        const int nthreads = std::max(1, options.num_threads);
+        const size_t batch = static_cast<size_t>(nthreads) * 4;
+        for (size_t first = 0; first < datasets.size(); first += batch) {
+            size_t current = std::min(batch, datasets.size() - first);
+            std::vector<Pending> pending(current);
+            for (size_t i = 0; i < current; ++i) {
+                pending[i].path = datasets[first + i];
+            }
+
+            utils::parallelize(current, nthreads, [&](int, size_t start, size_t len) -> void {
+                for (size_t i = start, end = start + len; i < end; ++i) {
+                    try {
+                        prepare(ihandle, pending[i], options);
+                    } catch (std::exception& e) {
+                        throw utils::combine_errors(e, "failed to load '" + pending[i].path + "'");
+                    }
+                }
+            });
+
+            for (auto& p : pending) {
+                try {
+                    commit(ihandle, ohandle, p, options);
+                } catch (std::exception& e) {
+                    throw utils::combine_errors(e, "failed to write '" + p.path + "'");
+                }
+                if (p.rewrite) {
+                    ++report.rewritten;
+                } else {
+                    ++report.copied;
+                }
+            }
+        }
+    }
+
+    H5::H5File ohandle(output, H5F_ACC_RDONLY);
+    try {
+        kanaval::validate(ohandle, embedded, version, validation);
+    } catch (std::exception& e) {
+        throw utils::combine_errors(e, "failed to validate the repacked state file");
+    }
+
+    report.input_bytes = std::filesystem::file_size(input);
+    report.output_bytes = std::filesystem::file_size(output);
+    report.input_load_time = load_time(ihandle);
+    report.output_load_time = load_time(ohandle);
+    return report;
+}
+
+}
+
+}
+
+#endif
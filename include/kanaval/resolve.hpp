@@ -0,0 +1,165 @@
+#ifndef KANAVAL_RESOLVE_HPP
+#define KANAVAL_RESOLVE_HPP
+
+#include "utils.hpp"
+#include "options.hpp"
+#include "container.hpp"
+#include "sniff.hpp"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <stdexcept>
+
+/**
+ * @file resolve.hpp
+ *
+ * @brief Resolve the input files of linked `.kana` files.
+ */
+
+namespace kanaval {
+
+namespace resolve {
+
+/**
+ * @brief Interface for resolving the identifiers of linked input files.
+ *
+ * Implementations should be safe to call concurrently from multiple threads.
+ */
+class Resolver {
+public:
+    virtual ~Resolver() = default;
+
+    /**
+     * @param id Identifier of a linked input file, i.e., the `id` in the state file.
+     * @return View of the file's contents.
+     * An error should be raised if the identifier cannot be resolved.
+     */
+    virtual container::FileView resolve(const std::string& id) const = 0;
+};
+
+/**
+ * @brief Resolve identifiers to files in a local directory.
+ *
+ * Each identifier is mapped to `<root>/<id>`, or to `<root>/<first two characters of id>/<id>` if `sharded = true`.
+ * The latter is the same layout as a `store::Store`.
+ */
+class DirectoryResolver : public Resolver {
+public:
+    /**
+     * @param root Path to the directory containing the input files.
+     * @param sharded Whether the files are sharded into subdirectories by the first two characters of their identifiers.
+     */
+    DirectoryResolver(std::string root, bool sharded = false) : root(std::move(root)), sharded(sharded) {}
+
+    /**
+     * @param id Identifier of a linked input file.
+     * @return Path to the file.
+     */
+    std::string path(const std::string& id) const {
+        if (id.empty() || id.find('/') != std::string::npos || id == "." || id == "..") {
+            throw std::runtime_error("invalid identifier '" + id + "'");
+        }
+        if (sharded) {
+            return root + "/" + id.substr(0, 2) + "/" + id;
+        } else {
+            return root + "/" + id;
+        }
+    }
+
+    /**
+     * @param id Identifier of a linked input file.
+     * @return Memory-mapped view of the file at `path(id)`.
+     */
+    container::FileView resolve(const std::string& id) const override {
+        auto p = path(id);
+        return container::view_range(p, 0, container::file_size(p));
+    }
+
+private:
+    std::string root;
+    bool sharded;
+};
+
+/**
+ * Resolve all linked input files of a `.kana` file.
+ * Each unique identifier is only resolved once, and the lookups are performed in parallel across `options.num_threads` threads.
+ *
+ * @param reader Reader for a linked `.kana` file.
+ * @param resolver Resolver for the identifiers.
+ * @param options Validation options, only `num_threads` is used.
+ *
+ * @return Views of the contents of each input file, in the order of `reader.entries()`.
+ * An error is raised listing all identifiers that could not be resolved.
+ */
+inline std::vector<container::FileView> resolve_all(const container::Reader& reader, const Resolver& resolver, const Options& options = Options()) {
+    if (reader.header().format_type != container::LINKED) {
+        throw std::runtime_error("input files are not linked");
+    }
+
+    const auto& entries = reader.entries();
+    std::vector<std::string> unique_ids;
+    std::unordered_map<std::string, size_t> mapping;
+    std::vector<size_t> positions;
+    positions.reserve(entries.size());
+    for (const auto& e : entries) {
+        auto it = mapping.find(e.id);
+        if (it == mapping.end()) {
+            it = mapping.emplace(e.id, unique_ids.size()).first;
+            unique_ids.push_back(e.id);
+        }
+        positions.push_back(it->second);
+    }
+
+    // Collecting all failures rather than stopping at the first, so that users can fix their cache in one go.
+    std::vector<container::FileView> resolved(unique_ids.size());
+    std::vector<std::string> errors(unique_ids.size());
+    utils::parallelize(unique_ids.size(), options.num_threads, [&](int, size_t start, size_t len) -> void {
+        for (size_t i = start, end = start + len; i < end; ++i) {
+            try {
+                resolved[i] = resolver.resolve(unique_ids[i]);
+            } catch (std::exception& e) {
+                errors[i] = e.what();
+            }
+        }
+    });
+
+    std::string message;
+    for (size_t i = 0; i < unique_ids.size(); ++i) {
+        if (!errors[i].empty()) {
+            message += "\n  - failed to resolve '" + unique_ids[i] + "'; " + errors[i];
+        }
+    }
+    if (!message.empty()) {
+        throw std::runtime_error("failed to resolve linked input files" + message);
+    }
+
+    std::vector<container::FileView> output;
+    output.reserve(entries.size());
+    for (auto p : positions) {
+        output.push_back(resolved[p]);
+    }
+    return output;
+}
+
+/**
+ * Check that all linked input files of a `.kana` file can be resolved.
+ * If `options.deep = true`, the contents of the resolved files are also checked with `sniff::check()` and `sniff::check_dimensions()`,
+ * i.e., the same checks that are used for embedded files.
+ *
+ * @param reader Reader for a linked `.kana` file.
+ * @param resolver Resolver for the identifiers.
+ * @param options Validation options.
+ */
+inline void check(const container::Reader& reader, const Resolver& resolver, const Options& options = Options()) {
+    auto views = resolve_all(reader, resolver, options);
+    if (options.deep) {
+        sniff::check(reader, views, options);
+        sniff::check_dimensions(reader, views, options);
+    }
+}
+
+}
+
+}
+
+#endif
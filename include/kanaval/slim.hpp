@@ -0,0 +1,284 @@
+#ifndef KANAVAL_SLIM_HPP
+#define KANAVAL_SLIM_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include "options.hpp"
+#include "writer.hpp"
+#include "v2/_validate.hpp"
+#include "v3/_validate.hpp"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <filesystem>
+#include <unordered_set>
+#include <stdexcept>
+
+/**
+ * @file slim.hpp
+ *
+ * @brief Export smaller state files by removing optional results.
+ */
+
+namespace kanaval {
+
+namespace slim {
+
+/**
+ * @brief Summary of the changes from slimming a state file.
+ */
+struct Report {
+    /**
+     * Size of the input file in bytes.
+     */
+    uint64_t input_bytes = 0;
+
+    /**
+     * Size of the output file in bytes.
+     */
+    uint64_t output_bytes = 0;
+
+    /**
+     * Paths of the groups and datasets that were removed.
+     */
+    std::vector<std::string> removed;
+
+    /**
+     * Number of datasets that were converted from double to single precision.
+     */
+    size_t downcast = 0;
+};
+
+// Unlike `H5Lexists()`, this does not fail if an intermediate group is missing.
+inline bool exists(const H5::H5File& handle, const std::string& path) {
+    size_t pos = 0;
+    while (true) {
+        pos = path.find('/', pos);
+        auto current = path.substr(0, pos);
+        if (!handle.exists(current)) {
+            return false;
+        }
+        if (pos == std::string::npos) {
+            return true;
+        }
+        if (handle.childObjType(current) != H5O_TYPE_GROUP) {
+            return false;
+        }
+        ++pos;
+    }
+}
+
+/**
+ * Identify the results that are not required by the validators, given the choices made in the analysis:
+ *
+ * - `clusters` from `snn_graph_cluster` or `kmeans_cluster`, if the method was not chosen in `choose_clustering`.
+ * - `corrected` from `batch_correction`, if no correction was performed or there is only one block.
+ * - AUCs from `marker_detection` and `custom_selections` in version 3 files, if `compute_auc = 0`.
+ *
+ * @param handle Handle to a valid state file.
+ * @param version Version of the kana file.
+ * @param cluster_method Clustering method reported by the validators.
+ * @param num_blocks Number of blocks reported by the validators.
+ *
+ * @return Paths to the unnecessary groups or datasets.
+ */
+inline std::vector<std::string> unneeded(const H5::H5File& handle, int version, const std::string& cluster_method, int num_blocks) {
+    std::vector<std::string> output;
+    auto add_if_exists = [&](const std::string& path) -> void {
+        if (exists(handle, path)) {
+            output.push_back(path);
+        }
+    };
+
+    if (cluster_method != "snn_graph") {
+        add_if_exists("snn_graph_cluster/results/clusters");
+    }
+    if (cluster_method != "kmeans") {
+        add_if_exists("kmeans_cluster/results/clusters");
+    }
+
+    if (exists(handle, "batch_correction/parameters/method")) {
+        auto method = utils::load_string(handle, "batch_correction/parameters/method");
+        if (method != "mnn" || num_blocks <= 1) {
+            add_if_exists("batch_correction/results/corrected");
+        }
+    }
+
+    if (version >= 3000000) {
+        if (utils::load_integer_scalar<>(handle, "marker_detection/parameters/compute_auc") == 0) {
+            auto phandle = handle.openGroup("marker_detection/results/per_cluster");
+            for (hsize_t m = 0, nmod = phandle.getNumObjs(); m < nmod; ++m) {
+                auto modality = phandle.getObjnameByIdx(m);
+                auto mhandle = phandle.openGroup(modality);
+                for (hsize_t c = 0, nclust = mhandle.getNumObjs(); c < nclust; ++c) {
+                    add_if_exists("marker_detection/results/per_cluster/" + modality + "/" + mhandle.getObjnameByIdx(c) + "/auc");
+                }
+            }
+        }
+
+        if (utils::load_integer_scalar<>(handle, "custom_selections/parameters/compute_auc") == 0) {
+            auto shandle = handle.openGroup("custom_selections/results/per_selection");
+            for (hsize_t s = 0, nsel = shandle.getNumObjs(); s < nsel; ++s) {
+                auto selection = shandle.getObjnameByIdx(s);
+                auto mhandle = shandle.openGroup(selection);
+                for (hsize_t m = 0, nmod = mhandle.getNumObjs(); m < nmod; ++m) {
+                    add_if_exists("custom_selections/results/per_selection/" + selection + "/" + mhandle.getObjnameByIdx(m) + "/auc");
+                }
+            }
+        }
+    }
+
+    return output;
+}
+
+// Only double-precision results with 1 or 2 dimensions are converted; parameters are left alone as they may be compared exactly, e.g., when checking for reruns.
+// The QC metrics and thresholds are also left alone, as rounding them separately could change which cells are discarded,
+// causing the file to fail deep validation as the discards would no longer match.
+inline bool is_downcastable(const H5::DataSet& dhandle, const std::string& path) {
+    const std::string results = "/results/";
+    auto pos = path.find(results);
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    const std::string qc = "quality_control";
+    if (pos >= qc.size() && path.compare(pos - qc.size(), qc.size(), qc) == 0) {
+        auto remainder = path.substr(pos + results.size());
+        if (remainder.rfind("metrics/", 0) == 0 || remainder.rfind("thresholds/", 0) == 0) {
+            return false;
+        }
+    }
+    if (dhandle.getTypeClass() != H5T_FLOAT || dhandle.getFloatType().getSize() <= 4) {
+        return false;
+    }
+    auto dims = utils::load_dataset_dimensions(dhandle);
+    return (dims.size() == 1 || (dims.size() == 2 && dims[1] > 0));
+}
+
+inline void downcast_dataset(const H5::DataSet& dhandle, const H5::Group& parent, const std::string& name, const writer::Options& options) {
+    auto dims = utils::load_dataset_dimensions(dhandle);
+    hsize_t nrow = dims[0], ncol = (dims.size() > 1 ? dims[1] : 0);
+    std::vector<double> values(nrow * (ncol ? ncol : 1));
+    if (!values.empty()) {
+        dhandle.read(values.data(), H5::PredType::NATIVE_DOUBLE);
+    }
+
+    std::vector<float> converted(values.size());
+    constexpr double limit = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < values.size(); ++i) {
+        auto v = values[i];
+        if (std::isfinite(v) && std::abs(v) > limit) {
+            throw std::runtime_error("values are too large for single precision");
+        }
+        converted[i] = v;
+    }
+
+    writer::write_array(parent, name, converted.data(), nrow, ncol, options);
+}
+
+inline void copy_group(const H5::H5File& input, const H5::Group& output, const std::string& path, const std::unordered_set<std::string>& removed, bool downcast, const writer::Options& options, Report& report) {
+    auto ghandle = (path.empty() ? input.openGroup("/") : input.openGroup(path));
+    hsize_t nchildren = ghandle.getNumObjs();
+    for (hsize_t i = 0; i < nchildren; ++i) {
+        auto name = ghandle.getObjnameByIdx(i);
+        auto child = (path.empty() ? name : path + "/" + name);
+        if (removed.find(child) != removed.end()) {
+            continue;
+        }
+
+        if (ghandle.childObjType(name) == H5O_TYPE_GROUP) {
+            auto ohandle = output.createGroup(name);
+            writer::copy_attributes(ghandle.openGroup(name), ohandle);
+            copy_group(input, ohandle, child, removed, downcast, options, report);
+            continue;
+        }
+
+        if (downcast) {
+            auto dhandle = ghandle.openDataSet(name);
+            if (is_downcastable(dhandle, child)) {
+                try {
+                    downcast_dataset(dhandle, output, name, options);
+                    writer::copy_attributes(dhandle, output.openDataSet(name));
+                } catch (std::exception& e) {
+                    throw utils::combine_errors(e, "failed to downcast '" + child + "'");
+                }
+                ++report.downcast;
+                continue;
+            }
+        }
+
+        if (H5Ocopy(ghandle.getId(), name.c_str(), output.getId(), name.c_str(), H5P_DEFAULT, H5P_DEFAULT) < 0) {
+            throw std::runtime_error("failed to copy '" + child + "'");
+        }
+    }
+}
+
+/**
+ * Create a smaller copy of a state file for sharing, by removing the results that are not required by the validators (see `unneeded()`).
+ * If `downcast = true`, double-precision results are also converted to single precision, which is permitted by the specification as all floating-point datasets only need to be of a float type.
+ * The QC metrics and thresholds are excluded from conversion so that the discards remain consistent with them.
+ * The output file uses the latest HDF5 format, and any converted datasets are written with `writer::write_array()`.
+ * Both the input and output files are validated.
+ *
+ * @param input Path to the input state file.
+ * @param output Path to the output state file.
+ * Any existing file is overwritten.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file.
+ * @param downcast Whether to convert double-precision results to single precision.
+ * @param writing Options for writing converted datasets.
+ * @param validation Options for validating the input and output files.
+ *
+ * @return Report of the removed and converted datasets.
+ */
+inline Report slim(const std::string& input, const std::string& output, bool embedded, int version, bool downcast = false, const writer::Options& writing = writer::Options(), const Options& validation = Options()) {
+    Report report;
+    H5::H5File ihandle(input, H5F_ACC_RDONLY);
+
+    std::string cluster_method;
+    int num_blocks;
+    try {
+        if (version < 3000000) {
+            auto summary = v2::validate(ihandle, embedded, version, validation);
+            cluster_method = summary.cluster_method;
+            num_blocks = summary.inputs.num_samples;
+        } else {
+            auto summary = v3::validate(ihandle, embedded, version, validation);
+            cluster_method = summary.cluster_method;
+            num_blocks = summary.inputs.num_blocks;
+        }
+    } catch (std::exception& e) {
+        throw utils::combine_errors(e, "failed to validate the input state file");
+    }
+
+    report.removed = unneeded(ihandle, version, cluster_method, num_blocks);
+    std::unordered_set<std::string> removed(report.removed.begin(), report.removed.end());
+
+    {
+        auto ohandle = writer::create_file(output);
+        writer::copy_attributes(ihandle.openGroup("/"), ohandle.openGroup("/"));
+        copy_group(ihandle, ohandle.openGroup("/"), "", removed, downcast, writing, report);
+    }
+
+    H5::H5File ohandle(output, H5F_ACC_RDONLY);
+    try {
+        if (version < 3000000) {
+            v2::validate(ohandle, embedded, version, validation);
+        } else {
+            v3::validate(ohandle, embedded, version, validation);
+        }
+    } catch (std::exception& e) {
+        throw utils::combine_errors(e, "failed to validate the slimmed state file");
+    }
+
+    report.input_bytes = std::filesystem::file_size(input);
+    report.output_bytes = std::filesystem::file_size(output);
+    return report;
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,904 @@
+#ifndef KANAVAL_SNIFF_HPP
+#define KANAVAL_SNIFF_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include "options.hpp"
+#include "container.hpp"
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <sstream>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef KANAVAL_USE_ZLIB
+#include "zlib.h"
+#endif
+
+/**
+ * @file sniff.hpp
+ *
+ * @brief Check that embedded input files match their declared formats.
+ */
+
+namespace kanaval {
+
+namespace sniff {
+
+/**
+ * @brief Dimensions from the size line of a MatrixMarket file.
+ */
+struct MatrixMarketHeader {
+    /**
+     * Number of rows.
+     */
+    uint64_t rows = 0;
+
+    /**
+     * Number of columns.
+     */
+    uint64_t columns = 0;
+
+    /**
+     * Number of non-zero entries.
+     */
+    uint64_t nonzeros = 0;
+
+    /**
+     * Whether the file was Gzip-compressed.
+     */
+    bool gzipped = false;
+
+    /**
+     * Whether the matrix uses the `pattern` field, i.e., each line only contains the row and column indices.
+     */
+    bool pattern = false;
+
+    /**
+     * Number of (decompressed) bytes occupied by the banner, comments and size line.
+     * The entries start immediately after these bytes.
+     */
+    uint64_t header_bytes = 0;
+};
+
+// Maximum number of (decompressed) bytes to inspect when looking for the MatrixMarket banner and size line.
+inline constexpr size_t max_header_bytes = 65536;
+
+inline bool is_gzipped(const container::FileView& view) {
+    return view.size() >= 2 && view.data()[0] == 0x1f && view.data()[1] == 0x8b;
+}
+
+// Returns up to `max_header_bytes` from the start of the file, inflating it if necessary.
+// Only the first few pages of the view are touched, even for large files.
+inline std::string leading_text(const container::FileView& view, bool gzipped) {
+    if (!gzipped) {
+        size_t n = std::min(static_cast<uint64_t>(max_header_bytes), view.size());
+        return std::string(reinterpret_cast<const char*>(view.data()), n);
+    }
+
+#ifdef KANAVAL_USE_ZLIB
+    std::string output(max_header_bytes, '\0');
+    z_stream strm;
+    std::memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK) {
+        throw std::runtime_error("failed to initialize Gzip decompression");
+    }
+
+    const unsigned char* src = view.data();
+    uint64_t remaining = view.size();
+    strm.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    strm.avail_out = output.size();
+
+    int status = Z_OK;
+    while (strm.avail_out && status == Z_OK) {
+        if (strm.avail_in == 0) {
+            if (remaining == 0) {
+                break;
+            }
+            uInt take = std::min(remaining, static_cast<uint64_t>(max_header_bytes));
+            strm.next_in = const_cast<Bytef*>(src);
+            strm.avail_in = take;
+            src += take;
+            remaining -= take;
+        }
+        status = inflate(&strm, Z_NO_FLUSH);
+        if (status == Z_STREAM_END && (strm.avail_in || remaining)) {
+            status = inflateReset(&strm); // move onto the next member of a multi-member file.
+        }
+    }
+
+    output.resize(output.size() - strm.avail_out);
+    inflateEnd(&strm);
+    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+        throw std::runtime_error("failed to decompress Gzip-compressed contents");
+    }
+    return output;
+#else
+    throw std::runtime_error("Gzip-compressed contents cannot be inspected without Zlib");
+#endif
+}
+
+inline std::string to_lower(std::string x) {
+    for (auto& c : x) {
+        c = std::tolower(static_cast<unsigned char>(c));
+    }
+    return x;
+}
+
+/**
+ * Check the banner and size line of a MatrixMarket file.
+ * The file should contain a sparse matrix in coordinate format, and may be Gzip-compressed.
+ * Only the start of the file is inspected.
+ *
+ * If `KANAVAL_USE_ZLIB` is not defined, Gzip-compressed files are only checked for the Gzip magic number,
+ * and the dimensions in the output are set to zero.
+ *
+ * @param view View of the file.
+ * @return Dimensions of the matrix.
+ */
+inline MatrixMarketHeader check_matrix_market(const container::FileView& view) {
+    MatrixMarketHeader output;
+    output.gzipped = is_gzipped(view);
+#ifndef KANAVAL_USE_ZLIB
+    if (output.gzipped) {
+        return output;
+    }
+#endif
+
+    auto text = leading_text(view, output.gzipped);
+    size_t pos = 0;
+    auto next_line = [&](std::string& line) -> bool {
+        if (pos >= text.size()) {
+            return false;
+        }
+        auto end = text.find('\n', pos);
+        if (end == std::string::npos) {
+            if (text.size() == max_header_bytes) {
+                return false; // incomplete line at the end of the inspected region.
+            }
+            end = text.size();
+        }
+        line = text.substr(pos, end - pos);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        pos = end + 1;
+        return true;
+    };
+
+    std::string line;
+    if (!next_line(line)) {
+        throw std::runtime_error("missing the MatrixMarket banner");
+    }
+
+    std::istringstream banner(line);
+    std::string marker, object, format, field;
+    banner >> marker >> object >> format >> field;
+    if (marker != "%%MatrixMarket") {
+        throw std::runtime_error("first line should start with '%%MatrixMarket'");
+    }
+    if (to_lower(object) != "matrix" || to_lower(format) != "coordinate") {
+        throw std::runtime_error("MatrixMarket banner should describe a 'matrix' in 'coordinate' format");
+    }
+    field = to_lower(field);
+    if (field != "integer" && field != "real" && field != "double" && field != "pattern") {
+        throw std::runtime_error("unsupported MatrixMarket field '" + field + "'");
+    }
+    output.pattern = (field == "pattern");
+
+    while (true) {
+        if (!next_line(line)) {
+            throw std::runtime_error("failed to find the MatrixMarket size line in the first " + std::to_string(max_header_bytes) + " bytes");
+        }
+        if (!line.empty() && line[0] == '%') {
+            continue;
+        }
+        if (line.find_first_not_of(" \t") == std::string::npos) {
+            continue;
+        }
+        break;
+    }
+
+    std::istringstream sizes(line);
+    long long rows = -1, columns = -1, nonzeros = -1;
+    std::string extra;
+    if (!(sizes >> rows >> columns >> nonzeros) || (sizes >> extra) || rows < 0 || columns < 0 || nonzeros < 0) {
+        throw std::runtime_error("MatrixMarket size line should contain three non-negative integers");
+    }
+
+    output.rows = rows;
+    output.columns = columns;
+    output.nonzeros = nonzeros;
+    output.header_bytes = std::min(pos, text.size());
+    return output;
+}
+
+// Parsing of the MatrixMarket entries.
+// Each line is checked for in-bounds, 1-based row and column indices, followed by a value unless the field is `pattern`.
+// Indices are parsed eight digits at a time with SWAR (SIMD within a register) on little-endian platforms,
+// which is portable across architectures and avoids a dependency on specific instruction sets.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && (defined(__GNUC__) || defined(__clang__))
+#define KANAVAL_SWAR_DIGITS 1
+#endif
+
+inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Parses an unsigned integer starting at `ptr`, returning a pointer past the last digit.
+// `ptr` is returned unchanged if there are no digits.
+inline const char* parse_index(const char* ptr, const char* end, uint64_t& value) {
+    value = 0;
+#ifdef KANAVAL_SWAR_DIGITS
+    while (end - ptr >= 8) {
+        uint64_t word;
+        std::memcpy(&word, ptr, 8);
+
+        // Each byte of 'bad' is non-zero if the corresponding character is not a digit.
+        // Carries from non-digit bytes may affect later bytes, but we only use the bytes up to the first non-digit.
+        uint64_t bad = ((word & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull) | (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull);
+        int ndigits = (bad ? __builtin_ctzll(bad) / 8 : 8);
+        if (ndigits == 0) {
+            return ptr;
+        }
+
+        // Shifting the digits to the top, so that the unused bytes become leading zeros.
+        uint64_t digits = (word & 0x0F0F0F0F0F0F0F0Full) << (8 * (8 - ndigits));
+        digits = (digits * 10 + (digits >> 8)) & 0x00FF00FF00FF00FFull;
+        digits = (digits * 100 + (digits >> 16)) & 0x0000FFFF0000FFFFull;
+        digits = (digits * 10000 + (digits >> 32)) & 0x00000000FFFFFFFFull;
+
+        static const uint64_t powers[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+        value = value * powers[ndigits] + digits;
+        ptr += ndigits;
+        if (ndigits < 8) {
+            return ptr;
+        }
+    }
+#endif
+
+    for (; ptr < end && *ptr >= '0' && *ptr <= '9'; ++ptr) {
+        value = value * 10 + (*ptr - '0');
+    }
+    return ptr;
+}
+
+// Parses all lines in [start, end), which should begin at the start of a line.
+// Returns the number of entries.
+inline uint64_t parse_entries(const char* start, const char* end, const MatrixMarketHeader& header, uint64_t base_offset) {
+    uint64_t count = 0;
+    const char* ptr = start;
+
+    auto fail = [&](const std::string& msg) -> void {
+        throw std::runtime_error(msg + " at byte " + std::to_string(base_offset + (ptr - start)));
+    };
+
+    while (ptr < end) {
+        while (ptr < end && is_blank(*ptr)) {
+            ++ptr;
+        }
+        if (ptr == end) {
+            break;
+        }
+        if (*ptr == '\n' || *ptr == '%') {
+            auto eol = static_cast<const char*>(std::memchr(ptr, '\n', end - ptr));
+            ptr = (eol ? eol + 1 : end);
+            continue;
+        }
+
+        uint64_t row, col;
+        // More than 18 digits could overflow, and is out of range anyway.
+        auto next = parse_index(ptr, end, row);
+        if (next == ptr || next == end || !is_blank(*next) || next - ptr > 18) {
+            fail("expected a row index");
+        }
+        ptr = next;
+        while (ptr < end && is_blank(*ptr)) {
+            ++ptr;
+        }
+
+        next = parse_index(ptr, end, col);
+        if (next == ptr || (next < end && !is_blank(*next) && *next != '\n') || next - ptr > 18) {
+            fail("expected a column index");
+        }
+        ptr = next;
+
+        if (row < 1 || row > header.rows) {
+            fail("row index " + std::to_string(row) + " is out of range");
+        }
+        if (col < 1 || col > header.columns) {
+            fail("column index " + std::to_string(col) + " is out of range");
+        }
+
+        if (!header.pattern) {
+            while (ptr < end && is_blank(*ptr)) {
+                ++ptr;
+            }
+            if (ptr == end || *ptr == '\n') {
+                fail("expected a value");
+            }
+        }
+
+        auto eol = static_cast<const char*>(std::memchr(ptr, '\n', end - ptr));
+        ptr = (eol ? eol + 1 : end);
+        ++count;
+    }
+
+    return count;
+}
+
+// Size of the blocks of decompressed text for parsing Gzip-compressed files.
+inline constexpr size_t inflate_block_size = 16777216;
+
+/**
+ * Parse all entries of a MatrixMarket file, checking that the row and column indices are in bounds
+ * and that the number of entries is equal to the number of non-zero elements in the size line.
+ *
+ * For uncompressed files, the entries are split into chunks at line boundaries and parsed in parallel across `options.num_threads` threads.
+ * For Gzip-compressed files, decompression is inherently serial, so blocks of decompressed text are parsed in parallel between rounds of decompression.
+ * Parsing Gzip-compressed files requires `KANAVAL_USE_ZLIB`.
+ *
+ * @param view View of the file.
+ * @param options Validation options, only `num_threads` is used.
+ * @return Dimensions of the matrix.
+ */
+inline MatrixMarketHeader parse_matrix_market(const container::FileView& view, const Options& options = Options()) {
+    auto header = check_matrix_market(view);
+    int nthreads = std::max(1, options.num_threads);
+    uint64_t count = 0;
+
+    if (!header.gzipped) {
+        const char* start = reinterpret_cast<const char*>(view.data()) + header.header_bytes;
+        const char* end = reinterpret_cast<const char*>(view.data()) + view.size();
+
+        // Splitting into several chunks per thread, each starting at a line boundary.
+        size_t nchunks = (nthreads > 1 ? nthreads * 4 : 1);
+        std::vector<const char*> bounds(nchunks + 1, end);
+        bounds[0] = start;
+        uint64_t per_chunk = (end - start) / nchunks;
+        for (size_t c = 1; c < nchunks; ++c) {
+            const char* candidate = std::max(bounds[c - 1], start + c * per_chunk);
+            auto eol = static_cast<const char*>(std::memchr(candidate, '\n', end - candidate));
+            bounds[c] = (eol ? eol + 1 : end);
+        }
+
+        std::vector<uint64_t> counts(nchunks);
+        utils::parallelize(nchunks, nthreads, [&](int, size_t first, size_t len) -> void {
+            for (size_t c = first, last = first + len; c < last; ++c) {
+                counts[c] = parse_entries(bounds[c], bounds[c + 1], header, bounds[c] - reinterpret_cast<const char*>(view.data()));
+            }
+        });
+        for (auto c : counts) {
+            count += c;
+        }
+
+    } else {
+#ifdef KANAVAL_USE_ZLIB
+        z_stream strm;
+        std::memset(&strm, 0, sizeof(strm));
+        if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK) {
+            throw std::runtime_error("failed to initialize Gzip decompression");
+        }
+        strm.next_in = const_cast<Bytef*>(view.data());
+        uint64_t remaining_in = view.size();
+
+        // Each block starts with the incomplete line carried over from the previous block.
+        std::vector<std::vector<char> > blocks(nthreads);
+        std::vector<uint64_t> offsets(nthreads), counts(nthreads);
+        std::vector<char> carry;
+        uint64_t consumed = 0, to_skip = header.header_bytes;
+        bool finished = false;
+
+        try {
+            while (!finished) {
+                size_t nfilled = 0;
+                for (; nfilled < blocks.size() && !finished; ++nfilled) {
+                    auto& current = blocks[nfilled];
+                    current.resize(carry.size() + inflate_block_size);
+                    std::copy(carry.begin(), carry.end(), current.begin());
+                    strm.next_out = reinterpret_cast<Bytef*>(current.data() + carry.size());
+                    strm.avail_out = inflate_block_size;
+
+                    while (strm.avail_out) {
+                        if (strm.avail_in == 0) {
+                            uInt take = std::min(remaining_in, static_cast<uint64_t>(1) << 30);
+                            strm.avail_in = take;
+                            remaining_in -= take;
+                        }
+                        int status = ::inflate(&strm, Z_NO_FLUSH);
+                        if (status == Z_STREAM_END) {
+                            // Multi-member files (e.g., from bgzip or concatenation) continue with the next member.
+                            if (strm.avail_in == 0 && remaining_in == 0) {
+                                finished = true;
+                                break;
+                            }
+                            if (inflateReset(&strm) != Z_OK) {
+                                throw std::runtime_error("failed to decompress Gzip-compressed contents");
+                            }
+                            continue;
+                        }
+                        if (status != Z_OK) {
+                            throw std::runtime_error("failed to decompress Gzip-compressed contents");
+                        }
+                    }
+                    current.resize(current.size() - strm.avail_out);
+
+                    // Skipping the header in the first block(s).
+                    size_t skip = std::min(to_skip, static_cast<uint64_t>(current.size()));
+                    current.erase(current.begin(), current.begin() + skip);
+                    to_skip -= skip;
+                    offsets[nfilled] = consumed + skip;
+
+                    carry.clear();
+                    if (!finished) {
+                        auto it = std::find(current.rbegin(), current.rend(), '\n');
+                        size_t keep = current.rend() - it;
+                        carry.insert(carry.end(), current.begin() + keep, current.end());
+                        current.resize(keep);
+                    }
+                    consumed += skip + current.size();
+                }
+
+                utils::parallelize(nfilled, nthreads, [&](int, size_t first, size_t len) -> void {
+                    for (size_t b = first, last = first + len; b < last; ++b) {
+                        counts[b] = parse_entries(blocks[b].data(), blocks[b].data() + blocks[b].size(), header, offsets[b]);
+                    }
+                });
+                for (size_t b = 0; b < nfilled; ++b) {
+                    count += counts[b];
+                }
+            }
+        } catch (...) {
+            inflateEnd(&strm);
+            throw;
+        }
+        inflateEnd(&strm);
+#else
+        throw std::runtime_error("Gzip-compressed MatrixMarket files cannot be parsed without Zlib");
+#endif
+    }
+
+    if (count != header.nonzeros) {
+        throw std::runtime_error("number of entries (" + std::to_string(count) + ") is not equal to the number of non-zero elements in the size line (" + std::to_string(header.nonzeros) + ")");
+    }
+    return header;
+}
+
+/**
+ * Check that a file starts with the HDF5 signature.
+ * The signature may also be located after a user block, i.e., at offsets of 512, 1024, 2048, etc.
+ *
+ * @param view View of the file.
+ * @return Whether the HDF5 signature was found.
+ */
+inline bool has_hdf5_signature(const container::FileView& view) {
+    static const unsigned char signature[8] = { 0x89, 'H', 'D', 'F', '\r', '\n', 0x1a, '\n' };
+    for (uint64_t offset = 0; offset + 8 <= view.size(); offset = (offset ? offset * 2 : 512)) {
+        if (std::memcmp(view.data() + offset, signature, 8) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Opens the file image and applies `fun` to the handle, converting HDF5 errors into regular exceptions.
+template<class Function>
+void inspect_hdf5(const container::FileView& view, const std::string& format, Function fun) {
+    if (!has_hdf5_signature(view)) {
+        throw std::runtime_error(format + " file should be a HDF5 file");
+    }
+
+    std::lock_guard<std::mutex> lock(utils::hdf5_mutex());
+    try {
+        auto handle = container::open_image(view);
+        fun(handle);
+    } catch (H5::Exception& e) {
+        throw std::runtime_error("failed to inspect " + format + " file; " + e.getDetailMsg());
+    }
+}
+
+// Returns the name of the group containing the 10X matrix, or an empty string if none can be found.
+inline std::string find_10x_matrix(const H5::H5File& handle) {
+    auto is_matrix = [&](const std::string& name) -> bool {
+        if (handle.childObjType(name) != H5O_TYPE_GROUP) {
+            return false;
+        }
+        auto ghandle = handle.openGroup(name);
+        for (auto field : { "data", "indices", "indptr", "shape" }) {
+            if (!ghandle.exists(field)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    if (handle.exists("matrix")) {
+        if (!is_matrix("matrix")) {
+            throw std::runtime_error("'matrix' group in 10X file should contain 'data', 'indices', 'indptr' and 'shape'");
+        }
+        return "matrix";
+    }
+
+    size_t nobjs = handle.getNumObjs();
+    for (size_t i = 0; i < nobjs; ++i) {
+        auto name = handle.getObjnameByIdx(i);
+        if (is_matrix(name)) {
+            return name;
+        }
+    }
+    return "";
+}
+
+/**
+ * Check that a file is a HDF5 file in the 10X feature-barcode matrix format.
+ * This requires a `matrix` group (or, for the legacy format, a group for each genome) containing the `data`, `indices`, `indptr` and `shape` datasets.
+ * Only the superblock and the relevant object headers are read.
+ *
+ * @param view View of the file.
+ */
+inline void check_10x(const container::FileView& view) {
+    inspect_hdf5(view, "10X", [](const H5::H5File& handle) -> void {
+        if (find_10x_matrix(handle).empty()) {
+            throw std::runtime_error("10X file should contain a 'matrix' group");
+        }
+    });
+}
+
+/**
+ * Check that a file is a HDF5 file in the H5AD format, i.e., with the `X`, `obs` and `var` objects at the top level.
+ * Only the superblock and the root group are read.
+ *
+ * @param view View of the file.
+ */
+inline void check_h5ad(const container::FileView& view) {
+    inspect_hdf5(view, "H5AD", [](const H5::H5File& handle) -> void {
+        for (auto name : { "X", "obs", "var" }) {
+            if (!handle.exists(name)) {
+                throw std::runtime_error("H5AD file should contain '" + std::string(name) + "'");
+            }
+        }
+    });
+}
+
+/**
+ * @brief Dimensions of an input matrix.
+ */
+struct Dimensions {
+    /**
+     * Number of features.
+     */
+    uint64_t features = 0;
+
+    /**
+     * Number of cells.
+     */
+    uint64_t cells = 0;
+};
+
+/**
+ * Obtain the dimensions of the matrix in a 10X HDF5 file from its `shape` dataset.
+ * No other datasets are read.
+ *
+ * @param view View of the file.
+ * @return Dimensions of the matrix.
+ */
+inline Dimensions dimensions_10x(const container::FileView& view) {
+    Dimensions output;
+    inspect_hdf5(view, "10X", [&](const H5::H5File& handle) -> void {
+        auto name = find_10x_matrix(handle);
+        if (name.empty()) {
+            throw std::runtime_error("10X file should contain a 'matrix' group");
+        }
+
+        auto shape = utils::load_integer_vector<hsize_t>(handle.openGroup(name), "shape");
+        if (shape.size() != 2) {
+            throw std::runtime_error("'shape' in 10X file should have length 2");
+        }
+        output.features = shape[0];
+        output.cells = shape[1];
+    });
+    return output;
+}
+
+// Length of the index of a H5AD 'obs' or 'var' group (or compound dataset, in older versions of the format).
+inline uint64_t h5ad_index_length(const H5::H5File& handle, const std::string& name) {
+    if (handle.childObjType(name) == H5O_TYPE_DATASET) {
+        hsize_t len;
+        auto space = handle.openDataSet(name).getSpace();
+        if (space.getSimpleExtentNdims() != 1) {
+            throw std::runtime_error("'" + name + "' in H5AD file should be 1-dimensional");
+        }
+        space.getSimpleExtentDims(&len);
+        return len;
+    }
+
+    auto ghandle = handle.openGroup(name);
+    std::string index = "_index";
+    if (ghandle.attrExists("_index")) {
+        auto ahandle = ghandle.openAttribute("_index");
+        ahandle.read(ahandle.getStrType(), index);
+    }
+
+    auto space = ghandle.openDataSet(index).getSpace();
+    if (space.getSimpleExtentNdims() != 1) {
+        throw std::runtime_error("index of '" + name + "' in H5AD file should be 1-dimensional");
+    }
+    hsize_t len;
+    space.getSimpleExtentDims(&len);
+    return len;
+}
+
+/**
+ * Obtain the dimensions of the matrix in a H5AD file.
+ * If `X` is a dense dataset, its dimensions are used directly;
+ * if `X` is a sparse matrix group, its `shape` (or `h5sparse_shape`) attribute is used.
+ * Otherwise, the dimensions are taken from the lengths of the `obs` and `var` indices.
+ * Only the metadata is read, not the contents of `X`.
+ *
+ * @param view View of the file.
+ * @return Dimensions of the matrix.
+ */
+inline Dimensions dimensions_h5ad(const container::FileView& view) {
+    Dimensions output;
+    inspect_hdf5(view, "H5AD", [&](const H5::H5File& handle) -> void {
+        for (auto name : { "X", "obs", "var" }) {
+            if (!handle.exists(name)) {
+                throw std::runtime_error("H5AD file should contain '" + std::string(name) + "'");
+            }
+        }
+
+        if (handle.childObjType("X") == H5O_TYPE_DATASET) {
+            auto space = handle.openDataSet("X").getSpace();
+            if (space.getSimpleExtentNdims() != 2) {
+                throw std::runtime_error("'X' in H5AD file should be 2-dimensional");
+            }
+            hsize_t dims[2];
+            space.getSimpleExtentDims(dims);
+            output.cells = dims[0];
+            output.features = dims[1];
+            return;
+        }
+
+        auto xhandle = handle.openGroup("X");
+        for (auto attr : { "shape", "h5sparse_shape" }) {
+            if (xhandle.attrExists(attr)) {
+                auto ahandle = xhandle.openAttribute(attr);
+                if (ahandle.getSpace().getSimpleExtentNpoints() != 2) {
+                    throw std::runtime_error("'" + std::string(attr) + "' attribute of 'X' in H5AD file should have length 2");
+                }
+                hsize_t dims[2];
+                ahandle.read(H5::PredType::NATIVE_HSIZE, dims);
+                output.cells = dims[0];
+                output.features = dims[1];
+                return;
+            }
+        }
+
+        output.cells = h5ad_index_length(handle, "obs");
+        output.features = h5ad_index_length(handle, "var");
+    });
+    return output;
+}
+
+/**
+ * Check the contents of a single embedded file against its declared format and type.
+ * MatrixMarket `mtx` files are checked with `check_matrix_market()`;
+ * `h5` files are checked with `check_10x()` or `check_h5ad()` for the `10X` and `H5AD` formats, respectively.
+ * Other files are not inspected.
+ *
+ * @param entry Details of the file.
+ * @param view View of the file's contents.
+ */
+inline void check_entry(const container::Entry& entry, const container::FileView& view) {
+    if (entry.format == "MatrixMarket") {
+        if (entry.type == "mtx") {
+            check_matrix_market(view);
+        }
+    } else if (entry.format == "10X") {
+        if (entry.type == "h5") {
+            check_10x(view);
+        }
+    } else if (entry.format == "H5AD") {
+        if (entry.type == "h5") {
+            check_h5ad(view);
+        }
+    }
+}
+
+inline std::vector<container::FileView> embedded_views(const container::Reader& reader) {
+    std::vector<container::FileView> views;
+    views.reserve(reader.entries().size());
+    for (const auto& e : reader.entries()) {
+        views.push_back(reader.view(e));
+    }
+    return views;
+}
+
+/**
+ * Check that all input files of a `.kana` file match their declared formats, see `check_entry()` for details.
+ * Only the first few bytes of each file are read.
+ *
+ * Files are checked in parallel across `options.num_threads` threads.
+ * The text-based checks (including decompression of Gzip-compressed MatrixMarket files) are fully parallel;
+ * the HDF5-based checks are serialized as the HDF5 library is not guaranteed to be thread-safe.
+ *
+ * @param reader Reader for a `.kana` file.
+ * @param views Views of the contents of each input file, in the order of `reader.entries()`.
+ * For linked files, these can be obtained with a `resolve::Resolver`.
+ * @param options Validation options, only `num_threads` is used.
+ */
+inline void check(const container::Reader& reader, const std::vector<container::FileView>& views, const Options& options = Options()) {
+    const auto& entries = reader.entries();
+    if (views.size() != entries.size()) {
+        throw std::runtime_error("number of views should be equal to the number of input files");
+    }
+
+    utils::parallelize(entries.size(), options.num_threads, [&](int, size_t start, size_t len) -> void {
+        for (size_t i = start, end = start + len; i < end; ++i) {
+            const auto& e = entries[i];
+            try {
+                check_entry(e, views[i]);
+            } catch (std::exception& err) {
+                throw utils::combine_errors(err, "failed to check contents of file " + std::to_string(i) + " ('" + e.name + "')");
+            }
+        }
+    });
+}
+
+/**
+ * Overload of `check()` for the files embedded in a `.kana` file.
+ * The files are read directly from the `.kana` file without extracting anything.
+ *
+ * @param reader Reader for an embedded `.kana` file.
+ * @param options Validation options, only `num_threads` is used.
+ */
+inline void check(const container::Reader& reader, const Options& options = Options()) {
+    check(reader, embedded_views(reader), options);
+}
+
+/**
+ * Cross-check the dimensions of each embedded input matrix against the `inputs` results in the state file.
+ * For MatrixMarket files, the entire file is parsed with `parse_matrix_market()`;
+ * for 10X and H5AD files, only the shape metadata is read with `dimensions_10x()` and `dimensions_h5ad()`, respectively.
+ *
+ * If there is only one dataset, its number of features should be greater than the largest feature identity across all modalities.
+ * (With multiple datasets, the identities refer to the intersection of features across datasets and cannot be checked against a single file.)
+ * If the dimensions of all datasets are known, the total number of cells should be equal to `num_cells`,
+ * or no less than `num_cells` if the cells were subsetted, i.e., `subset/cells` is present.
+ * For v1 files, the number of cells and identities are taken from `dimensions` and `identities`, respectively.
+ *
+ * Datasets are checked concurrently across `options.num_threads` threads.
+ * The threads are also used to parse each MatrixMarket file in parallel, if there are more threads than datasets.
+ *
+ * @param reader Reader for a `.kana` file.
+ * @param views Views of the contents of each input file, in the order of `reader.entries()`.
+ * @param options Validation options, only `num_threads` is used.
+ */
+inline void check_dimensions(const container::Reader& reader, const std::vector<container::FileView>& views, const Options& options = Options()) {
+    const auto& entries = reader.entries();
+    if (views.size() != entries.size()) {
+        throw std::runtime_error("number of views should be equal to the number of input files");
+    }
+
+    // Collecting the details from the state file.
+    uint64_t num_cells = 0;
+    bool subsetted = false;
+    long long max_identity = -1;
+    {
+        auto handle = reader.open_state();
+        auto ihandle = utils::check_and_open_group(handle, "inputs");
+        auto phandle = utils::check_and_open_group(ihandle, "parameters");
+        auto rhandle = utils::check_and_open_group(ihandle, "results");
+        if (phandle.exists("subset")) {
+            subsetted = utils::check_and_open_group(phandle, "subset").exists("cells");
+        }
+
+        if (reader.header().version < 2000000) {
+            // v1 only has RNA, with the dimensions in a single dataset and the identities (from v1.2 onwards) as a dataset rather than a group.
+            auto dims = utils::load_integer_vector<int>(rhandle, "dimensions");
+            if (dims.size() != 2) {
+                throw std::runtime_error("'dimensions' should be a dataset of length 2");
+            }
+            num_cells = dims[1];
+            if (rhandle.exists("identities")) {
+                for (long long i : utils::load_integer_vector(rhandle, "identities")) {
+                    max_identity = std::max(max_identity, i);
+                }
+            }
+
+        } else {
+            num_cells = utils::load_integer_scalar<long long>(rhandle, "num_cells");
+
+            // Identities are named differently between v2 and v3.
+            std::string iname = (rhandle.exists("feature_identities") ? "feature_identities" : "identities");
+            auto idhandle = utils::check_and_open_group(rhandle, iname);
+            for (auto modality : { "RNA", "ADT", "CRISPR" }) {
+                if (idhandle.exists(modality)) {
+                    for (long long i : utils::load_integer_vector(idhandle, modality)) {
+                        max_identity = std::max(max_identity, i);
+                    }
+                }
+            }
+        }
+    }
+
+    // Finding the file containing the matrix for each dataset, or -1 if the format is not supported.
+    std::vector<std::string> datasets;
+    std::vector<int> matrix_files;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& e = entries[i];
+        if (datasets.empty() || datasets.back() != e.dataset) {
+            datasets.push_back(e.dataset);
+            matrix_files.push_back(-1);
+        }
+        if ((e.format == "MatrixMarket" && e.type == "mtx") || ((e.format == "10X" || e.format == "H5AD") && e.type == "h5")) {
+            matrix_files.back() = i;
+        }
+    }
+
+    size_t ndatasets = datasets.size();
+    Options inner = options;
+    inner.num_threads = std::max(1, options.num_threads / static_cast<int>(std::max(ndatasets, static_cast<size_t>(1))));
+
+    std::vector<Dimensions> dimensions(ndatasets);
+    utils::parallelize(ndatasets, options.num_threads, [&](int, size_t start, size_t len) -> void {
+        for (size_t d = start, end = start + len; d < end; ++d) {
+            if (matrix_files[d] < 0) {
+                continue;
+            }
+
+            const auto& e = entries[matrix_files[d]];
+            auto& current = dimensions[d];
+            try {
+                const auto& view = views[matrix_files[d]];
+                if (e.format == "MatrixMarket") {
+                    auto header = parse_matrix_market(view, inner);
+                    current.features = header.rows;
+                    current.cells = header.columns;
+                } else if (e.format == "10X") {
+                    current = dimensions_10x(view);
+                } else {
+                    current = dimensions_h5ad(view);
+                }
+
+                if (ndatasets == 1 && max_identity >= 0 && static_cast<uint64_t>(max_identity) >= current.features) {
+                    throw std::runtime_error("number of features (" + std::to_string(current.features) + ") should be greater than the largest feature identity (" + std::to_string(max_identity) + ")");
+                }
+            } catch (std::exception& err) {
+                throw utils::combine_errors(err, "failed to check " + e.format + " file '" + e.name + "'");
+            }
+        }
+    });
+
+    bool all_known = true;
+    uint64_t total_cells = 0;
+    for (size_t d = 0; d < ndatasets; ++d) {
+        all_known = all_known && matrix_files[d] >= 0;
+        total_cells += dimensions[d].cells;
+    }
+
+    if (all_known) {
+        if (subsetted ? total_cells < num_cells : total_cells != num_cells) {
+            throw std::runtime_error("total number of cells in the input files (" + std::to_string(total_cells) + ") is not consistent with 'num_cells' (" + std::to_string(num_cells) + ")");
+        }
+    }
+}
+
+/**
+ * Overload of `check_dimensions()` for the files embedded in a `.kana` file.
+ *
+ * @param reader Reader for an embedded `.kana` file.
+ * @param options Validation options, only `num_threads` is used.
+ */
+inline void check_dimensions(const container::Reader& reader, const Options& options = Options()) {
+    check_dimensions(reader, embedded_views(reader), options);
+}
+
+}
+
+}
+
+#endif
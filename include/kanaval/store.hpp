@@ -0,0 +1,379 @@
+#ifndef KANAVAL_STORE_HPP
+#define KANAVAL_STORE_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include "container.hpp"
+#include "writer.hpp"
+#include "kanaval.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <atomic>
+#include <stdexcept>
+
+/**
+ * @file store.hpp
+ *
+ * @brief Convert between embedded and linked `.kana` files with a local content-addressed store.
+ */
+
+namespace kanaval {
+
+namespace store {
+
+/**
+ * @brief SHA-256 hash, as defined in FIPS 180-4.
+ */
+class Sha256 {
+public:
+    /**
+     * @param data Pointer to the bytes to be added.
+     * @param n Number of bytes.
+     */
+    void add(const void* data, size_t n) {
+        auto ptr = static_cast<const unsigned char*>(data);
+        total += n;
+
+        if (used) {
+            size_t take = std::min(n, static_cast<size_t>(64) - used);
+            std::memcpy(block + used, ptr, take);
+            used += take;
+            ptr += take;
+            n -= take;
+            if (used < 64) {
+                return;
+            }
+            compress(block);
+            used = 0;
+        }
+
+        for (; n >= 64; ptr += 64, n -= 64) {
+            compress(ptr);
+        }
+
+        std::memcpy(block, ptr, n);
+        used = n;
+    }
+
+    /**
+     * @return Lower-case hexadecimal digest of all bytes added so far.
+     * This should only be called once.
+     */
+    std::string hex() {
+        uint64_t nbits = total * 8;
+        unsigned char padding[72] = { 0x80 };
+        size_t npad = (used < 56 ? 56 - used : 120 - used);
+        for (int b = 0; b < 8; ++b) {
+            padding[npad + b] = (nbits >> (56 - 8 * b)) & 0xFF;
+        }
+        add(padding, npad + 8);
+
+        static const char digits[] = "0123456789abcdef";
+        std::string output;
+        output.reserve(64);
+        for (auto h : state) {
+            for (int shift = 28; shift >= 0; shift -= 4) {
+                output.push_back(digits[(h >> shift) & 0xF]);
+            }
+        }
+        return output;
+    }
+
+private:
+    uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    unsigned char block[64];
+    size_t used = 0;
+    uint64_t total = 0;
+
+    static uint32_t rotr(uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void compress(const unsigned char* chunk) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (static_cast<uint32_t>(chunk[4 * i]) << 24) | (static_cast<uint32_t>(chunk[4 * i + 1]) << 16) | (static_cast<uint32_t>(chunk[4 * i + 2]) << 8) | chunk[4 * i + 3];
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+};
+
+/**
+ * @param view View of a file's contents.
+ * @return SHA-256 digest of the contents, to be used as the identifier in the store.
+ */
+inline std::string hash(const container::FileView& view) {
+    Sha256 hasher;
+    hasher.add(view.data(), view.size());
+    return hasher.hex();
+}
+
+/**
+ * @brief Local content-addressed store of input files.
+ *
+ * Each file is stored once at `<root>/<first two digits of id>/<id>`, where `id` is the SHA-256 digest of its contents.
+ */
+class Store {
+public:
+    /**
+     * @param root Path to the root directory of the store.
+     * This is created if it does not already exist.
+     */
+    Store(std::string root) : root(std::move(root)) {
+        std::filesystem::create_directories(this->root);
+    }
+
+    /**
+     * @param id Identifier of a file.
+     * This should be a SHA-256 digest in lower-case hexadecimal, e.g., from `hash()`;
+     * anything else is rejected so that crafted identifiers cannot refer to paths outside of the store.
+     * @return Path to the file in the store.
+     */
+    std::string path(const std::string& id) const {
+        bool valid = (id.size() == 64);
+        for (auto c : id) {
+            valid = valid && ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'));
+        }
+        if (!valid) {
+            throw std::runtime_error("invalid identifier '" + id + "'");
+        }
+        return root + "/" + id.substr(0, 2) + "/" + id;
+    }
+
+    /**
+     * @param id Identifier of a file.
+     * @return Whether the file is present in the store.
+     */
+    bool has(const std::string& id) const {
+        return std::filesystem::exists(path(id));
+    }
+
+    /**
+     * Add a file to the store, if it is not already present.
+     * The file is written to a unique temporary path and renamed, so readers never observe a partially written file,
+     * and concurrent calls with the same `id` (e.g., from different processes) do not interfere with each other.
+     *
+     * @param view View of the file's contents.
+     * @param id Identifier of the file, typically from `hash()`.
+     */
+    void put(const container::FileView& view, const std::string& id) const {
+        auto dest = path(id);
+        if (std::filesystem::exists(dest)) {
+            return;
+        }
+
+        std::filesystem::create_directories(root + "/" + id.substr(0, 2));
+        auto tmp = temporary_path(dest);
+        try {
+            container::Output sink(tmp);
+            sink.write(view.data(), view.size());
+            sink.close();
+            std::filesystem::rename(tmp, dest);
+        } catch (...) {
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            throw;
+        }
+    }
+
+private:
+    std::string root;
+
+    // Random suffix from a non-deterministic source, combined with a per-process counter in case the source is deterministic.
+    static std::string temporary_path(const std::string& dest) {
+        static std::atomic<uint64_t> counter(0);
+        std::random_device rd;
+        uint64_t token = (static_cast<uint64_t>(rd()) << 32) ^ rd() ^ (counter++ * 0x9e3779b97f4a7c15ull);
+        static const char digits[] = "0123456789abcdef";
+        std::string suffix;
+        for (int shift = 60; shift >= 0; shift -= 4) {
+            suffix.push_back(digits[(token >> shift) & 0xF]);
+        }
+        return dest + "." + suffix + ".tmp";
+    }
+};
+
+// Extract the state file from a `.kana` file to a standalone HDF5 file, for modification before re-packing.
+inline void extract_state(const container::Reader& reader, const std::string& path) {
+    container::Output sink(path);
+    auto view = reader.state();
+    sink.write(view.data(), view.size());
+    sink.close();
+}
+
+inline void validate_converted(const std::string& path) {
+    container::Reader reader(path);
+    try {
+        auto handle = reader.open_state();
+        kanaval::validate(handle, reader.header().format_type == container::EMBEDDED, reader.header().version);
+    } catch (std::exception& e) {
+        throw utils::combine_errors(e, "failed to validate the converted state file");
+    }
+}
+
+/**
+ * Convert an embedded `.kana` file into a linked file.
+ * Each embedded input file is hashed and added to the store, and the state file is rewritten so that each file's `offset` and `size` are replaced with an `id` containing its hash.
+ * Identical input files across multiple `.kana` files are only stored once.
+ * The converted file is validated before this function returns.
+ *
+ * @param input Path to an embedded `.kana` file.
+ * @param store Store for the input files.
+ * @param output Path to the output `.kana` file.
+ * @param num_threads Number of threads to use for hashing the input files.
+ *
+ * @return Identifier of each input file, in the order of `container::Reader::entries()`.
+ */
+inline std::vector<std::string> to_linked(const std::string& input, const Store& store, const std::string& output, int num_threads = 1) {
+    container::Reader reader(input);
+    if (reader.header().format_type != container::EMBEDDED) {
+        throw std::runtime_error("input files are not embedded in '" + input + "'");
+    }
+
+    const auto& entries = reader.entries();
+    std::vector<container::FileView> views;
+    views.reserve(entries.size());
+    for (const auto& e : entries) {
+        views.push_back(reader.view(e));
+    }
+
+    // No HDF5 calls here, so the files can be hashed in parallel without the HDF5 mutex.
+    std::vector<std::string> ids(entries.size());
+    utils::parallelize(entries.size(), num_threads, [&](int, size_t start, size_t len) -> void {
+        for (size_t i = start, end = start + len; i < end; ++i) {
+            ids[i] = hash(views[i]);
+        }
+    });
+
+    for (size_t i = 0; i < ids.size(); ++i) {
+        store.put(views[i], ids[i]);
+    }
+
+    auto tmp = output + ".state.h5";
+    try {
+        extract_state(reader, tmp);
+        {
+            H5::H5File handle(tmp, H5F_ACC_RDWR);
+            auto groups = container::list_file_groups(handle);
+            for (size_t i = 0; i < groups.size(); ++i) {
+                auto& fhandle = groups[i];
+                for (auto name : { "offset", "size", "id" }) {
+                    if (fhandle.exists(name)) {
+                        fhandle.unlink(name);
+                    }
+                }
+                writer::write_string(fhandle, "id", ids[i]);
+            }
+        }
+
+        container::Header header;
+        header.format_type = container::LINKED;
+        header.version = reader.header().version;
+        header.state_nbytes = container::file_size(tmp);
+
+        container::Output sink(output);
+        unsigned char buffer[container::header_size];
+        container::encode_header(header, buffer);
+        sink.write(buffer, container::header_size);
+        sink.append(tmp, header.state_nbytes);
+        sink.close();
+    } catch (...) {
+        std::filesystem::remove(tmp);
+        throw;
+    }
+    std::filesystem::remove(tmp);
+
+    validate_converted(output);
+    return ids;
+}
+
+/**
+ * Convert a linked `.kana` file back into an embedded file, by retrieving each input file from the store.
+ * The converted file is validated before this function returns.
+ *
+ * @param input Path to a linked `.kana` file, typically created by `to_linked()`.
+ * @param store Store containing the input files.
+ * @param output Path to the output `.kana` file.
+ */
+inline void to_embedded(const std::string& input, const Store& store, const std::string& output) {
+    container::Reader reader(input);
+    if (reader.header().format_type != container::LINKED) {
+        throw std::runtime_error("input files are already embedded in '" + input + "'");
+    }
+
+    std::vector<std::string> paths;
+    for (const auto& e : reader.entries()) {
+        if (!store.has(e.id)) {
+            throw std::runtime_error("file '" + e.name + "' with identifier '" + e.id + "' is not present in the store");
+        }
+        paths.push_back(store.path(e.id));
+    }
+
+    auto tmp = output + ".state.h5";
+    try {
+        extract_state(reader, tmp);
+        {
+            H5::H5File handle(tmp, H5F_ACC_RDWR);
+            for (auto& fhandle : container::list_file_groups(handle)) {
+                if (fhandle.exists("id")) {
+                    fhandle.unlink("id");
+                }
+            }
+        }
+        container::pack(tmp, paths, output, reader.header().version);
+    } catch (...) {
+        std::filesystem::remove(tmp);
+        throw;
+    }
+    std::filesystem::remove(tmp);
+
+    validate_converted(output);
+}
+
+}
+
+}
+
+#endif
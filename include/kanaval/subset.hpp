@@ -0,0 +1,187 @@
+#ifndef KANAVAL_SUBSET_HPP
+#define KANAVAL_SUBSET_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * @file subset.hpp
+ *
+ * @brief Extract per-cell results for a subset of cells.
+ */
+
+namespace kanaval {
+
+namespace subset {
+
+/**
+ * @brief Run of consecutive indices.
+ */
+struct Run {
+    /**
+     * First index in the run.
+     */
+    hsize_t start;
+
+    /**
+     * Number of indices in the run.
+     */
+    hsize_t length;
+};
+
+/**
+ * @tparam Index Integer type of the indices.
+ * @param indices Sorted and unique indices.
+ * @return Runs of consecutive indices, in increasing order.
+ */
+template<typename Index>
+std::vector<Run> coalesce(const std::vector<Index>& indices) {
+    std::vector<Run> output;
+    for (auto i : indices) {
+        hsize_t current = i;
+        if (!output.empty() && output.back().start + output.back().length == current) {
+            ++(output.back().length);
+        } else {
+            output.push_back(Run{ current, 1 });
+        }
+    }
+    return output;
+}
+
+/**
+ * Select the rows of a 1- or 2-dimensional dataset for a subset of cells, where the cells are in the first dimension.
+ * Runs of consecutive cells are selected as a union of hyperslabs spanning whole rows.
+ * For 1-dimensional datasets where the cells are too scattered for this to be worthwhile, individual elements are selected instead;
+ * this is not done for 2-dimensional datasets as each row would require one point per column.
+ * Either way, the HDF5 library only reads the chunks that contain the selected cells.
+ *
+ * @tparam Index Integer type of the indices.
+ * @param space Dataspace for the dataset, to be modified with the selection.
+ * @param indices Sorted and unique indices of the cells of interest.
+ */
+template<typename Index>
+void select_rows(H5::DataSpace& space, const std::vector<Index>& indices) {
+    size_t ndims = space.getSimpleExtentNdims();
+    if (ndims < 1 || ndims > 2) {
+        throw std::runtime_error("expected a 1- or 2-dimensional dataset");
+    }
+
+    hsize_t dims[2] = { 0, 1 };
+    space.getSimpleExtentDims(dims);
+
+    if (!utils::is_unique_and_sorted(indices)) {
+        throw std::runtime_error("indices should be sorted and unique");
+    }
+    if (indices.empty()) {
+        space.selectNone();
+        return;
+    }
+
+    bool negative = false;
+    if constexpr(std::is_signed<Index>::value) {
+        negative = (indices.front() < 0);
+    }
+    if (negative || static_cast<hsize_t>(indices.back()) >= dims[0]) {
+        throw std::runtime_error("indices are out of range for the first dimension of the dataset");
+    }
+
+    auto runs = coalesce(indices);
+
+    // Points are cheaper for HDF5 to process when most runs contain a single cell.
+    if (ndims == 1 && runs.size() * 2 > indices.size()) {
+        std::vector<hsize_t> coords(indices.begin(), indices.end());
+        space.selectElements(H5S_SELECT_SET, coords.size(), coords.data());
+        return;
+    }
+
+    bool first = true;
+    for (const auto& r : runs) {
+        hsize_t offset[2] = { r.start, 0 };
+        hsize_t count[2] = { r.length, dims[1] };
+        space.selectHyperslab(first ? H5S_SELECT_SET : H5S_SELECT_OR, count, offset);
+        first = false;
+    }
+}
+
+/**
+ * Extract the rows of a 1- or 2-dimensional dataset for a subset of cells, e.g., the UMAP coordinates or the PCs.
+ *
+ * @tparam T Type of the output values.
+ * @tparam Index Integer type of the indices.
+ *
+ * @param dhandle Handle to the dataset, with cells in the first dimension.
+ * @param indices Sorted and unique indices of the cells of interest.
+ * @param[out] buffer Pointer to an array of length equal to the product of `indices.size()` and the extent of the second dimension (if any).
+ * On output, this is filled with the row-major contents of the selected rows.
+ */
+template<typename T, typename Index>
+void extract(const H5::DataSet& dhandle, const std::vector<Index>& indices, T* buffer) {
+    auto fspace = dhandle.getSpace();
+    select_rows(fspace, indices);
+
+    hsize_t total = fspace.getSelectNpoints();
+    if (total == 0) {
+        return;
+    }
+
+    H5::DataSpace mspace(1, &total);
+    dhandle.read(buffer, utils::native_type<T>(), mspace, fspace);
+}
+
+/**
+ * Extract the same subset of cells from multiple datasets, e.g., the t-SNE coordinates and the cluster assignments.
+ *
+ * @tparam T Type of the output values.
+ * @tparam Index Integer type of the indices.
+ *
+ * @param datasets Pointers to the datasets, each with cells in the first dimension.
+ * @param indices Sorted and unique indices of the cells of interest.
+ * @param[out] buffers Pointers to arrays for each dataset, see `extract()` for details.
+ */
+template<typename T, typename Index>
+void extract(const std::vector<const H5::DataSet*>& datasets, const std::vector<Index>& indices, const std::vector<T*>& buffers) {
+    if (datasets.size() != buffers.size()) {
+        throw std::runtime_error("number of buffers should be equal to the number of datasets");
+    }
+    for (size_t d = 0; d < datasets.size(); ++d) {
+        extract(*(datasets[d]), indices, buffers[d]);
+    }
+}
+
+/**
+ * @param handle Handle to a validated v3 state file.
+ * @param name Name of the custom selection.
+ * @return Sorted and unique indices of the cells in the selection, relative to the filtered cells.
+ */
+inline std::vector<int> selection_indices(const H5::H5File& handle, const std::string& name) {
+    auto chandle = utils::check_and_open_group(handle, "custom_selections");
+    auto phandle = utils::check_and_open_group(chandle, "parameters");
+    auto shandle = utils::check_and_open_group(phandle, "selections");
+    return utils::load_integer_vector(shandle, name);
+}
+
+/**
+ * @param clusters Handle to a dataset of cluster assignments, e.g., from `StateView::clusters()`.
+ * @param cluster Index of the cluster of interest.
+ * @return Sorted indices of the cells assigned to `cluster`, relative to the filtered cells.
+ */
+inline std::vector<int> cluster_indices(const H5::DataSet& clusters, int cluster) {
+    auto assignments = utils::load_integer_vector(clusters);
+    std::vector<int> output;
+    for (size_t i = 0; i < assignments.size(); ++i) {
+        if (assignments[i] == cluster) {
+            output.push_back(i);
+        }
+    }
+    return output;
+}
+
+}
+
+}
+
+#endif
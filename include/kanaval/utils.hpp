@@ -2,7 +2,32 @@
 #define KANAVAL_UTILS_HPP
 
 #include "H5Cpp.h"
+#include "options.hpp"
 #include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+
+#ifdef KANAVAL_USE_ZLIB
+#include "zlib.h"
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#define KANAVAL_HAS_PREAD 1
+#endif
 
 namespace kanaval {
 
@@ -91,6 +116,8 @@ T load_integer_scalar(const Object& handle, const std::string& name) {
         dhandle.read(&output, H5::PredType::NATIVE_HSIZE);
     } else if constexpr(std::is_same<T, int>::value) {
         dhandle.read(&output, H5::PredType::NATIVE_INT);
+    } else if constexpr(std::is_same<T, long long>::value) {
+        dhandle.read(&output, H5::PredType::NATIVE_LLONG);
     } else {
         static_assert(!sizeof(T*), "this type is not yet supported");
     }
@@ -224,6 +251,619 @@ bool is_unique_and_sorted(const V& values) {
     return true;
 }
 
+// All HDF5 calls from worker threads should be made while holding this mutex,
+// as the HDF5 library is not guaranteed to be thread-safe.
+// This includes the construction, copying and destruction of any HDF5 objects.
+inline std::mutex& hdf5_mutex() {
+    static std::mutex lock;
+    return lock;
+}
+
+// Split `ntasks` into contiguous ranges across `nthreads` threads.
+// `fun` is called with the thread index, the start of its range and the length of its range.
+// Any exception in a worker is rethrown in the calling thread.
+//
+// This can be overridden by defining the `KANAVAL_CUSTOM_PARALLEL` macro with the same signature,
+// e.g., to use an existing thread pool.
+template<class Function>
+void parallelize(size_t ntasks, int nthreads, Function fun) {
+#ifdef KANAVAL_CUSTOM_PARALLEL
+    KANAVAL_CUSTOM_PARALLEL(ntasks, nthreads, fun);
+#else
+    if (nthreads <= 1 || ntasks <= 1) {
+        fun(0, 0, ntasks);
+        return;
+    }
+
+    size_t per_thread = ntasks / nthreads + (ntasks % nthreads > 0);
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(nthreads);
+    workers.reserve(nthreads);
+
+    size_t start = 0;
+    for (int t = 0; t < nthreads && start < ntasks; ++t) {
+        size_t len = std::min(per_thread, ntasks - start);
+        workers.emplace_back([&fun,&errors](int t, size_t start, size_t len) -> void {
+            try {
+                fun(t, start, len);
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        }, t, start, len);
+        start += len;
+    }
+
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (auto& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+#endif
+}
+
+template<typename T>
+const H5::PredType& native_type() {
+    if constexpr(std::is_same<T, double>::value) {
+        return H5::PredType::NATIVE_DOUBLE;
+    } else if constexpr(std::is_same<T, float>::value) {
+        return H5::PredType::NATIVE_FLOAT;
+    } else if constexpr(std::is_same<T, int>::value) {
+        return H5::PredType::NATIVE_INT;
+    } else if constexpr(std::is_same<T, hsize_t>::value) {
+        return H5::PredType::NATIVE_HSIZE;
+    } else {
+        static_assert(!sizeof(T*), "this type is not yet supported");
+    }
+}
+
+// Read a block of consecutive rows from a 1- or 2-dimensional dataset,
+// i.e., the first dimension is sliced and the second dimension (if any) is taken in full.
+// Callers in worker threads should hold the `hdf5_mutex()`.
+template<typename T>
+void read_rows(const H5::DataSet& dhandle, hsize_t start, hsize_t len, hsize_t ncols, T* buffer) {
+    auto fspace = dhandle.getSpace();
+    size_t ndims = fspace.getSimpleExtentNdims();
+    hsize_t offset[2] = { start, 0 };
+    hsize_t count[2] = { len, ncols };
+    fspace.selectHyperslab(H5S_SELECT_SET, count, offset);
+
+    hsize_t total = len * (ndims > 1 ? ncols : 1);
+    H5::DataSpace mspace(1, &total);
+    dhandle.read(buffer, native_type<T>(), mspace, fspace);
+}
+
+// Number of rows and columns of a 1- or 2-dimensional dataset.
+// For 1-dimensional datasets, the number of columns is set to 1.
+inline std::pair<hsize_t, hsize_t> row_extent(const H5::DataSet& dhandle) {
+    auto dims = load_dataset_dimensions(dhandle);
+    if (dims.empty() || dims.size() > 2) {
+        throw std::runtime_error("expected a 1- or 2-dimensional dataset");
+    }
+    return std::make_pair(dims[0], (dims.size() > 1 ? dims[1] : static_cast<hsize_t>(1)));
+}
+
+// Reads blocks of consecutive rows from a 1- or 2-dimensional dataset, for use in worker threads.
+// By default, each block is read with a hyperslab selection under the `hdf5_mutex()`.
+//
+// If the dataset uses allocated contiguous storage without filters in a file that was opened read-only with the default (sec2) driver,
+// the file offset of its contents is obtained from HDF5 up front and each block is read with `pread()` without holding the lock.
+// This allows multiple threads to read from the file in parallel, which is only possible on POSIX systems.
+//
+// If `KANAVAL_USE_ZLIB` is defined and the dataset is stored in deflate-compressed chunks (optionally with shuffling),
+// the raw chunks are fetched with `H5Dread_chunk()` under the lock and decompressed after the lock is released.
+// This allows multiple threads to inflate chunks in parallel, rather than having HDF5 do so serially inside `H5Dread()`.
+// Each block is assembled from its overlapping chunks in order, so the output is the same as that of `read_rows()`.
+// Blocks that overlap unallocated chunks are read with `read_rows()` instead, so that HDF5 can supply the fill values.
+//
+// The constructor calls the HDF5 library and should be run in the calling thread or under the lock.
+template<typename T>
+class RowReader {
+public:
+    RowReader(const H5::DataSet& dhandle, hsize_t ncols) : dhandle(&dhandle), ncols(ncols) {
+        inspect();
+    }
+
+    // Buffers for raw and decompressed chunks, to be re-used across calls to `read()` in the same thread.
+    struct Workspace {
+        std::vector<std::vector<unsigned char> > raw;
+        std::vector<uint32_t> masks;
+        std::vector<unsigned char> inflated, unshuffled;
+    };
+
+    // Number of rows in each chunk if chunks are decompressed directly, otherwise 1.
+    // Blocks aligned to this value avoid decompressing the same chunk twice.
+    hsize_t alignment() const {
+        return chunk_rows;
+    }
+
+    void read(hsize_t start, hsize_t len, T* buffer, [[maybe_unused]] Workspace& work) const {
+        if (mode == Mode::HDF5 || len == 0) {
+            std::lock_guard<std::mutex> lck(hdf5_mutex());
+            read_rows(*dhandle, start, len, ncols, buffer);
+            return;
+        }
+
+#ifdef KANAVAL_HAS_PREAD
+        if (mode == Mode::CONTIGUOUS) {
+            size_t row_bytes = ncols * type_size;
+            size_t nbytes = len * row_bytes;
+            unsigned char* dest;
+            if (identical) {
+                dest = reinterpret_cast<unsigned char*>(buffer);
+            } else {
+                work.inflated.resize(nbytes);
+                dest = work.inflated.data();
+            }
+
+            off_t position = contents + start * row_bytes;
+            size_t done = 0;
+            while (done < nbytes) {
+                auto got = ::pread(file->fd, dest + done, nbytes - done, position + done);
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got <= 0) {
+                    throw std::runtime_error("failed to read contiguous dataset contents");
+                }
+                done += got;
+            }
+
+            if (!identical) {
+                convert(dest, len * ncols, buffer);
+            }
+            return;
+        }
+#endif
+
+#ifdef KANAVAL_USE_ZLIB
+        hsize_t first = start / chunk_rows, last = (start + len - 1) / chunk_rows;
+        size_t nchunks = last - first + 1;
+        work.raw.resize(nchunks);
+        work.masks.resize(nchunks);
+
+        {
+            std::lock_guard<std::mutex> lck(hdf5_mutex());
+            auto did = dhandle->getId();
+            for (size_t c = 0; c < nchunks; ++c) {
+                hsize_t offset[2] = { (first + c) * chunk_rows, 0 };
+                hsize_t size = 0;
+
+                // Unallocated chunks have no raw data to read, so we let HDF5 fill them in.
+                // Older versions of HDF5 fail to report the storage size of such chunks, so we fall back in that case as well.
+#if H5_VERSION_GE(1, 10, 5)
+                haddr_t address;
+                unsigned int filter_mask;
+                if (H5Dget_chunk_info_by_coord(did, offset, &filter_mask, &address, &size) < 0) {
+                    throw std::runtime_error("failed to query the size of a raw chunk");
+                }
+                bool allocated = (address != HADDR_UNDEF);
+#else
+                bool allocated = (H5Dget_chunk_storage_size(did, offset, &size) >= 0);
+#endif
+                if (!allocated || size == 0) {
+                    read_rows(*dhandle, start, len, ncols, buffer);
+                    return;
+                }
+                work.raw[c].resize(size);
+                if (H5Dread_chunk(did, H5P_DEFAULT, offset, &(work.masks[c]), work.raw[c].data()) < 0) {
+                    throw std::runtime_error("failed to read a raw chunk");
+                }
+            }
+        }
+
+        size_t row_bytes = ncols * type_size;
+        size_t chunk_bytes = chunk_rows * row_bytes;
+        for (size_t c = 0; c < nchunks; ++c) {
+            const auto& raw = work.raw[c];
+            const unsigned char* src = raw.data();
+            size_t srclen = raw.size();
+            uint32_t mask = work.masks[c];
+
+            // Filters are skipped for this chunk if their bit is set in the mask.
+            if (!(mask & (1u << deflate_index))) {
+                work.inflated.resize(chunk_bytes);
+                uLongf destlen = chunk_bytes;
+                if (uncompress(work.inflated.data(), &destlen, src, srclen) != Z_OK || destlen != chunk_bytes) {
+                    throw std::runtime_error("failed to decompress a raw chunk");
+                }
+                src = work.inflated.data();
+                srclen = destlen;
+            }
+            if (srclen != chunk_bytes) {
+                throw std::runtime_error("unexpected size for a raw chunk");
+            }
+
+            if (shuffle_index >= 0 && !(mask & (1u << shuffle_index))) {
+                work.unshuffled.resize(chunk_bytes);
+                size_t nelements = chunk_bytes / type_size;
+                for (size_t b = 0; b < type_size; ++b) {
+                    const unsigned char* plane = src + b * nelements;
+                    for (size_t i = 0; i < nelements; ++i) {
+                        work.unshuffled[i * type_size + b] = plane[i];
+                    }
+                }
+                src = work.unshuffled.data();
+            }
+
+            hsize_t chunk_start = (first + c) * chunk_rows;
+            hsize_t from = std::max(start, chunk_start);
+            hsize_t to = std::min(start + len, chunk_start + chunk_rows);
+            convert(src + (from - chunk_start) * row_bytes, (to - from) * ncols, buffer + (from - start) * ncols);
+        }
+#endif
+    }
+
+private:
+    const H5::DataSet* dhandle;
+    hsize_t ncols;
+    hsize_t chunk_rows = 1;
+
+    enum class Mode { HDF5, CONTIGUOUS, CHUNKED };
+    Mode mode = Mode::HDF5;
+
+    enum class Kind { FLOAT, DOUBLE, INT32, INT64, UINT8 };
+    Kind kind;
+    size_t type_size = 0;
+    bool identical = false;
+
+    void inspect() {
+        auto plist = dhandle->getCreatePlist();
+        auto pid = plist.getId();
+        auto layout = H5Pget_layout(pid);
+
+#ifdef KANAVAL_HAS_PREAD
+        if (layout == H5D_CONTIGUOUS && inspect_contiguous(pid) && inspect_type()) {
+            mode = Mode::CONTIGUOUS;
+            return;
+        }
+#endif
+
+#ifdef KANAVAL_USE_ZLIB
+        if (layout == H5D_CHUNKED) {
+            auto rows = inspect_chunks(pid);
+            if (rows && inspect_type()) {
+                chunk_rows = rows;
+                mode = Mode::CHUNKED;
+            }
+        }
+#endif
+
+        (void)layout;
+    }
+
+    // Only supporting file types that are identical to a native type, so that the stored bytes can be used as-is.
+    bool inspect_type() {
+        auto ftype = dhandle->getDataType();
+        auto tid = ftype.getId();
+        if (H5Tequal(tid, H5T_NATIVE_FLOAT) > 0) {
+            kind = Kind::FLOAT;
+        } else if (H5Tequal(tid, H5T_NATIVE_DOUBLE) > 0) {
+            kind = Kind::DOUBLE;
+        } else if (H5Tequal(tid, H5T_NATIVE_INT32) > 0) {
+            kind = Kind::INT32;
+        } else if (H5Tequal(tid, H5T_NATIVE_INT64) > 0) {
+            kind = Kind::INT64;
+        } else if (H5Tequal(tid, H5T_NATIVE_UINT8) > 0) {
+            kind = Kind::UINT8;
+        } else {
+            return false;
+        }
+
+        type_size = ftype.getSize();
+        identical = (H5Tequal(tid, native_type<T>().getId()) > 0);
+        return true;
+    }
+
+    template<typename Stored>
+    static void convert_from(const unsigned char* src, size_t n, T* out) {
+        for (size_t i = 0; i < n; ++i) {
+            Stored val;
+            std::memcpy(&val, src + i * sizeof(Stored), sizeof(Stored));
+            out[i] = val;
+        }
+    }
+
+    void convert(const unsigned char* src, size_t n, T* out) const {
+        switch (kind) {
+            case Kind::FLOAT: convert_from<float>(src, n, out); break;
+            case Kind::DOUBLE: convert_from<double>(src, n, out); break;
+            case Kind::INT32: convert_from<int32_t>(src, n, out); break;
+            case Kind::INT64: convert_from<int64_t>(src, n, out); break;
+            case Kind::UINT8: convert_from<uint8_t>(src, n, out); break;
+        }
+    }
+
+#ifdef KANAVAL_HAS_PREAD
+    struct Descriptor {
+        Descriptor(int fd) : fd(fd) {}
+        ~Descriptor() {
+            ::close(fd);
+        }
+        int fd;
+    };
+
+    std::shared_ptr<const Descriptor> file;
+    off_t contents = 0;
+
+    bool inspect_contiguous(hid_t pid) {
+        if (H5Pget_nfilters(pid) != 0 || H5Pget_external_count(pid) != 0) {
+            return false;
+        }
+
+        auto did = dhandle->getId();
+        haddr_t offset = H5Dget_offset(did);
+        if (offset == HADDR_UNDEF) {
+            return false;
+        }
+
+        // The offset is already absolute, i.e., it includes the user block, if any.
+        // We skip files that might be modified by this process, as the latest contents might not have been flushed yet.
+        hid_t fid = H5Iget_file_id(did);
+        if (fid < 0) {
+            return false;
+        }
+        hid_t fapl = H5Fget_access_plist(fid);
+        unsigned int intent = 0;
+        bool okay = (fapl >= 0 &&
+            H5Fget_intent(fid, &intent) >= 0 && intent == H5F_ACC_RDONLY &&
+            H5Pget_driver(fapl) == H5FD_SEC2);
+        if (fapl >= 0) {
+            H5Pclose(fapl);
+        }
+        H5Fclose(fid);
+        if (!okay) {
+            return false;
+        }
+
+        int fd = ::open(dhandle->getFileName().c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        file.reset(new Descriptor(fd));
+
+        auto extent = row_extent(*dhandle);
+        auto bytes = extent.first * extent.second * dhandle->getDataType().getSize();
+        contents = offset;
+        struct stat info;
+        return (::fstat(fd, &info) == 0 && static_cast<hsize_t>(info.st_size) >= static_cast<hsize_t>(contents) + bytes);
+    }
+#endif
+
+#ifdef KANAVAL_USE_ZLIB
+    int deflate_index = -1, shuffle_index = -1;
+
+    // Returns the number of rows in each chunk, or zero if the chunks cannot be decompressed directly.
+    hsize_t inspect_chunks(hid_t pid) {
+        hsize_t cdims[2];
+        int ndims = H5Pget_chunk(pid, 2, cdims);
+        if (ndims < 1 || ndims > 2 || (ndims == 2 && cdims[1] != ncols) || cdims[0] == 0) {
+            return 0;
+        }
+
+        // Only deflate, possibly preceded by shuffle, is supported.
+        int nfilters = H5Pget_nfilters(pid);
+        for (int f = 0; f < nfilters; ++f) {
+            unsigned int flags, cd_values[8];
+            size_t cd_nelmts = 8;
+            unsigned int config;
+            auto filter = H5Pget_filter2(pid, f, &flags, &cd_nelmts, cd_values, 0, NULL, &config);
+            if (filter == H5Z_FILTER_SHUFFLE && deflate_index < 0) {
+                shuffle_index = f;
+            } else if (filter == H5Z_FILTER_DEFLATE) {
+                deflate_index = f;
+            } else {
+                return 0;
+            }
+        }
+        if (deflate_index < 0) {
+            return 0;
+        }
+
+        return cdims[0];
+    }
+#endif
+};
+
+// Position of the first non-finite value.
+// Each stretch of values is scanned with a branch-free check that can be vectorized by the compiler,
+// and we only locate the offending value if the check fails.
+// Note that this assumes that the compiler honors IEEE semantics, i.e., no `-ffast-math`.
+template<typename T>
+size_t first_nonfinite(const T* ptr, size_t n) {
+    constexpr size_t stretch = 256;
+    constexpr T upper = std::numeric_limits<T>::max();
+
+    for (size_t start = 0; start < n; start += stretch) {
+        size_t end = std::min(n, start + stretch);
+        int bad = 0;
+        for (size_t i = start; i < end; ++i) {
+            bad |= !(std::abs(ptr[i]) <= upper);
+        }
+        if (bad) {
+            for (size_t i = start; i < end; ++i) {
+                if (!std::isfinite(ptr[i])) {
+                    return i;
+                }
+            }
+        }
+    }
+
+    return n;
+}
+
+// Position of the first value that is not finite or does not lie in `[lower, upper]`, using the same strategy as `first_nonfinite()`.
+// Non-finite bounds are allowed, e.g., to check that values are not NaN.
+template<typename T>
+size_t first_outside(const T* ptr, size_t n, T lower, T upper) {
+    constexpr size_t stretch = 256;
+
+    for (size_t start = 0; start < n; start += stretch) {
+        size_t end = std::min(n, start + stretch);
+        int bad = 0;
+        for (size_t i = start; i < end; ++i) {
+            bad |= !(ptr[i] >= lower && ptr[i] <= upper);
+        }
+        if (bad) {
+            for (size_t i = start; i < end; ++i) {
+                if (!(ptr[i] >= lower && ptr[i] <= upper)) {
+                    return i;
+                }
+            }
+        }
+    }
+
+    return n;
+}
+
+// Apply `fun` to blocks of rows from one or more 1- or 2-dimensional datasets,
+// where the blocks are distributed across threads.
+// Each block is read by a `RowReader`, i.e., without the `hdf5_mutex()` where the storage allows it (see above),
+// while `fun` is called without holding the lock so that checks on one block can be performed while another block is being read.
+//
+// `fun` is called with the thread index, the index of the dataset in `datasets`,
+// the first row of the block, the number of rows in the block and a pointer to the row-major block contents.
+// Blocks are not necessarily processed in order.
+template<typename T, class Function>
+void process_blocks(const std::vector<const H5::DataSet*>& datasets, const Options& options, Function fun) {
+    struct Block {
+        size_t dataset;
+        hsize_t start, len;
+    };
+
+    std::vector<Block> blocks;
+    std::vector<hsize_t> ncols;
+    std::vector<RowReader<T> > readers;
+    for (size_t d = 0; d < datasets.size(); ++d) {
+        auto extent = row_extent(*(datasets[d]));
+        ncols.push_back(extent.second);
+        readers.emplace_back(*(datasets[d]), extent.second);
+
+        hsize_t per_block = std::max(static_cast<hsize_t>(1), options.block_size / std::max(static_cast<hsize_t>(1), extent.second));
+        hsize_t align = readers.back().alignment();
+        per_block = (per_block + align - 1) / align * align;
+        for (hsize_t start = 0; start < extent.first; start += per_block) {
+            blocks.push_back(Block{ d, start, std::min(per_block, extent.first - start) });
+        }
+    }
+
+    parallelize(blocks.size(), options.num_threads, [&](int t, size_t start, size_t len) -> void {
+        std::vector<T> buffer;
+        typename RowReader<T>::Workspace work;
+        for (size_t b = start, end = start + len; b < end; ++b) {
+            const auto& current = blocks[b];
+            buffer.resize(current.len * ncols[current.dataset]);
+            readers[current.dataset].read(current.start, current.len, buffer.data(), work);
+            fun(t, current.dataset, current.start, current.len, static_cast<const T*>(buffer.data()));
+        }
+    });
+}
+
+// Apply `fun` to aligned blocks from multiple 1-dimensional datasets of the same length,
+// i.e., the same range of entries is loaded from all datasets before calling `fun`.
+// This allows checks that involve several datasets to be fused into a single pass,
+// with memory usage bounded by `block_size` values per dataset per thread.
+//
+// `fun` is called with the thread index, the first entry of the block, the number of entries in the block,
+// and a vector of pointers to the block contents for each dataset (in the same order as `datasets`).
+// Blocks are processed in order within each thread but not necessarily across threads.
+template<typename T, class Function>
+void process_aligned_blocks(const std::vector<const H5::DataSet*>& datasets, hsize_t length, const Options& options, Function fun) {
+    std::vector<RowReader<T> > readers;
+    hsize_t align = 1;
+    for (size_t d = 0; d < datasets.size(); ++d) {
+        readers.emplace_back(*(datasets[d]), 1);
+        align = std::max(align, readers.back().alignment());
+    }
+
+    // Aligning to the largest chunk size, which is exact when all datasets share the same chunking.
+    hsize_t per_block = std::max(static_cast<hsize_t>(1), options.block_size);
+    per_block = (per_block + align - 1) / align * align;
+    size_t nblocks = length / per_block + (length % per_block > 0);
+
+    parallelize(nblocks, options.num_threads, [&](int t, size_t start, size_t len) -> void {
+        std::vector<std::vector<T> > buffers(datasets.size());
+        std::vector<const T*> pointers(datasets.size());
+        typename RowReader<T>::Workspace work;
+
+        for (size_t b = start, end = start + len; b < end; ++b) {
+            hsize_t first = b * per_block;
+            hsize_t current = std::min(per_block, length - first);
+
+            for (size_t d = 0; d < datasets.size(); ++d) {
+                buffers[d].resize(current);
+                readers[d].read(first, current, buffers[d].data(), work);
+                pointers[d] = buffers[d].data();
+            }
+
+            fun(t, first, current, static_cast<const std::vector<const T*>&>(pointers));
+        }
+    });
+}
+
+// Check that all values in one or more 1- or 2-dimensional float datasets are finite.
+// Single-precision datasets are loaded as such, to avoid the cost of type conversion.
+// An error is raised that reports the first row containing a non-finite value.
+inline void check_finite(const std::vector<std::pair<std::string, const H5::DataSet*> >& datasets, const Options& options) {
+    constexpr hsize_t none = std::numeric_limits<hsize_t>::max();
+    std::vector<hsize_t> first_bad(datasets.size(), none);
+    std::mutex record;
+
+    auto runner = [&](auto placeholder, bool single) -> void {
+        typedef decltype(placeholder) Type;
+
+        std::vector<const H5::DataSet*> subset;
+        std::vector<size_t> indices;
+        std::vector<hsize_t> ncols;
+        for (size_t d = 0; d < datasets.size(); ++d) {
+            const auto& current = *(datasets[d].second);
+            if ((current.getDataType().getSize() <= sizeof(float)) == single) {
+                subset.push_back(&current);
+                indices.push_back(d);
+                ncols.push_back(row_extent(current).second);
+            }
+        }
+
+        process_blocks<Type>(subset, options, [&](int, size_t d, hsize_t start, hsize_t len, const Type* values) -> void {
+            size_t n = len * ncols[d];
+            auto pos = first_nonfinite(values, n);
+            if (pos < n) {
+                std::lock_guard<std::mutex> lck(record);
+                auto& current = first_bad[indices[d]];
+                current = std::min(current, start + pos / ncols[d]);
+            }
+        });
+    };
+
+    runner(float(0), true);
+    runner(double(0), false);
+
+    for (size_t d = 0; d < datasets.size(); ++d) {
+        if (first_bad[d] != none) {
+            throw std::runtime_error("'" + datasets[d].first + "' dataset contains non-finite values (first in row " + std::to_string(first_bad[d]) + ")");
+        }
+    }
+}
+
+// Check that the variance explained by each of the `len` PCs is finite, non-negative and non-increasing.
+inline void check_var_exp_values(const H5::DataSet& vhandle, hsize_t len) {
+    std::vector<double> var_exp(len);
+    if (len) {
+        vhandle.read(var_exp.data(), H5::PredType::NATIVE_DOUBLE);
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        if (!std::isfinite(var_exp[i]) || var_exp[i] < 0) {
+            throw std::runtime_error("'var_exp' dataset should contain finite non-negative values");
+        }
+        if (i && var_exp[i] > var_exp[i - 1]) {
+            throw std::runtime_error("'var_exp' dataset should be non-increasing");
+        }
+    }
+}
+
 }
 
 }
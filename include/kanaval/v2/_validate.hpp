@@ -31,13 +31,74 @@
 #include "cell_labelling.hpp"
 
 #include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <string>
 
 namespace kanaval {
 
 namespace v2 {
 
-void validate(const H5::H5File& handle, bool embedded, int version) {
-    auto i_out = validate_inputs(handle, embedded, version);
+/**
+ * @brief Summary of the facts derived during validation of a v2 state file.
+ */
+struct Summary {
+    /**
+     * Details from the `inputs` step.
+     */
+    inputs::Details inputs;
+
+    /**
+     * Number of cells remaining after filtering.
+     */
+    int filtered_cells = 0;
+
+    /**
+     * Number of PCs for each modality in use.
+     */
+    std::unordered_map<std::string, int> num_pcs;
+
+    /**
+     * Clustering method from the `choose_clustering` step.
+     */
+    std::string cluster_method;
+
+    /**
+     * Number of clusters for the chosen clustering method.
+     */
+    int num_clusters = 0;
+
+    /**
+     * Number of cells in each cluster for the chosen clustering method.
+     */
+    std::vector<int> cluster_sizes;
+
+    /**
+     * Name and number of cells for each custom selection.
+     */
+    std::vector<std::pair<std::string, int> > selections;
+
+    /**
+     * Names of the references used for cell labelling.
+     */
+    std::vector<std::string> references;
+};
+
+/**
+ * Validate the analysis state HDF5 file for version 2 of the kana format.
+ * An error is raised if an invalid structure is detected in any step.
+ *
+ * @param handle Open handle to a HDF5 file.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file.
+ * @param options Options for validation.
+ *
+ * @return Summary of the facts derived during validation.
+ */
+inline Summary validate(const H5::H5File& handle, bool embedded, int version, const Options& options = Options()) {
+    Summary output;
+    auto& i_out = output.inputs;
+    i_out = validate_inputs(handle, embedded, version);
 
     size_t rna_idx = std::find(i_out.modalities.begin(), i_out.modalities.end(), std::string("RNA")) - i_out.modalities.begin();
     size_t adt_idx = std::find(i_out.modalities.begin(), i_out.modalities.end(), std::string("ADT")) - i_out.modalities.begin();
@@ -53,6 +114,7 @@ void validate(const H5::H5File& handle, bool embedded, int version) {
     if (filtered_cells < 0) {
         filtered_cells = std::max(rna_filtered.second, adt_filtered.second);
     }
+    output.filtered_cells = filtered_cells;
 
     // Normalization.
     validate_normalization(handle);
@@ -61,41 +123,56 @@ void validate(const H5::H5File& handle, bool embedded, int version) {
     validate_feature_selection(handle, i_out.num_features[rna_idx]);
 
     // Dimensionality reduction.
-    auto rna_pcs = validate_pca(handle, filtered_cells, version);
-    auto adt_pcs = validate_adt_pca(handle, filtered_cells, adt_in_use, version);
+    auto rna_pcs = validate_pca(handle, filtered_cells, version, options);
+    auto adt_pcs = validate_adt_pca(handle, filtered_cells, adt_in_use, version, options);
+
+    if (rna_in_use) {
+        output.num_pcs["RNA"] = rna_pcs;
+    }
+    if (adt_in_use) {
+        output.num_pcs["ADT"] = adt_pcs;
+    }
 
     int total_pcs = (rna_in_use ? rna_pcs : 0) + (adt_in_use ? adt_pcs : 0);
     validate_combine_embeddings(handle, filtered_cells, i_out.modalities, total_pcs, version);
-    validate_batch_correction(handle, total_pcs, filtered_cells, i_out.num_samples, version);
+    validate_batch_correction(handle, total_pcs, filtered_cells, i_out.num_samples, version, options);
 
     validate_neighbor_index(handle);
 
     // Clustering.
     auto cluster_method = validate_choose_clustering(handle);
+    output.cluster_method = cluster_method;
     int nclusters = 0;
 
     {
         bool is_snn = (cluster_method == "snn_graph");
-        int snn_found = validate_snn_graph_cluster(handle, filtered_cells, is_snn);
+        std::vector<int> sizes;
+        int snn_found = validate_snn_graph_cluster(handle, filtered_cells, is_snn, &sizes);
         if (is_snn) {
             nclusters = snn_found;
+            output.cluster_sizes = std::move(sizes);
         }
     }
 
     {
         bool is_kmeans = (cluster_method == "kmeans");
-        int kmeans_found = validate_kmeans_cluster(handle, filtered_cells, is_kmeans);
+        std::vector<int> sizes;
+        int kmeans_found = validate_kmeans_cluster(handle, filtered_cells, is_kmeans, &sizes);
         if (is_kmeans) {
             nclusters = kmeans_found;
+            output.cluster_sizes = std::move(sizes);
         }
     }
+    output.num_clusters = nclusters;
 
-    validate_tsne(handle, filtered_cells);
-    validate_umap(handle, filtered_cells);
+    validate_tsne(handle, filtered_cells, options);
+    validate_umap(handle, filtered_cells, options);
 
     validate_marker_detection(handle, nclusters, i_out.modalities, i_out.num_features, version);
-    validate_custom_selections(handle, filtered_cells, i_out.modalities, i_out.num_features, version);
-    validate_cell_labelling(handle, nclusters);
+    output.selections = validate_custom_selections(handle, filtered_cells, i_out.modalities, i_out.num_features, version);
+    output.references = validate_cell_labelling(handle, nclusters);
+
+    return output;
 }
 
 }
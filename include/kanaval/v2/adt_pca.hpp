@@ -10,7 +10,7 @@ namespace kanaval {
 
 namespace v2 {
 
-inline int validate_adt_pca(const H5::H5File& handle, int num_cells, bool adt_in_use, int version) {
+inline int validate_adt_pca(const H5::H5File& handle, int num_cells, bool adt_in_use, int version, const Options& options = Options()) {
     if (version < 2000000) {
         return -1;        
     }
@@ -36,7 +36,7 @@ inline int validate_adt_pca(const H5::H5File& handle, int num_cells, bool adt_in
     try {
         auto rhandle = utils::check_and_open_group(ahandle, "results");
         if (adt_in_use) {
-            obs_pcs = pca::check_pca_contents(rhandle, num_pcs, num_cells);
+            obs_pcs = pca::check_pca_contents(rhandle, num_pcs, num_cells, options);
         }
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'adt_pca'");
@@ -9,9 +9,10 @@ namespace kanaval {
 
 namespace v2 {
 
-inline void validate_batch_correction(const H5::H5File& handle, int num_dims, int num_cells, int num_samples, int version) {
+// Returns whether a batch-corrected embedding is present, i.e., MNN correction was performed with multiple samples.
+inline bool validate_batch_correction(const H5::H5File& handle, int num_dims, int num_cells, int num_samples, int version, const Options& options = Options()) {
     if (version < 2000000) {
-        return;
+        return false;
     }
 
     auto xhandle = utils::check_and_open_group(handle, "batch_correction");
@@ -40,13 +41,16 @@ inline void validate_batch_correction(const H5::H5File& handle, int num_dims, in
 
         if (method == "mnn" && num_samples > 1) {
             std::vector<size_t> pdims { static_cast<size_t>(num_cells), static_cast<size_t>(num_dims) };
-            utils::check_and_open_dataset(rhandle, "corrected", H5T_FLOAT, pdims);
+            auto chandle = utils::check_and_open_dataset(rhandle, "corrected", H5T_FLOAT, pdims);
+            if (options.deep) {
+                utils::check_finite({ { "corrected", &chandle } }, options);
+            }
         }
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'batch_correction'");
     }
 
-    return;
+    return method == "mnn" && num_samples > 1;
 }
 
 }
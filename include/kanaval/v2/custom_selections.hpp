@@ -23,10 +23,11 @@ inline void validate_custom_markers(const H5::Group& shandle, int num_features)
 
 }
 
-inline void validate_custom_selections(const H5::Group& handle, int num_cells, const std::vector<std::string>& modalities, const std::vector<int>& num_features, int version) {
+inline std::vector<std::pair<std::string, int> > validate_custom_selections(const H5::Group& handle, int num_cells, const std::vector<std::string>& modalities, const std::vector<int>& num_features, int version) {
     auto cshandle = utils::check_and_open_group(handle, "custom_selections");
 
     std::vector<std::string> selections;
+    std::vector<std::pair<std::string, int> > sizes;
     try {
         auto phandle = utils::check_and_open_group(cshandle, "parameters");
         auto shandle = utils::check_and_open_group(phandle, "selections");
@@ -52,6 +53,8 @@ inline void validate_custom_selections(const H5::Group& handle, int num_cells, c
                     throw std::runtime_error("indices should be unique for selection '" + selections.back() + "'");
                 }
             }
+
+            sizes.emplace_back(name, involved.size());
         }
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve parameters from 'custom_selections'");
@@ -102,7 +105,7 @@ inline void validate_custom_selections(const H5::Group& handle, int num_cells, c
         throw utils::combine_errors(e, "failed to retrieve results from 'custom_selections'");
     }
 
-    return;
+    return sizes;
 }
 
 }
@@ -10,7 +10,7 @@ namespace kanaval {
 
 namespace v2 {
 
-inline int validate_pca(const H5::H5File& handle, int num_cells, int version = 1001000) {
+inline int validate_pca(const H5::H5File& handle, int num_cells, int version = 1001000, const Options& options = Options()) {
     auto xhandle = utils::check_and_open_group(handle, "pca");
 
     int npcs;
@@ -39,11 +39,14 @@ inline int validate_pca(const H5::H5File& handle, int num_cells, int version = 1
     int obs_pcs;
     try {
         auto rhandle = utils::check_and_open_group(xhandle, "results");
-        obs_pcs = pca::check_pca_contents(rhandle, npcs, num_cells);
+        obs_pcs = pca::check_pca_contents(rhandle, npcs, num_cells, options);
 
         if (version >= 1001000 && version < 2000000) {
             if (block_method == "mnn") {
-                utils::check_and_open_dataset(rhandle, "corrected", H5T_FLOAT, { static_cast<size_t>(num_cells), static_cast<size_t>(obs_pcs) });
+                auto chandle = utils::check_and_open_dataset(rhandle, "corrected", H5T_FLOAT, { static_cast<size_t>(num_cells), static_cast<size_t>(obs_pcs) });
+                if (options.deep) {
+                    utils::check_finite({ { "corrected", &chandle } }, options);
+                }
             }
         }
 
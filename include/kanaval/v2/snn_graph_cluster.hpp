@@ -9,7 +9,7 @@ namespace kanaval {
 
 namespace v2 {
 
-inline int validate_snn_graph_cluster(const H5::H5File& handle, int num_cells, bool in_use = true) {
+inline int validate_snn_graph_cluster(const H5::H5File& handle, int num_cells, bool in_use = true, std::vector<int>* cluster_sizes = nullptr) {
     auto xhandle = utils::check_and_open_group(handle, "snn_graph_cluster");
 
     try {
@@ -61,6 +61,10 @@ inline int validate_snn_graph_cluster(const H5::H5File& handle, int num_cells, b
                         throw std::runtime_error("each cluster must be represented at least once in 'clusters'");
                     }
                 }
+
+                if (cluster_sizes) {
+                    *cluster_sizes = std::move(counts);
+                }
             }
         }
     } catch (std::exception& e) {
@@ -9,7 +9,7 @@ namespace kanaval {
 
 namespace v2 {
 
-inline void validate_umap(const H5::H5File& handle, int num_cells) {
+inline void validate_umap(const H5::H5File& handle, int num_cells, const Options& options = Options()) {
     auto thandle = utils::check_and_open_group(handle, "umap");
 
     try {
@@ -39,8 +39,11 @@ inline void validate_umap(const H5::H5File& handle, int num_cells) {
         auto rhandle = utils::check_and_open_group(thandle, "results");
 
         std::vector<size_t> dims { static_cast<size_t>(num_cells) };
-        utils::check_and_open_dataset(rhandle, "x", H5T_FLOAT, dims);
-        utils::check_and_open_dataset(rhandle, "y", H5T_FLOAT, dims);
+        auto xhandle = utils::check_and_open_dataset(rhandle, "x", H5T_FLOAT, dims);
+        auto yhandle = utils::check_and_open_dataset(rhandle, "y", H5T_FLOAT, dims);
+        if (options.deep) {
+            utils::check_finite({ { "x", &xhandle }, { "y", &yhandle } }, options);
+        }
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'umap'");
     }
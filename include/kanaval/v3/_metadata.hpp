@@ -3,6 +3,8 @@
 
 #include "H5Cpp.h"
 #include "../utils.hpp"
+#include <string>
+#include <utility>
 #include <stdexcept>
 
 namespace kanaval {
@@ -11,7 +13,9 @@ namespace v3 {
 
 // Here we're using a double underscore for consistency,
 // given that everything else has validate_<step_name>.
-inline void validate__metadata(const H5::H5File& handle, int version) {
+// This returns the name and version of the application that created the file.
+inline std::pair<std::string, std::string> validate__metadata(const H5::H5File& handle, int version) {
+    std::pair<std::string, std::string> output;
     try {    
         auto mhandle = utils::check_and_open_group(handle, "_metadata");
         auto v = utils::load_integer_scalar(mhandle, "format_version");
@@ -19,11 +23,13 @@ inline void validate__metadata(const H5::H5File& handle, int version) {
             throw std::runtime_error("'format_version' is not consistent with kana file version");
         }
 
-        utils::load_string(mhandle, "application_name");
-        utils::load_string(mhandle, "application_version");
+        output.first = utils::load_string(mhandle, "application_name");
+        output.second = utils::load_string(mhandle, "application_version");
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to check the '_metadata'");
     }
+
+    return output;
 }
 
 }
@@ -0,0 +1,150 @@
+#ifndef KANAVAL__REVALIDATE_V3_HPP
+#define KANAVAL__REVALIDATE_V3_HPP
+
+#include "H5Cpp.h"
+#include "_validate.hpp"
+#include "../fingerprint.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * @file _revalidate.hpp
+ *
+ * @brief Incremental revalidation of a v3 state file.
+ */
+
+namespace kanaval {
+
+namespace v3 {
+
+/**
+ * @brief Report from a previous validation of a state file.
+ *
+ * This can be held by the caller and passed to `revalidate()` after the state file is modified,
+ * e.g., when **kana** re-saves the state after re-clustering.
+ */
+struct Report {
+    /**
+     * Whether the data files are embedded.
+     */
+    bool embedded = true;
+
+    /**
+     * Version of the kana file.
+     */
+    int version = 0;
+
+    /**
+     * Whether deep validation was performed, see `Options::deep`.
+     */
+    bool deep = false;
+
+    /**
+     * Facts derived during validation.
+     */
+    Summary summary;
+
+    /**
+     * Fingerprint of each step's group, see `fingerprint::compute()`.
+     */
+    std::unordered_map<std::string, uint64_t> fingerprints;
+};
+
+/**
+ * @param handle Open handle to a HDF5 file.
+ * @return Fingerprints for the groups of all steps in `steps::graph`.
+ */
+inline std::unordered_map<std::string, uint64_t> fingerprint_steps(const H5::H5File& handle) {
+    std::unordered_map<std::string, uint64_t> output;
+    for (const auto& s : steps::graph) {
+        output[s.name] = fingerprint::compute(handle, s.name);
+    }
+    return output;
+}
+
+/**
+ * Validate the state file and report the derived facts and per-step fingerprints.
+ * The fingerprints are computed before validation so that they describe the contents that were actually validated.
+ *
+ * @param handle Open handle to a HDF5 file.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file.
+ * @param options Options for validation.
+ *
+ * @return Report that can be used in `revalidate()`.
+ */
+inline Report validate_with_report(const H5::H5File& handle, bool embedded, int version, const Options& options = Options()) {
+    Report output;
+    output.embedded = embedded;
+    output.version = version;
+    output.deep = options.deep;
+    output.fingerprints = fingerprint_steps(handle);
+    output.summary = validate(handle, embedded, version, options);
+    return output;
+}
+
+/**
+ * Revalidate a state file after modification.
+ * Only the steps with changed fingerprints and their downstream dependents in `steps::graph` are validated again;
+ * facts for the other steps are taken from the previous report.
+ * All steps are validated if `embedded`, `version` or `Options::deep` differ from the previous report.
+ *
+ * @param handle Open handle to a HDF5 file.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file.
+ * @param previous Report from a previous validation of the same file.
+ * @param[out] rerun Optional pointer to a vector, to be filled with the names of the steps that were validated again.
+ * @param options Options for validation.
+ *
+ * @return Report for the modified file.
+ */
+inline Report revalidate(const H5::H5File& handle, bool embedded, int version, const Report& previous, std::vector<std::string>* rerun = nullptr, const Options& options = Options()) {
+    Report output;
+    output.embedded = embedded;
+    output.version = version;
+    output.deep = options.deep;
+    output.fingerprints = fingerprint_steps(handle);
+
+    bool everything = (embedded != previous.embedded || version != previous.version || options.deep != previous.deep);
+    std::unordered_set<std::string> dirty;
+    for (const auto& s : steps::graph) {
+        bool changed = everything;
+
+        if (!changed) {
+            auto it = previous.fingerprints.find(s.name);
+            changed = (it == previous.fingerprints.end() || it->second != output.fingerprints[s.name]);
+        }
+
+        if (!changed) {
+            for (const auto& d : s.depends) {
+                if (dirty.find(d) != dirty.end()) {
+                    changed = true;
+                    break;
+                }
+            }
+        }
+
+        if (changed) {
+            dirty.insert(s.name);
+            if (rerun) {
+                rerun->push_back(s.name);
+            }
+        }
+    }
+
+    output.summary = previous.summary;
+    validate_steps(handle, embedded, version, output.summary, [&](const std::string& name) -> bool {
+        return dirty.find(name) != dirty.end();
+    }, options);
+
+    return output;
+}
+
+}
+
+}
+
+#endif
@@ -36,85 +36,333 @@
 #include "_metadata.hpp"
 #include <algorithm>
 #include <unordered_map>
+#include <vector>
+#include <string>
 
 namespace kanaval {
 
 namespace v3 {
 
-void validate(const H5::H5File& handle, bool embedded, int version) {
-    auto i_out = validate_inputs(handle, embedded, version);
+/**
+ * @brief Facts derived during validation of a v3 state file.
+ *
+ * These are passed from upstream steps to their downstream dependents,
+ * e.g., the number of filtered cells is used to check the dimensions of the PCs.
+ */
+struct Summary {
+    /**
+     * Details from the `inputs` step.
+     */
+    inputs::Details inputs;
+
+    /**
+     * Number of cells remaining after QC for each available modality.
+     */
+    std::unordered_map<std::string, int> qc_remaining;
+
+    /**
+     * Number of cells remaining after filtering.
+     */
+    int filtered_cells = 0;
+
+    /**
+     * Available modalities that were used to filter cells, from `cell_filtering`.
+     */
+    std::vector<std::string> filtering_modalities;
+
+    /**
+     * Number of PCs for each available modality.
+     */
+    std::unordered_map<std::string, int> num_pcs;
+
+    /**
+     * Total number of dimensions in the combined embedding.
+     */
+    int total_pcs = 0;
+
+    /**
+     * Available modalities with non-zero weights in `combine_embeddings`.
+     */
+    std::vector<std::string> embedding_modalities;
+
+    /**
+     * Whether a batch-corrected embedding is present in `batch_correction`.
+     */
+    bool batch_corrected = false;
+
+    /**
+     * Clustering method from the `choose_clustering` step.
+     */
+    std::string cluster_method;
+
+    /**
+     * Number of clusters reported by `snn_graph_cluster`.
+     */
+    int snn_clusters = 0;
+
+    /**
+     * Number of clusters reported by `kmeans_cluster`.
+     */
+    int kmeans_clusters = 0;
+
+    /**
+     * Number of clusters for the chosen clustering method.
+     */
+    int num_clusters = 0;
+
+    /**
+     * Number of cells in each cluster reported by `snn_graph_cluster`.
+     */
+    std::vector<int> snn_cluster_sizes;
+
+    /**
+     * Number of cells in each cluster reported by `kmeans_cluster`.
+     */
+    std::vector<int> kmeans_cluster_sizes;
+
+    /**
+     * Number of cells in each cluster for the chosen clustering method.
+     */
+    std::vector<int> cluster_sizes;
+
+    /**
+     * Name and number of cells for each custom selection.
+     */
+    std::vector<std::pair<std::string, int> > selections;
+
+    /**
+     * Names of the references used for cell labelling.
+     */
+    std::vector<std::string> references;
+
+    /**
+     * Name of the application that created the file, from `_metadata`.
+     */
+    std::string application_name;
+
+    /**
+     * Version of the application that created the file, from `_metadata`.
+     */
+    std::string application_version;
+};
+
+namespace steps {
+
+/**
+ * @brief A step in the analysis and the upstream steps that it depends on.
+ */
+struct Step {
+    std::string name;
+    std::vector<std::string> depends;
+};
+
+/**
+ * Steps in the order in which they are validated.
+ * Each step only depends on steps that appear before it.
+ */
+inline const std::vector<Step> graph {
+    { "inputs", {} },
+
+    { "rna_quality_control", { "inputs" } },
+    { "adt_quality_control", { "inputs" } },
+    { "crispr_quality_control", { "inputs" } },
+    { "cell_filtering", { "inputs", "rna_quality_control", "adt_quality_control", "crispr_quality_control" } },
+
+    { "rna_normalization", {} },
+    { "adt_normalization", { "inputs", "cell_filtering" } },
+    { "crispr_normalization", {} },
+
+    { "feature_selection", { "inputs" } },
+
+    { "rna_pca", { "inputs", "cell_filtering" } },
+    { "adt_pca", { "inputs", "cell_filtering" } },
+    { "crispr_pca", { "inputs", "cell_filtering" } },
+    { "combine_embeddings", { "cell_filtering", "rna_pca", "adt_pca", "crispr_pca" } },
+    { "batch_correction", { "inputs", "cell_filtering", "combine_embeddings" } },
+
+    { "neighbor_index", {} },
+
+    { "choose_clustering", {} },
+    { "snn_graph_cluster", { "cell_filtering", "choose_clustering" } },
+    { "kmeans_cluster", { "cell_filtering", "choose_clustering" } },
+
+    { "tsne", { "cell_filtering" } },
+    { "umap", { "cell_filtering" } },
+
+    { "marker_detection", { "inputs", "choose_clustering", "snn_graph_cluster", "kmeans_cluster" } },
+    { "custom_selections", { "inputs", "cell_filtering" } },
+    { "cell_labelling", { "inputs", "choose_clustering", "snn_graph_cluster", "kmeans_cluster" } },
+
+    { "_metadata", {} }
+};
+
+}
+
+/**
+ * Validate the steps of a state file, skipping those that do not need to be re-run.
+ * Facts from skipped steps are taken from the existing contents of `output`.
+ *
+ * @tparam Rerun Function that accepts a step name and returns a boolean.
+ *
+ * @param handle Open handle to a HDF5 file.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file.
+ * @param output Summary of the facts from a previous validation.
+ * On completion, this is updated with facts from the re-run steps.
+ * @param rerun Function that indicates whether a step should be validated.
+ * @param options Options for validation.
+ */
+template<class Rerun>
+void validate_steps(const H5::H5File& handle, bool embedded, int version, Summary& output, Rerun rerun, const Options& options = Options()) {
+    auto& i_out = output.inputs;
+    if (rerun("inputs")) {
+        i_out = validate_inputs(handle, embedded, version);
+    }
 
     auto rnaIt = i_out.num_features.find("RNA");
     bool rna_available = rnaIt != i_out.num_features.end();
     bool adt_available = i_out.num_features.find("ADT") != i_out.num_features.end();
     bool crispr_available = i_out.num_features.find("CRISPR") != i_out.num_features.end();
 
-    auto add_modalities = [](auto& host, auto rna_val, auto adt_val, auto crispr_val) -> void {
-        if (rna_val >= 0) { host["RNA"] = rna_val; }
-        if (adt_val >= 0) { host["ADT"] = adt_val; }
-        if (crispr_val >= 0) { host["CRISPR"] = crispr_val; }
+    auto features_for = [&](const std::string& modality) -> int {
+        auto it = i_out.num_features.find(modality);
+        return (it == i_out.num_features.end() ? -1 : it->second);
+    };
+
+    auto set_modality = [](auto& host, const std::string& modality, int val) -> void {
+        if (val >= 0) { 
+            host[modality] = val; 
+        } else {
+            host.erase(modality);
+        }
     };
 
     // Quality control.
-    int filtered_cells;
     {
-        std::unordered_map<std::string, int> survivors;
-        add_modalities(survivors, 
-            validate_rna_quality_control(handle, i_out.num_cells, i_out.num_blocks, rna_available, version),
-            validate_adt_quality_control(handle, i_out.num_cells, i_out.num_blocks, adt_available, version),
-            validate_crispr_quality_control(handle, i_out.num_cells, i_out.num_blocks, crispr_available, version)
-        );
-        filtered_cells = validate_cell_filtering(handle, i_out.num_cells, survivors, version);
+        auto& survivors = output.qc_remaining;
+        if (rerun("rna_quality_control")) {
+            set_modality(survivors, "RNA", validate_rna_quality_control(handle, i_out.num_cells, i_out.num_blocks, rna_available, version, features_for("RNA"), options));
+        }
+        if (rerun("adt_quality_control")) {
+            set_modality(survivors, "ADT", validate_adt_quality_control(handle, i_out.num_cells, i_out.num_blocks, adt_available, version, features_for("ADT"), options));
+        }
+        if (rerun("crispr_quality_control")) {
+            set_modality(survivors, "CRISPR", validate_crispr_quality_control(handle, i_out.num_cells, i_out.num_blocks, crispr_available, version, features_for("CRISPR"), options));
+        }
+        if (rerun("cell_filtering")) {
+            output.filtered_cells = validate_cell_filtering(handle, i_out.num_cells, survivors, version, options, &(output.filtering_modalities));
+        }
     }
+    int filtered_cells = output.filtered_cells;
 
     // Normalization.
-    validate_rna_normalization(handle);
-    v2::validate_adt_normalization(handle, filtered_cells, adt_available, version);
-    validate_crispr_normalization(handle);
+    if (rerun("rna_normalization")) {
+        validate_rna_normalization(handle);
+    }
+    if (rerun("adt_normalization")) {
+        v2::validate_adt_normalization(handle, filtered_cells, adt_available, version);
+    }
+    if (rerun("crispr_normalization")) {
+        validate_crispr_normalization(handle);
+    }
 
     // Feature selection.
-    validate_feature_selection(handle, (rna_available ? rnaIt->second : -1), rna_available, version);
+    if (rerun("feature_selection")) {
+        validate_feature_selection(handle, (rna_available ? rnaIt->second : -1), rna_available, version);
+    }
 
     // Dimensionality reduction.
     {
-        std::unordered_map<std::string, int> num_pcs;
-        add_modalities(num_pcs,
-            validate_rna_pca(handle, filtered_cells, rna_available, version),
-            v2::validate_adt_pca(handle, filtered_cells, adt_available, version),
-            validate_crispr_pca(handle, filtered_cells, crispr_available, version)
-        );
-        int total_pcs = validate_combine_embeddings(handle, filtered_cells, num_pcs, version);
-        v2::validate_batch_correction(handle, total_pcs, filtered_cells, i_out.num_blocks, version);
+        auto& num_pcs = output.num_pcs;
+        if (rerun("rna_pca")) {
+            set_modality(num_pcs, "RNA", validate_rna_pca(handle, filtered_cells, rna_available, version, options));
+        }
+        if (rerun("adt_pca")) {
+            set_modality(num_pcs, "ADT", v2::validate_adt_pca(handle, filtered_cells, adt_available, version, options));
+        }
+        if (rerun("crispr_pca")) {
+            set_modality(num_pcs, "CRISPR", validate_crispr_pca(handle, filtered_cells, crispr_available, version, options));
+        }
+        if (rerun("combine_embeddings")) {
+            output.total_pcs = validate_combine_embeddings(handle, filtered_cells, num_pcs, version, options, &(output.embedding_modalities));
+        }
+        if (rerun("batch_correction")) {
+            output.batch_corrected = v2::validate_batch_correction(handle, output.total_pcs, filtered_cells, i_out.num_blocks, version, options);
+        }
     }
 
-    v2::validate_neighbor_index(handle);
+    if (rerun("neighbor_index")) {
+        v2::validate_neighbor_index(handle);
+    }
 
     // Clustering.
-    auto cluster_method = v2::validate_choose_clustering(handle);
-    int nclusters = 0;
+    if (rerun("choose_clustering")) {
+        output.cluster_method = v2::validate_choose_clustering(handle);
+    }
     {
-        bool is_snn = (cluster_method == "snn_graph");
-        int snn_found = validate_snn_graph_cluster(handle, filtered_cells, is_snn);
+        bool is_snn = (output.cluster_method == "snn_graph");
+        if (rerun("snn_graph_cluster")) {
+            output.snn_clusters = validate_snn_graph_cluster(handle, filtered_cells, is_snn, &(output.snn_cluster_sizes));
+        }
 
-        bool is_kmeans = (cluster_method == "kmeans");
-        int kmeans_found = v2::validate_kmeans_cluster(handle, filtered_cells, is_kmeans);
+        bool is_kmeans = (output.cluster_method == "kmeans");
+        if (rerun("kmeans_cluster")) {
+            output.kmeans_clusters = v2::validate_kmeans_cluster(handle, filtered_cells, is_kmeans, &(output.kmeans_cluster_sizes));
+        }
 
         if (is_snn) {
-            nclusters = snn_found;
+            output.num_clusters = output.snn_clusters;
+            output.cluster_sizes = output.snn_cluster_sizes;
         } else if (is_kmeans) {
-            nclusters = kmeans_found;
+            output.num_clusters = output.kmeans_clusters;
+            output.cluster_sizes = output.kmeans_cluster_sizes;
+        } else {
+            output.num_clusters = 0;
+            output.cluster_sizes.clear();
         }
     }
+    int nclusters = output.num_clusters;
 
-    v2::validate_tsne(handle, filtered_cells);
-    v2::validate_umap(handle, filtered_cells);
+    if (rerun("tsne")) {
+        v2::validate_tsne(handle, filtered_cells, options);
+    }
+    if (rerun("umap")) {
+        v2::validate_umap(handle, filtered_cells, options);
+    }
 
-    validate_marker_detection(handle, nclusters, i_out.num_features, version);
-    validate_custom_selections(handle, filtered_cells, i_out.num_features, version);
-    validate_cell_labelling(handle, nclusters, rna_available, version);
+    if (rerun("marker_detection")) {
+        validate_marker_detection(handle, nclusters, i_out.num_features, version, options);
+    }
+    if (rerun("custom_selections")) {
+        output.selections = validate_custom_selections(handle, filtered_cells, i_out.num_features, version, options);
+    }
+    if (rerun("cell_labelling")) {
+        output.references = validate_cell_labelling(handle, nclusters, rna_available, version);
+    }
 
     // Checking metadata.
-    validate__metadata(handle, version);
+    if (rerun("_metadata")) {
+        auto meta = validate__metadata(handle, version);
+        output.application_name = meta.first;
+        output.application_version = meta.second;
+    }
+}
+
+/**
+ * Validate the analysis state HDF5 file for version 3 of the kana format.
+ * An error is raised if an invalid structure is detected in any step.
+ *
+ * @param handle Open handle to a HDF5 file.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file.
+ * @param options Options for validation.
+ *
+ * @return Summary of the facts derived during validation.
+ */
+inline Summary validate(const H5::H5File& handle, bool embedded, int version, const Options& options = Options()) {
+    Summary output;
+    validate_steps(handle, embedded, version, output, [](const std::string&) -> bool { return true; }, options);
+    return output;
 }
 
 }
@@ -3,14 +3,16 @@
 
 #include "H5Cpp.h"
 #include <vector>
+#include <limits>
 #include "../utils.hpp"
 #include "quality_control.hpp"
+#include "../options.hpp"
 
 namespace kanaval {
     
 namespace v3 {
 
-inline int validate_adt_quality_control(const H5::H5File& handle, int num_cells, int num_blocks, bool adt_available, int version) {
+inline int validate_adt_quality_control(const H5::H5File& handle, int num_cells, int num_blocks, bool adt_available, int version, int num_features = -1, const Options& options = Options()) {
     auto xhandle = utils::check_and_open_group(handle, "adt_quality_control");
 
     try {
@@ -36,9 +38,21 @@ inline int validate_adt_quality_control(const H5::H5File& handle, int num_cells,
             xhandle, 
             num_cells, 
             num_blocks, 
-            { { "sums", H5T_FLOAT }, { "detected", H5T_INTEGER }, { "igg_total", H5T_FLOAT }},
+            { 
+                { "sums", H5T_FLOAT, 0 }, 
+                { "detected", H5T_INTEGER, 0, (num_features >= 0 ? num_features : std::numeric_limits<double>::max()) }, 
+                { "igg_total", H5T_FLOAT, 0 }
+            },
             { "detected", "igg_total" },
-            adt_available
+            adt_available,
+            [](size_t n, const std::vector<const double*>& metrics, const std::vector<double>& thresholds, unsigned char* expected) -> void {
+                const double* detected = metrics[1];
+                const double* igg_total = metrics[2];
+                for (size_t i = 0; i < n; ++i) {
+                    expected[i] = quality_control::either_threshold(detected[i] < thresholds[0], quality_control::above_threshold(igg_total[i], thresholds[1]));
+                }
+            },
+            options
         );
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'adt_quality_control'");
@@ -6,33 +6,118 @@
 #include <unordered_map>
 #include "../utils.hpp"
 #include "quality_control.hpp"
+#include "../options.hpp"
+#include <string>
+#include <limits>
+#include <mutex>
 
 namespace kanaval {
 
 namespace v3 {
 
-inline int validate_cell_filtering(const H5::H5File& handle, int num_cells, const std::unordered_map<std::string, int>& modalities, int version) {
+namespace cell_filtering {
+
+// Check that the combined discards are the union of the per-modality QC discards.
+// All vectors are streamed together in aligned blocks so that memory usage is bounded for large numbers of cells.
+inline int check_union(const H5::H5File& handle, const H5::Group& rhandle, int num_cells, const std::vector<std::string>& steps, const Options& options) {
+    std::vector<H5::DataSet> dhandles;
+    std::vector<size_t> dims{ static_cast<size_t>(num_cells) };
+
+    for (const auto& s : steps) {
+        try {
+            auto shandle = utils::check_and_open_group(handle, s);
+            auto srhandle = utils::check_and_open_group(shandle, "results");
+            dhandles.push_back(utils::check_and_open_dataset(srhandle, "discards", H5T_INTEGER, dims));
+        } catch (std::exception& e) {
+            throw utils::combine_errors(e, "failed to retrieve discard information from '" + s + "'");
+        }
+    }
+
+    try {
+        dhandles.push_back(utils::check_and_open_dataset(rhandle, "discards", H5T_INTEGER, dims));
+    } catch (std::exception& e) {
+        throw utils::combine_errors(e, "failed to retrieve discard information from 'results'");
+    }
+
+    std::vector<const H5::DataSet*> pointers;
+    for (const auto& d : dhandles) {
+        pointers.push_back(&d);
+    }
+
+    constexpr hsize_t none = std::numeric_limits<hsize_t>::max();
+    hsize_t first_mismatch = none;
+    int remaining = 0;
+    std::mutex record;
+    size_t nsteps = steps.size();
+
+    utils::process_aligned_blocks<int>(pointers, num_cells, options, [&](int, hsize_t start, hsize_t len, const std::vector<const int*>& values) -> void {
+        std::vector<unsigned char> expected(len);
+        for (size_t s = 0; s < nsteps; ++s) {
+            const int* current = values[s];
+            for (hsize_t i = 0; i < len; ++i) {
+                expected[i] |= (current[i] != 0);
+            }
+        }
+
+        const int* combined = values.back();
+        int bad = 0, local_remaining = 0;
+        for (hsize_t i = 0; i < len; ++i) {
+            unsigned char observed = (combined[i] != 0);
+            bad |= (observed != expected[i]);
+            local_remaining += !observed;
+        }
+
+        hsize_t local_mismatch = none;
+        if (bad) {
+            for (hsize_t i = 0; i < len; ++i) {
+                if ((combined[i] != 0) != expected[i]) {
+                    local_mismatch = start + i;
+                    break;
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lck(record);
+        remaining += local_remaining;
+        first_mismatch = std::min(first_mismatch, local_mismatch);
+    });
+
+    if (first_mismatch != none) {
+        throw std::runtime_error("'discards' should be the union of the discards from the quality control steps (first mismatch at cell " + std::to_string(first_mismatch) + ")");
+    }
+
+    return remaining;
+}
+
+}
+
+// If `used` is supplied, it is filled with the available modalities that were used for filtering.
+inline int validate_cell_filtering(const H5::H5File& handle, int num_cells, const std::unordered_map<std::string, int>& modalities, int version, const Options& options = Options(), std::vector<std::string>* used = nullptr) {
     auto qhandle = utils::check_and_open_group(handle, "cell_filtering");
 
     // Checking parameters.
     int modalities_for_filtering = 0;
     int last_found = 0;
+    std::vector<std::string> qc_steps;
+    std::vector<std::string> found;
     try {
         auto phandle = utils::check_and_open_group(qhandle, "parameters");
 
-        auto find_modality = [&](const std::string& flag, const std::string& target) -> void {
+        auto find_modality = [&](const std::string& flag, const std::string& target, const std::string& step) -> void {
             if (utils::load_integer_scalar(phandle, flag)) {
                 auto it = modalities.find(target);
                 if (it != modalities.end()) {
                     ++modalities_for_filtering;
                     last_found = it->second;
+                    qc_steps.push_back(step);
+                    found.push_back(target);
                 }
             }
         };
 
-        find_modality("use_rna", "RNA");
-        find_modality("use_adt", "ADT");
-        find_modality("use_crispr", "CRISPR");
+        find_modality("use_rna", "RNA", "rna_quality_control");
+        find_modality("use_adt", "ADT", "adt_quality_control");
+        find_modality("use_crispr", "CRISPR", "crispr_quality_control");
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve parameters from 'cell_filtering'");
     }
@@ -42,7 +127,11 @@ inline int validate_cell_filtering(const H5::H5File& handle, int num_cells, cons
     try {
         auto rhandle = utils::check_and_open_group(qhandle, "results");
         if (modalities_for_filtering > 1) {
-            remaining = quality_control::check_discard_vector(rhandle, num_cells);
+            if (options.deep) {
+                remaining = cell_filtering::check_union(handle, rhandle, num_cells, qc_steps, options);
+            } else {
+                remaining = quality_control::check_discard_vector(rhandle, num_cells);
+            }
         } else if (modalities_for_filtering == 1) {
             remaining = last_found;
         } else {
@@ -52,6 +141,9 @@ inline int validate_cell_filtering(const H5::H5File& handle, int num_cells, cons
         throw utils::combine_errors(e, "failed to retrieve results from 'cell_filtering'");
     }
 
+    if (used) {
+        *used = std::move(found);
+    }
     return remaining;
 }
 
@@ -10,10 +10,11 @@ namespace kanaval {
 
 namespace v3 {
 
-inline void validate_cell_labelling(const H5::H5File& handle, int num_clusters, bool rna_available, int version) {
+inline std::vector<std::string> validate_cell_labelling(const H5::H5File& handle, int num_clusters, bool rna_available, int version) {
     auto nhandle = utils::check_and_open_group(handle, "cell_labelling");
 
     std::unordered_set<std::string> refs;
+    std::vector<std::string> ordered;
     try {
         auto phandle = utils::check_and_open_group(nhandle, "parameters");
         
@@ -25,6 +26,7 @@ inline void validate_cell_labelling(const H5::H5File& handle, int num_clusters,
                     throw std::runtime_error("duplicated reference '" + r + "' in '" + species + "'");
                 }
                 refs.insert(r);
+                ordered.push_back(r);
             }
         }
     } catch (std::exception& e) {
@@ -63,7 +65,7 @@ inline void validate_cell_labelling(const H5::H5File& handle, int num_clusters,
         throw utils::combine_errors(e, "failed to retrieve results from 'cell_labelling'");
     }
 
-    return;
+    return ordered;
 }
 
 }
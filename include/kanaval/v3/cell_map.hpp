@@ -0,0 +1,207 @@
+#ifndef KANAVAL_CELL_MAP_V3_HPP
+#define KANAVAL_CELL_MAP_V3_HPP
+
+#include "H5Cpp.h"
+#include "state_view.hpp"
+#include "../bitvector.hpp"
+#include "../utils.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @file cell_map.hpp
+ *
+ * @brief Map cell indices between the original, subsetted and filtered spaces.
+ */
+
+namespace kanaval {
+
+namespace v3 {
+
+/**
+ * @brief Mapping between the cell index spaces of a v3 state file.
+ *
+ * Cells are indexed in three different ways:
+ *
+ * - The original space refers to the columns of the input matrices.
+ * - The subsetted space refers to the cells retained by `inputs/parameters/subset`, and is used by the QC and filtering steps.
+ * - The filtered space refers to the cells that were not discarded by `cell_filtering`,
+ *   and is used by all downstream steps, e.g., the PCs, the clusters, the indices in `custom_selections/parameters/selections`.
+ *
+ * Each transition is stored as a `BitVector` where set bits represent the retained cells,
+ * so moving forward to a more restricted space is a rank query and moving back is a select query.
+ * This uses around 1.25 bits per cell for each transition, rather than a full integer array for each direction.
+ */
+class CellMap {
+public:
+    /**
+     * Construct the mapping from a validated state file.
+     * The subset indices and discards are each read in a single streaming pass in blocks of `block_size`.
+     *
+     * @param view View of a validated v3 state file.
+     * @param num_original Number of cells in the original input matrices.
+     * If zero, this is set to one plus the largest subset index, or the number of subsetted cells if no subsetting was performed.
+     * @param block_size Number of values to read at a time.
+     */
+    CellMap(const StateView& view, hsize_t num_original = 0, hsize_t block_size = 65536) {
+        block_size = std::max(static_cast<hsize_t>(1), block_size);
+        hsize_t num_cells = view.summary().inputs.num_cells;
+        std::vector<int> buffer(std::min(block_size, num_cells));
+
+        auto ihandle = utils::check_and_open_group(view.file(), "inputs");
+        auto phandle = utils::check_and_open_group(ihandle, "parameters");
+        // Same as inputs::check_subset_cells(), a 'subset' group without 'cells' means that no subsetting was performed.
+        bool has_subset = false;
+        if (phandle.exists("subset")) {
+            has_subset = utils::check_and_open_group(phandle, "subset").exists("cells");
+        }
+
+        if (has_subset) {
+            auto shandle = utils::check_and_open_group(utils::check_and_open_group(phandle, "subset"), "cells");
+            if (!shandle.exists("indices")) {
+                throw std::runtime_error("subsetting by annotation cannot be mapped to the original cells without 'subset/cells/indices'");
+            }
+
+            auto dhandle = utils::check_and_open_dataset(shandle, "indices", H5T_INTEGER);
+            hsize_t expected = 0;
+            for (hsize_t start = 0; start < num_cells; start += block_size) {
+                hsize_t len = std::min(block_size, num_cells - start);
+                utils::read_rows(dhandle, start, len, 1, buffer.data());
+                for (hsize_t i = 0; i < len; ++i) {
+                    hsize_t current = buffer[i];
+                    original.append(current - expected, false);
+                    original.push_back(true);
+                    expected = current + 1;
+                }
+            }
+
+            if (num_original) {
+                if (num_original < expected) {
+                    throw std::runtime_error("number of original cells should be greater than all subset indices");
+                }
+                original.append(num_original - expected, false);
+            }
+
+            original.finish();
+            subsetted = true;
+        } else {
+            if (num_original && num_original != num_cells) {
+                throw std::runtime_error("number of original cells should be equal to the number of cells in the absence of subsetting");
+            }
+        }
+
+        if (view.has_discards()) {
+            auto dhandle = view.discards();
+            for (hsize_t start = 0; start < num_cells; start += block_size) {
+                hsize_t len = std::min(block_size, num_cells - start);
+                utils::read_rows(dhandle, start, len, 1, buffer.data());
+                for (hsize_t i = 0; i < len; ++i) {
+                    kept.push_back(buffer[i] == 0);
+                }
+            }
+            kept.finish();
+            filtered = true;
+        }
+
+        nsubset = num_cells;
+    }
+
+    /**
+     * @return Number of cells in the original input matrices.
+     */
+    size_t num_original() const {
+        return (subsetted ? original.size() : nsubset);
+    }
+
+    /**
+     * @return Number of cells after subsetting.
+     */
+    size_t num_subsetted() const {
+        return nsubset;
+    }
+
+    /**
+     * @return Number of cells after filtering.
+     */
+    size_t num_filtered() const {
+        return (filtered ? kept.count() : nsubset);
+    }
+
+    /**
+     * @param i Index of a cell in the original space.
+     * @return Index of the same cell in the subsetted space, or -1 if it was not retained by the subset.
+     */
+    long long original_to_subsetted(size_t i) const {
+        check(i, num_original());
+        if (!subsetted) {
+            return i;
+        }
+        return (original.get(i) ? static_cast<long long>(original.rank(i)) : -1);
+    }
+
+    /**
+     * @param i Index of a cell in the subsetted space.
+     * @return Index of the same cell in the original space.
+     */
+    size_t subsetted_to_original(size_t i) const {
+        check(i, nsubset);
+        return (subsetted ? original.select(i) : i);
+    }
+
+    /**
+     * @param i Index of a cell in the subsetted space.
+     * @return Index of the same cell in the filtered space, or -1 if it was discarded.
+     */
+    long long subsetted_to_filtered(size_t i) const {
+        check(i, nsubset);
+        if (!filtered) {
+            return i;
+        }
+        return (kept.get(i) ? static_cast<long long>(kept.rank(i)) : -1);
+    }
+
+    /**
+     * @param i Index of a cell in the filtered space.
+     * @return Index of the same cell in the subsetted space.
+     */
+    size_t filtered_to_subsetted(size_t i) const {
+        check(i, num_filtered());
+        return (filtered ? kept.select(i) : i);
+    }
+
+    /**
+     * @param i Index of a cell in the original space.
+     * @return Index of the same cell in the filtered space, or -1 if it was not retained by the subset or was discarded.
+     */
+    long long original_to_filtered(size_t i) const {
+        auto s = original_to_subsetted(i);
+        return (s < 0 ? -1 : subsetted_to_filtered(s));
+    }
+
+    /**
+     * @param i Index of a cell in the filtered space.
+     * @return Index of the same cell in the original space.
+     */
+    size_t filtered_to_original(size_t i) const {
+        return subsetted_to_original(filtered_to_subsetted(i));
+    }
+
+private:
+    BitVector original, kept;
+    bool subsetted = false, filtered = false;
+    size_t nsubset = 0;
+
+    static void check(size_t i, size_t n) {
+        if (i >= n) {
+            throw std::out_of_range("cell index " + std::to_string(i) + " is out of range");
+        }
+    }
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,360 @@
+#ifndef KANAVAL_COLUMNAR_V3_HPP
+#define KANAVAL_COLUMNAR_V3_HPP
+
+#include "H5Cpp.h"
+#include "state_view.hpp"
+#include "../arrow.hpp"
+#include "../subset.hpp"
+#include "../utils.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <ostream>
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @file columnar.hpp
+ *
+ * @brief Export per-cell and per-feature results from a v3 state file as Arrow record batches.
+ */
+
+namespace kanaval {
+
+namespace v3 {
+
+namespace columnar {
+
+// A source of one or more consecutive output columns.
+// This is usually a dataset, where datasets with multiple columns (e.g., the embedding) supply one output column per dataset column.
+struct Source {
+    enum class Kind { DATASET, SELECTION, INDEX };
+    Kind kind = Kind::DATASET;
+    arrow::Type type = arrow::Type::FLOAT64;
+
+    H5::DataSet dataset;
+    hsize_t ncols = 1;
+
+    // Whether the rows refer to the filtered cells, in which case discarded cells are reported as nulls.
+    bool filtered = false;
+
+    // Sorted indices of the cells in a custom selection.
+    std::vector<int> members;
+
+    size_t first_column = 0;
+};
+
+inline void list_datasets(const H5::Group& handle, const std::string& prefix, std::vector<std::string>& output) {
+    auto n = handle.getNumObjs();
+    for (hsize_t i = 0; i < n; ++i) {
+        auto name = handle.getObjnameByIdx(i);
+        auto type = handle.childObjType(name);
+        if (type == H5O_TYPE_DATASET) {
+            output.push_back(prefix + name);
+        } else if (type == H5O_TYPE_GROUP) {
+            list_datasets(handle.openGroup(name), prefix + name + "/", output);
+        }
+    }
+}
+
+inline void add_source(Source source, const std::vector<std::string>& names, std::vector<Source>& sources, std::vector<arrow::Field>& fields) {
+    source.first_column = fields.size();
+    for (const auto& n : names) {
+        fields.push_back(arrow::Field{ n, source.type, source.filtered });
+    }
+    sources.push_back(std::move(source));
+}
+
+// Fill a column from a strided array of values for the filtered cells, inserting nulls for discarded cells if `keep` is supplied.
+template<typename T>
+void fill_column(const T* values, size_t stride, const unsigned char* keep, size_t len, arrow::Type type, arrow::Column& column) {
+    std::vector<T> expanded(len);
+    if (keep) {
+        size_t k = 0;
+        for (size_t i = 0; i < len; ++i) {
+            if (keep[i]) {
+                expanded[i] = values[k * stride];
+                ++k;
+            } else {
+                ++column.null_count;
+            }
+        }
+        if (column.null_count) {
+            arrow::pack_bits(keep, len, column.validity);
+        }
+    } else {
+        for (size_t i = 0; i < len; ++i) {
+            expanded[i] = values[i * stride];
+        }
+    }
+
+    if (type == arrow::Type::BOOL) {
+        std::vector<unsigned char> flags(len);
+        for (size_t i = 0; i < len; ++i) {
+            flags[i] = (expanded[i] != 0);
+        }
+        arrow::pack_bits(flags.data(), len, column.values);
+    } else {
+        arrow::fill_values(expanded.data(), len, column);
+    }
+}
+
+// Stream through `num_rows` rows in batches of `batch_size`, writing each batch after all its columns have been filled.
+// Within each batch, sources are read and converted in parallel; reads are serialized by the `utils::RowReader`s,
+// but decompression (if possible) and conversion to the Arrow layout are performed concurrently.
+// If `discards` is supplied, the sources marked as `filtered` have one row per retained cell.
+inline void write_table(std::ostream& stream, std::vector<arrow::Field> fields, const std::vector<Source>& sources, hsize_t num_rows, const H5::DataSet* discards, hsize_t batch_size, int num_threads) {
+    size_t ncolumns = fields.size();
+    arrow::StreamWriter writer(stream, std::move(fields));
+    batch_size = std::max(static_cast<hsize_t>(1), batch_size);
+
+    std::vector<std::unique_ptr<utils::RowReader<double> > > float_readers(sources.size());
+    std::vector<std::unique_ptr<utils::RowReader<int> > > int_readers(sources.size());
+    for (size_t s = 0; s < sources.size(); ++s) {
+        const auto& src = sources[s];
+        if (src.kind != Source::Kind::DATASET) {
+            continue;
+        } else if (src.type == arrow::Type::FLOAT64) {
+            float_readers[s].reset(new utils::RowReader<double>(src.dataset, src.ncols));
+        } else {
+            int_readers[s].reset(new utils::RowReader<int>(src.dataset, src.ncols));
+        }
+    }
+
+    std::unique_ptr<utils::RowReader<int> > discard_reader;
+    if (discards) {
+        discard_reader.reset(new utils::RowReader<int>(*discards, 1));
+    }
+
+    std::vector<int> discard_buffer;
+    std::vector<unsigned char> keep;
+    typename utils::RowReader<int>::Workspace discard_work;
+    hsize_t filtered_start = 0;
+
+    for (hsize_t start = 0; start < num_rows; start += batch_size) {
+        hsize_t len = std::min(batch_size, num_rows - start);
+        hsize_t filtered_len = len;
+        if (discards) {
+            discard_buffer.resize(len);
+            discard_reader->read(start, len, discard_buffer.data(), discard_work);
+            keep.resize(len);
+            filtered_len = 0;
+            for (hsize_t i = 0; i < len; ++i) {
+                keep[i] = (discard_buffer[i] == 0);
+                filtered_len += keep[i];
+            }
+        }
+
+        std::vector<arrow::Column> columns(ncolumns);
+        utils::parallelize(sources.size(), num_threads, [&](int, size_t first, size_t nsources) -> void {
+            std::vector<double> fbuffer;
+            std::vector<int> ibuffer;
+            std::vector<unsigned char> flags;
+            typename utils::RowReader<double>::Workspace fwork;
+            typename utils::RowReader<int>::Workspace iwork;
+
+            for (size_t s = first, end = first + nsources; s < end; ++s) {
+                const auto& src = sources[s];
+                const unsigned char* mask = (src.filtered && discards ? keep.data() : NULL);
+                hsize_t offset = (src.filtered ? filtered_start : start);
+                hsize_t count = (src.filtered ? filtered_len : len);
+
+                if (src.kind == Source::Kind::SELECTION) {
+                    flags.assign(count, 0);
+                    auto it = std::lower_bound(src.members.begin(), src.members.end(), static_cast<int>(offset));
+                    for (; it != src.members.end() && static_cast<hsize_t>(*it) < offset + count; ++it) {
+                        flags[*it - offset] = 1;
+                    }
+                    fill_column(flags.data(), 1, mask, len, src.type, columns[src.first_column]);
+
+                } else if (src.kind == Source::Kind::INDEX) {
+                    ibuffer.resize(count);
+                    for (hsize_t i = 0; i < count; ++i) {
+                        ibuffer[i] = offset + i;
+                    }
+                    fill_column(ibuffer.data(), 1, mask, len, src.type, columns[src.first_column]);
+
+                } else if (src.type == arrow::Type::FLOAT64) {
+                    fbuffer.resize(count * src.ncols);
+                    if (count) { // all cells in this batch may be discarded.
+                        float_readers[s]->read(offset, count, fbuffer.data(), fwork);
+                    }
+                    for (hsize_t c = 0; c < src.ncols; ++c) {
+                        fill_column(fbuffer.data() + c, src.ncols, mask, len, src.type, columns[src.first_column + c]);
+                    }
+
+                } else {
+                    ibuffer.resize(count * src.ncols);
+                    if (count) {
+                        int_readers[s]->read(offset, count, ibuffer.data(), iwork);
+                    }
+                    for (hsize_t c = 0; c < src.ncols; ++c) {
+                        fill_column(ibuffer.data() + c, src.ncols, mask, len, src.type, columns[src.first_column + c]);
+                    }
+                }
+            }
+        });
+
+        writer.write(len, columns);
+        filtered_start += filtered_len;
+    }
+
+    writer.close();
+}
+
+}
+
+/**
+ * Export the per-cell results of a validated state file as an Arrow IPC stream.
+ * Each row corresponds to a cell after subsetting, and the columns are:
+ *
+ * - `<modality>/<metric>`, containing the QC metrics for each available modality, e.g., `RNA/sums`.
+ * - `discard`, indicating whether the cell was discarded during filtering.
+ *   This is only present if cells were filtered, see `StateView::has_discards()`.
+ * - `PC<i>` for each dimension `i` (starting from 1) of the embedding used for downstream steps, see `StateView::embedding()`.
+ * - `cluster`, containing the cluster assignment for the chosen clustering method.
+ * - `tsne/x`, `tsne/y`, `umap/x` and `umap/y`, containing the coordinates of each cell.
+ * - `selection/<name>` for each custom selection, indicating whether the cell belongs to that selection.
+ *
+ * Results that are only computed for the retained cells (i.e., all columns after `discard`) are set to null for discarded cells.
+ *
+ * Cells are processed in batches, each of which is emitted as a separate record batch,
+ * so memory usage is bounded by `batch_size` rows regardless of the number of cells.
+ * Within each batch, the columns are filled in parallel.
+ *
+ * @param view View of a validated v3 state file.
+ * @param stream Output stream, opened in binary mode.
+ * @param batch_size Number of cells in each record batch.
+ * @param num_threads Number of threads to use.
+ */
+inline void export_cells(const StateView& view, std::ostream& stream, hsize_t batch_size = 65536, int num_threads = 1) {
+    std::vector<columnar::Source> sources;
+    std::vector<arrow::Field> fields;
+    const auto& summary = view.summary();
+
+    for (const auto& mod : std::vector<std::pair<std::string, std::string> >{ { "RNA", "rna" }, { "ADT", "adt" }, { "CRISPR", "crispr" } }) {
+        if (summary.qc_remaining.find(mod.first) == summary.qc_remaining.end()) {
+            continue;
+        }
+
+        auto mhandle = utils::check_and_open_group(view.results(mod.second + "_quality_control"), "metrics");
+        std::vector<std::string> metrics;
+        columnar::list_datasets(mhandle, "", metrics);
+        for (const auto& m : metrics) {
+            columnar::Source src;
+            src.dataset = mhandle.openDataSet(m);
+            src.type = (src.dataset.getTypeClass() == H5T_INTEGER ? arrow::Type::INT32 : arrow::Type::FLOAT64);
+            columnar::add_source(std::move(src), { mod.first + "/" + m }, sources, fields);
+        }
+    }
+
+    std::unique_ptr<H5::DataSet> discards;
+    if (view.has_discards()) {
+        discards.reset(new H5::DataSet(view.discards()));
+        columnar::Source src;
+        src.dataset = *discards;
+        src.type = arrow::Type::BOOL;
+        columnar::add_source(std::move(src), { "discard" }, sources, fields);
+    }
+
+    {
+        columnar::Source src;
+        src.dataset = view.embedding();
+        src.ncols = utils::row_extent(src.dataset).second;
+        src.filtered = true;
+        std::vector<std::string> names;
+        for (hsize_t i = 0; i < src.ncols; ++i) {
+            names.push_back("PC" + std::to_string(i + 1));
+        }
+        columnar::add_source(std::move(src), names, sources, fields);
+    }
+
+    {
+        columnar::Source src;
+        src.dataset = view.clusters();
+        src.type = arrow::Type::INT32;
+        src.filtered = true;
+        columnar::add_source(std::move(src), { "cluster" }, sources, fields);
+    }
+
+    for (const auto& emb : std::vector<std::pair<std::string, std::pair<H5::DataSet, H5::DataSet> > >{ { "tsne", view.tsne() }, { "umap", view.umap() } }) {
+        columnar::Source x;
+        x.dataset = emb.second.first;
+        x.filtered = true;
+        columnar::add_source(std::move(x), { emb.first + "/x" }, sources, fields);
+
+        columnar::Source y;
+        y.dataset = emb.second.second;
+        y.filtered = true;
+        columnar::add_source(std::move(y), { emb.first + "/y" }, sources, fields);
+    }
+
+    {
+        auto chandle = utils::check_and_open_group(view.file(), "custom_selections");
+        auto phandle = utils::check_and_open_group(chandle, "parameters");
+        auto shandle = utils::check_and_open_group(phandle, "selections");
+        auto nsel = shandle.getNumObjs();
+        for (hsize_t s = 0; s < nsel; ++s) {
+            auto name = shandle.getObjnameByIdx(s);
+            columnar::Source src;
+            src.kind = columnar::Source::Kind::SELECTION;
+            src.type = arrow::Type::BOOL;
+            src.filtered = true;
+            src.members = subset::selection_indices(view.file(), name);
+            columnar::add_source(std::move(src), { "selection/" + name }, sources, fields);
+        }
+    }
+
+    columnar::write_table(stream, std::move(fields), sources, summary.inputs.num_cells, discards.get(), batch_size, num_threads);
+}
+
+/**
+ * Export the marker statistics for a cluster or custom selection as an Arrow IPC stream.
+ * Each row corresponds to a feature, and the columns are:
+ *
+ * - `feature`, containing the index of the feature.
+ * - One column for each statistic in `group`, named by its path relative to `group`, e.g., `means`, `lfc/min_rank`.
+ *
+ * Features are processed in batches, each of which is emitted as a separate record batch.
+ *
+ * @param group Group containing the marker statistics, e.g., from `StateView::markers()` or `StateView::selection()`.
+ * @param stream Output stream, opened in binary mode.
+ * @param batch_size Number of features in each record batch.
+ * @param num_threads Number of threads to use.
+ */
+inline void export_markers(const H5::Group& group, std::ostream& stream, hsize_t batch_size = 65536, int num_threads = 1) {
+    std::vector<std::string> statistics;
+    columnar::list_datasets(group, "", statistics);
+    if (statistics.empty()) {
+        throw std::runtime_error("no marker statistics available for export");
+    }
+
+    std::vector<columnar::Source> sources;
+    std::vector<arrow::Field> fields;
+    {
+        columnar::Source src;
+        src.kind = columnar::Source::Kind::INDEX;
+        src.type = arrow::Type::INT32;
+        columnar::add_source(std::move(src), { "feature" }, sources, fields);
+    }
+
+    hsize_t num_features = 0;
+    for (size_t s = 0; s < statistics.size(); ++s) {
+        columnar::Source src;
+        src.dataset = group.openDataSet(statistics[s]);
+        auto dims = utils::load_dataset_dimensions(src.dataset);
+        if (dims.size() != 1 || (s && dims[0] != num_features)) {
+            throw std::runtime_error("'" + statistics[s] + "' should be a 1-dimensional dataset of length equal to the number of features");
+        }
+        num_features = dims[0];
+        columnar::add_source(std::move(src), { statistics[s] }, sources, fields);
+    }
+
+    columnar::write_table(stream, std::move(fields), sources, num_features, NULL, batch_size, num_threads);
+}
+
+}
+
+}
+
+#endif
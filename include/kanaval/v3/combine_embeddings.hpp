@@ -11,12 +11,14 @@ namespace kanaval {
 
 namespace v3 {
 
-inline int validate_combine_embeddings(const H5::H5File& handle, int num_cells, const std::unordered_map<std::string, int>& modalities, int version) {
+// If `used` is supplied, it is filled with the available modalities that have non-zero weights.
+inline int validate_combine_embeddings(const H5::H5File& handle, int num_cells, const std::unordered_map<std::string, int>& modalities, int version, const Options& options = Options(), std::vector<std::string>* used = nullptr) {
     auto xhandle = utils::check_and_open_group(handle, "combine_embeddings");
 
     // Checking the parameters.
     int total_dims = 0;
     int num_modalities = 0;
+    std::vector<std::string> found;
     try {
         auto phandle = utils::check_and_open_group(xhandle, "parameters");
         utils::check_and_open_scalar(phandle, "approximate", H5T_INTEGER);
@@ -27,6 +29,7 @@ inline int validate_combine_embeddings(const H5::H5File& handle, int num_cells,
                 if (it != modalities.end()) {
                     ++num_modalities;
                     total_dims += it->second;
+                    found.push_back(target);
                 }
             }
         };
@@ -47,12 +50,18 @@ inline int validate_combine_embeddings(const H5::H5File& handle, int num_cells,
 
         if (num_modalities > 1) {
             std::vector<size_t> pdims { static_cast<size_t>(num_cells), static_cast<size_t>(total_dims) };
-            utils::check_and_open_dataset(rhandle, "combined", H5T_FLOAT, pdims);
+            auto chandle = utils::check_and_open_dataset(rhandle, "combined", H5T_FLOAT, pdims);
+            if (options.deep) {
+                utils::check_finite({ { "combined", &chandle } }, options);
+            }
         }
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'combine_embeddings'");
     }
 
+    if (used) {
+        *used = std::move(found);
+    }
     return total_dims;
 }
 
@@ -12,7 +12,7 @@ namespace kanaval {
 
 namespace v3 {
 
-inline int validate_crispr_pca(const H5::H5File& handle, int num_cells, bool crispr_available, int version) {
+inline int validate_crispr_pca(const H5::H5File& handle, int num_cells, bool crispr_available, int version, const Options& options = Options()) {
     auto xhandle = utils::check_and_open_group(handle, "crispr_pca");
 
     int npcs;
@@ -27,7 +27,7 @@ inline int validate_crispr_pca(const H5::H5File& handle, int num_cells, bool cri
     try {
         auto rhandle = utils::check_and_open_group(xhandle, "results");
         if (crispr_available) {
-            obs_pcs = pca::check_pca_contents(rhandle, npcs, num_cells);
+            obs_pcs = pca::check_pca_contents(rhandle, npcs, num_cells, options);
         }
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'crispr_pca'");
@@ -3,14 +3,18 @@
 
 #include "H5Cpp.h"
 #include <vector>
+#include <limits>
+#include <cmath>
+#include <algorithm>
 #include "../utils.hpp"
 #include "quality_control.hpp"
+#include "../options.hpp"
 
 namespace kanaval {
 
 namespace v3 {
 
-inline int validate_crispr_quality_control(const H5::H5File& handle, int num_cells, int num_blocks, bool crispr_available, int version) {
+inline int validate_crispr_quality_control(const H5::H5File& handle, int num_cells, int num_blocks, bool crispr_available, int version, int num_features = -1, const Options& options = Options()) {
     auto xhandle = utils::check_and_open_group(handle, "crispr_quality_control");
 
     try {
@@ -29,9 +33,24 @@ inline int validate_crispr_quality_control(const H5::H5File& handle, int num_cel
             xhandle, 
             num_cells, 
             num_blocks, 
-            { { "sums", H5T_FLOAT }, { "detected", H5T_INTEGER }, { "max_proportion", H5T_FLOAT }, { "max_index", H5T_INTEGER }},
+            { 
+                { "sums", H5T_FLOAT, 0 }, 
+                { "detected", H5T_INTEGER, 0, (num_features >= 0 ? num_features : std::numeric_limits<double>::max()) }, 
+                { "max_proportion", H5T_FLOAT, 0, 1 }, 
+                { "max_index", H5T_INTEGER, 0, (num_features >= 0 ? num_features - 1 : std::numeric_limits<double>::max()) }
+            },
             { "max_count" },
-            crispr_available
+            crispr_available,
+            [](size_t n, const std::vector<const double*>& metrics, const std::vector<double>& thresholds, unsigned char* expected) -> void {
+                // The maximum count is not stored, so we recompute it from the sum and proportion.
+                // This may differ from the writer's value by round-off error, so counts close to the threshold could go either way.
+                const double* sums = metrics[0];
+                const double* max_proportion = metrics[2];
+                for (size_t i = 0; i < n; ++i) {
+                    expected[i] = quality_control::below_threshold(sums[i] * max_proportion[i], thresholds[0]);
+                }
+            },
+            options
         );
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'crispr_quality_control'");
@@ -6,16 +6,18 @@
 #include <unordered_map>
 #include "../utils.hpp"
 #include "markers.hpp"
+#include "../options.hpp"
 
 namespace kanaval {
 
 namespace v3 {
 
-inline void validate_custom_selections(const H5::Group& handle, int num_cells, const std::unordered_map<std::string, int>& modalities, int version) {
+inline std::vector<std::pair<std::string, int> > validate_custom_selections(const H5::Group& handle, int num_cells, const std::unordered_map<std::string, int>& modalities, int version, const Options& options = Options()) {
     auto cshandle = utils::check_and_open_group(handle, "custom_selections");
 
     // Checking the parameters.
     std::vector<std::string> selections;
+    std::vector<std::pair<std::string, int> > sizes;
     bool has_auc;
     try {
         auto phandle = utils::check_and_open_group(cshandle, "parameters");
@@ -36,6 +38,8 @@ inline void validate_custom_selections(const H5::Group& handle, int num_cells, c
             if (!utils::is_unique_and_sorted(involved)) {
                 throw std::runtime_error("indices should be sorted and unique for selection '" + selections.back() + "'");
             }
+
+            sizes.emplace_back(name, involved.size());
         }
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve parameters from 'custom_selections'");
@@ -49,9 +53,14 @@ inline void validate_custom_selections(const H5::Group& handle, int num_cells, c
             throw std::runtime_error("number of groups in 'per_selection' is not consistent with the expected number of selections");
         }
 
+        std::vector<H5::Group> shandles;
+        shandles.reserve(selections.size());
+        std::vector<markers::Task> tasks;
+
         for (const auto& s : selections) {
             try {
-                auto shandle = utils::check_and_open_group(mhandle, s);
+                shandles.push_back(utils::check_and_open_group(mhandle, s));
+                const auto& shandle = shandles.back();
                 for (const auto& mod : modalities) {
                     std::vector<size_t> dims{ static_cast<size_t>(mod.second) };
 
@@ -69,17 +78,36 @@ inline void validate_custom_selections(const H5::Group& handle, int num_cells, c
                     } catch (std::exception& e) {
                         throw utils::combine_errors(e, "failed to retrieve statistics for modality '" + mod.first + "'");
                     }
+
+                    if (options.deep) {
+                        tasks.push_back(markers::Task{ &shandle, mod.first, dims[0], "failed to retrieve statistics for selection '" + s + "' in 'results/per_selection'\n  - failed to retrieve statistics for modality '" + mod.first + "'" });
+                    }
                 }
             } catch (std::exception& e) {
                 throw utils::combine_errors(e, "failed to retrieve statistics for selection '" + s + "' in 'results/per_selection'");
             }
         }
 
+        if (options.deep) {
+            std::vector<std::string> datasets { "means", "detected" };
+            if (has_auc) {
+                datasets.push_back("auc");
+            }
+
+            markers::check_statistics(tasks, datasets, options, [&](const std::vector<std::vector<double> >& values, size_t) -> void {
+                markers::check_finite(values[0], "means");
+                markers::check_proportion(values[1], "detected");
+                if (has_auc) {
+                    markers::check_proportion(values[2], "auc");
+                }
+            });
+        }
+
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'custom_selections'");
     }
 
-    return;
+    return sizes;
 }
 
 }
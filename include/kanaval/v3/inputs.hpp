@@ -21,7 +21,7 @@ namespace inputs {
 inline size_t check_datasets(const H5::Group& phandle, bool embedded) {
     auto dhandle = utils::check_and_open_group(phandle, "datasets");
     size_t ndatasets = dhandle.getNumObjs();
-    int last = 0;
+    long long last = 0; // 64-bit, as embedded files can be several GB.
     std::unordered_set<std::string> used_names;
 
     for (size_t d = 0; d < ndatasets; ++d) {
@@ -45,7 +45,7 @@ inline size_t check_datasets(const H5::Group& phandle, bool embedded) {
                     utils::load_string(curfhandle, "name");
 
                     if (embedded) {
-                        int offset = utils::load_integer_scalar(curfhandle, "offset");
+                        auto offset = utils::load_integer_scalar<long long>(curfhandle, "offset");
                         if (offset < 0) {
                             throw std::runtime_error("offset should be non-negative");
                         }
@@ -53,7 +53,7 @@ inline size_t check_datasets(const H5::Group& phandle, bool embedded) {
                             throw std::runtime_error("byte range is not contiguous with previous file");
                         }
 
-                        int size = utils::load_integer_scalar(curfhandle, "size");
+                        auto size = utils::load_integer_scalar<long long>(curfhandle, "size");
                         if (size < 0) {
                             throw std::runtime_error("size should be non-negative");
                         }
@@ -6,12 +6,13 @@
 #include <unordered_map>
 #include "../utils.hpp"
 #include "markers.hpp"
+#include "../options.hpp"
 
 namespace kanaval {
 
 namespace v3 {
 
-inline void validate_marker_detection(const H5::Group& handle, int num_clusters, const std::unordered_map<std::string, int>& modalities, int version) {
+inline void validate_marker_detection(const H5::Group& handle, int num_clusters, const std::unordered_map<std::string, int>& modalities, int version, const Options& options = Options()) {
     auto xhandle = utils::check_and_open_group(handle, "marker_detection");
 
     // Checking the parameters.
@@ -27,8 +28,14 @@ inline void validate_marker_detection(const H5::Group& handle, int num_clusters,
     try {
         auto rhandle = utils::check_and_open_group(xhandle, "results");
         auto chandle = utils::check_and_open_group(rhandle, "per_cluster");
+
+        std::vector<H5::Group> mohandles;
+        mohandles.reserve(modalities.size());
+        std::vector<markers::Task> tasks;
+
         for (const auto& mod : modalities) {
-            auto mohandle = utils::check_and_open_group(chandle, mod.first);
+            mohandles.push_back(utils::check_and_open_group(chandle, mod.first));
+            const auto& mohandle = mohandles.back();
             if (mohandle.getNumObjs() != num_clusters) {
                 throw std::runtime_error("number of groups in 'per_cluster/" + mod.first + "' is not consistent with the expected number of clusters");
             }
@@ -57,8 +64,45 @@ inline void validate_marker_detection(const H5::Group& handle, int num_clusters,
                 } catch (std::exception& e) {
                     throw utils::combine_errors(e, "failed to retrieve statistics for cluster " + std::to_string(i) + " in 'per_cluster/" + mod.first + "'");
                 }
+
+                if (options.deep) {
+                    tasks.push_back(markers::Task{ &mohandle, std::to_string(i), dims[0], "failed to retrieve statistics for cluster " + std::to_string(i) + " in 'per_cluster/" + mod.first + "'" });
+                }
             }
         }
+
+        if (options.deep) {
+            std::vector<std::string> datasets { "means", "detected" };
+            std::vector<std::string> used;
+            for (const auto& eff : markers::effects) {
+                if (!has_auc && eff == "auc") {
+                    continue;
+                }
+                used.push_back(eff);
+                datasets.push_back(eff + "/mean");
+                datasets.push_back(eff + "/min");
+                datasets.push_back(eff + "/min_rank");
+            }
+
+            markers::check_statistics(tasks, datasets, options, [&](const std::vector<std::vector<double> >& values, size_t num_features) -> void {
+                markers::check_finite(values[0], "means");
+                markers::check_proportion(values[1], "detected");
+
+                for (size_t e = 0; e < used.size(); ++e) {
+                    const auto& eff = used[e];
+                    const auto& mean = values[2 + 3 * e];
+                    const auto& min = values[3 + 3 * e];
+                    const auto& min_rank = values[4 + 3 * e];
+
+                    if (eff == "auc") {
+                        markers::check_proportion(mean, eff + "/mean");
+                        markers::check_proportion(min, eff + "/min");
+                    }
+                    markers::check_min_mean(min, mean, eff);
+                    markers::check_range(min_rank, 1, num_features, eff + "/min_rank", "lie in [1, " + std::to_string(num_features) + "]");
+                }
+            });
+        }
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'marker_detection'");
     }
@@ -3,6 +3,14 @@
 
 #include "H5Cpp.h"
 #include <vector>
+#include <string>
+#include <limits>
+#include <mutex>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include "../utils.hpp"
+#include "../options.hpp"
 
 namespace kanaval {
 
@@ -20,6 +28,110 @@ inline bool check_common_parameters(const H5::Group& phandle) {
     return utils::load_integer_scalar<>(phandle, "compute_auc");
 }
 
+// A group of statistics to be checked in deep mode, e.g., for one cluster in one modality.
+struct Task {
+    const H5::Group* parent;
+    std::string name;
+    size_t num_features;
+    std::string context;
+};
+
+inline void check_range(const std::vector<double>& values, double lower, double upper, const std::string& name, const std::string& requirement) {
+    auto pos = utils::first_outside(values.data(), values.size(), lower, upper);
+    if (pos < values.size()) {
+        throw std::runtime_error("'" + name + "' should " + requirement + " (first violation at feature " + std::to_string(pos) + ")");
+    }
+}
+
+inline void check_proportion(const std::vector<double>& values, const std::string& name) {
+    check_range(values, 0, 1, name, "lie in [0, 1]");
+}
+
+inline void check_finite(const std::vector<double>& values, const std::string& name) {
+    constexpr double limit = std::numeric_limits<double>::max();
+    check_range(values, -limit, limit, name, "be finite");
+}
+
+// Whether `min` is greater than `mean`, beyond a small relative tolerance.
+// When a feature has the same effect size in all comparisons, the mean of the effects can end up slightly below their minimum due to round-off,
+// e.g., (0.7 + 0.7 + 0.7) / 3 < 0.7 in double precision.
+inline bool exceeds_mean(double min, double mean) {
+    constexpr double tolerance = 1e-8;
+    return min > mean + tolerance * std::max({ std::abs(min), std::abs(mean), 1.0 });
+}
+
+// Check that `min` is no greater than `mean` for an effect size summary, ignoring NaNs.
+inline void check_min_mean(const std::vector<double>& min, const std::vector<double>& mean, const std::string& effect) {
+    size_t n = min.size();
+    int bad = 0;
+    for (size_t i = 0; i < n; ++i) {
+        bad |= exceeds_mean(min[i], mean[i]);
+    }
+    if (bad) {
+        for (size_t i = 0; i < n; ++i) {
+            if (exceeds_mean(min[i], mean[i])) {
+                throw std::runtime_error("'" + effect + "/min' should be no greater than '" + effect + "/mean' (first violation at feature " + std::to_string(i) + ")");
+            }
+        }
+    }
+}
+
+// Check the statistics for each task in parallel.
+// For each task, all `datasets` in the group are opened in one batch while holding the `utils::hdf5_mutex()`,
+// and their contents are loaded by `utils::RowReader`s so that contiguous or compressed datasets can be read and decompressed without the lock.
+// `check` is then called on the loaded vectors (in the same order as `datasets`) and the number of features without the lock.
+// The error for the earliest failing task is rethrown with the task's context.
+template<class Check>
+void check_statistics(const std::vector<Task>& tasks, const std::vector<std::string>& datasets, const Options& options, Check check) {
+    std::vector<std::string> errors(tasks.size());
+    std::atomic<bool> failed(false);
+
+    utils::parallelize(tasks.size(), options.num_threads, [&](int, size_t start, size_t len) -> void {
+        std::vector<std::vector<double> > buffers(datasets.size());
+        std::vector<H5::DataSet> handles;
+        std::vector<utils::RowReader<double> > readers;
+        handles.reserve(datasets.size()); // readers hold pointers to the handles, so we can't reallocate.
+        readers.reserve(datasets.size());
+        typename utils::RowReader<double>::Workspace work;
+
+        for (size_t t = start, end = start + len; t < end && !failed; ++t) {
+            const auto& current = tasks[t];
+            try {
+                {
+                    std::lock_guard<std::mutex> lck(utils::hdf5_mutex());
+                    auto ghandle = current.parent->openGroup(current.name);
+                    for (size_t d = 0; d < datasets.size(); ++d) {
+                        handles.push_back(ghandle.openDataSet(datasets[d]));
+                        readers.emplace_back(handles.back(), 1);
+                    }
+                }
+                for (size_t d = 0; d < datasets.size(); ++d) {
+                    buffers[d].resize(current.num_features);
+                    readers[d].read(0, current.num_features, buffers[d].data(), work);
+                }
+                check(static_cast<const std::vector<std::vector<double> >&>(buffers), current.num_features);
+            } catch (std::exception& e) {
+                errors[t] = e.what();
+                failed = true;
+            } catch (H5::Exception& e) {
+                errors[t] = e.getDetailMsg();
+                failed = true;
+            }
+
+            // Closing the handles also involves the HDF5 library.
+            std::lock_guard<std::mutex> lck(utils::hdf5_mutex());
+            readers.clear();
+            handles.clear();
+        }
+    });
+
+    for (size_t t = 0; t < tasks.size(); ++t) {
+        if (!errors[t].empty()) {
+            throw std::runtime_error(tasks[t].context + "\n  - " + errors[t]);
+        }
+    }
+}
+
 }
 
 }
@@ -35,7 +35,7 @@ inline int check_parameters(const H5::Group& phandle) {
 }
 
 template<class Object>
-size_t check_pca_contents(const Object& rhandle, int max_pcs, int num_cells) {
+size_t check_pca_contents(const Object& rhandle, int max_pcs, int num_cells, const Options& options = Options()) {
     auto vhandle = utils::check_and_open_dataset(rhandle, "var_exp", H5T_FLOAT);
     auto dspace = vhandle.getSpace();
     if (dspace.getSimpleExtentNdims() != 1) {
@@ -48,7 +48,13 @@ size_t check_pca_contents(const Object& rhandle, int max_pcs, int num_cells) {
         throw std::runtime_error("length of 'var_exp' dataset exceeds the requested number of PCs");
     }
     
-    utils::check_and_open_dataset(rhandle, "pcs", H5T_FLOAT, { static_cast<size_t>(num_cells), static_cast<size_t>(observed) });
+    auto phandle = utils::check_and_open_dataset(rhandle, "pcs", H5T_FLOAT, { static_cast<size_t>(num_cells), static_cast<size_t>(observed) });
+
+    if (options.deep) {
+        utils::check_var_exp_values(vhandle, observed);
+        utils::check_finite({ { "pcs", &phandle } }, options);
+    }
+
     return observed;
 }
 
@@ -3,7 +3,14 @@
 
 #include "H5Cpp.h"
 #include <vector>
+#include <string>
+#include <limits>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+#include <mutex>
 #include "../utils.hpp"
+#include "../options.hpp"
 
 namespace kanaval {
 
@@ -11,6 +18,47 @@ namespace v3 {
 
 namespace quality_control {
 
+// Description of a QC metric.
+// In deep mode, all values should be finite and lie in `[lower, upper]`.
+struct Metric {
+    std::string name;
+    H5T_class_t type;
+    double lower = -std::numeric_limits<double>::max();
+    double upper = std::numeric_limits<double>::max();
+};
+
+// Recompute the discard status for a block of `n` cells, given the pointers to the metric values for that block
+// (in the same order as the metrics passed to `validate_results()`) and the threshold values for the first block
+// (in the same order as the thresholds). Cells that should be discarded are marked by setting `expected` to 1,
+// while cells that lie too close to the threshold to be reliably recomputed are marked with `AMBIGUOUS` and are not checked.
+constexpr unsigned char AMBIGUOUS = 2;
+
+typedef std::function<void(size_t n, const std::vector<const double*>& metrics, const std::vector<double>& thresholds, unsigned char* expected)> DiscardRule;
+
+// Whether `value` lies below `threshold`, or `AMBIGUOUS` if the two are within a relative tolerance of each other.
+// The spec only requires a float type for the metrics, so a writer may store them in single precision after computing the discards in double;
+// the tolerance also covers any round-off when a metric has to be recomputed from other stored values.
+inline unsigned char below_threshold(double value, double threshold) {
+    constexpr double tolerance = 1e-6;
+    if (std::abs(value - threshold) <= tolerance * std::max(std::abs(value), std::abs(threshold))) {
+        return AMBIGUOUS;
+    }
+    return value < threshold;
+}
+
+inline unsigned char above_threshold(double value, double threshold) {
+    auto status = below_threshold(value, threshold);
+    return (status == AMBIGUOUS ? status : !status);
+}
+
+// A cell is discarded if it fails any filter, even if it is ambiguous for the others.
+inline unsigned char either_threshold(unsigned char left, unsigned char right) {
+    if (left == 1 || right == 1) {
+        return 1;
+    }
+    return std::max(left, right);
+}
+
 template<class Object>
 int check_discard_vector(const Object& rhandle, size_t num_cells) {
     int remaining = 0;
@@ -31,39 +79,161 @@ int check_discard_vector(const Object& rhandle, size_t num_cells) {
     return remaining;
 }
 
+inline std::string format_bound(double x) {
+    if (x == std::floor(x) && std::abs(x) < 1e15) {
+        return std::to_string(static_cast<long long>(x));
+    } else {
+        return std::to_string(x);
+    }
+}
+
+inline std::string describe_bounds(const Metric& m) {
+    constexpr double limit = std::numeric_limits<double>::max();
+    if (m.lower == -limit && m.upper == limit) {
+        return "finite";
+    } else if (m.upper == limit) {
+        return "finite and no less than " + format_bound(m.lower);
+    } else if (m.lower == -limit) {
+        return "finite and no greater than " + format_bound(m.upper);
+    } else {
+        return "finite and lie in [" + format_bound(m.lower) + ", " + format_bound(m.upper) + "]";
+    }
+}
+
+// Stream through the metrics and discards in a single pass, checking the bounds of each metric,
+// counting the number of retained cells and (for a single block) comparing the discards to those computed by `rule`.
+inline int check_contents(
+    const H5::Group& rhandle,
+    int num_cells,
+    int num_blocks,
+    const std::vector<Metric>& metrics,
+    const std::vector<H5::DataSet>& mhandles,
+    const std::vector<std::string>& thresholds,
+    const std::vector<H5::DataSet>& thandles,
+    const DiscardRule& rule,
+    const Options& options)
+{
+    std::vector<double> first_thresholds;
+    for (size_t t = 0; t < thresholds.size(); ++t) {
+        std::vector<double> values(num_blocks);
+        thandles[t].read(values.data(), H5::PredType::NATIVE_DOUBLE);
+        auto pos = utils::first_nonfinite(values.data(), values.size());
+        if (pos < values.size()) {
+            throw std::runtime_error("'thresholds/" + thresholds[t] + "' should contain finite values (first violation in block " + std::to_string(pos) + ")");
+        }
+        first_thresholds.push_back(num_blocks ? values.front() : 0);
+    }
+
+    H5::DataSet dihandle;
+    try {
+        std::vector<size_t> dims{ static_cast<size_t>(num_cells) };
+        dihandle = utils::check_and_open_dataset(rhandle, "discards", H5T_INTEGER, dims);
+    } catch (std::exception& e) {
+        throw utils::combine_errors(e, "failed to retrieve discard information from 'results'");
+    }
+
+    std::vector<const H5::DataSet*> everything;
+    for (const auto& m : mhandles) {
+        everything.push_back(&m);
+    }
+    everything.push_back(&dihandle);
+
+    const bool compare = (rule && num_blocks == 1);
+    constexpr hsize_t none = std::numeric_limits<hsize_t>::max();
+    std::vector<hsize_t> first_bad(metrics.size(), none);
+    hsize_t first_mismatch = none;
+    int remaining = 0;
+    std::mutex record;
+
+    utils::process_aligned_blocks<double>(everything, num_cells, options, [&](int, hsize_t start, hsize_t len, const std::vector<const double*>& values) -> void {
+        std::vector<hsize_t> local_bad(metrics.size(), none);
+        for (size_t m = 0; m < metrics.size(); ++m) {
+            auto pos = utils::first_outside(values[m], len, metrics[m].lower, metrics[m].upper);
+            if (pos < len) {
+                local_bad[m] = start + pos;
+            }
+        }
+
+        const double* discards = values.back();
+        int local_remaining = 0;
+        for (hsize_t i = 0; i < len; ++i) {
+            local_remaining += (discards[i] == 0);
+        }
+
+        hsize_t local_mismatch = none;
+        if (compare) {
+            std::vector<unsigned char> expected(len);
+            rule(len, values, first_thresholds, expected.data());
+            for (hsize_t i = 0; i < len; ++i) {
+                if (expected[i] != AMBIGUOUS && expected[i] != (discards[i] != 0)) {
+                    local_mismatch = start + i;
+                    break;
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lck(record);
+        remaining += local_remaining;
+        first_mismatch = std::min(first_mismatch, local_mismatch);
+        for (size_t m = 0; m < metrics.size(); ++m) {
+            first_bad[m] = std::min(first_bad[m], local_bad[m]);
+        }
+    });
+
+    for (size_t m = 0; m < metrics.size(); ++m) {
+        if (first_bad[m] != none) {
+            throw std::runtime_error("'metrics/" + metrics[m].name + "' should be " + describe_bounds(metrics[m]) + " (first violation at cell " + std::to_string(first_bad[m]) + ")");
+        }
+    }
+
+    if (first_mismatch != none) {
+        throw std::runtime_error("'discards' is not consistent with the thresholds applied to the metrics (first mismatch at cell " + std::to_string(first_mismatch) + ")");
+    }
+
+    return remaining;
+}
+
 inline int validate_results(
     const H5::Group& handle, 
     int num_cells, 
     int num_blocks, 
-    const std::vector<std::pair<std::string, H5T_class_t> >& metrics,
+    const std::vector<Metric>& metrics,
     const std::vector<std::string>& thresholds,
-    bool in_use)
+    bool in_use,
+    const DiscardRule& rule = DiscardRule(),
+    const Options& options = Options())
 {
     auto rhandle = utils::check_and_open_group(handle, "results");
     int remaining = -1;
 
     if (in_use) {
+        std::vector<H5::DataSet> mhandles;
         try {
             auto mhandle = utils::check_and_open_group(rhandle, "metrics");
             std::vector<size_t> dims{ static_cast<size_t>(num_cells) };
             for (const auto& m : metrics) {
-                utils::check_and_open_dataset(mhandle, m.first, m.second, dims);
+                mhandles.push_back(utils::check_and_open_dataset(mhandle, m.name, m.type, dims));
             }
         } catch (std::exception& e) {
             throw utils::combine_errors(e, "failed to retrieve metrics from 'results'");
         }
 
+        std::vector<H5::DataSet> thandles;
         try {
             auto thandle = utils::check_and_open_group(rhandle, "thresholds");
             std::vector<size_t> dims{ static_cast<size_t>(num_blocks) };
             for (const auto& t : thresholds) {
-                utils::check_and_open_dataset(thandle, t, H5T_FLOAT, dims);
+                thandles.push_back(utils::check_and_open_dataset(thandle, t, H5T_FLOAT, dims));
             }
         } catch (std::exception& e) {
             throw utils::combine_errors(e, "failed to retrieve thresholds from 'results'");
         }
 
-        remaining = check_discard_vector(rhandle, num_cells);
+        if (options.deep) {
+            remaining = check_contents(rhandle, num_cells, num_blocks, metrics, mhandles, thresholds, thandles, rule, options);
+        } else {
+            remaining = check_discard_vector(rhandle, num_cells);
+        }
     }
 
     return remaining;
@@ -12,7 +12,7 @@ namespace kanaval {
 
 namespace v3 {
 
-inline int validate_rna_pca(const H5::H5File& handle, int num_cells, bool rna_available, int version) {
+inline int validate_rna_pca(const H5::H5File& handle, int num_cells, bool rna_available, int version, const Options& options = Options()) {
     auto xhandle = utils::check_and_open_group(handle, "rna_pca");
 
     int npcs;
@@ -31,7 +31,7 @@ inline int validate_rna_pca(const H5::H5File& handle, int num_cells, bool rna_av
     try {
         auto rhandle = utils::check_and_open_group(xhandle, "results");
         if (rna_available) {
-            obs_pcs = pca::check_pca_contents(rhandle, npcs, num_cells);
+            obs_pcs = pca::check_pca_contents(rhandle, npcs, num_cells, options);
         }
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'rna_pca'");
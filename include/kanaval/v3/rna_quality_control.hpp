@@ -3,14 +3,16 @@
 
 #include "H5Cpp.h"
 #include <vector>
+#include <limits>
 #include "../utils.hpp"
 #include "quality_control.hpp"
+#include "../options.hpp"
 
 namespace kanaval {
 
 namespace v3 {
 
-inline int validate_rna_quality_control(const H5::H5File& handle, int num_cells, int num_blocks, bool rna_available, int version) {
+inline int validate_rna_quality_control(const H5::H5File& handle, int num_cells, int num_blocks, bool rna_available, int version, int num_features = -1, const Options& options = Options()) {
     auto xhandle = utils::check_and_open_group(handle, "rna_quality_control");
 
     try {
@@ -32,9 +34,23 @@ inline int validate_rna_quality_control(const H5::H5File& handle, int num_cells,
             xhandle, 
             num_cells, 
             num_blocks, 
-            { { "sums", H5T_FLOAT }, { "detected", H5T_INTEGER }, { "proportion", H5T_FLOAT }},
+            { 
+                { "sums", H5T_FLOAT, 0 }, 
+                { "detected", H5T_INTEGER, 0, (num_features >= 0 ? num_features : std::numeric_limits<double>::max()) }, 
+                { "proportion", H5T_FLOAT, 0, 1 }
+            },
             { "sums", "detected", "proportion" },
-            rna_available
+            rna_available,
+            [](size_t n, const std::vector<const double*>& metrics, const std::vector<double>& thresholds, unsigned char* expected) -> void {
+                const double* sums = metrics[0];
+                const double* detected = metrics[1];
+                const double* proportion = metrics[2];
+                for (size_t i = 0; i < n; ++i) {
+                    auto status = quality_control::either_threshold(quality_control::below_threshold(sums[i], thresholds[0]), quality_control::above_threshold(proportion[i], thresholds[2]));
+                    expected[i] = quality_control::either_threshold(status, detected[i] < thresholds[1]);
+                }
+            },
+            options
         );
     } catch (std::exception& e) {
         throw utils::combine_errors(e, "failed to retrieve results from 'rna_quality_control'");
@@ -0,0 +1,228 @@
+#ifndef KANAVAL_STATE_VIEW_V3_HPP
+#define KANAVAL_STATE_VIEW_V3_HPP
+
+#include "H5Cpp.h"
+#include "_validate.hpp"
+#include "../utils.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+/**
+ * @file state_view.hpp
+ *
+ * @brief Typed view of a validated v3 state file.
+ */
+
+namespace kanaval {
+
+namespace v3 {
+
+/**
+ * @brief View of a validated v3 state file.
+ *
+ * This holds the facts derived during validation along with a handle to the file,
+ * so that downstream readers can access each step's results without re-deriving its structure.
+ * Groups are opened on first access and cached for subsequent calls.
+ *
+ * Accessors assume that the file has not been modified since validation.
+ * Instances are not thread-safe, consistent with the HDF5 library itself.
+ */
+class StateView {
+public:
+    /**
+     * @param handle Open handle to a validated HDF5 file.
+     * @param summary Summary of the facts derived during validation of `handle`.
+     */
+    StateView(const H5::H5File& handle, Summary summary) : handle(handle), facts(std::move(summary)) {}
+
+    /**
+     * @return Summary of the facts derived during validation.
+     */
+    const Summary& summary() const {
+        return facts;
+    }
+
+    /**
+     * @return Handle to the underlying file.
+     */
+    const H5::H5File& file() const {
+        return handle;
+    }
+
+    /**
+     * @param step Name of the step, see `steps::graph`.
+     * @return Handle to the `results` group of `step`.
+     */
+    const H5::Group& results(const std::string& step) const {
+        auto it = cache.find(step);
+        if (it == cache.end()) {
+            auto shandle = utils::check_and_open_group(handle, step);
+            it = cache.emplace(step, utils::check_and_open_group(shandle, "results")).first;
+        }
+        return it->second;
+    }
+
+    /**
+     * @param step Name of the step, see `steps::graph`.
+     * @param name Name of the dataset inside the `results` group of `step`.
+     * @return Handle to the dataset.
+     */
+    H5::DataSet dataset(const std::string& step, const std::string& name) const {
+        return utils::check_and_open_dataset(results(step), name);
+    }
+
+    /**
+     * @return Whether any modality was used to filter cells.
+     * If `false`, all cells are retained and `discards()` should not be called.
+     */
+    bool has_discards() const {
+        return !facts.filtering_modalities.empty();
+    }
+
+    /**
+     * @return Handle to a dataset of length equal to the number of cells, indicating whether each cell was discarded.
+     * This is taken from `cell_filtering` if multiple modalities were used for filtering, otherwise it is taken from the QC step of the single modality.
+     */
+    H5::DataSet discards() const {
+        const auto& used = facts.filtering_modalities;
+        if (used.empty()) {
+            throw std::runtime_error("no modality was used to filter cells");
+        } else if (used.size() > 1) {
+            return dataset("cell_filtering", "discards");
+        } else {
+            return dataset(qc_step(used.front()), "discards");
+        }
+    }
+
+    /**
+     * @param modality Name of the modality, e.g., `"RNA"`.
+     * @return Handle to a dataset containing the PCs for `modality`, with filtered cells in the rows and PCs in the columns.
+     */
+    H5::DataSet pcs(const std::string& modality) const {
+        if (facts.num_pcs.find(modality) == facts.num_pcs.end()) {
+            throw std::runtime_error("no PCs available for modality '" + modality + "'");
+        }
+        return dataset(pca_step(modality), "pcs");
+    }
+
+    /**
+     * @return Handle to a dataset containing the low-dimensional embedding used by downstream steps,
+     * with filtered cells in the rows and dimensions in the columns.
+     * This is the batch-corrected embedding if available, otherwise the combined embedding across modalities,
+     * otherwise the PCs of the single modality with non-zero weight.
+     */
+    H5::DataSet embedding() const {
+        if (facts.batch_corrected) {
+            return dataset("batch_correction", "corrected");
+        }
+
+        const auto& used = facts.embedding_modalities;
+        if (used.size() > 1) {
+            return dataset("combine_embeddings", "combined");
+        } else if (used.size() == 1) {
+            return pcs(used.front());
+        } else {
+            throw std::runtime_error("no modality was used to compute the embedding");
+        }
+    }
+
+    /**
+     * @return Handle to a dataset containing the cluster assignments for the chosen clustering method, with one entry per filtered cell.
+     */
+    H5::DataSet clusters() const {
+        if (facts.cluster_method == "snn_graph") {
+            return dataset("snn_graph_cluster", "clusters");
+        } else if (facts.cluster_method == "kmeans") {
+            return dataset("kmeans_cluster", "clusters");
+        } else {
+            throw std::runtime_error("unknown clustering method '" + facts.cluster_method + "'");
+        }
+    }
+
+    /**
+     * @return Handles to the datasets containing the t-SNE x- and y-coordinates, respectively, with one entry per filtered cell.
+     */
+    std::pair<H5::DataSet, H5::DataSet> tsne() const {
+        return std::make_pair(dataset("tsne", "x"), dataset("tsne", "y"));
+    }
+
+    /**
+     * @return Handles to the datasets containing the UMAP x- and y-coordinates, respectively, with one entry per filtered cell.
+     */
+    std::pair<H5::DataSet, H5::DataSet> umap() const {
+        return std::make_pair(dataset("umap", "x"), dataset("umap", "y"));
+    }
+
+    /**
+     * @param modality Name of the modality, e.g., `"RNA"`.
+     * @param cluster Index of the cluster.
+     * @return Handle to the group containing marker statistics for `cluster` in `modality`.
+     */
+    H5::Group markers(const std::string& modality, int cluster) const {
+        if (cluster < 0 || cluster >= facts.num_clusters) {
+            throw std::runtime_error("cluster index " + std::to_string(cluster) + " is out of range");
+        }
+        auto chandle = utils::check_and_open_group(results("marker_detection"), "per_cluster");
+        auto mhandle = utils::check_and_open_group(chandle, modality);
+        return utils::check_and_open_group(mhandle, std::to_string(cluster));
+    }
+
+    /**
+     * @param selection Name of the custom selection.
+     * @param modality Name of the modality, e.g., `"RNA"`.
+     * @return Handle to the group containing marker statistics for `selection` in `modality`.
+     */
+    H5::Group selection(const std::string& selection, const std::string& modality) const {
+        auto phandle = utils::check_and_open_group(results("custom_selections"), "per_selection");
+        auto shandle = utils::check_and_open_group(phandle, selection);
+        return utils::check_and_open_group(shandle, modality);
+    }
+
+private:
+    H5::H5File handle;
+    Summary facts;
+    mutable std::unordered_map<std::string, H5::Group> cache;
+
+    static std::string qc_step(const std::string& modality) {
+        if (modality == "RNA") {
+            return "rna_quality_control";
+        } else if (modality == "ADT") {
+            return "adt_quality_control";
+        } else {
+            return "crispr_quality_control";
+        }
+    }
+
+    static std::string pca_step(const std::string& modality) {
+        if (modality == "RNA") {
+            return "rna_pca";
+        } else if (modality == "ADT") {
+            return "adt_pca";
+        } else {
+            return "crispr_pca";
+        }
+    }
+};
+
+/**
+ * Validate the analysis state HDF5 file for version 3 of the kana format, and return a view for downstream readers.
+ * This is equivalent to calling `validate()` and constructing a `StateView` from the resulting `Summary`.
+ *
+ * @param handle Open handle to a HDF5 file.
+ * @param embedded Whether the data files are embedded.
+ * @param version Version of the kana file.
+ * @param options Options for validation.
+ *
+ * @return View of the validated file.
+ */
+inline StateView validate_view(const H5::H5File& handle, bool embedded, int version, const Options& options = Options()) {
+    return StateView(handle, validate(handle, embedded, version, options));
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef KANAVAL_TOP_MARKERS_V3_HPP
+#define KANAVAL_TOP_MARKERS_V3_HPP
+
+#include "H5Cpp.h"
+#include "markers.hpp"
+#include "../utils.hpp"
+#include <vector>
+#include <string>
+#include <queue>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+
+/**
+ * @file top_markers.hpp
+ *
+ * @brief Query the top markers from a validated v3 state file.
+ */
+
+namespace kanaval {
+
+namespace v3 {
+
+/**
+ * @brief Top markers for a cluster or custom selection.
+ */
+struct TopMarkers {
+    /**
+     * Indices of the top features, ordered from best to worst.
+     */
+    std::vector<hsize_t> features;
+
+    /**
+     * Value used to rank each feature in `features`.
+     * This is the minimum rank for marker detection, or the effect size for custom selections.
+     */
+    std::vector<double> scores;
+
+    /**
+     * Values of the requested statistics for each feature in `features`.
+     * Each key is the path to the statistic relative to the group for the cluster/selection, e.g., `"means"`, `"lfc/mean"`.
+     */
+    std::unordered_map<std::string, std::vector<double> > statistics;
+};
+
+namespace top_markers {
+
+// Stream through a vector of scores to find the `k` smallest values, with ties broken by index.
+// This uses a bounded max-heap so that memory usage only depends on `k` and `block_size`.
+// NaNs are treated as infinitely large, i.e., always ranked last.
+inline std::vector<std::pair<double, hsize_t> > select_smallest(const H5::DataSet& dhandle, size_t k, bool negate, hsize_t block_size) {
+    auto dims = utils::load_dataset_dimensions(dhandle);
+    if (dims.size() != 1) {
+        throw std::runtime_error("expected a 1-dimensional dataset of scores");
+    }
+    hsize_t n = dims[0];
+    k = std::min(static_cast<hsize_t>(k), n);
+
+    std::priority_queue<std::pair<double, hsize_t> > heap;
+    if (k == 0) {
+        return {};
+    }
+
+    block_size = std::max(static_cast<hsize_t>(1), block_size);
+    std::vector<double> buffer(std::min(block_size, n));
+
+    for (hsize_t start = 0; start < n; start += block_size) {
+        hsize_t len = std::min(block_size, n - start);
+        utils::read_rows(dhandle, start, len, 1, buffer.data());
+
+        for (hsize_t i = 0; i < len; ++i) {
+            double score = (negate ? -buffer[i] : buffer[i]);
+            if (std::isnan(score)) {
+                score = std::numeric_limits<double>::infinity();
+            }
+
+            std::pair<double, hsize_t> current(score, start + i);
+            if (heap.size() < k) {
+                heap.push(current);
+            } else if (current < heap.top()) {
+                heap.pop();
+                heap.push(current);
+            }
+        }
+    }
+
+    std::vector<std::pair<double, hsize_t> > output;
+    output.reserve(heap.size());
+    while (!heap.empty()) {
+        output.push_back(heap.top());
+        heap.pop();
+    }
+    std::reverse(output.begin(), output.end());
+    return output;
+}
+
+// Read the values of a 1-dimensional dataset at the specified indices, in the specified order.
+inline std::vector<double> gather(const H5::DataSet& dhandle, const std::vector<hsize_t>& indices) {
+    std::vector<double> output(indices.size());
+    if (indices.empty()) {
+        return output;
+    }
+
+    auto fspace = dhandle.getSpace();
+    fspace.selectElements(H5S_SELECT_SET, indices.size(), indices.data());
+    hsize_t total = indices.size();
+    H5::DataSpace mspace(1, &total);
+    dhandle.read(output.data(), H5::PredType::NATIVE_DOUBLE, mspace, fspace);
+    return output;
+}
+
+// Open a dataset at a path relative to `ghandle`, checking each intermediate group so that missing paths raise a `std::runtime_error`.
+inline H5::DataSet open_statistic(const H5::Group& ghandle, const std::string& path) {
+    H5::Group current = ghandle;
+    size_t start = 0;
+    while (true) {
+        auto pos = path.find('/', start);
+        if (pos == std::string::npos) {
+            return utils::check_and_open_dataset(current, path.substr(start));
+        }
+        current = utils::check_and_open_group(current, path.substr(start, pos - start));
+        start = pos + 1;
+    }
+}
+
+inline void check_effect(const std::string& effect) {
+    if (std::find(markers::effects.begin(), markers::effects.end(), effect) == markers::effects.end()) {
+        throw std::runtime_error("unknown effect size '" + effect + "'");
+    }
+}
+
+inline TopMarkers query(const H5::Group& ghandle, const std::string& score, bool negate, size_t k, const std::vector<std::string>& statistics, hsize_t block_size) {
+    TopMarkers output;
+
+    auto shandle = open_statistic(ghandle, score);
+    auto selected = select_smallest(shandle, k, negate, block_size);
+    for (const auto& s : selected) {
+        output.features.push_back(s.second);
+    }
+
+    // Re-gathering the scores to report the original values, e.g., without negation or NaN replacement.
+    output.scores = gather(shandle, output.features);
+
+    for (const auto& stat : statistics) {
+        output.statistics[stat] = gather(open_statistic(ghandle, stat), output.features);
+    }
+
+    return output;
+}
+
+}
+
+/**
+ * Find the top markers for a cluster, based on the minimum rank for an effect size.
+ * Only the minimum ranks are read in full, in blocks of `block_size`;
+ * the requested statistics are only read for the top features.
+ *
+ * @param handle Handle to a validated v3 state file.
+ * @param modality Name of the modality, e.g., `"RNA"`.
+ * @param cluster Index of the cluster.
+ * @param effect Name of the effect size, see `markers::effects`.
+ * @param k Number of top markers to report.
+ * @param statistics Paths to the statistics to report for each top marker, relative to the group for the cluster.
+ * @param block_size Number of ranks to read at a time.
+ *
+ * @return The top markers, ordered by increasing minimum rank.
+ */
+inline TopMarkers top_cluster_markers(
+    const H5::H5File& handle,
+    const std::string& modality,
+    int cluster,
+    const std::string& effect,
+    size_t k,
+    const std::vector<std::string>& statistics = { "means", "detected" },
+    hsize_t block_size = 65536)
+{
+    top_markers::check_effect(effect);
+    auto mhandle = utils::check_and_open_group(handle, "marker_detection");
+    auto rhandle = utils::check_and_open_group(mhandle, "results");
+    auto chandle = utils::check_and_open_group(rhandle, "per_cluster");
+    auto ohandle = utils::check_and_open_group(chandle, modality);
+    auto ghandle = utils::check_and_open_group(ohandle, std::to_string(cluster));
+    return top_markers::query(ghandle, effect + "/min_rank", false, k, statistics, block_size);
+}
+
+/**
+ * Find the top markers for a custom selection, based on the effect size.
+ * Only the effect sizes are read in full, in blocks of `block_size`;
+ * the requested statistics are only read for the top features.
+ *
+ * @param handle Handle to a validated v3 state file.
+ * @param selection Name of the custom selection.
+ * @param modality Name of the modality, e.g., `"RNA"`.
+ * @param effect Name of the effect size, see `markers::effects`.
+ * @param k Number of top markers to report.
+ * @param statistics Paths to the statistics to report for each top marker, relative to the group for the selection and modality.
+ * @param block_size Number of effect sizes to read at a time.
+ *
+ * @return The top markers, ordered by decreasing effect size.
+ */
+inline TopMarkers top_selection_markers(
+    const H5::H5File& handle,
+    const std::string& selection,
+    const std::string& modality,
+    const std::string& effect,
+    size_t k,
+    const std::vector<std::string>& statistics = { "means", "detected" },
+    hsize_t block_size = 65536)
+{
+    top_markers::check_effect(effect);
+    auto mhandle = utils::check_and_open_group(handle, "custom_selections");
+    auto rhandle = utils::check_and_open_group(mhandle, "results");
+    auto phandle = utils::check_and_open_group(rhandle, "per_selection");
+    auto shandle = utils::check_and_open_group(phandle, selection);
+    auto ghandle = utils::check_and_open_group(shandle, modality);
+    return top_markers::query(ghandle, effect, true, k, statistics, block_size);
+}
+
+}
+
+}
+
+#endif
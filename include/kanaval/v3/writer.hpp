@@ -0,0 +1,1065 @@
+#ifndef KANAVAL_WRITER_V3_HPP
+#define KANAVAL_WRITER_V3_HPP
+
+#include "H5Cpp.h"
+#include "_validate.hpp"
+#include "markers.hpp"
+#include "../writer.hpp"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <stdexcept>
+
+/**
+ * @file writer.hpp
+ *
+ * @brief Write v3 state files from in-memory results.
+ */
+
+namespace kanaval {
+
+namespace v3 {
+
+/**
+ * @brief Write the steps of a v3 state file, validating each step as it is written.
+ *
+ * Each step is written from a description of its parameters and pointers to its results,
+ * so that large per-cell arrays are never copied before being written to file.
+ * Storage is chosen for each dataset by `writer::write_array()`, i.e., compact storage for small datasets
+ * and shuffled, deflated chunks for large datasets, which are compressed in parallel if `KANAVAL_USE_ZLIB` is defined.
+ * The file itself is created with the latest HDF5 file format, see `writer::create_file()`.
+ *
+ * Steps should be written in the order of `steps::graph`, or at least after all of their dependencies.
+ * Once a step is written, it is immediately checked with the same validator as `validate()`,
+ * so that mistakes are reported for the offending step rather than when the file is eventually read.
+ * After all steps are written, the file is a valid v3 state file and `summary()` is the same as the output of `validate()`.
+ */
+class Writer {
+public:
+    /**
+     * @brief Details of a data file in the `inputs` step.
+     */
+    struct File {
+        /**
+         * Type of the file, e.g., `"mtx"`, `"genes"`, `"h5"`.
+         */
+        std::string type;
+
+        /**
+         * Name of the file.
+         */
+        std::string name;
+
+        /**
+         * Size of the file in bytes, for embedded files.
+         * Offsets are computed automatically from the sizes of all preceding files.
+         */
+        hsize_t size = 0;
+
+        /**
+         * Identifier for the file, for linked files.
+         */
+        std::string id;
+    };
+
+    /**
+     * @brief Details of an input dataset in the `inputs` step.
+     */
+    struct Dataset {
+        /**
+         * Format of the dataset, e.g., `"MatrixMarket"`, `"10X"`.
+         */
+        std::string format;
+
+        /**
+         * Name of the dataset, unique across all datasets.
+         */
+        std::string name;
+
+        /**
+         * Files for this dataset.
+         */
+        std::vector<File> files;
+
+        /**
+         * JSON string containing an object of reader options.
+         * If empty, no options are written.
+         */
+        std::string options;
+    };
+
+    /**
+     * @brief Contents of the `inputs` step.
+     */
+    struct Inputs {
+        /**
+         * Input datasets.
+         */
+        std::vector<Dataset> datasets;
+
+        /**
+         * Name of the blocking factor for a single dataset.
+         * If empty, no blocking factor is written.
+         */
+        std::string block_factor;
+
+        /**
+         * Sorted and unique indices of the original cells that were retained by subsetting.
+         * If empty, no subsetting is assumed.
+         */
+        std::vector<int> subset;
+
+        /**
+         * Number of cells after subsetting.
+         */
+        int num_cells = 0;
+
+        /**
+         * Number of blocks.
+         */
+        int num_blocks = 1;
+
+        /**
+         * Indices of the features for each modality, i.e., any of `"RNA"`, `"ADT"` or `"CRISPR"`.
+         */
+        std::vector<std::pair<std::string, std::vector<int> > > feature_identities;
+
+        /**
+         * Names of the features for each modality, which should have the same lengths as `feature_identities`.
+         * This may be empty or contain a subset of the modalities.
+         */
+        std::vector<std::pair<std::string, std::vector<std::string> > > feature_names;
+    };
+
+    /**
+     * @brief Contents of the `rna_quality_control` step.
+     *
+     * Per-cell arrays should be of length equal to the number of cells, while thresholds should have length equal to the number of blocks.
+     * Results are only written if RNA is available.
+     */
+    struct RnaQualityControl {
+        bool use_mito_default = true;
+        std::string mito_prefix = "mt-";
+        double nmads = 3;
+
+        const double* sums = nullptr;
+        const int* detected = nullptr;
+        const double* proportion = nullptr;
+        std::vector<double> sums_threshold, detected_threshold, proportion_threshold;
+        const int* discards = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `adt_quality_control` step.
+     *
+     * Per-cell arrays should be of length equal to the number of cells, while thresholds should have length equal to the number of blocks.
+     * Results are only written if ADTs are available.
+     */
+    struct AdtQualityControl {
+        std::string igg_prefix = "IgG";
+        double nmads = 3;
+        double min_detected_drop = 0.1;
+
+        const double* sums = nullptr;
+        const int* detected = nullptr;
+        const double* igg_total = nullptr;
+        std::vector<double> detected_threshold, igg_total_threshold;
+        const int* discards = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `crispr_quality_control` step.
+     *
+     * Per-cell arrays should be of length equal to the number of cells, while thresholds should have length equal to the number of blocks.
+     * Results are only written if CRISPR guides are available.
+     */
+    struct CrisprQualityControl {
+        double nmads = 3;
+
+        const double* sums = nullptr;
+        const int* detected = nullptr;
+        const int* max_index = nullptr;
+        const double* max_proportion = nullptr;
+        std::vector<double> max_count_threshold;
+        const int* discards = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `cell_filtering` step.
+     */
+    struct CellFiltering {
+        bool use_rna = true;
+        bool use_adt = true;
+        bool use_crispr = true;
+
+        /**
+         * Array of length equal to the number of cells, indicating whether each cell was discarded.
+         * This is only written if non-NULL, and is required if more than one available modality is used for filtering.
+         */
+        const int* discards = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `adt_normalization` step.
+     */
+    struct AdtNormalization {
+        int num_pcs = 25;
+        int num_clusters = 20;
+
+        /**
+         * Array of length equal to the number of filtered cells, only written if ADTs are available.
+         */
+        const double* size_factors = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `feature_selection` step.
+     *
+     * Each array should be of length equal to the number of RNA features, and is only written if RNA is available.
+     */
+    struct FeatureSelection {
+        double span = 0.3;
+
+        const double* means = nullptr;
+        const double* vars = nullptr;
+        const double* fitted = nullptr;
+        const double* resids = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `rna_pca`, `adt_pca` or `crispr_pca` steps.
+     */
+    struct Pca {
+        int num_pcs = 20;
+
+        /**
+         * Number of highly variable genes, only used for `rna_pca`.
+         */
+        int num_hvgs = 2000;
+
+        std::string block_method = "none";
+
+        /**
+         * Percentage of variance explained by each PC, in non-increasing order.
+         * This may be shorter than `num_pcs`.
+         */
+        std::vector<double> var_exp;
+
+        /**
+         * Row-major array of PCs where the rows are the filtered cells and the columns are the PCs, i.e., one column per entry of `var_exp`.
+         * Only written if the modality is available.
+         */
+        const double* pcs = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `combine_embeddings` step.
+     */
+    struct CombineEmbeddings {
+        double rna_weight = 1;
+        double adt_weight = 1;
+        double crispr_weight = 1;
+        bool approximate = true;
+
+        /**
+         * Row-major array where the rows are the filtered cells and the columns are the PCs of all modalities with non-zero weights.
+         * This is only written if non-NULL, and is required if more than one available modality has a non-zero weight.
+         */
+        const double* combined = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `batch_correction` step.
+     */
+    struct BatchCorrection {
+        std::string method = "none";
+        int num_neighbors = 20;
+        bool approximate = true;
+
+        /**
+         * Row-major array with the same dimensions as the combined embedding.
+         * This is only written if non-NULL, and is required for MNN correction with multiple blocks.
+         */
+        const double* corrected = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `snn_graph_cluster` step.
+     */
+    struct SnnGraphCluster {
+        int k = 10;
+        std::string scheme = "rank";
+        std::string algorithm = "multilevel";
+        double multilevel_resolution = 1;
+        double leiden_resolution = 1;
+        int walktrap_steps = 4;
+
+        /**
+         * Array of cluster assignments with length equal to the number of filtered cells.
+         * This is only written if non-NULL, and is required if this is the chosen clustering method.
+         */
+        const int* clusters = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `kmeans_cluster` step.
+     */
+    struct KmeansCluster {
+        int k = 10;
+
+        /**
+         * Array of cluster assignments with length equal to the number of filtered cells.
+         * This is only written if non-NULL, and is required if this is the chosen clustering method.
+         */
+        const int* clusters = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `tsne` step.
+     */
+    struct Tsne {
+        double perplexity = 30;
+        int iterations = 500;
+        bool animate = false;
+
+        /**
+         * Arrays of coordinates with length equal to the number of filtered cells.
+         */
+        const double* x = nullptr;
+        const double* y = nullptr;
+    };
+
+    /**
+     * @brief Contents of the `umap` step.
+     */
+    struct Umap {
+        int num_neighbors = 15;
+        int num_epochs = 500;
+        double min_dist = 0.1;
+        bool animate = false;
+
+        /**
+         * Arrays of coordinates with length equal to the number of filtered cells.
+         */
+        const double* x = nullptr;
+        const double* y = nullptr;
+    };
+
+    /**
+     * @brief Summaries of an effect size across pairwise comparisons for one group of cells.
+     */
+    struct EffectSummary {
+        const double* mean = nullptr;
+        const double* min = nullptr;
+        const double* min_rank = nullptr;
+    };
+
+    /**
+     * @brief Marker statistics for one cluster in one modality.
+     *
+     * Each array should be of length equal to the number of features in the modality.
+     * The AUCs are only written if they were computed.
+     */
+    struct ClusterMarkers {
+        const double* means = nullptr;
+        const double* detected = nullptr;
+        EffectSummary lfc, delta_detected, cohen, auc;
+    };
+
+    /**
+     * @brief Contents of the `marker_detection` step.
+     */
+    struct MarkerDetection {
+        bool compute_auc = true;
+        double lfc_threshold = 0;
+
+        /**
+         * Statistics for each available modality, containing one entry per cluster.
+         */
+        std::unordered_map<std::string, std::vector<ClusterMarkers> > per_cluster;
+    };
+
+    /**
+     * @brief Marker statistics for one selection in one modality.
+     *
+     * Each array should be of length equal to the number of features in the modality.
+     * The AUCs are only written if they were computed.
+     */
+    struct SelectionMarkers {
+        const double* means = nullptr;
+        const double* detected = nullptr;
+        const double* lfc = nullptr;
+        const double* delta_detected = nullptr;
+        const double* cohen = nullptr;
+        const double* auc = nullptr;
+    };
+
+    /**
+     * @brief A custom selection of cells.
+     */
+    struct Selection {
+        std::string name;
+
+        /**
+         * Sorted and unique indices of the filtered cells in this selection.
+         */
+        std::vector<int> indices;
+
+        /**
+         * Statistics for each available modality.
+         */
+        std::unordered_map<std::string, SelectionMarkers> markers;
+    };
+
+    /**
+     * @brief Contents of the `custom_selections` step.
+     */
+    struct CustomSelections {
+        bool compute_auc = true;
+        double lfc_threshold = 0;
+        std::vector<Selection> selections;
+    };
+
+    /**
+     * @brief Contents of the `cell_labelling` step.
+     */
+    struct CellLabelling {
+        std::vector<std::string> human_references;
+        std::vector<std::string> mouse_references;
+
+        /**
+         * Assigned label for each cluster, for each reference that was used.
+         */
+        std::vector<std::pair<std::string, std::vector<std::string> > > per_reference;
+
+        /**
+         * Best reference for each cluster, only written if more than one reference was used.
+         */
+        std::vector<std::string> integrated;
+    };
+
+public:
+    /**
+     * @param path Path to the output file.
+     * Any existing file is overwritten.
+     * @param embedded Whether the data files are embedded.
+     * @param options Options for writing datasets.
+     * @param validation Options for validating each step.
+     * @param version Version of the kana file.
+     */
+    Writer(const std::string& path, bool embedded = true, const writer::Options& options = writer::Options(), const Options& validation = Options(), int version = 3000000) :
+        handle(writer::create_file(path)), embedded(embedded), version(version), options(options), validation(validation) {}
+
+public:
+    /**
+     * @param contents Contents of the `inputs` step.
+     */
+    void write_inputs(const Inputs& contents) {
+        auto xhandle = start("inputs");
+        auto phandle = xhandle.createGroup("parameters");
+
+        auto dhandle = phandle.createGroup("datasets");
+        hsize_t offset = 0;
+        for (size_t d = 0; d < contents.datasets.size(); ++d) {
+            const auto& current = contents.datasets[d];
+            auto curdhandle = dhandle.createGroup(std::to_string(d));
+            writer::write_string(curdhandle, "format", current.format);
+            writer::write_string(curdhandle, "name", current.name);
+            if (!current.options.empty()) {
+                writer::write_string(curdhandle, "options", current.options);
+            }
+
+            auto fhandle = curdhandle.createGroup("files");
+            for (size_t f = 0; f < current.files.size(); ++f) {
+                const auto& file = current.files[f];
+                auto curfhandle = fhandle.createGroup(std::to_string(f));
+                writer::write_string(curfhandle, "type", file.type);
+                writer::write_string(curfhandle, "name", file.name);
+                if (embedded) {
+                    writer::write_scalar(curfhandle, "offset", offset);
+                    writer::write_scalar(curfhandle, "size", file.size);
+                    offset += file.size;
+                } else {
+                    writer::write_string(curfhandle, "id", file.id);
+                }
+            }
+        }
+
+        if (!contents.subset.empty()) {
+            auto shandle = phandle.createGroup("subset").createGroup("cells");
+            writer::write_vector(shandle, "indices", contents.subset.data(), contents.subset.size(), options);
+        }
+        if (!contents.block_factor.empty()) {
+            writer::write_string(phandle, "block_factor", contents.block_factor);
+        }
+
+        auto rhandle = xhandle.createGroup("results");
+        writer::write_scalar(rhandle, "num_cells", contents.num_cells);
+        writer::write_scalar(rhandle, "num_blocks", contents.num_blocks);
+
+        auto ihandle = rhandle.createGroup("feature_identities");
+        for (const auto& mod : contents.feature_identities) {
+            writer::write_vector(ihandle, mod.first, mod.second.data(), mod.second.size(), options);
+        }
+        if (!contents.feature_names.empty()) {
+            auto nhandle = rhandle.createGroup("feature_names");
+            for (const auto& mod : contents.feature_names) {
+                writer::write_strings(nhandle, mod.first, mod.second, options);
+            }
+        }
+
+        finish("inputs");
+    }
+
+    /**
+     * @param contents Contents of the `rna_quality_control` step.
+     */
+    void write_rna_quality_control(const RnaQualityControl& contents) {
+        auto xhandle = start("rna_quality_control");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "use_mito_default", static_cast<int>(contents.use_mito_default));
+        writer::write_string(phandle, "mito_prefix", contents.mito_prefix);
+        writer::write_scalar(phandle, "nmads", contents.nmads);
+
+        auto rhandle = xhandle.createGroup("results");
+        if (available("RNA")) {
+            auto mhandle = rhandle.createGroup("metrics");
+            write_cells(mhandle, "sums", contents.sums);
+            write_cells(mhandle, "detected", contents.detected);
+            write_cells(mhandle, "proportion", contents.proportion);
+
+            auto thandle = rhandle.createGroup("thresholds");
+            write_blocks(thandle, "sums", contents.sums_threshold);
+            write_blocks(thandle, "detected", contents.detected_threshold);
+            write_blocks(thandle, "proportion", contents.proportion_threshold);
+
+            write_cells(rhandle, "discards", contents.discards);
+        }
+
+        finish("rna_quality_control");
+    }
+
+    /**
+     * @param contents Contents of the `adt_quality_control` step.
+     */
+    void write_adt_quality_control(const AdtQualityControl& contents) {
+        auto xhandle = start("adt_quality_control");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_string(phandle, "igg_prefix", contents.igg_prefix);
+        writer::write_scalar(phandle, "nmads", contents.nmads);
+        writer::write_scalar(phandle, "min_detected_drop", contents.min_detected_drop);
+
+        auto rhandle = xhandle.createGroup("results");
+        if (available("ADT")) {
+            auto mhandle = rhandle.createGroup("metrics");
+            write_cells(mhandle, "sums", contents.sums);
+            write_cells(mhandle, "detected", contents.detected);
+            write_cells(mhandle, "igg_total", contents.igg_total);
+
+            auto thandle = rhandle.createGroup("thresholds");
+            write_blocks(thandle, "detected", contents.detected_threshold);
+            write_blocks(thandle, "igg_total", contents.igg_total_threshold);
+
+            write_cells(rhandle, "discards", contents.discards);
+        }
+
+        finish("adt_quality_control");
+    }
+
+    /**
+     * @param contents Contents of the `crispr_quality_control` step.
+     */
+    void write_crispr_quality_control(const CrisprQualityControl& contents) {
+        auto xhandle = start("crispr_quality_control");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "nmads", contents.nmads);
+
+        auto rhandle = xhandle.createGroup("results");
+        if (available("CRISPR")) {
+            auto mhandle = rhandle.createGroup("metrics");
+            write_cells(mhandle, "sums", contents.sums);
+            write_cells(mhandle, "detected", contents.detected);
+            write_cells(mhandle, "max_index", contents.max_index);
+            write_cells(mhandle, "max_proportion", contents.max_proportion);
+
+            auto thandle = rhandle.createGroup("thresholds");
+            write_blocks(thandle, "max_count", contents.max_count_threshold);
+
+            write_cells(rhandle, "discards", contents.discards);
+        }
+
+        finish("crispr_quality_control");
+    }
+
+    /**
+     * @param contents Contents of the `cell_filtering` step.
+     */
+    void write_cell_filtering(const CellFiltering& contents) {
+        auto xhandle = start("cell_filtering");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "use_rna", static_cast<int>(contents.use_rna));
+        writer::write_scalar(phandle, "use_adt", static_cast<int>(contents.use_adt));
+        writer::write_scalar(phandle, "use_crispr", static_cast<int>(contents.use_crispr));
+
+        auto rhandle = xhandle.createGroup("results");
+        if (contents.discards) {
+            write_cells(rhandle, "discards", contents.discards);
+        }
+
+        finish("cell_filtering");
+    }
+
+    /**
+     * Write the `rna_normalization` step, which has no parameters or results.
+     */
+    void write_rna_normalization() {
+        write_empty("rna_normalization");
+    }
+
+    /**
+     * @param contents Contents of the `adt_normalization` step.
+     */
+    void write_adt_normalization(const AdtNormalization& contents) {
+        auto xhandle = start("adt_normalization");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "num_pcs", contents.num_pcs);
+        writer::write_scalar(phandle, "num_clusters", contents.num_clusters);
+
+        auto rhandle = xhandle.createGroup("results");
+        if (available("ADT")) {
+            write_filtered(rhandle, "size_factors", contents.size_factors);
+        }
+
+        finish("adt_normalization");
+    }
+
+    /**
+     * Write the `crispr_normalization` step, which has no parameters or results.
+     */
+    void write_crispr_normalization() {
+        write_empty("crispr_normalization");
+    }
+
+    /**
+     * @param contents Contents of the `feature_selection` step.
+     */
+    void write_feature_selection(const FeatureSelection& contents) {
+        auto xhandle = start("feature_selection");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "span", contents.span);
+
+        auto rhandle = xhandle.createGroup("results");
+        if (available("RNA")) {
+            hsize_t ngenes = current.inputs.num_features.at("RNA");
+            write_required(rhandle, "means", contents.means, ngenes, 0);
+            write_required(rhandle, "vars", contents.vars, ngenes, 0);
+            write_required(rhandle, "fitted", contents.fitted, ngenes, 0);
+            write_required(rhandle, "resids", contents.resids, ngenes, 0);
+        }
+
+        finish("feature_selection");
+    }
+
+    /**
+     * @param contents Contents of the `rna_pca` step.
+     */
+    void write_rna_pca(const Pca& contents) {
+        write_pca("rna_pca", "RNA", contents, true);
+    }
+
+    /**
+     * @param contents Contents of the `adt_pca` step.
+     */
+    void write_adt_pca(const Pca& contents) {
+        write_pca("adt_pca", "ADT", contents, false);
+    }
+
+    /**
+     * @param contents Contents of the `crispr_pca` step.
+     */
+    void write_crispr_pca(const Pca& contents) {
+        write_pca("crispr_pca", "CRISPR", contents, false);
+    }
+
+    /**
+     * @param contents Contents of the `combine_embeddings` step.
+     */
+    void write_combine_embeddings(const CombineEmbeddings& contents) {
+        auto xhandle = start("combine_embeddings");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "rna_weight", contents.rna_weight);
+        writer::write_scalar(phandle, "adt_weight", contents.adt_weight);
+        writer::write_scalar(phandle, "crispr_weight", contents.crispr_weight);
+        writer::write_scalar(phandle, "approximate", static_cast<int>(contents.approximate));
+
+        auto rhandle = xhandle.createGroup("results");
+        if (contents.combined) {
+            int total = 0;
+            auto add_modality = [&](double weight, const std::string& modality) -> void {
+                auto it = current.num_pcs.find(modality);
+                if (weight > 0 && it != current.num_pcs.end()) {
+                    total += it->second;
+                }
+            };
+            add_modality(contents.rna_weight, "RNA");
+            add_modality(contents.adt_weight, "ADT");
+            add_modality(contents.crispr_weight, "CRISPR");
+            write_required(rhandle, "combined", contents.combined, current.filtered_cells, total);
+        }
+
+        finish("combine_embeddings");
+    }
+
+    /**
+     * @param contents Contents of the `batch_correction` step.
+     */
+    void write_batch_correction(const BatchCorrection& contents) {
+        auto xhandle = start("batch_correction");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_string(phandle, "method", contents.method);
+        writer::write_scalar(phandle, "num_neighbors", contents.num_neighbors);
+        writer::write_scalar(phandle, "approximate", static_cast<int>(contents.approximate));
+
+        auto rhandle = xhandle.createGroup("results");
+        if (contents.corrected) {
+            write_required(rhandle, "corrected", contents.corrected, current.filtered_cells, current.total_pcs);
+        }
+
+        finish("batch_correction");
+    }
+
+    /**
+     * @param approximate Whether an approximate neighbor search was used.
+     */
+    void write_neighbor_index(bool approximate = true) {
+        auto xhandle = start("neighbor_index");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "approximate", static_cast<int>(approximate));
+        xhandle.createGroup("results");
+        finish("neighbor_index");
+    }
+
+    /**
+     * @param method Chosen clustering method, either `"kmeans"` or `"snn_graph"`.
+     */
+    void write_choose_clustering(const std::string& method) {
+        auto xhandle = start("choose_clustering");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_string(phandle, "method", method);
+        xhandle.createGroup("results");
+        finish("choose_clustering");
+    }
+
+    /**
+     * @param contents Contents of the `snn_graph_cluster` step.
+     */
+    void write_snn_graph_cluster(const SnnGraphCluster& contents) {
+        auto xhandle = start("snn_graph_cluster");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "k", contents.k);
+        writer::write_string(phandle, "scheme", contents.scheme);
+        writer::write_string(phandle, "algorithm", contents.algorithm);
+        writer::write_scalar(phandle, "multilevel_resolution", contents.multilevel_resolution);
+        writer::write_scalar(phandle, "leiden_resolution", contents.leiden_resolution);
+        writer::write_scalar(phandle, "walktrap_steps", contents.walktrap_steps);
+
+        auto rhandle = xhandle.createGroup("results");
+        if (contents.clusters) {
+            write_filtered(rhandle, "clusters", contents.clusters);
+        }
+
+        finish("snn_graph_cluster");
+    }
+
+    /**
+     * @param contents Contents of the `kmeans_cluster` step.
+     */
+    void write_kmeans_cluster(const KmeansCluster& contents) {
+        auto xhandle = start("kmeans_cluster");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "k", contents.k);
+
+        auto rhandle = xhandle.createGroup("results");
+        if (contents.clusters) {
+            write_filtered(rhandle, "clusters", contents.clusters);
+        }
+
+        finish("kmeans_cluster");
+    }
+
+    /**
+     * @param contents Contents of the `tsne` step.
+     */
+    void write_tsne(const Tsne& contents) {
+        auto xhandle = start("tsne");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "perplexity", contents.perplexity);
+        writer::write_scalar(phandle, "iterations", contents.iterations);
+        writer::write_scalar(phandle, "animate", static_cast<int>(contents.animate));
+
+        auto rhandle = xhandle.createGroup("results");
+        write_filtered(rhandle, "x", contents.x);
+        write_filtered(rhandle, "y", contents.y);
+
+        finish("tsne");
+    }
+
+    /**
+     * @param contents Contents of the `umap` step.
+     */
+    void write_umap(const Umap& contents) {
+        auto xhandle = start("umap");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "num_neighbors", contents.num_neighbors);
+        writer::write_scalar(phandle, "num_epochs", contents.num_epochs);
+        writer::write_scalar(phandle, "min_dist", contents.min_dist);
+        writer::write_scalar(phandle, "animate", static_cast<int>(contents.animate));
+
+        auto rhandle = xhandle.createGroup("results");
+        write_filtered(rhandle, "x", contents.x);
+        write_filtered(rhandle, "y", contents.y);
+
+        finish("umap");
+    }
+
+    /**
+     * @param contents Contents of the `marker_detection` step.
+     */
+    void write_marker_detection(const MarkerDetection& contents) {
+        auto xhandle = start("marker_detection");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "compute_auc", static_cast<int>(contents.compute_auc));
+        writer::write_scalar(phandle, "lfc_threshold", contents.lfc_threshold);
+
+        auto rhandle = xhandle.createGroup("results");
+        auto chandle = rhandle.createGroup("per_cluster");
+        for (const auto& mod : current.inputs.num_features) {
+            auto it = contents.per_cluster.find(mod.first);
+            if (it == contents.per_cluster.end()) {
+                throw std::runtime_error("no marker statistics supplied for modality '" + mod.first + "'");
+            }
+
+            auto mohandle = chandle.createGroup(mod.first);
+            const auto& clusters = it->second;
+            for (size_t i = 0; i < clusters.size(); ++i) {
+                const auto& stats = clusters[i];
+                auto ihandle = mohandle.createGroup(std::to_string(i));
+                write_required(ihandle, "means", stats.means, mod.second, 0);
+                write_required(ihandle, "detected", stats.detected, mod.second, 0);
+
+                const EffectSummary* effects[] = { &stats.lfc, &stats.delta_detected, &stats.cohen, &stats.auc };
+                for (size_t e = 0; e < markers::effects.size(); ++e) {
+                    const auto& eff = markers::effects[e];
+                    if (!contents.compute_auc && eff == "auc") {
+                        continue;
+                    }
+                    auto ehandle = ihandle.createGroup(eff);
+                    write_required(ehandle, "mean", effects[e]->mean, mod.second, 0);
+                    write_required(ehandle, "min", effects[e]->min, mod.second, 0);
+                    write_required(ehandle, "min_rank", effects[e]->min_rank, mod.second, 0);
+                }
+            }
+        }
+
+        finish("marker_detection");
+    }
+
+    /**
+     * @param contents Contents of the `custom_selections` step.
+     */
+    void write_custom_selections(const CustomSelections& contents) {
+        auto xhandle = start("custom_selections");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "compute_auc", static_cast<int>(contents.compute_auc));
+        writer::write_scalar(phandle, "lfc_threshold", contents.lfc_threshold);
+
+        auto shandle = phandle.createGroup("selections");
+        for (const auto& sel : contents.selections) {
+            writer::write_vector(shandle, sel.name, sel.indices.data(), sel.indices.size(), options);
+        }
+
+        auto rhandle = xhandle.createGroup("results");
+        auto pshandle = rhandle.createGroup("per_selection");
+        for (const auto& sel : contents.selections) {
+            auto curshandle = pshandle.createGroup(sel.name);
+            for (const auto& mod : current.inputs.num_features) {
+                auto it = sel.markers.find(mod.first);
+                if (it == sel.markers.end()) {
+                    throw std::runtime_error("no marker statistics supplied for modality '" + mod.first + "' in selection '" + sel.name + "'");
+                }
+
+                const auto& stats = it->second;
+                auto mhandle = curshandle.createGroup(mod.first);
+                write_required(mhandle, "means", stats.means, mod.second, 0);
+                write_required(mhandle, "detected", stats.detected, mod.second, 0);
+                write_required(mhandle, "lfc", stats.lfc, mod.second, 0);
+                write_required(mhandle, "delta_detected", stats.delta_detected, mod.second, 0);
+                write_required(mhandle, "cohen", stats.cohen, mod.second, 0);
+                if (contents.compute_auc) {
+                    write_required(mhandle, "auc", stats.auc, mod.second, 0);
+                }
+            }
+        }
+
+        finish("custom_selections");
+    }
+
+    /**
+     * @param contents Contents of the `cell_labelling` step.
+     */
+    void write_cell_labelling(const CellLabelling& contents) {
+        auto xhandle = start("cell_labelling");
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_strings(phandle, "human_references", contents.human_references, options);
+        writer::write_strings(phandle, "mouse_references", contents.mouse_references, options);
+
+        auto rhandle = xhandle.createGroup("results");
+        if (available("RNA")) {
+            auto perhandle = rhandle.createGroup("per_reference");
+            for (const auto& ref : contents.per_reference) {
+                writer::write_strings(perhandle, ref.first, ref.second, options);
+            }
+            if (contents.per_reference.size() > 1) {
+                writer::write_strings(rhandle, "integrated", contents.integrated, options);
+            }
+        }
+
+        finish("cell_labelling");
+    }
+
+    /**
+     * Write the `_metadata` group, using the version of the kana file supplied in the constructor.
+     *
+     * @param application_name Name of the application that created the file.
+     * @param application_version Version of the application.
+     */
+    void write__metadata(const std::string& application_name, const std::string& application_version) {
+        auto xhandle = start("_metadata");
+        writer::write_scalar(xhandle, "format_version", version);
+        writer::write_string(xhandle, "application_name", application_name);
+        writer::write_string(xhandle, "application_version", application_version);
+        finish("_metadata");
+    }
+
+public:
+    /**
+     * @return Handle to the file being written.
+     */
+    const H5::H5File& file() const {
+        return handle;
+    }
+
+    /**
+     * @return Facts derived from validation of the steps written so far.
+     */
+    const Summary& summary() const {
+        return current;
+    }
+
+    /**
+     * Flush the file to disk and close it.
+     * No further steps can be written after this is called.
+     */
+    void close() {
+        handle.close();
+    }
+
+private:
+    H5::H5File handle;
+    bool embedded;
+    int version;
+    writer::Options options;
+    Options validation;
+    Summary current;
+    std::unordered_set<std::string> written;
+
+    H5::Group start(const std::string& step) {
+        if (written.find(step) != written.end() || handle.exists(step)) {
+            throw std::runtime_error("step '" + step + "' has already been written");
+        }
+
+        for (const auto& s : steps::graph) {
+            if (s.name == step) {
+                for (const auto& d : s.depends) {
+                    if (written.find(d) == written.end()) {
+                        throw std::runtime_error("step '" + d + "' should be written before '" + step + "'");
+                    }
+                }
+                break;
+            }
+        }
+
+        return handle.createGroup(step);
+    }
+
+    // Validating only the newly written step, with facts from the upstream steps taken from the existing summary.
+    // A step that fails validation is removed so that it can be written again, and its dependents are blocked until then.
+    void finish(const std::string& step) {
+        try {
+            validate_steps(handle, embedded, version, current, [&](const std::string& s) -> bool { return s == step; }, validation);
+        } catch (std::exception& e) {
+            handle.unlink(step);
+            throw utils::combine_errors(e, "failed to validate '" + step + "' after writing");
+        }
+        written.insert(step);
+    }
+
+    void write_empty(const std::string& step) {
+        auto xhandle = start(step);
+        xhandle.createGroup("parameters");
+        xhandle.createGroup("results");
+        finish(step);
+    }
+
+    bool available(const std::string& modality) const {
+        return current.inputs.num_features.find(modality) != current.inputs.num_features.end();
+    }
+
+    template<typename T>
+    void write_required(const H5::Group& parent, const std::string& name, const T* values, hsize_t nrow, hsize_t ncol) {
+        if (values == nullptr) {
+            throw std::runtime_error("no values supplied for '" + name + "'");
+        }
+        writer::write_array(parent, name, values, nrow, ncol, options);
+    }
+
+    template<typename T>
+    void write_cells(const H5::Group& parent, const std::string& name, const T* values) {
+        write_required(parent, name, values, current.inputs.num_cells, 0);
+    }
+
+    template<typename T>
+    void write_filtered(const H5::Group& parent, const std::string& name, const T* values) {
+        write_required(parent, name, values, current.filtered_cells, 0);
+    }
+
+    void write_blocks(const H5::Group& parent, const std::string& name, const std::vector<double>& values) {
+        writer::write_vector(parent, name, values.data(), values.size(), options);
+    }
+
+    void write_pca(const std::string& step, const std::string& modality, const Pca& contents, bool has_hvgs) {
+        auto xhandle = start(step);
+        auto phandle = xhandle.createGroup("parameters");
+        writer::write_scalar(phandle, "num_pcs", contents.num_pcs);
+        if (has_hvgs) {
+            writer::write_scalar(phandle, "num_hvgs", contents.num_hvgs);
+        }
+        writer::write_string(phandle, "block_method", contents.block_method);
+
+        auto rhandle = xhandle.createGroup("results");
+        if (available(modality)) {
+            writer::write_vector(rhandle, "var_exp", contents.var_exp.data(), contents.var_exp.size(), options);
+            write_required(rhandle, "pcs", contents.pcs, current.filtered_cells, contents.var_exp.size());
+        }
+
+        finish(step);
+    }
+};
+
+}
+
+}
+
+#endif
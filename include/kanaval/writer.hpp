@@ -0,0 +1,440 @@
+#ifndef KANAVAL_WRITER_HPP
+#define KANAVAL_WRITER_HPP
+
+#include "H5Cpp.h"
+#include "utils.hpp"
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#ifdef KANAVAL_USE_ZLIB
+#include "zlib.h"
+#endif
+
+/**
+ * @file writer.hpp
+ *
+ * @brief Write datasets with sensible storage choices.
+ */
+
+namespace kanaval {
+
+namespace writer {
+
+/**
+ * @brief Options for writing datasets.
+ */
+struct Options {
+    /**
+     * Number of threads to use for compression.
+     * This is only used if `KANAVAL_USE_ZLIB` is defined, otherwise HDF5 compresses each chunk serially.
+     */
+    int num_threads = 1;
+
+    /**
+     * Deflate compression level, from 0 to 9.
+     * If 0, large datasets are stored contiguously without compression.
+     */
+    int compression_level = 6;
+
+    /**
+     * Whether to shuffle the bytes of each value before compression.
+     */
+    bool shuffle = true;
+
+    /**
+     * Target number of values in each chunk.
+     * This is defined in terms of values rather than bytes so that all per-cell datasets have the same number of rows per chunk,
+     * regardless of their type; this allows the validators to read aligned blocks from several datasets without decompressing any chunk twice.
+     */
+    hsize_t chunk_size = 131072;
+
+    /**
+     * Maximum size of a dataset in bytes for compact storage, i.e., in the object header.
+     * Larger datasets are chunked and compressed, or stored contiguously if `compression_level = 0`.
+     * This should be less than 64 KB, the HDF5 limit for compact datasets.
+     */
+    hsize_t compact_size = 16384;
+};
+
+/**
+ * Create a new HDF5 file, using the latest version of the file format.
+ * This enables compact storage of links in small groups and more efficient indexing of chunks,
+ * but the file can only be read by HDF5 1.10 or later.
+ *
+ * @param path Path to the file.
+ * Any existing file is overwritten.
+ *
+ * @return Handle to the new file.
+ */
+inline H5::H5File create_file(const std::string& path) {
+    H5::FileAccPropList fapl;
+    fapl.setLibverBounds(H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+    return H5::H5File(path, H5F_ACC_TRUNC, H5::FileCreatPropList::DEFAULT, fapl);
+}
+
+// Number of rows in each chunk, such that each chunk contains whole rows.
+inline hsize_t chunk_rows(hsize_t nrow, hsize_t ncol, const Options& options) {
+    hsize_t per_chunk = std::max(static_cast<hsize_t>(1), options.chunk_size / std::max(static_cast<hsize_t>(1), ncol));
+    return std::max(static_cast<hsize_t>(1), std::min(per_chunk, nrow));
+}
+
+inline H5::DSetCreatPropList compact_plist() {
+    H5::DSetCreatPropList plist;
+    plist.setLayout(H5D_COMPACT);
+    return plist;
+}
+
+#ifdef KANAVAL_USE_ZLIB
+/**
+ * @brief A chunk that has been compressed for `H5Dwrite_chunk()`.
+ */
+struct Chunk {
+    /**
+     * Contents of the chunk, as it should be stored in the file.
+     */
+    std::vector<unsigned char> data;
+
+    /**
+     * Filter mask for the chunk, where the deflate bit is set if the chunk is stored uncompressed.
+     */
+    uint32_t mask = 0;
+};
+
+// Compress chunk `index` of a row-major array of raw bytes, where each chunk contains `rows_per_chunk` whole rows.
+// The chunk is padded to its full size, shuffled and deflated, exactly as the HDF5 filters would have done.
+// Like the HDF5 deflate filter, incompressible chunks are stored uncompressed with the deflate bit set in their filter mask.
+// `padded` and `shuffled` are workspaces that can be reused across calls in the same thread.
+inline void compress_chunk(const unsigned char* values, hsize_t nrow, hsize_t row_bytes, size_t type_size, hsize_t rows_per_chunk, hsize_t index, const Options& options, 
+    std::vector<unsigned char>& padded, std::vector<unsigned char>& shuffled, Chunk& output)
+{
+    size_t chunk_bytes = rows_per_chunk * row_bytes;
+    hsize_t row_start = index * rows_per_chunk;
+    hsize_t row_end = std::min(nrow, row_start + rows_per_chunk);
+    padded.assign(chunk_bytes, 0);
+    std::memcpy(padded.data(), values + row_start * row_bytes, (row_end - row_start) * row_bytes);
+
+    const unsigned char* src = padded.data();
+    if (options.shuffle && type_size > 1) {
+        shuffled.resize(chunk_bytes);
+        size_t nelements = chunk_bytes / type_size;
+        for (size_t b = 0; b < type_size; ++b) {
+            unsigned char* plane = shuffled.data() + b * nelements;
+            for (size_t i = 0; i < nelements; ++i) {
+                plane[i] = padded[i * type_size + b];
+            }
+        }
+        src = shuffled.data();
+    }
+
+    const int deflate_index = (options.shuffle ? 1 : 0);
+    output.data.resize(compressBound(chunk_bytes));
+    uLongf destlen = output.data.size();
+    if (compress2(output.data.data(), &destlen, src, chunk_bytes, std::min(options.compression_level, 9)) == Z_OK && destlen < chunk_bytes) {
+        output.data.resize(destlen);
+        output.mask = 0;
+    } else {
+        output.data.assign(src, src + chunk_bytes);
+        output.mask = 1u << deflate_index;
+    }
+}
+
+// Write a compressed chunk that starts at row `row_start` of a 1- or 2-dimensional dataset.
+inline void write_chunk(const H5::DataSet& dhandle, hsize_t row_start, const Chunk& chunk) {
+    hsize_t offset[2] = { row_start, 0 };
+    if (H5Dwrite_chunk(dhandle.getId(), H5P_DEFAULT, chunk.mask, offset, chunk.data.size(), chunk.data.data()) < 0) {
+        throw std::runtime_error("failed to write a raw chunk");
+    }
+}
+
+// Compress chunks in parallel and write them directly with `H5Dwrite_chunk()`, bypassing HDF5's serial filter pipeline.
+// Chunks are processed in batches so that they are written to the file in order and memory usage is bounded.
+inline void write_chunks(const H5::DataSet& dhandle, const unsigned char* values, hsize_t nrow, hsize_t row_bytes, size_t type_size, hsize_t rows_per_chunk, const Options& options) {
+    hsize_t nchunks = nrow / rows_per_chunk + (nrow % rows_per_chunk > 0);
+    const int nthreads = std::max(1, options.num_threads);
+    const size_t batch = static_cast<size_t>(nthreads) * 4;
+    std::vector<Chunk> compressed(batch);
+
+    for (hsize_t first = 0; first < nchunks; first += batch) {
+        size_t current = std::min(static_cast<hsize_t>(batch), nchunks - first);
+
+        utils::parallelize(current, nthreads, [&](int, size_t start, size_t len) -> void {
+            std::vector<unsigned char> padded, shuffled;
+            for (size_t c = start, end = start + len; c < end; ++c) {
+                compress_chunk(values, nrow, row_bytes, type_size, rows_per_chunk, first + c, options, padded, shuffled, compressed[c]);
+            }
+        });
+
+        for (size_t c = 0; c < current; ++c) {
+            write_chunk(dhandle, (first + c) * rows_per_chunk, compressed[c]);
+        }
+    }
+}
+#endif
+
+// Number of rows in each chunk of a dataset created by `write_array()`, or zero if the dataset is not chunked, i.e., it is compact or contiguous.
+// This does not call the HDF5 library, so it can be used to plan compression in worker threads.
+inline hsize_t array_chunk_rows(hsize_t nrow, hsize_t ncol, size_t type_size, const Options& options) {
+    hsize_t row_values = (ncol ? ncol : 1);
+    if (nrow * row_values * type_size <= options.compact_size || options.compression_level <= 0) {
+        return 0;
+    }
+    return chunk_rows(nrow, row_values, options);
+}
+
+/**
+ * Choose the storage for a 1- or 2-dimensional dataset, as described in `write_array()`.
+ *
+ * @param nrow Number of rows.
+ * @param ncol Number of columns.
+ * If zero, the dataset is 1-dimensional.
+ * @param type_size Size of each value in bytes.
+ * @param options Options for writing.
+ * @param[out] rows_per_chunk Number of rows in each chunk for chunked storage, or zero for compact or contiguous storage.
+ *
+ * @return Dataset creation property list.
+ */
+inline H5::DSetCreatPropList array_plist(hsize_t nrow, hsize_t ncol, size_t type_size, const Options& options, hsize_t& rows_per_chunk) {
+    rows_per_chunk = array_chunk_rows(nrow, ncol, type_size, options);
+    hsize_t total_bytes = nrow * (ncol ? ncol : 1) * type_size;
+    if (total_bytes <= options.compact_size) {
+        return compact_plist();
+    }
+
+    H5::DSetCreatPropList plist;
+    plist.setFillTime(H5D_FILL_TIME_NEVER);
+    if (rows_per_chunk == 0) {
+        return plist;
+    }
+
+    hsize_t cdims[2] = { rows_per_chunk, ncol };
+    plist.setChunk(ncol ? 2 : 1, cdims);
+    if (options.shuffle) {
+        plist.setShuffle();
+    }
+    plist.setDeflate(std::min(options.compression_level, 9));
+    return plist;
+}
+
+/**
+ * Write a 1- or 2-dimensional dataset from a row-major array of raw bytes, with the same storage as `write_array()`.
+ * This is useful for datasets with types that are only known at run time, e.g., when copying datasets from another file.
+ *
+ * @tparam Object HDF5 object that can contain datasets, e.g., a file or group.
+ *
+ * @param handle Handle to the parent object.
+ * @param name Name of the dataset.
+ * @param dtype Datatype of the values, used for both the file and memory.
+ * @param values Pointer to an array of `nrow * ncol` values (or `nrow` values for a 1-dimensional dataset), each of which is of size `dtype.getSize()`.
+ * @param nrow Number of rows.
+ * @param ncol Number of columns.
+ * If zero, a 1-dimensional dataset is created.
+ * @param options Options for writing.
+ *
+ * @return Handle to the new dataset.
+ */
+template<class Object>
+H5::DataSet write_bytes(const Object& handle, const std::string& name, const H5::DataType& dtype, const unsigned char* values, hsize_t nrow, hsize_t ncol, const Options& options) {
+    hsize_t dims[2] = { nrow, ncol };
+    H5::DataSpace space(ncol ? 2 : 1, dims);
+    size_t type_size = dtype.getSize();
+
+    hsize_t rows_per_chunk;
+    auto plist = array_plist(nrow, ncol, type_size, options, rows_per_chunk);
+    auto dhandle = handle.createDataSet(name, dtype, space, plist);
+    if (nrow == 0) {
+        return dhandle;
+    }
+
+#ifdef KANAVAL_USE_ZLIB
+    if (rows_per_chunk) {
+        write_chunks(dhandle, values, nrow, (ncol ? ncol : 1) * type_size, type_size, rows_per_chunk, options);
+        return dhandle;
+    }
+#endif
+
+    dhandle.write(values, dtype);
+    return dhandle;
+}
+
+/**
+ * Write a 1- or 2-dimensional numeric dataset from a row-major array.
+ * Small datasets use compact storage, while larger datasets are split into chunks of whole rows and compressed with shuffle and deflate.
+ * If `KANAVAL_USE_ZLIB` is defined, chunks are compressed in parallel across `Options::num_threads` threads.
+ * The file datatype is the same as the native type of `T`, so that readers can use the contents of each chunk without conversion.
+ *
+ * @tparam T Type of the values, see `utils::native_type()`.
+ * @tparam Object HDF5 object that can contain datasets, e.g., a file or group.
+ *
+ * @param handle Handle to the parent object.
+ * @param name Name of the dataset.
+ * @param values Pointer to an array of length `nrow * ncol`, or `nrow` for a 1-dimensional dataset.
+ * @param nrow Number of rows.
+ * @param ncol Number of columns.
+ * If zero, a 1-dimensional dataset is created.
+ * @param options Options for writing.
+ *
+ * @return Handle to the new dataset.
+ */
+template<typename T, class Object>
+H5::DataSet write_array(const Object& handle, const std::string& name, const T* values, hsize_t nrow, hsize_t ncol, const Options& options) {
+    return write_bytes(handle, name, utils::native_type<T>(), reinterpret_cast<const unsigned char*>(values), nrow, ncol, options);
+}
+
+/**
+ * Write a 1-dimensional numeric dataset, see `write_array()` for details.
+ *
+ * @tparam T Type of the values.
+ * @tparam Object HDF5 object that can contain datasets, e.g., a file or group.
+ *
+ * @param handle Handle to the parent object.
+ * @param name Name of the dataset.
+ * @param values Pointer to an array of length `n`.
+ * @param n Number of values.
+ * @param options Options for writing.
+ *
+ * @return Handle to the new dataset.
+ */
+template<typename T, class Object>
+H5::DataSet write_vector(const Object& handle, const std::string& name, const T* values, hsize_t n, const Options& options = Options()) {
+    return write_array(handle, name, values, n, 0, options);
+}
+
+/**
+ * Write a 2-dimensional numeric dataset, see `write_array()` for details.
+ *
+ * @tparam T Type of the values.
+ * @tparam Object HDF5 object that can contain datasets, e.g., a file or group.
+ *
+ * @param handle Handle to the parent object.
+ * @param name Name of the dataset.
+ * @param values Pointer to a row-major array of length `nrow * ncol`.
+ * @param nrow Number of rows.
+ * @param ncol Number of columns.
+ * @param options Options for writing.
+ *
+ * @return Handle to the new dataset.
+ */
+template<typename T, class Object>
+H5::DataSet write_matrix(const Object& handle, const std::string& name, const T* values, hsize_t nrow, hsize_t ncol, const Options& options = Options()) {
+    if (ncol == 0) {
+        throw std::runtime_error("number of columns should be positive for '" + name + "'");
+    }
+    return write_array(handle, name, values, nrow, ncol, options);
+}
+
+/**
+ * Write a scalar numeric dataset with compact storage.
+ *
+ * @tparam T Type of the value.
+ * @tparam Object HDF5 object that can contain datasets, e.g., a file or group.
+ *
+ * @param handle Handle to the parent object.
+ * @param name Name of the dataset.
+ * @param value Value to write.
+ *
+ * @return Handle to the new dataset.
+ */
+template<typename T, class Object>
+H5::DataSet write_scalar(const Object& handle, const std::string& name, T value) {
+    const auto& dtype = utils::native_type<T>();
+    auto dhandle = handle.createDataSet(name, dtype, H5::DataSpace(), compact_plist());
+    dhandle.write(&value, dtype);
+    return dhandle;
+}
+
+/**
+ * Write a scalar string dataset with a fixed-length datatype and compact storage.
+ *
+ * @tparam Object HDF5 object that can contain datasets, e.g., a file or group.
+ *
+ * @param handle Handle to the parent object.
+ * @param name Name of the dataset.
+ * @param value String to write.
+ *
+ * @return Handle to the new dataset.
+ */
+template<class Object>
+H5::DataSet write_string(const Object& handle, const std::string& name, const std::string& value) {
+    H5::StrType stype(H5::PredType::C_S1, std::max(static_cast<size_t>(1), value.size()));
+    auto dhandle = handle.createDataSet(name, stype, H5::DataSpace(), compact_plist());
+    std::vector<char> buffer(stype.getSize());
+    std::copy(value.begin(), value.end(), buffer.begin());
+    dhandle.write(buffer.data(), stype);
+    return dhandle;
+}
+
+/**
+ * Write a 1-dimensional string dataset with a fixed-length datatype, using the length of the longest string.
+ * Small datasets use compact storage, otherwise the dataset is stored contiguously.
+ *
+ * @tparam Object HDF5 object that can contain datasets, e.g., a file or group.
+ *
+ * @param handle Handle to the parent object.
+ * @param name Name of the dataset.
+ * @param values Strings to write.
+ * @param options Options for writing.
+ *
+ * @return Handle to the new dataset.
+ */
+template<class Object>
+H5::DataSet write_strings(const Object& handle, const std::string& name, const std::vector<std::string>& values, const Options& options = Options()) {
+    size_t maxlen = 1;
+    for (const auto& v : values) {
+        maxlen = std::max(maxlen, v.size());
+    }
+
+    std::vector<char> buffer(maxlen * values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        std::copy(values[i].begin(), values[i].end(), buffer.begin() + i * maxlen);
+    }
+
+    H5::StrType stype(H5::PredType::C_S1, maxlen);
+    hsize_t n = values.size();
+    H5::DataSpace space(1, &n);
+
+    auto plist = (buffer.size() <= options.compact_size ? compact_plist() : H5::DSetCreatPropList());
+    auto dhandle = handle.createDataSet(name, stype, space, plist);
+    if (n) {
+        dhandle.write(buffer.data(), stype);
+    }
+    return dhandle;
+}
+
+/**
+ * Copy all attributes from one group or dataset to another, e.g., when an object is rewritten rather than copied with `H5Ocopy()`.
+ * Attributes are copied with their original datatype and dataspace.
+ *
+ * @param from Handle to the source group or dataset.
+ * @param to Handle to the destination group or dataset.
+ */
+inline void copy_attributes(const H5::H5Object& from, const H5::H5Object& to) {
+    int nattrs = from.getNumAttrs();
+    std::vector<unsigned char> buffer;
+    for (int a = 0; a < nattrs; ++a) {
+        auto ahandle = from.openAttribute(static_cast<unsigned int>(a));
+        auto dtype = ahandle.getDataType();
+        auto space = ahandle.getSpace();
+        auto copy = to.createAttribute(ahandle.getName(), dtype, space);
+
+        hssize_t n = space.getSimpleExtentNpoints();
+        if (n <= 0) {
+            continue;
+        }
+        buffer.resize(n * dtype.getSize());
+        ahandle.read(dtype, buffer.data());
+        copy.write(dtype, buffer.data());
+
+        // Freeing any memory allocated for variable-length values; this is a no-op for other types.
+        H5Dvlen_reclaim(dtype.getId(), space.getId(), H5P_DEFAULT, buffer.data());
+    }
+}
+
+}
+
+}
+
+#endif
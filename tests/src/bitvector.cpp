@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include "kanaval/bitvector.hpp"
+#include <vector>
+#include <random>
+
+static void compare_bitvector(const std::vector<bool>& expected) {
+    kanaval::BitVector bits;
+    for (auto b : expected) {
+        bits.push_back(b);
+    }
+    bits.finish();
+    ASSERT_EQ(bits.size(), expected.size());
+
+    size_t ones = 0;
+    std::vector<size_t> positions;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(bits.get(i), expected[i]);
+        EXPECT_EQ(bits.rank(i), ones);
+        if (expected[i]) {
+            positions.push_back(i);
+            ++ones;
+        }
+    }
+    EXPECT_EQ(bits.rank(expected.size()), ones);
+    EXPECT_EQ(bits.count(), ones);
+
+    for (size_t j = 0; j < positions.size(); ++j) {
+        EXPECT_EQ(bits.select(j), positions[j]);
+    }
+    EXPECT_ANY_THROW(bits.select(ones));
+}
+
+TEST(BitVector, Basic) {
+    compare_bitvector({});
+    compare_bitvector({ true });
+    compare_bitvector({ false, true, true, false, true });
+    compare_bitvector(std::vector<bool>(1000, true));
+    compare_bitvector(std::vector<bool>(1000, false));
+}
+
+TEST(BitVector, Random) {
+    std::mt19937_64 rng(42);
+
+    // Checking dense, sparse and intermediate densities across multiple directory blocks and select samples.
+    for (double density : { 0.001, 0.05, 0.5, 0.99 }) {
+        std::bernoulli_distribution dist(density);
+        std::vector<bool> expected(100000);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            expected[i] = dist(rng);
+        }
+        compare_bitvector(expected);
+    }
+}
+
+TEST(BitVector, Append) {
+    kanaval::BitVector bits;
+    bits.append(1000, false);
+    bits.push_back(true);
+    bits.append(70, true);
+    bits.append(5000, false);
+    bits.push_back(true);
+    bits.finish();
+
+    EXPECT_EQ(bits.size(), 6072);
+    EXPECT_EQ(bits.count(), 72);
+    EXPECT_EQ(bits.select(0), 1000);
+    EXPECT_EQ(bits.select(70), 1070);
+    EXPECT_EQ(bits.select(71), 6071);
+    EXPECT_EQ(bits.rank(1050), 50);
+    EXPECT_EQ(bits.rank(6071), 71);
+}
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include "kanaval/container.hpp"
+#include "kanaval/kanaval.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v2/helpers.h"
+#include "v3/helpers.h"
+#include <fstream>
+#include <vector>
+#include <string>
+
+static void quick_write_file(const std::string& path, const std::string& contents) {
+    std::ofstream out(path, std::ios::binary);
+    out << contents;
+}
+
+static std::string quick_read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+TEST(Container, Header) {
+    kanaval::container::Header header;
+    header.format_type = kanaval::container::LINKED;
+    header.version = 3000000;
+    header.state_nbytes = 0x0102030405060708ull;
+
+    unsigned char buffer[kanaval::container::header_size];
+    kanaval::container::encode_header(header, buffer);
+    EXPECT_EQ(buffer[0], 1);
+    EXPECT_EQ(buffer[8], 3000000 & 0xFF);
+    EXPECT_EQ(buffer[16], 0x08);
+    EXPECT_EQ(buffer[23], 0x01);
+
+    auto decoded = kanaval::container::decode_header(buffer);
+    EXPECT_EQ(decoded.format_type, header.format_type);
+    EXPECT_EQ(decoded.version, header.version);
+    EXPECT_EQ(decoded.state_nbytes, header.state_nbytes);
+}
+
+TEST(Container, Pack) {
+    const std::string state = "TEST_container.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+    }
+
+    // Some larger contents to exercise repeated copies.
+    std::string mtx(3000001, 'x');
+    for (size_t i = 0; i < mtx.size(); i += 7) {
+        mtx[i] = 'a' + (i % 26);
+    }
+    quick_write_file("TEST_container.mtx", mtx);
+    quick_write_file("TEST_container.tsv", "GENE1\nGENE2\n");
+
+    const std::string output = "TEST_container.kana";
+    auto header = kanaval::container::pack(state, { "TEST_container.mtx", "TEST_container.tsv" }, output, 3000000);
+    EXPECT_EQ(header.format_type, kanaval::container::EMBEDDED);
+    EXPECT_EQ(header.version, 3000000);
+
+    // Offsets were updated in the state file, which is still valid.
+    {
+        H5::H5File handle(state, H5F_ACC_RDONLY);
+        auto groups = kanaval::container::list_file_groups(handle);
+        ASSERT_EQ(groups.size(), 2);
+        EXPECT_EQ(kanaval::utils::load_integer_scalar<hsize_t>(groups[0], "offset"), 0);
+        EXPECT_EQ(kanaval::utils::load_integer_scalar<hsize_t>(groups[0], "size"), mtx.size());
+        EXPECT_EQ(kanaval::utils::load_integer_scalar<hsize_t>(groups[1], "offset"), mtx.size());
+        EXPECT_EQ(kanaval::utils::load_integer_scalar<hsize_t>(groups[1], "size"), 12);
+        EXPECT_NO_THROW(kanaval::v3::validate(handle, true, latest));
+    }
+
+    auto packed = quick_read_file(output);
+    auto state_contents = quick_read_file(state);
+    ASSERT_EQ(packed.size(), kanaval::container::header_size + state_contents.size() + mtx.size() + 12);
+
+    auto decoded = kanaval::container::decode_header(reinterpret_cast<const unsigned char*>(packed.data()));
+    EXPECT_EQ(decoded.state_nbytes, state_contents.size());
+
+    size_t start = kanaval::container::header_size;
+    EXPECT_TRUE(packed.compare(start, state_contents.size(), state_contents) == 0);
+    start += state_contents.size();
+    EXPECT_TRUE(packed.compare(start, mtx.size(), mtx) == 0);
+    start += mtx.size();
+    EXPECT_EQ(packed.substr(start), "GENE1\nGENE2\n");
+}
+
+TEST(Container, PackFail) {
+    const std::string state = "TEST_container.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+    }
+    quick_write_file("TEST_container.tsv", "GENE1\n");
+
+    quick_throw([&]() -> void {
+        kanaval::container::pack(state, { "TEST_container.tsv" }, "TEST_container.kana", 3000000);
+    }, "number of input files");
+
+    quick_throw([&]() -> void {
+        kanaval::container::pack(state, { "TEST_container.tsv", "TEST_container.missing" }, "TEST_container.kana", 3000000);
+    }, "failed to inspect");
+}
+
+TEST(Container, Reader) {
+    const std::string state = "TEST_container.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+    }
+
+    // Embedding a HDF5 file as the first input.
+    std::vector<int> contents { 1, 2, 3, 4, 5 };
+    {
+        H5::H5File handle("TEST_container_inner.h5", H5F_ACC_TRUNC);
+        quick_write_dataset(handle, "foo", contents);
+    }
+    quick_write_file("TEST_container.tsv", "GENE1\nGENE2\n");
+
+    const std::string output = "TEST_container.kana";
+    kanaval::container::pack(state, { "TEST_container_inner.h5", "TEST_container.tsv" }, output, 3000000);
+
+    kanaval::container::Reader reader(output);
+    EXPECT_EQ(reader.header().version, 3000000);
+
+    const auto& entries = reader.entries();
+    ASSERT_EQ(entries.size(), 2);
+    EXPECT_EQ(entries[0].dataset, "IMMA_FIRST");
+    EXPECT_EQ(entries[0].type, "mtx");
+    EXPECT_EQ(entries[0].name, "foo.mtx");
+    EXPECT_EQ(entries[1].type, "genes");
+    EXPECT_EQ(entries[1].offset, entries[0].size);
+
+    // State file can be opened directly.
+    {
+        auto handle = reader.open_state();
+        EXPECT_NO_THROW(kanaval::v3::validate(handle, true, latest));
+    }
+
+    auto gview = reader.view("IMMA_FIRST", "genes");
+    EXPECT_TRUE(gview.is_mapped());
+    EXPECT_EQ(gview.offset(), kanaval::container::header_size + reader.header().state_nbytes + entries[1].offset);
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(gview.data()), gview.size()), "GENE1\nGENE2\n");
+
+    // Embedded HDF5 file can be opened as a file image, even after the view is gone.
+    H5::H5File inner;
+    {
+        auto hview = reader.view(reader.find("IMMA_FIRST", "mtx"));
+        inner = kanaval::container::open_image(hview);
+    }
+    EXPECT_EQ(kanaval::utils::load_integer_vector(inner, "foo"), contents);
+
+    quick_throw([&]() -> void {
+        reader.find("IMMA_SECOND", "genes");
+    }, "no file of type");
+}
+
+TEST(Container, ReaderV2) {
+    const std::string state = "TEST_container.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v2::add_multiple_matrices(handle);
+    }
+
+    quick_write_file("TEST_container.h5ad", "H5");
+    quick_write_file("TEST_container.mtx", "MTX");
+    quick_write_file("TEST_container.tsv", "GENE1\n");
+
+    const std::string output = "TEST_container.kana";
+    kanaval::container::pack(state, { "TEST_container.h5ad", "TEST_container.mtx", "TEST_container.tsv" }, output, latest);
+
+    kanaval::container::Reader reader(output);
+    const auto& entries = reader.entries();
+    ASSERT_EQ(entries.size(), 3);
+    EXPECT_EQ(entries[0].dataset, "A");
+    EXPECT_EQ(entries[1].dataset, "B");
+    EXPECT_EQ(entries[2].dataset, "B");
+
+    auto mview = reader.view("B", "mtx");
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(mview.data()), mview.size()), "MTX");
+    auto hview = reader.view("A", "h5");
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(hview.data()), hview.size()), "H5");
+}
+
+TEST(Container, ReaderFail) {
+    quick_write_file("TEST_container.kana", "kana");
+    quick_throw([&]() -> void {
+        kanaval::container::Reader reader("TEST_container.kana");
+    }, "too small");
+
+    unsigned char buffer[kanaval::container::header_size];
+    kanaval::container::Header header;
+    header.version = 3000000;
+    header.state_nbytes = 1000;
+    kanaval::container::encode_header(header, buffer);
+    quick_write_file("TEST_container.kana", std::string(reinterpret_cast<const char*>(buffer), kanaval::container::header_size));
+    quick_throw([&]() -> void {
+        kanaval::container::Reader reader("TEST_container.kana");
+    }, "past the end");
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include "kanaval/manifest.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v3/helpers.h"
+
+TEST(Manifest, V3) {
+    const std::string path = "TEST_manifest.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+
+        // Using a v3 version number so that the v3 validators are dispatched.
+        auto mhandle = handle.openGroup("_metadata");
+        mhandle.unlink("format_version");
+        quick_write_dataset(mhandle, "format_version", 3000000);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto man = kanaval::create_manifest(handle, true, 3000000);
+    EXPECT_EQ(man.format_version, 3000000);
+    EXPECT_EQ(man.num_cells, 20);
+    EXPECT_EQ(man.filtered_cells, 15);
+    EXPECT_EQ(man.num_blocks, 1);
+
+    ASSERT_EQ(man.num_features.size(), 3);
+    EXPECT_EQ(man.num_features[0], std::make_pair(std::string("RNA"), 1000));
+    EXPECT_EQ(man.num_features[1], std::make_pair(std::string("ADT"), 4));
+    EXPECT_EQ(man.num_features[2], std::make_pair(std::string("CRISPR"), 6));
+    ASSERT_EQ(man.num_pcs.size(), 3);
+    EXPECT_EQ(man.num_pcs[0].second, 20);
+
+    EXPECT_EQ(man.cluster_method, "kmeans");
+    EXPECT_EQ(man.cluster_sizes, std::vector<int>(5, 3));
+
+    ASSERT_EQ(man.selections.size(), 3);
+    EXPECT_EQ(man.selections[0].first, "bar");
+    EXPECT_EQ(man.selections[0].second, 15);
+
+    EXPECT_EQ(man.references, (std::vector<std::string>{ "BlueprintEncode", "DatabaseImmuneCellExpression", "ImmGen", "MouseRNAseq" }));
+    EXPECT_EQ(man.application_name, "bakana");
+    EXPECT_EQ(man.application_version, "1.1.1");
+}
+
+TEST(Manifest, Json) {
+    kanaval::Manifest man;
+    man.format_version = 2001000;
+    man.num_cells = 10;
+    man.filtered_cells = 8;
+    man.num_blocks = 2;
+    man.num_features = { { "RNA", 100 }, { "ADT", 5 } };
+    man.num_pcs = { { "RNA", 20 } };
+    man.cluster_method = "snn_graph";
+    man.cluster_sizes = { 5, 3 };
+    man.selections = { { "foo\"bar", 2 } };
+    man.references = { "ImmGen" };
+
+    EXPECT_EQ(kanaval::to_json(man), 
+        "{\"format_version\":2001000,\"num_cells\":10,\"filtered_cells\":8,\"num_blocks\":2,"
+        "\"num_features\":{\"RNA\":100,\"ADT\":5},\"num_pcs\":{\"RNA\":20},"
+        "\"clustering\":{\"method\":\"snn_graph\",\"sizes\":[5,3]},"
+        "\"selections\":{\"foo\\\"bar\":2},\"references\":[\"ImmGen\"],\"application\":null}"
+    );
+
+    man.application_name = "kana";
+    man.application_version = "3.0.0\n";
+    auto json = kanaval::to_json(man);
+    std::string expected = "\"application\":{\"name\":\"kana\",\"version\":\"3.0.0\\u000a\"}}";
+    ASSERT_TRUE(json.size() > expected.size());
+    EXPECT_EQ(json.substr(json.size() - expected.size()), expected);
+}
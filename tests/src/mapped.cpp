@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include "kanaval/mapped.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+static std::vector<double> mock_values(size_t n) {
+    std::vector<double> values(n);
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = static_cast<double>(i) / 7;
+    }
+    return values;
+}
+
+TEST(Mapped, Contiguous) {
+    const std::string path = "TEST_mapped.h5";
+    auto values = mock_values(1000);
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        hsize_t dims[2] = { 100, 10 };
+        H5::DataSpace space(2, dims);
+        auto dhandle = handle.createDataSet("pcs", H5::PredType::NATIVE_DOUBLE, space);
+        dhandle.write(values.data(), H5::PredType::NATIVE_DOUBLE);
+        quick_write_dataset(handle, "clusters", std::vector<int>{ 0, 1, 2, 1, 0 });
+    }
+
+    kanaval::mapped::Span<double> span;
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        auto dhandle = handle.openDataSet("pcs");
+        EXPECT_NE(kanaval::mapped::contiguous_offset<double>(dhandle), HADDR_UNDEF);
+        EXPECT_EQ(kanaval::mapped::contiguous_offset<float>(dhandle), HADDR_UNDEF);
+        span = kanaval::mapped::open<double>(dhandle);
+
+        auto clusters = kanaval::mapped::open<int>(handle.openDataSet("clusters"));
+        EXPECT_EQ(std::vector<int>(clusters.begin(), clusters.end()), (std::vector<int>{ 0, 1, 2, 1, 0 }));
+    }
+
+    // Span is still valid after the file is closed.
+    EXPECT_TRUE(span.is_mapped());
+    EXPECT_EQ(std::vector<double>(span.begin(), span.end()), values);
+
+    // Falls back to a copy for type conversions.
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        auto converted = kanaval::mapped::open<float>(handle.openDataSet("pcs"));
+        EXPECT_FALSE(converted.is_mapped());
+        EXPECT_EQ(converted.size(), 1000);
+        EXPECT_FLOAT_EQ(converted[999], values[999]);
+    }
+}
+
+TEST(Mapped, Fallback) {
+    const std::string path = "TEST_mapped.h5";
+    auto values = mock_values(1000);
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        hsize_t n = values.size(), chunk = 100;
+        H5::DataSpace space(1, &n);
+        H5::DSetCreatPropList plist;
+        plist.setChunk(1, &chunk);
+        plist.setDeflate(6);
+        auto dhandle = handle.createDataSet("x", H5::PredType::NATIVE_DOUBLE, space, plist);
+        dhandle.write(values.data(), H5::PredType::NATIVE_DOUBLE);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto dhandle = handle.openDataSet("x");
+    EXPECT_EQ(kanaval::mapped::contiguous_offset<double>(dhandle), HADDR_UNDEF);
+
+    auto span = kanaval::mapped::open<double>(dhandle);
+    EXPECT_FALSE(span.is_mapped());
+    EXPECT_EQ(std::vector<double>(span.begin(), span.end()), values);
+}
+
+TEST(Mapped, Container) {
+    const std::string path = "TEST_mapped.h5";
+    const std::string container = "TEST_mapped.kana";
+    auto values = mock_values(500);
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        hsize_t n = values.size();
+        H5::DataSpace space(1, &n);
+        auto dhandle = handle.createDataSet("x", H5::PredType::NATIVE_DOUBLE, space);
+        dhandle.write(values.data(), H5::PredType::NATIVE_DOUBLE);
+    }
+
+    // Embedding the HDF5 file in a container after some header bytes.
+    const size_t header = 4096;
+    {
+        std::ifstream input(path, std::ios::binary);
+        std::vector<char> contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        std::ofstream output(container, std::ios::binary);
+        std::vector<char> padding(header, 'k');
+        output.write(padding.data(), padding.size());
+        output.write(contents.data(), contents.size());
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto span = kanaval::mapped::open<double>(handle.openDataSet("x"), container, header);
+    EXPECT_TRUE(span.is_mapped());
+    EXPECT_EQ(std::vector<double>(span.begin(), span.end()), values);
+}
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include "kanaval/migrate.hpp"
+#include "kanaval/kanaval.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v2/helpers.h"
+#include <fstream>
+#include <vector>
+#include <string>
+
+static void quick_write_file(const std::string& path, const std::string& contents) {
+    std::ofstream out(path, std::ios::binary);
+    out << contents;
+}
+
+TEST(Migrate, Single) {
+    const std::string input = "TEST_migrate_v2.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+        quick_write_dataset(handle, "tsne/results/extra", std::vector<double>{ 1.5, 2.5 });
+    }
+
+    const std::string output = "TEST_migrate_v3.h5";
+    kanaval::v3::Summary summary;
+    {
+        H5::H5File handle(input, H5F_ACC_RDONLY);
+        summary = kanaval::migrate::migrate_state(handle, output, true, latest);
+    }
+    EXPECT_EQ(summary.inputs.num_cells, 10);
+    EXPECT_EQ(summary.inputs.num_blocks, 1);
+    EXPECT_EQ(summary.filtered_cells, 8);
+    EXPECT_EQ(summary.num_pcs["RNA"], 20);
+    EXPECT_EQ(summary.cluster_method, "kmeans");
+    EXPECT_EQ(summary.num_clusters, 5);
+    EXPECT_EQ(summary.application_name, "kana");
+
+    H5::H5File handle(output, H5F_ACC_RDONLY);
+    EXPECT_NO_THROW(kanaval::validate(handle, true, 3000000));
+    EXPECT_EQ(kanaval::utils::load_string(handle, "inputs/parameters/datasets/0/name"), "default");
+    EXPECT_EQ(kanaval::utils::load_string(handle, "inputs/parameters/datasets/0/files/1/type"), "genes");
+    EXPECT_EQ(kanaval::utils::load_integer_vector(handle, "inputs/results/feature_identities/RNA").size(), 1000);
+    EXPECT_FALSE(handle.exists("quality_control"));
+    EXPECT_FALSE(handle.exists("rna_quality_control/parameters/skip"));
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(handle, "cell_filtering/parameters/use_rna"), 1);
+    EXPECT_EQ(kanaval::utils::load_string(handle, "snn_graph_cluster/parameters/algorithm"), "multilevel");
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(handle, "_metadata/format_version"), 3000000);
+
+    // Unchanged datasets are copied verbatim.
+    H5::DataSet extra = handle.openDataSet("tsne/results/extra");
+    std::vector<double> values(2);
+    extra.read(values.data(), H5::PredType::NATIVE_DOUBLE);
+    EXPECT_EQ(values, (std::vector<double>{ 1.5, 2.5 }));
+}
+
+TEST(Migrate, Multiple) {
+    const std::string input = "TEST_migrate_v2.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle, true, true);
+        quick_write_dataset(handle, "combine_embeddings/parameters/weights/RNA", 2.0);
+        quick_write_dataset(handle, "combine_embeddings/parameters/weights/ADT", 0.5);
+    }
+
+    const std::string output = "TEST_migrate_v3.h5";
+    kanaval::v3::Summary summary;
+    {
+        H5::H5File handle(input, H5F_ACC_RDONLY);
+        summary = kanaval::migrate::migrate_state(handle, output, true, latest, "foo", "1.2.3");
+    }
+    EXPECT_EQ(summary.inputs.num_blocks, 2);
+    EXPECT_EQ(summary.num_pcs["ADT"], 10);
+    EXPECT_EQ(summary.total_pcs, 30);
+    EXPECT_EQ(summary.application_version, "1.2.3");
+
+    H5::H5File handle(output, H5F_ACC_RDONLY);
+    EXPECT_EQ(kanaval::utils::load_string(handle, "inputs/parameters/datasets/0/name"), "A");
+    EXPECT_EQ(kanaval::utils::load_string(handle, "inputs/parameters/datasets/0/format"), "10X");
+    EXPECT_EQ(kanaval::utils::load_string(handle, "inputs/parameters/datasets/1/name"), "B");
+    EXPECT_EQ(handle.openGroup("inputs/parameters/datasets/1/files").getNumObjs(), 2);
+    EXPECT_EQ(kanaval::utils::load_float_scalar(handle, "combine_embeddings/parameters/rna_weight"), 2);
+    EXPECT_EQ(kanaval::utils::load_float_scalar(handle, "combine_embeddings/parameters/adt_weight"), 0.5);
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(handle, "cell_filtering/parameters/use_adt"), 1);
+}
+
+// Files from v2.0 have no 'skip' flags for the QC steps, and no v2 files have 'compute_auc' or 'lfc_threshold' for the marker steps.
+static void check_version(int version) {
+    const std::string input = "TEST_migrate_v2.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle, false, true);
+        if (version < 2001000) {
+            handle.unlink("quality_control/parameters/skip");
+            handle.unlink("adt_quality_control/parameters/skip");
+        }
+        EXPECT_FALSE(handle.exists("marker_detection/parameters/compute_auc"));
+        EXPECT_FALSE(handle.exists("custom_selections/parameters/lfc_threshold"));
+    }
+
+    const std::string output = "TEST_migrate_v3.h5";
+    kanaval::v3::Summary summary;
+    {
+        H5::H5File handle(input, H5F_ACC_RDONLY);
+        summary = kanaval::migrate::migrate_state(handle, output, true, version);
+    }
+    EXPECT_EQ(summary.filtered_cells, 8);
+    EXPECT_EQ(summary.num_pcs["ADT"], 10);
+
+    H5::H5File handle(output, H5F_ACC_RDONLY);
+    EXPECT_NO_THROW(kanaval::validate(handle, true, 3000000));
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(handle, "cell_filtering/parameters/use_rna"), 1);
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(handle, "cell_filtering/parameters/use_adt"), 1);
+    EXPECT_FALSE(handle.exists("rna_quality_control/parameters/skip"));
+    EXPECT_FALSE(handle.exists("adt_quality_control/parameters/skip"));
+
+    for (std::string step : { "marker_detection", "custom_selections" }) {
+        EXPECT_EQ(kanaval::utils::load_integer_scalar(handle, step + "/parameters/compute_auc"), 1);
+        EXPECT_EQ(kanaval::utils::load_float_scalar(handle, step + "/parameters/lfc_threshold"), 0);
+    }
+}
+
+TEST(Migrate, Versions) {
+    check_version(2000000);
+    check_version(2001000);
+}
+
+TEST(Migrate, Skipped) {
+    const std::string input = "TEST_migrate_v2.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::add_quality_control(handle, 10, 1, 2);
+        handle.unlink("quality_control/parameters/skip");
+        quick_write_dataset(handle, "quality_control/parameters/skip", 1);
+    }
+
+    {
+        H5::H5File ihandle(input, H5F_ACC_RDONLY);
+        H5::H5File ohandle("TEST_migrate_v3.h5", H5F_ACC_TRUNC);
+        EXPECT_TRUE(kanaval::migrate::migrate_quality_control(ihandle, "quality_control", ohandle, "rna_quality_control", true));
+        EXPECT_FALSE(ohandle.exists("rna_quality_control/parameters/skip"));
+        EXPECT_TRUE(ohandle.exists("rna_quality_control/results/metrics/sums"));
+    }
+
+    {
+        H5::H5File handle(input, H5F_ACC_RDWR);
+        handle.unlink("quality_control/results/metrics");
+    }
+    quick_throw([&]() -> void {
+        H5::H5File ihandle(input, H5F_ACC_RDONLY);
+        H5::H5File ohandle("TEST_migrate_v3.h5", H5F_ACC_TRUNC);
+        kanaval::migrate::migrate_quality_control(ihandle, "quality_control", ohandle, "rna_quality_control", true);
+    }, "without 'metrics'");
+}
+
+TEST(Migrate, Container) {
+    const std::string state = "TEST_migrate_v2.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+    }
+    quick_write_file("TEST_migrate.mtx", "MTX");
+    quick_write_file("TEST_migrate.tsv", "GENE1\n");
+    kanaval::container::pack(state, { "TEST_migrate.mtx", "TEST_migrate.tsv" }, "TEST_migrate_v2.kana", latest);
+
+    auto summary = kanaval::migrate::migrate("TEST_migrate_v2.kana", "TEST_migrate_v3.kana");
+    EXPECT_EQ(summary.filtered_cells, 8);
+
+    kanaval::container::Reader reader("TEST_migrate_v3.kana");
+    EXPECT_EQ(reader.header().version, 3000000);
+    EXPECT_EQ(reader.header().format_type, kanaval::container::EMBEDDED);
+    auto mview = reader.view("default", "mtx");
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(mview.data()), mview.size()), "MTX");
+    auto gview = reader.view("default", "genes");
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(gview.data()), gview.size()), "GENE1\n");
+
+    auto handle = reader.open_state();
+    EXPECT_NO_THROW(kanaval::validate(handle, true, 3000000));
+}
+
+TEST(Migrate, Fail) {
+    const std::string input = "TEST_migrate_v2.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+    }
+
+    quick_throw([&]() -> void {
+        H5::H5File handle(input, H5F_ACC_RDONLY);
+        kanaval::migrate::migrate_state(handle, "TEST_migrate_v3.h5", true, 3000000);
+    }, "only state files from version 2");
+
+    {
+        H5::H5File handle(input, H5F_ACC_RDWR);
+        handle.unlink("tsne");
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(input, H5F_ACC_RDONLY);
+        kanaval::migrate::migrate_state(handle, "TEST_migrate_v3.h5", true, latest);
+    }, "failed to validate the input state file");
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include "kanaval/profile.hpp"
+#include "kanaval/writer.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v2/helpers.h"
+#include <vector>
+#include <string>
+
+static const kanaval::profile::Dataset& find_dataset(const kanaval::profile::Profile& prof, const std::string& path) {
+    for (const auto& s : prof.steps) {
+        for (const auto& d : s.datasets) {
+            if (d.path == path) {
+                return d;
+            }
+        }
+    }
+    throw std::runtime_error("could not find '" + path + "'");
+}
+
+TEST(Profile, Layouts) {
+    const std::string path = "TEST_profile.h5";
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        auto ghandle = handle.createGroup("foo");
+
+        // Tiny chunks that also span the wrong axis.
+        {
+            hsize_t dims[2] = { 100, 10 };
+            H5::DataSpace space(2, dims);
+            H5::DSetCreatPropList plist;
+            hsize_t cdims[2] = { 100, 1 };
+            plist.setChunk(2, cdims);
+            std::vector<int> values(1000, 1);
+            auto dhandle = ghandle.createDataSet("tiny", H5::PredType::NATIVE_INT, space, plist);
+            dhandle.write(values.data(), H5::PredType::NATIVE_INT);
+        }
+
+        // Large and uncompressed.
+        quick_write_dataset(ghandle, "large", std::vector<double>(200000, 1.5));
+
+        // Well-behaved.
+        kanaval::writer::Options opt;
+        opt.chunk_size = 10000;
+        std::vector<double> values(20000, 2.5);
+        kanaval::writer::write_array(ghandle, "good", values.data(), 10000, 2, opt);
+        quick_write_dataset(ghandle, "name", std::vector<std::string>{ "A", "BB" });
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto prof = kanaval::profile::profile(handle, latest);
+    ASSERT_EQ(prof.steps.size(), 1);
+    EXPECT_EQ(prof.steps[0].name, "foo");
+    EXPECT_EQ(prof.steps[0].datasets.size(), 4);
+    EXPECT_EQ(prof.num_warnings, 3);
+    EXPECT_TRUE(prof.file_bytes > 0);
+
+    const auto& tiny = find_dataset(prof, "foo/tiny");
+    EXPECT_EQ(tiny.dtype, "int32");
+    EXPECT_EQ(tiny.dims, (std::vector<hsize_t>{ 100, 10 }));
+    EXPECT_EQ(tiny.layout, "chunked");
+    EXPECT_EQ(tiny.chunk_dims, (std::vector<hsize_t>{ 100, 1 }));
+    EXPECT_EQ(tiny.num_chunks, 10);
+    EXPECT_EQ(tiny.logical_bytes, 4000);
+    EXPECT_EQ(tiny.storage_bytes, 4000);
+    EXPECT_EQ(tiny.warnings.size(), 2);
+    EXPECT_TRUE(tiny.metadata_bytes > 0);
+
+    const auto& large = find_dataset(prof, "foo/large");
+    EXPECT_EQ(large.dtype, "float64");
+    EXPECT_EQ(large.layout, "contiguous");
+    EXPECT_EQ(large.compression_ratio, 1);
+    EXPECT_EQ(large.warnings, (std::vector<std::string>{ "large dataset without compression" }));
+
+    const auto& good = find_dataset(prof, "foo/good");
+    EXPECT_EQ(good.layout, "chunked");
+    EXPECT_EQ(good.chunk_dims, (std::vector<hsize_t>{ 5000, 2 }));
+    EXPECT_EQ(good.filters, (std::vector<std::string>{ "shuffle", "deflate" }));
+    EXPECT_TRUE(good.compression_ratio > 10);
+    EXPECT_TRUE(good.warnings.empty());
+    EXPECT_TRUE(good.read_cost < large.read_cost);
+
+    const auto& name = find_dataset(prof, "foo/name");
+    EXPECT_EQ(name.dtype, "string[2]");
+    EXPECT_EQ(name.layout, "contiguous");
+    EXPECT_TRUE(name.warnings.empty());
+
+    auto table = kanaval::profile::to_table(prof);
+    EXPECT_TRUE(table.find("! tiny chunks of 400 bytes") != std::string::npos);
+    EXPECT_TRUE(table.find("! chunks do not span whole rows") != std::string::npos);
+    EXPECT_TRUE(table.find("foo/good") != std::string::npos);
+}
+
+TEST(Profile, Steps) {
+    const std::string path = "TEST_profile.h5";
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto prof = kanaval::profile::profile(handle, latest);
+    ASSERT_EQ(prof.steps.size(), handle.getNumObjs());
+    EXPECT_EQ(prof.steps.front().name, "inputs");
+    EXPECT_EQ(prof.steps.back().name, "cell_labelling");
+
+    for (const auto& s : prof.steps) {
+        uint64_t total = 0;
+        for (const auto& d : s.datasets) {
+            total += d.logical_bytes;
+            EXPECT_EQ(d.path.rfind(s.name + "/", 0), 0);
+        }
+        EXPECT_EQ(s.logical_bytes, total);
+        EXPECT_TRUE(s.metadata_bytes > 0);
+    }
+
+    const auto& pcs = find_dataset(prof, "pca/results/pcs");
+    EXPECT_EQ(pcs.dims, (std::vector<hsize_t>{ 8, 20 }));
+    EXPECT_EQ(pcs.logical_bytes, 8 * 20 * 8);
+
+    const auto& format = find_dataset(prof, "inputs/parameters/format");
+    EXPECT_EQ(format.dtype, "string");
+    EXPECT_TRUE(format.dims.empty());
+}
+
+TEST(Profile, Json) {
+    kanaval::profile::Profile prof;
+    prof.file_bytes = 1000;
+    prof.free_bytes = 10;
+    prof.metadata_bytes = 50;
+    prof.num_warnings = 1;
+
+    prof.steps.resize(1);
+    auto& step = prof.steps[0];
+    step.name = "pca";
+    step.logical_bytes = 800;
+    step.storage_bytes = 400;
+    step.metadata_bytes = 100;
+    step.read_cost = 1200.5;
+
+    step.datasets.resize(2);
+    auto& first = step.datasets[0];
+    first.path = "pca/results/pcs";
+    first.dtype = "float64";
+    first.dims = { 10, 10 };
+    first.layout = "chunked";
+    first.chunk_dims = { 1, 10 };
+    first.filters = { "shuffle", "deflate" };
+    first.logical_bytes = 800;
+    first.storage_bytes = 400;
+    first.metadata_bytes = 80;
+    first.num_chunks = 10;
+    first.compression_ratio = 2;
+    first.read_cost = 1200.5;
+    first.warnings = { "tiny chunks of 80 bytes" };
+
+    auto& second = step.datasets[1];
+    second.path = "pca/parameters/num_pcs";
+    second.dtype = "int32";
+    second.layout = "compact";
+    second.metadata_bytes = 20;
+
+    EXPECT_EQ(kanaval::profile::to_json(prof),
+        "{\"file_bytes\":1000,\"free_bytes\":10,\"metadata_bytes\":50,\"num_warnings\":1,\"steps\":["
+        "{\"name\":\"pca\",\"logical_bytes\":800,\"storage_bytes\":400,\"metadata_bytes\":100,\"read_cost\":1200.5,\"datasets\":["
+        "{\"path\":\"pca/results/pcs\",\"dtype\":\"float64\",\"dims\":[10,10],\"layout\":\"chunked\",\"chunk_dims\":[1,10],"
+        "\"filters\":[\"shuffle\",\"deflate\"],\"logical_bytes\":800,\"storage_bytes\":400,\"metadata_bytes\":80,\"num_chunks\":10,"
+        "\"compression_ratio\":2,\"read_cost\":1200.5,\"warnings\":[\"tiny chunks of 80 bytes\"]},"
+        "{\"path\":\"pca/parameters/num_pcs\",\"dtype\":\"int32\",\"dims\":[],\"layout\":\"compact\",\"chunk_dims\":null,"
+        "\"filters\":[],\"logical_bytes\":0,\"storage_bytes\":0,\"metadata_bytes\":20,\"num_chunks\":0,"
+        "\"compression_ratio\":0,\"read_cost\":0,\"warnings\":[]}"
+        "]}]}"
+    );
+}
+
+TEST(Profile, TableLongNames) {
+    kanaval::profile::Profile prof;
+    prof.steps.resize(1);
+    auto& step = prof.steps[0];
+    step.name = "custom_selections";
+
+    step.datasets.resize(1);
+    auto& dataset = step.datasets[0];
+    dataset.path = "custom_selections/parameters/selections/" + std::string(600, 'x');
+    dataset.dtype = "int32";
+    dataset.layout = "contiguous";
+    dataset.logical_bytes = 123;
+    dataset.warnings = { "something " + std::string(600, 'y') };
+
+    // Long paths should be reported in full, followed by the rest of the row.
+    auto table = kanaval::profile::to_table(prof);
+    EXPECT_TRUE(table.find("  " + dataset.path + " int32 ") != std::string::npos);
+    EXPECT_TRUE(table.find("123 B") != std::string::npos);
+    EXPECT_TRUE(table.find("    ! " + dataset.warnings[0] + "\n") != std::string::npos);
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include "kanaval/repack.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v2/helpers.h"
+#include "v3/helpers.h"
+#include <vector>
+#include <string>
+
+static H5D_layout_t get_layout(const H5::H5File& handle, const std::string& name) {
+    return handle.openDataSet(name).getCreatePlist().getLayout();
+}
+
+// Mimic an old file with tiny chunks and no compression.
+static void add_fragmented(H5::H5File& handle, const std::string& name, hsize_t nrow, hsize_t ncol) {
+    std::vector<double> values(nrow * ncol);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = i * 0.5;
+    }
+
+    hsize_t dims[2] = { nrow, ncol };
+    H5::DataSpace space(2, dims);
+    H5::DSetCreatPropList plist;
+    hsize_t cdims[2] = { 1, 1 };
+    plist.setChunk(2, cdims);
+    auto dhandle = handle.createDataSet(name, H5::PredType::NATIVE_DOUBLE, space, plist);
+    dhandle.write(values.data(), H5::PredType::NATIVE_DOUBLE);
+}
+
+static std::vector<double> load_all(const H5::H5File& handle, const std::string& name) {
+    auto dhandle = handle.openDataSet(name);
+    std::vector<double> output(dhandle.getSpace().getSimpleExtentNpoints());
+    dhandle.read(output.data(), H5::PredType::NATIVE_DOUBLE);
+    return output;
+}
+
+static void check_version2(int nthreads) {
+    const std::string input = "TEST_repack_in.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+        add_fragmented(handle, "tsne/results/extra", 200, 3);
+        std::vector<double> medium(100);
+        for (size_t i = 0; i < medium.size(); ++i) {
+            medium[i] = i % 7;
+        }
+        quick_write_dataset(handle, "tsne/results/medium", medium); // fewer chunks than threads.
+        quick_write_dataset(handle, "custom_stuff", std::vector<std::string>{ "A", "BB", "CCC" });
+
+        // Adding attributes at all levels, including a variable-length string.
+        H5::DataSpace scalar;
+        handle.openGroup("/").createAttribute("origin", H5::PredType::NATIVE_INT, scalar).write(H5::PredType::NATIVE_INT, &nthreads);
+        int level = 5;
+        handle.openGroup("tsne").createAttribute("level", H5::PredType::NATIVE_INT, scalar).write(H5::PredType::NATIVE_INT, &level);
+        H5::StrType vtype(H5::PredType::C_S1, H5T_VARIABLE);
+        H5std_string units = "microns";
+        handle.openDataSet("tsne/results/extra").createAttribute("units", vtype, scalar).write(vtype, units);
+    }
+
+    kanaval::writer::Options opt;
+    opt.num_threads = nthreads;
+    opt.chunk_size = 60;
+    opt.compact_size = 512;
+
+    const std::string output = "TEST_repack_out.h5";
+    auto report = kanaval::repack::repack(input, output, true, latest, opt);
+    EXPECT_TRUE(report.rewritten > 0);
+    EXPECT_TRUE(report.copied > 0); // variable-length strings.
+    EXPECT_TRUE(report.input_bytes > 0);
+    EXPECT_TRUE(report.output_bytes > 0);
+    EXPECT_TRUE(report.output_bytes < report.input_bytes);
+    EXPECT_TRUE(report.input_load_time >= 0);
+    EXPECT_TRUE(report.output_load_time >= 0);
+
+    H5::H5File ihandle(input, H5F_ACC_RDONLY);
+    H5::H5File ohandle(output, H5F_ACC_RDONLY);
+    EXPECT_NO_THROW(kanaval::validate(ohandle, true, latest));
+
+    EXPECT_EQ(load_all(ihandle, "tsne/results/extra"), load_all(ohandle, "tsne/results/extra"));
+    EXPECT_EQ(load_all(ihandle, "tsne/results/medium"), load_all(ohandle, "tsne/results/medium"));
+    EXPECT_EQ(get_layout(ohandle, "tsne/results/medium"), H5D_CHUNKED);
+    EXPECT_EQ(load_all(ihandle, "pca/results/pcs"), load_all(ohandle, "pca/results/pcs"));
+    EXPECT_EQ(kanaval::utils::load_integer_vector(ihandle, "cell_filtering/results/discards"), kanaval::utils::load_integer_vector(ohandle, "cell_filtering/results/discards"));
+    EXPECT_EQ(kanaval::utils::load_string(ohandle, "inputs/parameters/format"), "MatrixMarket");
+    EXPECT_EQ(kanaval::utils::load_string_vector(ohandle, "custom_stuff"), (std::vector<std::string>{ "A", "BB", "CCC" }));
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(ohandle, "tsne/parameters/iterations"), 1000);
+
+    // Checking that the chunks are now whole rows.
+    auto extra = ohandle.openDataSet("tsne/results/extra");
+    auto plist = extra.getCreatePlist();
+    EXPECT_EQ(plist.getLayout(), H5D_CHUNKED);
+    hsize_t cdims[2];
+    plist.getChunk(2, cdims);
+    EXPECT_EQ(cdims[0], 20);
+    EXPECT_EQ(cdims[1], 3);
+    EXPECT_EQ(plist.getNfilters(), 2);
+
+    EXPECT_EQ(get_layout(ohandle, "tsne/parameters/perplexity"), H5D_COMPACT);
+    EXPECT_EQ(get_layout(ohandle, "tsne/results/x"), H5D_COMPACT);
+
+    // Checking that the attributes survive.
+    int origin = 0;
+    ohandle.openGroup("/").openAttribute("origin").read(H5::PredType::NATIVE_INT, &origin);
+    EXPECT_EQ(origin, nthreads);
+    int level = 0;
+    ohandle.openGroup("tsne").openAttribute("level").read(H5::PredType::NATIVE_INT, &level);
+    EXPECT_EQ(level, 5);
+    H5::StrType vtype(H5::PredType::C_S1, H5T_VARIABLE);
+    H5std_string units;
+    extra.openAttribute("units").read(vtype, units);
+    EXPECT_EQ(units, "microns");
+}
+
+static void check_version3(int nthreads) {
+    const std::string input = "TEST_repack_in.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        auto mhandle = handle.openGroup("_metadata");
+        mhandle.unlink("format_version");
+        quick_write_dataset(mhandle, "format_version", 3000000);
+    }
+
+    kanaval::writer::Options opt;
+    opt.num_threads = nthreads;
+    opt.compression_level = 0;
+    opt.compact_size = 100;
+
+    const std::string output = "TEST_repack_out.h5";
+    auto report = kanaval::repack::repack(input, output, true, 3000000, opt);
+    EXPECT_TRUE(report.rewritten > 0);
+
+    H5::H5File ihandle(input, H5F_ACC_RDONLY);
+    H5::H5File ohandle(output, H5F_ACC_RDONLY);
+    EXPECT_EQ(load_all(ihandle, "rna_pca/results/pcs"), load_all(ohandle, "rna_pca/results/pcs"));
+    EXPECT_EQ(get_layout(ohandle, "rna_pca/results/pcs"), H5D_CONTIGUOUS);
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(ohandle, "_metadata/format_version"), 3000000);
+}
+
+TEST(Repack, Version2) {
+    check_version2(1);
+    check_version2(3);
+}
+
+TEST(Repack, Version3) {
+    check_version3(1);
+    check_version3(3);
+}
+
+TEST(Repack, StepOrder) {
+    const std::string input = "TEST_repack_in.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+        quick_write_dataset(handle, "aaa_extra", 1);
+    }
+
+    H5::H5File handle(input, H5F_ACC_RDONLY);
+    auto order = kanaval::repack::step_order(handle, latest);
+    EXPECT_EQ(order.front(), "inputs");
+    EXPECT_EQ(order.back(), "aaa_extra");
+    EXPECT_EQ(order.size(), handle.getNumObjs());
+
+    auto qc = std::find(order.begin(), order.end(), "quality_control");
+    auto labels = std::find(order.begin(), order.end(), "cell_labelling");
+    EXPECT_TRUE(qc < labels);
+}
+
+TEST(Repack, Fail) {
+    const std::string input = "TEST_repack_in.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+        handle.unlink("tsne");
+    }
+
+    quick_throw([&]() -> void {
+        kanaval::repack::repack(input, "TEST_repack_out.h5", true, latest);
+    }, "failed to validate the input state file");
+}
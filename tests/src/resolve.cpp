@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include "kanaval/resolve.hpp"
+#include "kanaval/store.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v3/helpers.h"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <string>
+
+static void quick_write_file(const std::string& path, const std::string& contents) {
+    std::ofstream out(path, std::ios::binary);
+    out << contents;
+}
+
+static const std::string mtx = "%%MatrixMarket matrix coordinate integer general\n1000 20 2\n1 1 5\n1000 20 1\n";
+
+static std::vector<std::string> quick_linked(const std::string& root) {
+    const std::string state = "TEST_resolve.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        auto mhandle = handle.openGroup("_metadata");
+        mhandle.unlink("format_version");
+        quick_write_dataset(mhandle, "format_version", 3000000);
+    }
+    quick_write_file("TEST_resolve.mtx", mtx);
+    quick_write_file("TEST_resolve.tsv", "GENE1\nGENE2\n");
+    kanaval::container::pack(state, { "TEST_resolve.mtx", "TEST_resolve.tsv" }, "TEST_resolve.kana", 3000000);
+
+    std::filesystem::remove_all(root);
+    kanaval::store::Store store(root);
+    return kanaval::store::to_linked("TEST_resolve.kana", store, "TEST_resolve_linked.kana");
+}
+
+class CountingResolver : public kanaval::resolve::DirectoryResolver {
+public:
+    CountingResolver(std::string root) : DirectoryResolver(std::move(root), true) {}
+
+    kanaval::container::FileView resolve(const std::string& id) const override {
+        ++count;
+        return DirectoryResolver::resolve(id);
+    }
+
+    mutable std::atomic<int> count = 0;
+};
+
+TEST(Resolve, Basic) {
+    const std::string root = "TEST_resolve_store";
+    auto ids = quick_linked(root);
+    kanaval::container::Reader reader("TEST_resolve_linked.kana");
+
+    kanaval::Options opt;
+    opt.num_threads = 2;
+    kanaval::resolve::DirectoryResolver resolver(root, true);
+    auto views = kanaval::resolve::resolve_all(reader, resolver, opt);
+    ASSERT_EQ(views.size(), 2);
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(views[0].data()), views[0].size()), mtx);
+
+    opt.deep = true;
+    EXPECT_NO_THROW(kanaval::resolve::check(reader, resolver, opt));
+
+    // Unsharded directories also work.
+    const std::string flat = "TEST_resolve_flat";
+    std::filesystem::remove_all(flat);
+    std::filesystem::create_directories(flat);
+    for (const auto& id : ids) {
+        std::filesystem::copy_file(resolver.path(id), flat + "/" + id);
+    }
+    EXPECT_NO_THROW(kanaval::resolve::check(reader, kanaval::resolve::DirectoryResolver(flat), opt));
+
+    // Embedded files are rejected.
+    kanaval::container::Reader embedded("TEST_resolve.kana");
+    quick_throw([&]() -> void {
+        kanaval::resolve::resolve_all(embedded, resolver);
+    }, "not linked");
+}
+
+TEST(Resolve, Deduplicated) {
+    const std::string root = "TEST_resolve_store";
+    quick_linked(root);
+
+    // Pointing both files to the same identifier.
+    {
+        H5::H5File handle("TEST_resolve.h5", H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        for (auto& fhandle : kanaval::container::list_file_groups(handle)) {
+            fhandle.unlink("offset");
+            fhandle.unlink("size");
+            quick_write_dataset(fhandle, "id", kanaval::container::Reader("TEST_resolve_linked.kana").entries()[0].id);
+        }
+    }
+    {
+        kanaval::container::Header header;
+        header.format_type = kanaval::container::LINKED;
+        header.version = 3000000;
+        header.state_nbytes = kanaval::container::file_size("TEST_resolve.h5");
+        kanaval::container::Output sink("TEST_resolve_dup.kana");
+        unsigned char buffer[kanaval::container::header_size];
+        kanaval::container::encode_header(header, buffer);
+        sink.write(buffer, kanaval::container::header_size);
+        sink.append("TEST_resolve.h5", header.state_nbytes);
+        sink.close();
+    }
+
+    kanaval::container::Reader reader("TEST_resolve_dup.kana");
+    CountingResolver resolver(root);
+    kanaval::Options opt;
+    opt.num_threads = 2;
+    auto views = kanaval::resolve::resolve_all(reader, resolver, opt);
+    EXPECT_EQ(views.size(), 2);
+    EXPECT_EQ(resolver.count.load(), 1);
+}
+
+TEST(Resolve, Fail) {
+    const std::string root = "TEST_resolve_store";
+    auto ids = quick_linked(root);
+    kanaval::container::Reader reader("TEST_resolve_linked.kana");
+    kanaval::resolve::DirectoryResolver resolver(root, true);
+
+    // Corrupted cache contents are only detected by deep checks.
+    quick_write_file(resolver.path(ids[0]), "GENE1\nGENE2\n");
+    kanaval::Options opt;
+    EXPECT_NO_THROW(kanaval::resolve::check(reader, resolver, opt));
+    opt.deep = true;
+    quick_throw([&]() -> void {
+        kanaval::resolve::check(reader, resolver, opt);
+    }, "failed to check contents of file 0");
+
+    // All missing files are reported.
+    std::filesystem::remove(resolver.path(ids[0]));
+    std::filesystem::remove(resolver.path(ids[1]));
+    quick_throw([&]() -> void {
+        kanaval::resolve::check(reader, resolver, opt);
+    }, "failed to resolve '" + ids[0] + "'");
+    quick_throw([&]() -> void {
+        kanaval::resolve::check(reader, resolver, opt);
+    }, "failed to resolve '" + ids[1] + "'");
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include "kanaval/utils.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+static std::vector<double> sequence(size_t n, double shift) {
+    std::vector<double> values(n);
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = i + shift;
+    }
+    return values;
+}
+
+static void check_rows(const H5::DataSet& dhandle, hsize_t ncols, const std::vector<double>& expected) {
+    kanaval::utils::RowReader<double> reader(dhandle, ncols);
+    typename kanaval::utils::RowReader<double>::Workspace work;
+    hsize_t nrows = expected.size() / ncols;
+
+    for (hsize_t start = 0; start < nrows; start += 7) {
+        hsize_t len = std::min(static_cast<hsize_t>(11), nrows - start);
+        std::vector<double> buffer(len * ncols);
+        reader.read(start, len, buffer.data(), work);
+        EXPECT_EQ(buffer, std::vector<double>(expected.begin() + start * ncols, expected.begin() + (start + len) * ncols));
+    }
+}
+
+TEST(RowReader, Contiguous) {
+    const std::string path = "TEST_row_reader.h5";
+    auto values = sequence(300, 0.25);
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        quick_write_dataset(handle, "foo", values);
+        quick_write_dataset(handle, "bar", sequence(200, 64));
+
+        hsize_t dims[2] = { 100, 3 };
+        H5::DataSpace space(2, dims);
+        handle.createDataSet("matrix", H5::PredType::NATIVE_DOUBLE, space).write(values.data(), H5::PredType::NATIVE_DOUBLE);
+        quick_write_dataset(handle, "ints", std::vector<int>{ 5, 4, 3, 2, 1 });
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    check_rows(handle.openDataSet("foo"), 1, values);
+    check_rows(handle.openDataSet("matrix"), 3, values);
+    check_rows(handle.openDataSet("ints"), 1, std::vector<double>{ 5, 4, 3, 2, 1 });
+}
+
+TEST(RowReader, ContiguousUserblock) {
+    const std::string path = "TEST_row_reader.h5";
+    auto values = sequence(100, 0.5);
+
+    {
+        H5::FileCreatPropList fcpl;
+        fcpl.setUserblock(512);
+        H5::H5File handle(path, H5F_ACC_TRUNC, fcpl);
+        quick_write_dataset(handle, "foo", values);
+
+        // Adding another dataset afterwards, so that the contents of 'foo' are not at the end of the file.
+        quick_write_dataset(handle, "bar", sequence(200, 64));
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    check_rows(handle.openDataSet("foo"), 1, values);
+}
+
+TEST(RowReader, Hdf5) {
+    const std::string path = "TEST_row_reader.h5";
+    auto values = sequence(200, 0.5);
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+
+        // Unfiltered chunks are always read through HDF5.
+        hsize_t dims[2] = { 100, 2 };
+        H5::DataSpace space(2, dims);
+        H5::DSetCreatPropList plist;
+        hsize_t cdims[2] = { 7, 2 };
+        plist.setChunk(2, cdims);
+        handle.createDataSet("chunked", H5::PredType::NATIVE_DOUBLE, space, plist).write(values.data(), H5::PredType::NATIVE_DOUBLE);
+
+        // As are compact datasets.
+        hsize_t n = 20;
+        H5::DataSpace cspace(1, &n);
+        H5::DSetCreatPropList cplist;
+        cplist.setLayout(H5D_COMPACT);
+        handle.createDataSet("compact", H5::PredType::NATIVE_DOUBLE, cspace, cplist).write(values.data(), H5::PredType::NATIVE_DOUBLE);
+
+        quick_write_dataset(handle, "foo", values);
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        check_rows(handle.openDataSet("chunked"), 2, values);
+        check_rows(handle.openDataSet("compact"), 1, std::vector<double>(values.begin(), values.begin() + 20));
+    }
+
+    // Contiguous datasets in writable files are also read through HDF5, as recent writes might not be flushed yet.
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        auto dhandle = handle.openDataSet("foo");
+        std::vector<double> replacement(values.size(), -1);
+        dhandle.write(replacement.data(), H5::PredType::NATIVE_DOUBLE);
+        check_rows(dhandle, 1, replacement);
+    }
+}
+
+TEST(RowReader, Unallocated) {
+    const std::string path = "TEST_row_reader.h5";
+    std::vector<double> values(100);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = i;
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        hsize_t dims = 100;
+        H5::DataSpace space(1, &dims);
+        H5::DSetCreatPropList plist;
+        hsize_t cdims = 10;
+        plist.setChunk(1, &cdims);
+        plist.setDeflate(6);
+        double fill = -1;
+        plist.setFillValue(H5::PredType::NATIVE_DOUBLE, &fill);
+        auto dhandle = handle.createDataSet("foo", H5::PredType::NATIVE_DOUBLE, space, plist);
+
+        // Only writing the first 30 values, so the other chunks are never allocated.
+        hsize_t count = 30, offset = 0;
+        space.selectHyperslab(H5S_SELECT_SET, &count, &offset);
+        H5::DataSpace mspace(1, &count);
+        dhandle.write(values.data(), H5::PredType::NATIVE_DOUBLE, mspace, space);
+        std::fill(values.begin() + 30, values.end(), -1);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto dhandle = handle.openDataSet("foo");
+    kanaval::utils::RowReader<double> reader(dhandle, 1);
+    typename kanaval::utils::RowReader<double>::Workspace work;
+
+    std::vector<double> partial(40);
+    reader.read(5, 20, partial.data(), work);
+    EXPECT_EQ(std::vector<double>(partial.begin(), partial.begin() + 20), std::vector<double>(values.begin() + 5, values.begin() + 25));
+    reader.read(15, 40, partial.data(), work);
+    EXPECT_EQ(partial, std::vector<double>(values.begin() + 15, values.begin() + 55));
+}
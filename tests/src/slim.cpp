@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include "kanaval/slim.hpp"
+#include "kanaval/kanaval.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v2/helpers.h"
+#include "v3/helpers.h"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+static bool has_path(const std::vector<std::string>& paths, const std::string& target) {
+    return std::find(paths.begin(), paths.end(), target) != paths.end();
+}
+
+static size_t float_size(const H5::H5File& handle, const std::string& name) {
+    return handle.openDataSet(name).getFloatType().getSize();
+}
+
+TEST(Slim, Version2) {
+    const std::string input = "TEST_slim_in.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+    }
+
+    const std::string output = "TEST_slim_out.h5";
+    auto report = kanaval::slim::slim(input, output, true, latest);
+    EXPECT_EQ(report.removed.size(), 2);
+    EXPECT_TRUE(has_path(report.removed, "snn_graph_cluster/results/clusters")); // kmeans was chosen.
+    EXPECT_TRUE(has_path(report.removed, "batch_correction/results/corrected")); // only one block.
+    EXPECT_EQ(report.downcast, 0);
+    EXPECT_TRUE(report.output_bytes < report.input_bytes);
+
+    H5::H5File handle(output, H5F_ACC_RDONLY);
+    EXPECT_NO_THROW(kanaval::validate(handle, true, latest));
+    EXPECT_FALSE(handle.exists("snn_graph_cluster/results/clusters"));
+    EXPECT_TRUE(handle.exists("kmeans_cluster/results/clusters"));
+    EXPECT_FALSE(handle.exists("batch_correction/results/corrected"));
+    EXPECT_EQ(float_size(handle, "pca/results/pcs"), 8);
+}
+
+TEST(Slim, Downcast) {
+    const std::string input = "TEST_slim_in.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+        handle.unlink("tsne/results/x");
+        quick_write_dataset(handle, "tsne/results/x", std::vector<double>{ 1.5, -2.25, 0, 4, 5, 6, 7, 8 });
+    }
+
+    const std::string output = "TEST_slim_out.h5";
+    auto report = kanaval::slim::slim(input, output, true, latest, true);
+    EXPECT_TRUE(report.downcast > 0);
+
+    {
+        H5::H5File handle(output, H5F_ACC_RDONLY);
+        EXPECT_EQ(float_size(handle, "pca/results/pcs"), 4);
+        EXPECT_EQ(float_size(handle, "tsne/results/y"), 4);
+        EXPECT_EQ(float_size(handle, "tsne/parameters/perplexity"), 8); // parameters are left alone.
+        EXPECT_EQ(float_size(handle, "quality_control/results/metrics/sums"), 8); // QC metrics and thresholds are left alone.
+        EXPECT_EQ(float_size(handle, "quality_control/results/thresholds/sums"), 8);
+
+        std::vector<double> x(8);
+        handle.openDataSet("tsne/results/x").read(x.data(), H5::PredType::NATIVE_DOUBLE);
+        EXPECT_EQ(x, (std::vector<double>{ 1.5, -2.25, 0, 4, 5, 6, 7, 8 }));
+    }
+
+    // Values that can't be represented are caught.
+    {
+        H5::H5File handle(input, H5F_ACC_RDWR);
+        quick_set_value(handle, "tsne/results/y", 0, 1e300);
+    }
+    quick_throw([&]() -> void {
+        kanaval::slim::slim(input, output, true, latest, true);
+    }, "failed to downcast 'tsne/results/y'");
+}
+
+// Overwrite the QC results in a single-block v3 file so that the same cells are discarded by every step and the discards are consistent with the thresholds.
+// The RNA sums of the discarded cells are just below the threshold, such that they would be equal in single precision.
+static void make_qc_consistent(H5::H5File& handle, int num_cells, int lost) {
+    std::vector<int> discards(num_cells);
+    std::fill(discards.begin(), discards.begin() + lost, 1);
+
+    auto replace = [&](const std::string& step, const std::string& name, const auto& values) -> void {
+        auto rhandle = handle.openGroup(step + "/results");
+        rhandle.unlink(name);
+        quick_write_dataset(rhandle, name, values);
+    };
+
+    std::vector<double> sums(num_cells, 2000);
+    std::fill(sums.begin(), sums.begin() + lost, 1000.00000001);
+    replace("rna_quality_control", "metrics/sums", sums);
+    replace("rna_quality_control", "thresholds/sums", std::vector<double>{ 1000.00000002 });
+    replace("rna_quality_control", "thresholds/proportion", std::vector<double>{ 0.5 });
+    replace("rna_quality_control", "discards", discards);
+
+    std::vector<double> igg(num_cells);
+    std::fill(igg.begin(), igg.begin() + lost, 1);
+    replace("adt_quality_control", "metrics/igg_total", igg);
+    replace("adt_quality_control", "thresholds/igg_total", std::vector<double>{ 0.5 });
+    replace("adt_quality_control", "discards", discards);
+
+    std::vector<double> proportion(num_cells, 0.5);
+    std::fill(proportion.begin(), proportion.begin() + lost, 0);
+    replace("crispr_quality_control", "metrics/sums", std::vector<double>(num_cells, 100));
+    replace("crispr_quality_control", "metrics/max_proportion", proportion);
+    replace("crispr_quality_control", "thresholds/max_count", std::vector<double>{ 10 });
+    replace("crispr_quality_control", "discards", discards);
+}
+
+TEST(Slim, DeepValidation) {
+    const std::string input = "TEST_slim_in.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        auto mhandle = handle.openGroup("_metadata");
+        mhandle.unlink("format_version");
+        quick_write_dataset(mhandle, "format_version", 3000000);
+        make_qc_consistent(handle, 20, 5);
+    }
+
+    kanaval::Options validation;
+    validation.deep = true;
+    validation.num_threads = 2;
+
+    const std::string output = "TEST_slim_out.h5";
+    auto report = kanaval::slim::slim(input, output, true, 3000000, true, kanaval::writer::Options(), validation);
+    EXPECT_TRUE(report.downcast > 0);
+
+    H5::H5File handle(output, H5F_ACC_RDONLY);
+    EXPECT_NO_THROW(kanaval::validate(handle, true, 3000000, validation));
+    EXPECT_EQ(float_size(handle, "rna_quality_control/results/metrics/sums"), 8);
+    EXPECT_EQ(float_size(handle, "rna_quality_control/results/thresholds/sums"), 8);
+    EXPECT_EQ(float_size(handle, "rna_pca/results/pcs"), 4);
+}
+
+TEST(Slim, Version3) {
+    const std::string input = "TEST_slim_in.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        auto mhandle = handle.openGroup("_metadata");
+        mhandle.unlink("format_version");
+        quick_write_dataset(mhandle, "format_version", 3000000);
+
+        handle.unlink("marker_detection");
+        handle.unlink("custom_selections");
+        std::unordered_map<std::string, int> num_features { { "RNA", 1000 }, { "ADT", 4 }, { "CRISPR", 6 }};
+        v3::add_marker_detection(handle, num_features, 5, /* has_auc = */ false);
+        v3::add_custom_selections(handle, num_features, 15, /* has_auc = */ false);
+
+        // Adding AUCs anyway, which are ignored by the validators.
+        auto phandle = handle.openGroup("marker_detection/results/per_cluster/RNA/0");
+        auto ahandle = phandle.createGroup("auc");
+        quick_write_dataset(ahandle, "mean", std::vector<double>(1000));
+    }
+
+    const std::string output = "TEST_slim_out.h5";
+    auto report = kanaval::slim::slim(input, output, true, 3000000);
+    EXPECT_TRUE(has_path(report.removed, "snn_graph_cluster/results/clusters"));
+    EXPECT_TRUE(has_path(report.removed, "marker_detection/results/per_cluster/RNA/0/auc"));
+    EXPECT_FALSE(has_path(report.removed, "marker_detection/results/per_cluster/RNA/1/auc"));
+
+    H5::H5File handle(output, H5F_ACC_RDONLY);
+    EXPECT_FALSE(handle.exists("marker_detection/results/per_cluster/RNA/0/auc"));
+    EXPECT_TRUE(handle.exists("marker_detection/results/per_cluster/RNA/0/cohen"));
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(handle, "_metadata/format_version"), 3000000);
+}
+
+TEST(Slim, Fail) {
+    const std::string input = "TEST_slim_in.h5";
+    {
+        H5::H5File handle(input, H5F_ACC_TRUNC);
+        v2::spawn_full(handle);
+        handle.unlink("kmeans_cluster/results/clusters");
+    }
+
+    quick_throw([&]() -> void {
+        kanaval::slim::slim(input, "TEST_slim_out.h5", true, latest);
+    }, "failed to validate the input state file");
+}
@@ -0,0 +1,502 @@
+#include <gtest/gtest.h>
+#include "kanaval/sniff.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v2/helpers.h"
+#include "v3/helpers.h"
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <numeric>
+
+#ifdef KANAVAL_USE_ZLIB
+#include "zlib.h"
+#endif
+
+static kanaval::container::FileView quick_view(const std::string& contents) {
+    const std::string path = "TEST_sniff.txt";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << contents;
+    }
+    return kanaval::container::view_range(path, 0, contents.size());
+}
+
+TEST(Sniff, MatrixMarket) {
+    auto out = kanaval::sniff::check_matrix_market(quick_view("%%MatrixMarket matrix coordinate integer general\n% comment\n%\n 100 20 5\n1 1 1\n"));
+    EXPECT_FALSE(out.gzipped);
+    EXPECT_EQ(out.rows, 100);
+    EXPECT_EQ(out.columns, 20);
+    EXPECT_EQ(out.nonzeros, 5);
+
+    out = kanaval::sniff::check_matrix_market(quick_view("%%MatrixMarket Matrix Coordinate Real General\r\n10 2 0"));
+    EXPECT_EQ(out.rows, 10);
+    EXPECT_EQ(out.nonzeros, 0);
+
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_matrix_market(quick_view("GENE1\tFOO\n"));
+    }, "MatrixMarket");
+
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_matrix_market(quick_view("%%MatrixMarket matrix array real general\n10 2\n"));
+    }, "coordinate");
+
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_matrix_market(quick_view("%%MatrixMarket matrix coordinate complex general\n10 2 0\n"));
+    }, "unsupported");
+
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_matrix_market(quick_view("%%MatrixMarket matrix coordinate integer general\n10 2\n"));
+    }, "three non-negative integers");
+
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_matrix_market(quick_view("%%MatrixMarket matrix coordinate integer general\n% nothing else\n"));
+    }, "size line");
+}
+
+#ifdef KANAVAL_USE_ZLIB
+TEST(Sniff, MatrixMarketGzip) {
+    std::string contents = "%%MatrixMarket matrix coordinate integer general\n";
+    contents += std::string(100000, '%') + "\n"; // a long comment that spans multiple inflation steps.
+    contents += "50 40 30\n";
+
+    const std::string path = "TEST_sniff.mtx.gz";
+    {
+        auto gz = gzopen(path.c_str(), "wb");
+        gzwrite(gz, contents.data(), contents.size());
+        gzclose(gz);
+    }
+    auto view = kanaval::container::view_range(path, 0, kanaval::container::file_size(path));
+
+    // Too long for the default inspection limit.
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_matrix_market(view);
+    }, "size line");
+
+    contents = "%%MatrixMarket matrix coordinate integer general\n50 40 30\n1 1 1\n";
+    {
+        auto gz = gzopen(path.c_str(), "wb");
+        gzwrite(gz, contents.data(), contents.size());
+        gzclose(gz);
+    }
+    view = kanaval::container::view_range(path, 0, kanaval::container::file_size(path));
+    auto out = kanaval::sniff::check_matrix_market(view);
+    EXPECT_TRUE(out.gzipped);
+    EXPECT_EQ(out.rows, 50);
+    EXPECT_EQ(out.columns, 40);
+    EXPECT_EQ(out.nonzeros, 30);
+}
+#endif
+
+static kanaval::container::FileView quick_hdf5(const std::vector<std::string>& groups, const std::vector<std::string>& datasets) {
+    const std::string path = "TEST_sniff.h5";
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        for (const auto& g : groups) {
+            handle.createGroup(g);
+        }
+        for (const auto& d : datasets) {
+            quick_write_dataset(handle, d, 1);
+        }
+    }
+    return kanaval::container::view_range(path, 0, kanaval::container::file_size(path));
+}
+
+TEST(Sniff, HDF5) {
+    auto view = quick_hdf5({ "matrix" }, { "matrix/data", "matrix/indices", "matrix/indptr", "matrix/shape" });
+    EXPECT_TRUE(kanaval::sniff::has_hdf5_signature(view));
+    EXPECT_NO_THROW(kanaval::sniff::check_10x(view));
+
+    // Legacy format.
+    view = quick_hdf5({ "mm10" }, { "mm10/data", "mm10/indices", "mm10/indptr", "mm10/shape" });
+    EXPECT_NO_THROW(kanaval::sniff::check_10x(view));
+
+    view = quick_hdf5({ "matrix" }, { "matrix/data" });
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_10x(view);
+    }, "should contain 'data'");
+
+    view = quick_hdf5({ "obs", "var" }, { "X" });
+    EXPECT_NO_THROW(kanaval::sniff::check_h5ad(view));
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_10x(view);
+    }, "'matrix' group");
+
+    view = quick_hdf5({ "obs" }, { "X" });
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_h5ad(view);
+    }, "'var'");
+
+    auto text = quick_view("%%MatrixMarket matrix coordinate integer general\n10 2 0\n");
+    EXPECT_FALSE(kanaval::sniff::has_hdf5_signature(text));
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_h5ad(text);
+    }, "should be a HDF5 file");
+}
+
+static void quick_pack(const std::string& mtx) {
+    const std::string state = "TEST_sniff_state.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+    }
+    {
+        std::ofstream out("TEST_sniff.mtx", std::ios::binary);
+        out << mtx;
+    }
+    {
+        std::ofstream out("TEST_sniff.tsv", std::ios::binary);
+        out << "GENE1\nGENE2\n";
+    }
+    kanaval::container::pack(state, { "TEST_sniff.mtx", "TEST_sniff.tsv" }, "TEST_sniff.kana", 3000000);
+}
+
+TEST(Sniff, Container) {
+    quick_pack("%%MatrixMarket matrix coordinate integer general\n1000 20 1\n1 1 1\n");
+    kanaval::container::Reader reader("TEST_sniff.kana");
+    EXPECT_EQ(reader.entries()[0].format, "MatrixMarket");
+
+    kanaval::Options opt;
+    opt.num_threads = 2;
+    EXPECT_NO_THROW(kanaval::sniff::check(reader, opt));
+
+    quick_pack("GENE1\nGENE2\n");
+    kanaval::container::Reader reader2("TEST_sniff.kana");
+    quick_throw([&]() -> void {
+        kanaval::sniff::check(reader2, opt);
+    }, "file 0 ('foo.mtx')");
+}
+
+static std::string quick_mtx(uint64_t nrows, uint64_t ncols, size_t nnz, bool messy = false) {
+    std::string output = "%%MatrixMarket matrix coordinate integer general\n% comment\n";
+    output += std::to_string(nrows) + " " + std::to_string(ncols) + " " + std::to_string(nnz) + "\n";
+    std::mt19937_64 rng(nnz);
+    for (size_t i = 0; i < nnz; ++i) {
+        output += std::to_string(rng() % nrows + 1) + (messy ? "\t " : " ") + std::to_string(rng() % ncols + 1) + " " + std::to_string(rng() % 100);
+        if (messy && i % 7 == 0) {
+            output += "\r\n\n% interleaved comment";
+        }
+        output += "\n";
+    }
+    return output;
+}
+
+TEST(Sniff, ParseMatrixMarket) {
+    kanaval::Options opt;
+    for (int nthreads = 1; nthreads <= 3; ++nthreads) {
+        opt.num_threads = nthreads;
+        auto out = kanaval::sniff::parse_matrix_market(quick_view(quick_mtx(1000, 20, 5000)), opt);
+        EXPECT_EQ(out.rows, 1000);
+        EXPECT_EQ(out.columns, 20);
+        EXPECT_EQ(out.nonzeros, 5000);
+
+        EXPECT_NO_THROW(kanaval::sniff::parse_matrix_market(quick_view(quick_mtx(1000, 20, 1000, true)), opt));
+
+        // Indices with more than 8 digits.
+        EXPECT_NO_THROW(kanaval::sniff::parse_matrix_market(quick_view(quick_mtx(12345678901ull, 20, 1000)), opt));
+    }
+
+    // Indices at the boundaries.
+    EXPECT_NO_THROW(kanaval::sniff::parse_matrix_market(quick_view("%%MatrixMarket matrix coordinate pattern general\n100000000 1 3\n1 1\n100000000 1\n99999999 1")));
+    quick_throw([&]() -> void {
+        kanaval::sniff::parse_matrix_market(quick_view("%%MatrixMarket matrix coordinate pattern general\n100000000 1 1\n100000001 1\n"));
+    }, "row index 100000001 is out of range");
+    quick_throw([&]() -> void {
+        kanaval::sniff::parse_matrix_market(quick_view("%%MatrixMarket matrix coordinate integer general\n10 5 1\n1 0 2\n"));
+    }, "column index 0 is out of range");
+
+    quick_throw([&]() -> void {
+        kanaval::sniff::parse_matrix_market(quick_view("%%MatrixMarket matrix coordinate integer general\n10 5 2\n1 1 2\n"));
+    }, "number of entries");
+    quick_throw([&]() -> void {
+        kanaval::sniff::parse_matrix_market(quick_view("%%MatrixMarket matrix coordinate integer general\n10 5 1\n1 1\n"));
+    }, "expected a value");
+    quick_throw([&]() -> void {
+        kanaval::sniff::parse_matrix_market(quick_view("%%MatrixMarket matrix coordinate integer general\n10 5 1\n1a 1 2\n"));
+    }, "expected a row index");
+    quick_throw([&]() -> void {
+        kanaval::sniff::parse_matrix_market(quick_view("%%MatrixMarket matrix coordinate integer general\n10 5 2\n1 1 2\n2 x 2\n"));
+    }, "at byte 64");
+}
+
+#ifdef KANAVAL_USE_ZLIB
+TEST(Sniff, ParseMatrixMarketGzip) {
+    // Large enough to span multiple blocks of decompressed text.
+    auto contents = quick_mtx(100000, 5000, 2500000, true);
+    ASSERT_TRUE(contents.size() > 2 * kanaval::sniff::inflate_block_size);
+
+    const std::string path = "TEST_sniff.mtx.gz";
+    auto quick_gzip = [&](const std::string& x) -> kanaval::container::FileView {
+        auto gz = gzopen(path.c_str(), "wb1");
+        gzwrite(gz, x.data(), x.size());
+        gzclose(gz);
+        return kanaval::container::view_range(path, 0, kanaval::container::file_size(path));
+    };
+
+    kanaval::Options opt;
+    opt.num_threads = 3;
+    auto out = kanaval::sniff::parse_matrix_market(quick_gzip(contents), opt);
+    EXPECT_TRUE(out.gzipped);
+    EXPECT_EQ(out.nonzeros, 2500000);
+
+    contents += "100001 1 1\n";
+    quick_throw([&]() -> void {
+        kanaval::sniff::parse_matrix_market(quick_gzip(contents), opt);
+    }, "out of range");
+
+    // Truncated stream.
+    auto truncated = quick_gzip(contents);
+    {
+        std::ofstream out("TEST_sniff_truncated.gz", std::ios::binary);
+        out.write(reinterpret_cast<const char*>(truncated.data()), truncated.size() / 2);
+    }
+    auto tview = kanaval::container::view_range("TEST_sniff_truncated.gz", 0, truncated.size() / 2);
+    quick_throw([&]() -> void {
+        kanaval::sniff::parse_matrix_market(tview, opt);
+    }, "decompress");
+}
+#endif
+
+#ifdef KANAVAL_USE_ZLIB
+TEST(Sniff, ParseMatrixMarketMultiGzip) {
+    auto contents = quick_mtx(1000, 20, 50000);
+
+    // Splitting in the middle of lines and concatenating the separately compressed members, like 'cat a.gz b.gz' or bgzip.
+    const std::string path = "TEST_sniff.mtx.gz";
+    {
+        std::vector<size_t> cuts { 0, 37, contents.size() / 2 + 3, contents.size() };
+        std::ofstream out(path, std::ios::binary);
+        for (size_t c = 1; c < cuts.size(); ++c) {
+            const std::string member = "TEST_sniff_member.gz";
+            auto gz = gzopen(member.c_str(), "wb");
+            gzwrite(gz, contents.data() + cuts[c - 1], cuts[c] - cuts[c - 1]);
+            gzclose(gz);
+
+            std::ifstream in(member, std::ios::binary);
+            out << in.rdbuf();
+        }
+    }
+
+    for (int nthreads : { 1, 3 }) {
+        kanaval::Options opt;
+        opt.num_threads = nthreads;
+        auto out = kanaval::sniff::parse_matrix_market(kanaval::container::view_range(path, 0, kanaval::container::file_size(path)), opt);
+        EXPECT_TRUE(out.gzipped);
+        EXPECT_EQ(out.rows, 1000);
+        EXPECT_EQ(out.columns, 20);
+        EXPECT_EQ(out.nonzeros, 50000);
+    }
+}
+#endif
+
+TEST(Sniff, Dimensions) {
+    kanaval::Options opt;
+    opt.num_threads = 2;
+
+    quick_pack(quick_mtx(1000, 20, 500));
+    EXPECT_NO_THROW(kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"), opt));
+
+    quick_pack(quick_mtx(999, 20, 500));
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"), opt);
+    }, "largest feature identity");
+
+    quick_pack(quick_mtx(1000, 19, 500));
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"), opt);
+    }, "not consistent with 'num_cells'");
+
+    auto broken = quick_mtx(1000, 20, 500);
+    broken.pop_back();
+    broken.pop_back();
+    broken += "\n1 1 1\n";
+    quick_pack(broken);
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"), opt);
+    }, "failed to check MatrixMarket file 'foo.mtx'");
+}
+
+TEST(Sniff, DimensionsEmptySubset) {
+    quick_pack(quick_mtx(1000, 21, 500));
+    {
+        kanaval::container::Reader reader("TEST_sniff.kana");
+        EXPECT_ANY_THROW(kanaval::sniff::check_dimensions(reader));
+    }
+
+    // An empty 'subset' group does not count as subsetting.
+    const std::string state = "TEST_sniff_state.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_RDWR);
+        handle.createGroup("inputs/parameters/subset");
+    }
+    kanaval::container::pack(state, { "TEST_sniff.mtx", "TEST_sniff.tsv" }, "TEST_sniff.kana", 3000000);
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"));
+    }, "not consistent with 'num_cells'");
+}
+
+static void quick_pack_v1(const std::string& mtx, bool has_identities) {
+    const std::string state = "TEST_sniff_state.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v2::add_single_matrix(handle, "MatrixMarket", 1000, 20);
+        auto rhandle = handle.openGroup("inputs/results");
+        rhandle.unlink("num_cells");
+        rhandle.unlink("num_features");
+        rhandle.unlink("identities");
+        quick_write_dataset(rhandle, "dimensions", std::vector<int>{ 1000, 20 });
+        if (has_identities) {
+            std::vector<int> identities(1000);
+            std::iota(identities.begin(), identities.end(), 0);
+            quick_write_dataset(rhandle, "identities", identities);
+        }
+    }
+    {
+        std::ofstream out("TEST_sniff.mtx", std::ios::binary);
+        out << mtx;
+    }
+    {
+        std::ofstream out("TEST_sniff.tsv", std::ios::binary);
+        out << "GENE1\nGENE2\n";
+    }
+    kanaval::container::pack(state, { "TEST_sniff.mtx", "TEST_sniff.tsv" }, "TEST_sniff.kana", has_identities ? 1002000 : 1000000);
+}
+
+TEST(Sniff, DimensionsVersion1) {
+    for (bool has_identities : { true, false }) {
+        quick_pack_v1(quick_mtx(1000, 20, 500), has_identities);
+        EXPECT_NO_THROW(kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana")));
+
+        quick_pack_v1(quick_mtx(1000, 19, 500), has_identities);
+        quick_throw([&]() -> void {
+            kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"));
+        }, "not consistent with 'num_cells'");
+    }
+
+    quick_pack_v1(quick_mtx(999, 20, 500), true);
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"));
+    }, "largest feature identity");
+}
+
+static void quick_10x(const std::string& path, int nfeatures, int ncells) {
+    H5::H5File handle(path, H5F_ACC_TRUNC);
+    handle.createGroup("matrix");
+    for (auto field : { "data", "indices", "indptr" }) {
+        quick_write_dataset(handle, std::string("matrix/") + field, std::vector<int>{ 0 });
+    }
+    quick_write_dataset(handle, "matrix/shape", std::vector<int>{ nfeatures, ncells });
+}
+
+static void quick_h5ad(const std::string& path, int nfeatures, int ncells, int mode) {
+    H5::H5File handle(path, H5F_ACC_TRUNC);
+    handle.createGroup("obs");
+    handle.createGroup("var");
+
+    if (mode == 0) {
+        // Dense matrix.
+        hsize_t dims[2] = { static_cast<hsize_t>(ncells), static_cast<hsize_t>(nfeatures) };
+        handle.createDataSet("X", H5::PredType::NATIVE_INT, H5::DataSpace(2, dims));
+    } else {
+        auto xhandle = handle.createGroup("X");
+        if (mode == 1) {
+            // Sparse matrix.
+            hsize_t len = 2;
+            auto ahandle = xhandle.createAttribute("shape", H5::PredType::NATIVE_INT, H5::DataSpace(1, &len));
+            int shape[2] = { ncells, nfeatures };
+            ahandle.write(H5::PredType::NATIVE_INT, shape);
+        } else {
+            // Falling back to the indices.
+            H5::StrType stype(H5::PredType::C_S1, 5);
+            auto ahandle = handle.openGroup("obs").createAttribute("_index", stype, H5::DataSpace());
+            ahandle.write(stype, std::string("cells"));
+            quick_write_dataset(handle, "obs/cells", std::vector<int>(ncells));
+            quick_write_dataset(handle, "var/_index", std::vector<int>(nfeatures));
+        }
+    }
+}
+
+TEST(Sniff, HDF5Dimensions) {
+    const std::string path = "TEST_sniff.h5";
+    auto quick_view = [&]() -> kanaval::container::FileView {
+        return kanaval::container::view_range(path, 0, kanaval::container::file_size(path));
+    };
+
+    quick_10x(path, 1000, 50);
+    auto dims = kanaval::sniff::dimensions_10x(quick_view());
+    EXPECT_EQ(dims.features, 1000);
+    EXPECT_EQ(dims.cells, 50);
+
+    for (int mode = 0; mode < 3; ++mode) {
+        quick_h5ad(path, 200, 30 + mode, mode);
+        dims = kanaval::sniff::dimensions_h5ad(quick_view());
+        EXPECT_EQ(dims.features, 200);
+        EXPECT_EQ(dims.cells, 30 + mode);
+    }
+
+    quick_throw([&]() -> void {
+        kanaval::sniff::dimensions_10x(quick_view());
+    }, "'matrix' group");
+}
+
+static void quick_pack_hdf5(const std::string& mode, int nfeatures, int ncells) {
+    const std::string state = "TEST_sniff_state.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v3::add_single_matrix(handle, mode, 1000, 100);
+    }
+    if (mode == "10X") {
+        quick_10x("TEST_sniff.h5", nfeatures, ncells);
+    } else {
+        quick_h5ad("TEST_sniff.h5", nfeatures, ncells, 1);
+    }
+    kanaval::container::pack(state, { "TEST_sniff.h5" }, "TEST_sniff.kana", 3000000);
+}
+
+TEST(Sniff, DimensionsHDF5) {
+    for (std::string mode : { "10X", "H5AD" }) {
+        quick_pack_hdf5(mode, 1000, 100);
+        EXPECT_NO_THROW(kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana")));
+
+        quick_pack_hdf5(mode, 999, 100);
+        quick_throw([&]() -> void {
+            kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"));
+        }, "failed to check " + mode + " file 'foo.h5'");
+
+        quick_pack_hdf5(mode, 1000, 101);
+        quick_throw([&]() -> void {
+            kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"));
+        }, "not consistent with 'num_cells'");
+    }
+}
+
+TEST(Sniff, DimensionsMultiple) {
+    const std::string state = "TEST_sniff_state.h5";
+    auto quick_pack_multiple = [&](int ncells_10x, int ncells_mtx) -> void {
+        {
+            H5::H5File handle(state, H5F_ACC_TRUNC);
+            v3::add_multiple_matrices(handle, 500, 100);
+        }
+        quick_10x("TEST_sniff.h5", 600, ncells_10x);
+        {
+            std::ofstream out("TEST_sniff.mtx", std::ios::binary);
+            out << quick_mtx(700, ncells_mtx, 100);
+        }
+        {
+            std::ofstream out("TEST_sniff.tsv", std::ios::binary);
+            out << "GENE1\n";
+        }
+        kanaval::container::pack(state, { "TEST_sniff.h5", "TEST_sniff.mtx", "TEST_sniff.tsv" }, "TEST_sniff.kana", 3000000);
+    };
+
+    kanaval::Options opt;
+    opt.num_threads = 3;
+    quick_pack_multiple(60, 40);
+    EXPECT_NO_THROW(kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"), opt));
+
+    quick_pack_multiple(60, 41);
+    quick_throw([&]() -> void {
+        kanaval::sniff::check_dimensions(kanaval::container::Reader("TEST_sniff.kana"), opt);
+    }, "total number of cells in the input files (101)");
+}
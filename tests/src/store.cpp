@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include "kanaval/store.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v3/helpers.h"
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <string>
+
+static void quick_write_file(const std::string& path, const std::string& contents) {
+    std::ofstream out(path, std::ios::binary);
+    out << contents;
+}
+
+static std::string quick_sha256(const std::string& contents) {
+    kanaval::store::Sha256 hasher;
+    hasher.add(contents.data(), contents.size());
+    return hasher.hex();
+}
+
+TEST(Store, Sha256) {
+    EXPECT_EQ(quick_sha256(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(quick_sha256("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(quick_sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    // Adding in uneven pieces.
+    std::string million(1000000, 'a');
+    kanaval::store::Sha256 hasher;
+    size_t sofar = 0, step = 1;
+    while (sofar < million.size()) {
+        size_t take = std::min(step, million.size() - sofar);
+        hasher.add(million.data() + sofar, take);
+        sofar += take;
+        step = step * 3 % 1000 + 1;
+    }
+    EXPECT_EQ(hasher.hex(), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+static void quick_pack(const std::string& output, const std::string& mtx) {
+    const std::string state = "TEST_store.h5";
+    {
+        H5::H5File handle(state, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+
+        // Bumping the version so that the converted files are dispatched to the v3 validator.
+        auto mhandle = handle.openGroup("_metadata");
+        mhandle.unlink("format_version");
+        quick_write_dataset(mhandle, "format_version", 3000000);
+    }
+    quick_write_file("TEST_store.mtx", mtx);
+    quick_write_file("TEST_store.tsv", "GENE1\nGENE2\n");
+    kanaval::container::pack(state, { "TEST_store.mtx", "TEST_store.tsv" }, output, 3000000);
+}
+
+static std::string quick_view(const kanaval::container::Reader& reader, const std::string& type) {
+    auto view = reader.view("IMMA_FIRST", type);
+    return std::string(reinterpret_cast<const char*>(view.data()), view.size());
+}
+
+TEST(Store, RoundTrip) {
+    const std::string root = "TEST_store";
+    std::filesystem::remove_all(root);
+    kanaval::store::Store store(root);
+
+    std::string mtx(100001, 'x');
+    for (size_t i = 0; i < mtx.size(); i += 11) {
+        mtx[i] = 'a' + (i % 26);
+    }
+
+    quick_pack("TEST_store1.kana", mtx);
+    auto ids1 = kanaval::store::to_linked("TEST_store1.kana", store, "TEST_store1_linked.kana", 2);
+    ASSERT_EQ(ids1.size(), 2);
+    EXPECT_EQ(ids1[0], quick_sha256(mtx));
+    EXPECT_EQ(ids1[1], quick_sha256("GENE1\nGENE2\n"));
+    EXPECT_TRUE(store.has(ids1[0]));
+
+    // Same matrix in another file is deduplicated.
+    quick_pack("TEST_store2.kana", mtx);
+    auto ids2 = kanaval::store::to_linked("TEST_store2.kana", store, "TEST_store2_linked.kana");
+    EXPECT_EQ(ids1, ids2);
+
+    size_t nstored = 0;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+        nstored += entry.is_regular_file();
+    }
+    EXPECT_EQ(nstored, 2);
+
+    {
+        kanaval::container::Reader reader("TEST_store1_linked.kana");
+        EXPECT_EQ(reader.header().format_type, kanaval::container::LINKED);
+        EXPECT_EQ(reader.entries()[0].id, ids1[0]);
+        EXPECT_EQ(reader.entries()[1].id, ids1[1]);
+        EXPECT_EQ(kanaval::container::file_size("TEST_store1_linked.kana"), kanaval::container::header_size + reader.header().state_nbytes);
+    }
+
+    // Reversing the conversion.
+    kanaval::store::to_embedded("TEST_store2_linked.kana", store, "TEST_store2_embedded.kana");
+    {
+        kanaval::container::Reader reader("TEST_store2_embedded.kana");
+        EXPECT_EQ(reader.header().format_type, kanaval::container::EMBEDDED);
+        EXPECT_EQ(quick_view(reader, "mtx"), mtx);
+        EXPECT_EQ(quick_view(reader, "genes"), "GENE1\nGENE2\n");
+        EXPECT_EQ(reader.entries()[0].id, "");
+    }
+}
+
+TEST(Store, Fail) {
+    const std::string root = "TEST_store";
+    std::filesystem::remove_all(root);
+    kanaval::store::Store store(root);
+
+    quick_pack("TEST_store1.kana", "MTX");
+    quick_throw([&]() -> void {
+        kanaval::store::to_embedded("TEST_store1.kana", store, "TEST_store1_embedded.kana");
+    }, "already embedded");
+
+    kanaval::store::to_linked("TEST_store1.kana", store, "TEST_store1_linked.kana");
+    std::filesystem::remove_all(root);
+    kanaval::store::Store empty(root);
+    quick_throw([&]() -> void {
+        kanaval::store::to_embedded("TEST_store1_linked.kana", empty, "TEST_store1_embedded.kana");
+    }, "not present in the store");
+
+    quick_throw([&]() -> void {
+        store.path("a/b");
+    }, "invalid identifier");
+    quick_throw([&]() -> void {
+        store.path("..");
+    }, "invalid identifier");
+
+    // Only lower-case SHA-256 digests are accepted.
+    auto id = quick_sha256("abc");
+    EXPECT_EQ(store.path(id), root + "/" + id.substr(0, 2) + "/" + id);
+    quick_throw([&]() -> void {
+        store.path(id.substr(1));
+    }, "invalid identifier");
+    quick_throw([&]() -> void {
+        auto upper = id;
+        upper[0] = 'B';
+        store.path(upper);
+    }, "invalid identifier");
+    quick_throw([&]() -> void {
+        auto sneaky = id;
+        sneaky.replace(2, 3, "/..");
+        store.path(sneaky);
+    }, "invalid identifier");
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include "kanaval/subset.hpp"
+#include "H5Cpp.h"
+#include "utils.h"
+#include "v3/helpers.h"
+#include <vector>
+
+TEST(Subset, Coalesce) {
+    auto runs = kanaval::subset::coalesce(std::vector<int>{ 1, 2, 3, 7, 9, 10 });
+    ASSERT_EQ(runs.size(), 3);
+    EXPECT_EQ(runs[0].start, 1);
+    EXPECT_EQ(runs[0].length, 3);
+    EXPECT_EQ(runs[1].start, 7);
+    EXPECT_EQ(runs[1].length, 1);
+    EXPECT_EQ(runs[2].start, 9);
+    EXPECT_EQ(runs[2].length, 2);
+
+    EXPECT_TRUE(kanaval::subset::coalesce(std::vector<int>{}).empty());
+}
+
+TEST(Subset, Extract) {
+    const std::string path = "TEST_subset.h5";
+    const hsize_t ncells = 1000, ndims = 5;
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+
+        std::vector<double> x(ncells);
+        for (hsize_t i = 0; i < ncells; ++i) {
+            x[i] = i * 2.5;
+        }
+        quick_write_dataset(handle, "x", x);
+
+        hsize_t dims[2] = { ncells, ndims }, chunks[2] = { 64, ndims };
+        H5::DataSpace space(2, dims);
+        H5::DSetCreatPropList plist;
+        plist.setChunk(2, chunks);
+        plist.setDeflate(6);
+        auto dhandle = handle.createDataSet("pcs", H5::PredType::NATIVE_DOUBLE, space, plist);
+        std::vector<double> pcs(ncells * ndims);
+        for (hsize_t i = 0; i < pcs.size(); ++i) {
+            pcs[i] = i;
+        }
+        dhandle.write(pcs.data(), H5::PredType::NATIVE_DOUBLE);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto xhandle = handle.openDataSet("x");
+    auto phandle = handle.openDataSet("pcs");
+
+    // Runs of cells, which are selected as hyperslabs.
+    std::vector<int> runs { 5, 6, 7, 8, 100, 101, 102, 999 };
+    {
+        std::vector<double> x(runs.size()), pcs(runs.size() * ndims);
+        kanaval::subset::extract<double>({ &xhandle, &phandle }, runs, std::vector<double*>{ x.data(), pcs.data() });
+        for (size_t i = 0; i < runs.size(); ++i) {
+            EXPECT_EQ(x[i], runs[i] * 2.5);
+            for (hsize_t j = 0; j < ndims; ++j) {
+                EXPECT_EQ(pcs[i * ndims + j], runs[i] * ndims + j);
+            }
+        }
+    }
+
+    // Scattered cells, which are selected as points for 1-dimensional datasets and as single-row hyperslabs otherwise.
+    std::vector<int> scattered { 0, 17, 333, 334, 800 };
+    {
+        std::vector<double> x(scattered.size());
+        std::vector<float> pcs(scattered.size() * ndims);
+        kanaval::subset::extract(xhandle, scattered, x.data());
+        kanaval::subset::extract(phandle, scattered, pcs.data());
+        for (size_t i = 0; i < scattered.size(); ++i) {
+            EXPECT_EQ(x[i], scattered[i] * 2.5);
+            for (hsize_t j = 0; j < ndims; ++j) {
+                EXPECT_EQ(pcs[i * ndims + j], scattered[i] * ndims + j);
+            }
+        }
+    }
+
+    // Unsigned indices work as well.
+    {
+        std::vector<hsize_t> unsigned_scattered(scattered.begin(), scattered.end());
+        std::vector<double> pcs(scattered.size() * ndims);
+        kanaval::subset::extract(phandle, unsigned_scattered, pcs.data());
+        EXPECT_EQ(pcs[ndims], 17 * ndims);
+        EXPECT_ANY_THROW(kanaval::subset::extract(phandle, std::vector<hsize_t>{ 5, 1000 }, pcs.data()));
+    }
+
+    // Empty subsets are a no-op.
+    {
+        std::vector<double> x;
+        EXPECT_NO_THROW(kanaval::subset::extract(xhandle, std::vector<int>{}, x.data()));
+    }
+
+    std::vector<double> buffer(10 * ndims);
+    EXPECT_ANY_THROW(kanaval::subset::extract(xhandle, std::vector<int>{ 5, 2 }, buffer.data()));
+    EXPECT_ANY_THROW(kanaval::subset::extract(xhandle, std::vector<int>{ 5, 1000 }, buffer.data()));
+}
+
+TEST(Subset, Indices) {
+    const std::string path = "TEST_subset.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        auto dhandle = handle.openDataSet("kmeans_cluster/results/clusters");
+        std::vector<int> clusters(15);
+        for (int i = 0; i < 15; ++i) {
+            clusters[i] = i % 5;
+        }
+        dhandle.write(clusters.data(), H5::PredType::NATIVE_INT);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto chosen = kanaval::subset::selection_indices(handle, "foo");
+    EXPECT_EQ(chosen.size(), 15);
+
+    auto clustered = kanaval::subset::cluster_indices(handle.openDataSet("kmeans_cluster/results/clusters"), 2);
+    EXPECT_EQ(clustered, (std::vector<int>{ 2, 7, 12 }));
+
+    std::vector<double> x(clustered.size());
+    kanaval::subset::extract(handle.openDataSet("tsne/results/x"), clustered, x.data());
+    EXPECT_EQ(x, std::vector<double>(3));
+}
@@ -74,6 +74,16 @@ void quick_write_dataset(Object& handle, std::string name, std::vector<std::stri
     return;
 }
 
+template<class Object>
+void quick_set_value(Object& handle, std::string name, hsize_t index, double val) {
+    auto dhandle = handle.openDataSet(name);
+    auto space = dhandle.getSpace();
+    std::vector<double> contents(space.getSimpleExtentNpoints());
+    dhandle.read(contents.data(), H5::PredType::NATIVE_DOUBLE);
+    contents[index] = val;
+    dhandle.write(contents.data(), H5::PredType::NATIVE_DOUBLE);
+    return;
+}
 
 template<class Function>
 void quick_throw(Function fun, std::string msg) {
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "kanaval/v2/batch_correction.hpp"
 #include "../utils.h"
+#include <limits>
 #include <iostream>
 
 namespace v2 {
@@ -126,3 +127,21 @@ TEST(BatchCorrectionV2, ResultsFailed) {
     }
     quick_correct_throw(path, 5, 100, "'corrected'");
 }
+
+TEST(BatchCorrectionV2, DeepFailed) {
+    const std::string path = "TEST_batch_correction.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v2::add_batch_correction(handle, 100, 10);
+        quick_set_value(handle, "batch_correction/results/corrected", 10 * 50 + 3, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    kanaval::Options opt;
+    opt.deep = true;
+
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v2::validate_batch_correction(handle, 10, 100, 2, latest, opt);
+    }, "first in row 50");
+}
@@ -50,6 +50,8 @@ void add_tsne(H5::H5File&, int);
 
 void add_umap(H5::H5File&, int);
 
+void spawn_full(H5::H5File&, bool = false, bool = false);
+
 }
 
 #endif
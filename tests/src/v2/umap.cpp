@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "kanaval/v2/umap.hpp"
 #include "../utils.h"
+#include <limits>
 #include <iostream>
 
 namespace v2 {
@@ -107,3 +108,30 @@ TEST(UmapV2, ResultsFailed) {
     }
     quick_umap_throw(path, 500, "'x' dataset");
 }
+
+TEST(UmapV2, DeepFailed) {
+    const std::string path = "TEST_umap.h5";
+
+    kanaval::Options opt;
+    opt.deep = true;
+    opt.num_threads = 2;
+    opt.block_size = 128;
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v2::add_umap(handle, 1000);
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_NO_THROW(kanaval::v2::validate_umap(handle, 1000, opt));
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "umap/results/y", 555, std::numeric_limits<double>::quiet_NaN());
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v2::validate_umap(handle, 1000, opt);
+    }, "'y' dataset contains non-finite values");
+}
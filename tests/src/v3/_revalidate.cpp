@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include "kanaval/v3/_revalidate.hpp"
+#include "H5Cpp.h"
+#include "../utils.h"
+#include "helpers.h"
+#include "../v2/helpers.h"
+#include <algorithm>
+
+TEST(RevalidateV3, Unchanged) {
+    const std::string path = "TEST_revalidate.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto report = kanaval::v3::validate_with_report(handle, true, latest);
+    EXPECT_EQ(report.summary.filtered_cells, 15);
+    EXPECT_EQ(report.summary.num_clusters, 5);
+    EXPECT_EQ(report.summary.total_pcs, 30);
+
+    std::vector<std::string> rerun;
+    auto again = kanaval::v3::revalidate(handle, true, latest, report, &rerun);
+    EXPECT_TRUE(rerun.empty());
+    EXPECT_EQ(again.fingerprints, report.fingerprints);
+    EXPECT_EQ(again.summary.filtered_cells, 15);
+    EXPECT_EQ(again.summary.num_clusters, 5);
+
+    // Everything is re-run if the version changes (and fails in '_metadata').
+    rerun.clear();
+    EXPECT_ANY_THROW(kanaval::v3::revalidate(handle, true, latest + 1, report, &rerun));
+    EXPECT_EQ(rerun.size(), kanaval::v3::steps::graph.size());
+
+    // Same for switching to deep validation, as the unchanged steps were only checked superficially (and the mock QC results fail the deep checks).
+    kanaval::Options opt;
+    opt.deep = true;
+    rerun.clear();
+    EXPECT_FALSE(report.deep);
+    EXPECT_ANY_THROW(kanaval::v3::revalidate(handle, true, latest, report, &rerun, opt));
+    EXPECT_EQ(rerun.size(), kanaval::v3::steps::graph.size());
+}
+
+TEST(RevalidateV3, Reclustered) {
+    const std::string path = "TEST_revalidate.h5";
+
+    kanaval::v3::Report report;
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        report = kanaval::v3::validate_with_report(handle, true, latest);
+    }
+
+    // Mimicking a re-save after re-clustering.
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        handle.unlink("kmeans_cluster");
+        handle.unlink("marker_detection");
+        handle.unlink("cell_labelling");
+
+        int filtered_cells = 15;
+        v2::add_kmeans_cluster(handle, filtered_cells, 3);
+        std::unordered_map<std::string, int> num_features { { "RNA", 1000 }, { "ADT", 4 }, { "CRISPR", 6 }};
+        v3::add_marker_detection(handle, num_features, 3);
+        v2::add_cell_labelling(handle, 3);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    std::vector<std::string> rerun;
+    auto again = kanaval::v3::revalidate(handle, true, latest, report, &rerun);
+    EXPECT_EQ(again.summary.num_clusters, 3);
+    EXPECT_EQ(again.summary.filtered_cells, 15);
+
+    std::sort(rerun.begin(), rerun.end());
+    std::vector<std::string> expected { "cell_labelling", "kmeans_cluster", "marker_detection" };
+    EXPECT_EQ(rerun, expected);
+}
+
+TEST(RevalidateV3, Dependents) {
+    const std::string path = "TEST_revalidate.h5";
+
+    kanaval::v3::Report report;
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        report = kanaval::v3::validate_with_report(handle, true, latest);
+    }
+
+    // Modifying the clusters in place, without updating the markers.
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        auto dhandle = handle.openDataSet("kmeans_cluster/results/clusters");
+        std::vector<int> clusters(15);
+        for (int i = 0; i < 15; ++i) {
+            clusters[i] = i % 3;
+        }
+        dhandle.write(clusters.data(), H5::PredType::NATIVE_INT);
+    }
+
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::revalidate(handle, true, latest, report);
+    }, "marker_detection");
+
+    // Modifying a parameter in place only re-runs that step.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        report = kanaval::v3::validate_with_report(handle, true, latest);
+
+        auto dhandle = handle.openDataSet("tsne/parameters/perplexity");
+        double perp = -1;
+        dhandle.write(&perp, H5::PredType::NATIVE_DOUBLE);
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        std::vector<std::string> rerun;
+        EXPECT_ANY_THROW(kanaval::v3::revalidate(handle, true, latest, report, &rerun));
+        EXPECT_EQ(rerun, std::vector<std::string>{ "tsne" });
+    }
+
+    // Changes to the inputs propagate to nearly everything.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        report = kanaval::v3::validate_with_report(handle, true, latest);
+        handle.unlink("inputs/results/feature_identities/CRISPR");
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        std::vector<std::string> rerun;
+        auto again = kanaval::v3::revalidate(handle, true, latest, report, &rerun);
+        EXPECT_EQ(again.summary.inputs.num_features.size(), 2);
+        EXPECT_TRUE(std::find(rerun.begin(), rerun.end(), "marker_detection") != rerun.end());
+        EXPECT_TRUE(std::find(rerun.begin(), rerun.end(), "neighbor_index") == rerun.end());
+    }
+}
@@ -5,7 +5,9 @@
 #include "helpers.h"
 #include "../v2/helpers.h"
 
-static void spawn_full(H5::H5File& handle, int num_blocks = 1) {
+namespace v3 {
+
+void spawn_full(H5::H5File& handle, int num_blocks) {
     int num_cells = 20;
     int num_genes = 1000;
     int filtered_cells = 15;
@@ -55,12 +57,14 @@ static void spawn_full(H5::H5File& handle, int num_blocks = 1) {
     v3::add__metadata(handle);
 }
 
+}
+
 TEST(OverallV3, MultiModalOk) {
     const std::string path = "TEST_overall.h5";
 
     {
         H5::H5File handle(path, H5F_ACC_TRUNC);
-        spawn_full(handle);
+        v3::spawn_full(handle);
     }
     {
         H5::H5File handle(path, H5F_ACC_RDONLY);
@@ -101,7 +105,7 @@ TEST(OverallV3, MissingFail) {
     for (const auto& g : group) {
         {
             H5::H5File handle(path, H5F_ACC_TRUNC);
-            spawn_full(handle);
+            v3::spawn_full(handle);
             handle.unlink(g);
         }
         quick_throw([&]() -> void {
@@ -181,7 +185,7 @@ TEST(OverallV3, BlockedOk) {
 
     {
         H5::H5File handle(path, H5F_ACC_TRUNC);
-        spawn_full(handle, /* num_blocks = */ 2);
+        v3::spawn_full(handle, /* num_blocks = */ 2);
         auto pihandle = handle.openGroup("inputs/parameters");
         quick_write_dataset(pihandle, "block_factor", "FOO");
     }
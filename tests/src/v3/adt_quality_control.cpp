@@ -140,3 +140,79 @@ TEST(AdtQualityControlV3, ResultsFailed) {
     }
     quick_adt_qc_throw(path, 100, 1, "failed to retrieve thresholds");
 }
+
+TEST(AdtQualityControlV3, DeepFailed) {
+    const std::string path = "TEST_adt_quality_control.h5";
+    kanaval::Options opt;
+    opt.deep = true;
+
+    // First 10 cells fail on the IgG totals.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_adt_quality_control(handle, 100, 1);
+        auto rhandle = handle.openGroup("adt_quality_control/results");
+        std::vector<double> igg(100);
+        std::fill(igg.begin(), igg.begin() + 10, 2);
+        rhandle.unlink("metrics/igg_total");
+        quick_write_dataset(rhandle, "metrics/igg_total", igg);
+        rhandle.unlink("thresholds/igg_total");
+        quick_write_dataset(rhandle, "thresholds/igg_total", std::vector<double>{ 1 });
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_adt_quality_control(handle, 100, 1, true, latest, 4, opt), 90);
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "adt_quality_control/results/metrics/igg_total", 5, 0);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_adt_quality_control(handle, 100, 1, true, latest, 4, opt);
+    }, "first mismatch at cell 5");
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "adt_quality_control/results/metrics/detected", 50, 5);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_adt_quality_control(handle, 100, 1, true, latest, 4, opt);
+    }, "'metrics/detected' should be finite and lie in [0, 4]");
+}
+
+TEST(AdtQualityControlV3, DeepSinglePrecision) {
+    const std::string path = "TEST_adt_quality_control.h5";
+    kanaval::Options opt;
+    opt.deep = true;
+
+    // Cell 20 was retained as its IgG total lies just below the threshold in double precision, but it rounds up to 1 in single precision.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_adt_quality_control(handle, 100, 1);
+        auto rhandle = handle.openGroup("adt_quality_control/results");
+        std::vector<double> igg(100);
+        std::fill(igg.begin(), igg.begin() + 10, 2);
+        igg[20] = 0.99999998;
+        rhandle.unlink("metrics/igg_total");
+        hsize_t n = igg.size();
+        H5::DataSpace space(1, &n);
+        rhandle.createDataSet("metrics/igg_total", H5::PredType::NATIVE_FLOAT, space).write(igg.data(), H5::PredType::NATIVE_DOUBLE);
+        rhandle.unlink("thresholds/igg_total");
+        quick_write_dataset(rhandle, "thresholds/igg_total", std::vector<double>{ 0.99999999 });
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_adt_quality_control(handle, 100, 1, true, latest, 4, opt), 90);
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "adt_quality_control/results/discards", 5, 0);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_adt_quality_control(handle, 100, 1, true, latest, 4, opt);
+    }, "first mismatch at cell 5");
+}
@@ -1,11 +1,13 @@
 #include <gtest/gtest.h>
 #include "kanaval/v3/cell_filtering.hpp"
 #include "../utils.h"
+#include "helpers.h"
 #include <iostream>
+#include <unordered_map>
 
 namespace v3 {
 
-void add_cell_filtering(H5::H5File& handle, int num_cells, int lost = 10) {
+void add_cell_filtering(H5::H5File& handle, int num_cells, int lost) {
     auto qhandle = handle.createGroup("cell_filtering");
     auto phandle = qhandle.createGroup("parameters");
     quick_write_dataset(phandle, "use_rna", 1);
@@ -110,3 +112,110 @@ TEST(CellFilteringV3, ResultsFailed) {
     }
     quick_filter_throw(path, 100, { { "RNA", 81 }, { "ADT", 77 } }, "'discards' dataset");
 }
+
+TEST(CellFilteringV3, DeepUnion) {
+    const std::string path = "TEST_cell_filtering.h5";
+    std::unordered_map<std::string, int> modalities { { "RNA", 90 }, { "ADT", 93 } };
+
+    kanaval::Options opt;
+    opt.deep = true;
+    opt.num_threads = 2;
+    opt.block_size = 3;
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1, /* lost */ 10);
+        v3::add_adt_quality_control(handle, 100, 1, /* lost */ 7);
+        v3::add_cell_filtering(handle, 100, /* lost */ 10);
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_cell_filtering(handle, 100, modalities, latest, opt), 90);
+    }
+
+    // Not the union of the QC discards.
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "adt_quality_control/results/discards", 40, 1);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_cell_filtering(handle, 100, modalities, latest, opt);
+    }, "first mismatch at cell 40");
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1, /* lost */ 10);
+        v3::add_adt_quality_control(handle, 100, 1, /* lost */ 7);
+        v3::add_cell_filtering(handle, 100, /* lost */ 9);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_cell_filtering(handle, 100, modalities, latest, opt);
+    }, "first mismatch at cell 9");
+
+    // Missing QC discards.
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        handle.unlink("adt_quality_control/results/discards");
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_cell_filtering(handle, 100, modalities, latest, opt);
+    }, "'adt_quality_control'");
+
+    // Not checked without deep validation.
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_cell_filtering(handle, 100, modalities, latest), 91);
+    }
+}
+
+TEST(CellFilteringV3, DeepUnionCompressed) {
+    const std::string path = "TEST_cell_filtering.h5";
+    std::unordered_map<std::string, int> modalities { { "RNA", 900 }, { "ADT", 960 } };
+
+    auto replace = [&](H5::H5File& handle, const std::string& name, const H5::PredType& type, int lost) -> void {
+        handle.unlink(name);
+        hsize_t n = 1000, chunk = 128;
+        H5::DataSpace space(1, &n);
+        H5::DSetCreatPropList plist;
+        plist.setChunk(1, &chunk);
+        plist.setDeflate(6);
+        auto dhandle = handle.createDataSet(name, type, space, plist);
+
+        std::vector<int> discards(n);
+        for (int i = 0; i < lost; ++i) {
+            discards[i * 7] = 1;
+        }
+        dhandle.write(discards.data(), H5::PredType::NATIVE_INT);
+    };
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 1000, 1, 0);
+        v3::add_adt_quality_control(handle, 1000, 1, 0);
+        v3::add_cell_filtering(handle, 1000, 0);
+        replace(handle, "rna_quality_control/results/discards", H5::PredType::NATIVE_UINT8, 100);
+        replace(handle, "adt_quality_control/results/discards", H5::PredType::NATIVE_INT32, 40);
+        replace(handle, "cell_filtering/results/discards", H5::PredType::NATIVE_INT32, 100);
+    }
+
+    kanaval::Options opt;
+    opt.deep = true;
+    opt.num_threads = 3;
+    opt.block_size = 200;
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_cell_filtering(handle, 1000, modalities, latest, opt), 900);
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "adt_quality_control/results/discards", 701, 1);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_cell_filtering(handle, 1000, modalities, latest, opt);
+    }, "first mismatch at cell 701");
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include "kanaval/v3/cell_map.hpp"
+#include "H5Cpp.h"
+#include "../utils.h"
+#include "helpers.h"
+
+TEST(CellMapV3, NoSubset) {
+    const std::string path = "TEST_cell_map.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto view = kanaval::v3::validate_view(handle, true, latest);
+    kanaval::v3::CellMap map(view, 0, /* block_size = */ 7);
+    EXPECT_EQ(map.num_original(), 20);
+    EXPECT_EQ(map.num_subsetted(), 20);
+    EXPECT_EQ(map.num_filtered(), 15);
+
+    auto discards = kanaval::utils::load_integer_vector(view.discards());
+    int counter = 0;
+    for (size_t i = 0; i < discards.size(); ++i) {
+        EXPECT_EQ(map.original_to_subsetted(i), i);
+        EXPECT_EQ(map.subsetted_to_original(i), i);
+        if (discards[i]) {
+            EXPECT_EQ(map.subsetted_to_filtered(i), -1);
+            EXPECT_EQ(map.original_to_filtered(i), -1);
+        } else {
+            EXPECT_EQ(map.subsetted_to_filtered(i), counter);
+            EXPECT_EQ(map.filtered_to_subsetted(counter), i);
+            EXPECT_EQ(map.filtered_to_original(counter), i);
+            ++counter;
+        }
+    }
+
+    EXPECT_ANY_THROW(map.filtered_to_subsetted(15));
+    EXPECT_ANY_THROW(map.original_to_subsetted(20));
+    EXPECT_ANY_THROW(kanaval::v3::CellMap(view, 30));
+}
+
+TEST(CellMapV3, EmptySubset) {
+    const std::string path = "TEST_cell_map.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        handle.createGroup("inputs/parameters/subset");
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto view = kanaval::v3::validate_view(handle, true, latest);
+    kanaval::v3::CellMap map(view);
+    EXPECT_EQ(map.num_original(), 20);
+    EXPECT_EQ(map.num_subsetted(), 20);
+    EXPECT_EQ(map.original_to_subsetted(5), 5);
+    EXPECT_EQ(map.subsetted_to_original(19), 19);
+}
+
+TEST(CellMapV3, Subset) {
+    const std::string path = "TEST_cell_map.h5";
+
+    std::vector<int> subset;
+    for (int i = 0; i < 20; ++i) {
+        subset.push_back(i * 3 + (i % 2));
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        auto shandle = handle.createGroup("inputs/parameters/subset");
+        auto chandle = shandle.createGroup("cells");
+        quick_write_dataset(chandle, "indices", subset);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto view = kanaval::v3::validate_view(handle, true, latest);
+    auto discards = kanaval::utils::load_integer_vector(view.discards());
+
+    kanaval::v3::CellMap map(view, 100, /* block_size = */ 3);
+    EXPECT_EQ(map.num_original(), 100);
+    EXPECT_EQ(map.num_subsetted(), 20);
+    EXPECT_EQ(map.num_filtered(), 15);
+
+    int counter = 0;
+    for (size_t i = 0; i < subset.size(); ++i) {
+        EXPECT_EQ(map.original_to_subsetted(subset[i]), i);
+        EXPECT_EQ(map.subsetted_to_original(i), subset[i]);
+        if (discards[i]) {
+            EXPECT_EQ(map.original_to_filtered(subset[i]), -1);
+        } else {
+            EXPECT_EQ(map.original_to_filtered(subset[i]), counter);
+            EXPECT_EQ(map.filtered_to_original(counter), subset[i]);
+            ++counter;
+        }
+    }
+
+    EXPECT_EQ(map.original_to_subsetted(2), -1);
+    EXPECT_EQ(map.original_to_filtered(99), -1);
+
+    // Inferring the original number of cells.
+    kanaval::v3::CellMap inferred(view);
+    EXPECT_EQ(inferred.num_original(), subset.back() + 1);
+    EXPECT_ANY_THROW(kanaval::v3::CellMap(view, 10));
+}
@@ -0,0 +1,286 @@
+#include <gtest/gtest.h>
+#include "kanaval/v3/columnar.hpp"
+#include "H5Cpp.h"
+#include "../utils.h"
+#include "helpers.h"
+#include "columnar_golden.h"
+#include <sstream>
+#include <cstring>
+
+namespace {
+
+template<typename T>
+T read_le(const unsigned char* ptr) {
+    T out;
+    std::memcpy(&out, ptr, sizeof(T));
+    return out;
+}
+
+// Pointer to a field in a FlatBuffers table, or NULL if the field is absent.
+const unsigned char* table_field(const unsigned char* table, int id) {
+    const unsigned char* vtable = table - read_le<int32_t>(table);
+    auto vsize = read_le<uint16_t>(vtable);
+    if (4 + 2 * id >= vsize) {
+        return NULL;
+    }
+    auto offset = read_le<uint16_t>(vtable + 4 + 2 * id);
+    return (offset ? table + offset : NULL);
+}
+
+// FlatBuffers writers may omit scalar fields that are equal to their default.
+template<typename T>
+T table_scalar(const unsigned char* table, int id, T fallback = 0) {
+    auto ptr = table_field(table, id);
+    return (ptr ? read_le<T>(ptr) : fallback);
+}
+
+const unsigned char* follow(const unsigned char* ptr) {
+    return ptr + read_le<uint32_t>(ptr);
+}
+
+// Just enough of an Arrow IPC stream reader to check the contents of our record batches.
+struct Batch {
+    int64_t length;
+    std::vector<std::pair<int64_t, int64_t> > buffers;
+    std::string body;
+};
+
+std::vector<Batch> parse_stream(const std::string& contents, int& num_fields) {
+    std::vector<Batch> output;
+    size_t pos = 0;
+    auto base = reinterpret_cast<const unsigned char*>(contents.data());
+
+    while (true) {
+        EXPECT_EQ(read_le<uint32_t>(base + pos), 0xFFFFFFFFu);
+        auto metalen = read_le<int32_t>(base + pos + 4);
+        pos += 8;
+        if (metalen == 0) {
+            break;
+        }
+        EXPECT_EQ((pos + metalen) % 8, 0);
+
+        std::string meta(contents.substr(pos, metalen)); // copy to ensure alignment.
+        auto mptr = reinterpret_cast<const unsigned char*>(meta.data());
+        auto message = follow(mptr);
+        EXPECT_EQ(table_scalar<int16_t>(message, 0), 4);
+        auto type = table_scalar<uint8_t>(message, 1);
+        auto header = follow(table_field(message, 2));
+        auto body_length = table_scalar<int64_t>(message, 3);
+        pos += metalen;
+
+        if (type == 1) {
+            num_fields = read_le<uint32_t>(follow(table_field(header, 1)));
+        } else {
+            EXPECT_EQ(type, 3);
+            Batch current;
+            current.length = table_scalar<int64_t>(header, 0);
+            auto buffers = follow(table_field(header, 2));
+            auto nbuffers = read_le<uint32_t>(buffers);
+            for (uint32_t b = 0; b < nbuffers; ++b) {
+                current.buffers.emplace_back(read_le<int64_t>(buffers + 4 + 16 * b), read_le<int64_t>(buffers + 12 + 16 * b));
+            }
+            current.body = contents.substr(pos, body_length);
+            output.push_back(std::move(current));
+        }
+        pos += body_length;
+    }
+
+    EXPECT_EQ(pos, contents.size());
+    return output;
+}
+
+// Returns the values of a column across all batches, with nulls replaced by -1.
+template<typename T>
+std::vector<double> extract_column(const std::vector<Batch>& batches, int column, bool bits = false) {
+    std::vector<double> output;
+    for (const auto& b : batches) {
+        auto body = reinterpret_cast<const unsigned char*>(b.body.data());
+        const auto& validity = b.buffers[2 * column];
+        const auto& values = b.buffers[2 * column + 1];
+        for (int64_t i = 0; i < b.length; ++i) {
+            if (validity.second && !(body[validity.first + i / 8] & (1 << (i % 8)))) {
+                output.push_back(-1);
+            } else if (bits) {
+                output.push_back((body[values.first + i / 8] >> (i % 8)) & 1);
+            } else {
+                output.push_back(read_le<T>(body + values.first + i * sizeof(T)));
+            }
+        }
+    }
+    return output;
+}
+
+}
+
+TEST(ColumnarV3, Cells) {
+    const std::string path = "TEST_columnar.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+        auto shandle = handle.openGroup("custom_selections/parameters/selections");
+        shandle.unlink("foo");
+        quick_write_dataset(shandle, "foo", std::vector<int>{ 1, 3, 14 });
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto view = kanaval::v3::validate_view(handle, true, latest);
+    auto discards = kanaval::utils::load_integer_vector(view.discards());
+    auto clusters = kanaval::utils::load_integer_vector(view.clusters());
+
+    for (int threads = 1; threads <= 3; threads += 2) {
+        std::stringstream stream;
+        kanaval::v3::export_cells(view, stream, /* batch_size = */ 6, threads);
+
+        int num_fields = 0;
+        auto batches = parse_stream(stream.str(), num_fields);
+        ASSERT_EQ(batches.size(), 4);
+        EXPECT_EQ(batches.back().length, 2);
+
+        // RNA (3 metrics), ADT (3), CRISPR (4), discard, 30 PCs, cluster, 4 coordinates, 3 selections.
+        EXPECT_EQ(num_fields, 3 + 3 + 4 + 1 + 30 + 1 + 4 + 3);
+
+        auto discard_col = extract_column<int>(batches, 10, true);
+        auto cluster_col = extract_column<int32_t>(batches, 10 + 1 + 30);
+        auto foo_col = extract_column<int>(batches, num_fields - 2, true); // selections are ordered as 'bar', 'foo', 'whee'.
+        ASSERT_EQ(discard_col.size(), 20);
+
+        int counter = 0;
+        for (size_t i = 0; i < discards.size(); ++i) {
+            EXPECT_EQ(discard_col[i], discards[i] != 0);
+            if (discards[i]) {
+                EXPECT_EQ(cluster_col[i], -1);
+                EXPECT_EQ(foo_col[i], -1);
+            } else {
+                EXPECT_EQ(cluster_col[i], clusters[counter]);
+                EXPECT_EQ(foo_col[i], (counter == 1 || counter == 3 || counter == 14));
+                ++counter;
+            }
+        }
+    }
+}
+
+TEST(ColumnarV3, Markers) {
+    const std::string path = "TEST_columnar.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_marker_detection(handle, { { "RNA", 100 } }, 3);
+        auto ghandle = handle.openGroup("marker_detection/results/per_cluster/RNA/1");
+        quick_set_value(ghandle, "means", 55, 2.5);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto ghandle = handle.openGroup("marker_detection/results/per_cluster/RNA/1");
+    std::stringstream stream;
+    kanaval::v3::export_markers(ghandle, stream, /* batch_size = */ 30, /* num_threads = */ 2);
+
+    int num_fields = 0;
+    auto batches = parse_stream(stream.str(), num_fields);
+    ASSERT_EQ(batches.size(), 4);
+
+    // feature, detected, means, and 3 statistics for each of the 4 effects.
+    EXPECT_EQ(num_fields, 1 + 2 + 4 * 3);
+
+    auto features = extract_column<int32_t>(batches, 0);
+    ASSERT_EQ(features.size(), 100);
+    EXPECT_EQ(features[0], 0);
+    EXPECT_EQ(features[99], 99);
+
+    // Datasets are listed in name order, so 'means' comes after 'lfc'.
+    auto means = extract_column<double>(batches, 1 + 3 * 3 + 1 + 3);
+    EXPECT_EQ(means[55], 2.5);
+    EXPECT_EQ(means[54], 0);
+}
+
+// Small table covering every column type, with nulls and a batch where all cells are discarded.
+static std::string write_golden_table(const std::string& path, int num_threads) {
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        quick_write_dataset(handle, "discards", std::vector<int>{ 0, 0, 1, 1, 1, 1, 0 });
+        quick_write_dataset(handle, "sums", std::vector<double>{ 1.5, 2, 2.5, 3, 3.5, 4, 4.5 });
+        quick_write_dataset(handle, "clusters", std::vector<int>{ 2, 0, 1 });
+
+        hsize_t dims[2] = { 3, 2 };
+        H5::DataSpace space(2, dims);
+        std::vector<double> coords { -1, 1, -2, 2, -3, 3 };
+        handle.createDataSet("coords", H5::PredType::NATIVE_DOUBLE, space).write(coords.data(), H5::PredType::NATIVE_DOUBLE);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto discards = handle.openDataSet("discards");
+    std::vector<kanaval::v3::columnar::Source> sources;
+    std::vector<kanaval::arrow::Field> fields;
+
+    {
+        kanaval::v3::columnar::Source src;
+        src.kind = kanaval::v3::columnar::Source::Kind::INDEX;
+        src.type = kanaval::arrow::Type::INT32;
+        kanaval::v3::columnar::add_source(std::move(src), { "cell" }, sources, fields);
+    }
+    {
+        kanaval::v3::columnar::Source src;
+        src.dataset = handle.openDataSet("sums");
+        kanaval::v3::columnar::add_source(std::move(src), { "sums" }, sources, fields);
+    }
+    {
+        kanaval::v3::columnar::Source src;
+        src.dataset = discards;
+        src.type = kanaval::arrow::Type::BOOL;
+        kanaval::v3::columnar::add_source(std::move(src), { "discard" }, sources, fields);
+    }
+    {
+        kanaval::v3::columnar::Source src;
+        src.dataset = handle.openDataSet("clusters");
+        src.type = kanaval::arrow::Type::INT32;
+        src.filtered = true;
+        kanaval::v3::columnar::add_source(std::move(src), { "cluster" }, sources, fields);
+    }
+    {
+        kanaval::v3::columnar::Source src;
+        src.dataset = handle.openDataSet("coords");
+        src.ncols = 2;
+        src.filtered = true;
+        kanaval::v3::columnar::add_source(std::move(src), { "x", "y" }, sources, fields);
+    }
+    {
+        kanaval::v3::columnar::Source src;
+        src.kind = kanaval::v3::columnar::Source::Kind::SELECTION;
+        src.type = kanaval::arrow::Type::BOOL;
+        src.filtered = true;
+        src.members = { 1 };
+        kanaval::v3::columnar::add_source(std::move(src), { "selected" }, sources, fields);
+    }
+
+    std::stringstream stream;
+    kanaval::v3::columnar::write_table(stream, std::move(fields), sources, 7, &discards, /* batch_size = */ 3, num_threads);
+    return stream.str();
+}
+
+TEST(ColumnarV3, Golden) {
+    // Our output should be byte-identical to the stream that was checked against pyarrow.
+    std::string expected(reinterpret_cast<const char*>(golden_kanaval), sizeof(golden_kanaval));
+    for (int threads = 1; threads <= 3; threads += 2) {
+        EXPECT_EQ(write_golden_table("TEST_columnar.h5", threads), expected);
+    }
+
+    // Checking our parser against the same table written by pyarrow, so that its use in the other tests is trustworthy.
+    std::string reference(reinterpret_cast<const char*>(golden_pyarrow), sizeof(golden_pyarrow));
+    for (const auto& contents : std::vector<std::string>{ expected, reference }) {
+        int num_fields = 0;
+        auto batches = parse_stream(contents, num_fields);
+        EXPECT_EQ(num_fields, 7);
+        ASSERT_EQ(batches.size(), 3);
+        EXPECT_EQ(batches[0].length, 3);
+        EXPECT_EQ(batches[1].length, 3);
+        EXPECT_EQ(batches[2].length, 1);
+
+        EXPECT_EQ(extract_column<int32_t>(batches, 0), (std::vector<double>{ 0, 1, 2, 3, 4, 5, 6 }));
+        EXPECT_EQ(extract_column<double>(batches, 1), (std::vector<double>{ 1.5, 2, 2.5, 3, 3.5, 4, 4.5 }));
+        EXPECT_EQ(extract_column<int>(batches, 2, true), (std::vector<double>{ 0, 0, 1, 1, 1, 1, 0 }));
+        EXPECT_EQ(extract_column<int32_t>(batches, 3), (std::vector<double>{ 2, 0, -1, -1, -1, -1, 1 }));
+        EXPECT_EQ(extract_column<double>(batches, 4), (std::vector<double>{ -1, -2, -1, -1, -1, -1, -3 }));
+        EXPECT_EQ(extract_column<double>(batches, 5), (std::vector<double>{ 1, 2, -1, -1, -1, -1, 3 }));
+        EXPECT_EQ(extract_column<int>(batches, 6, true), (std::vector<double>{ 0, 1, -1, -1, -1, -1, 0 }));
+    }
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "kanaval/v3/combine_embeddings.hpp"
 #include "../utils.h"
+#include <limits>
 #include <iostream>
 
 namespace v3 {
@@ -125,3 +126,32 @@ TEST(CombineEmbeddingsV3, ResultsFailed) {
     }
     quick_combine_throw(path, 100, { { "RNA", 10 }, { "ADT", 5 } }, "dimensions");
 }
+
+TEST(CombineEmbeddingsV3, DeepFailed) {
+    const std::string path = "TEST_combine_embeddings.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_combine_embeddings(handle, 100, 15);
+    }
+
+    kanaval::Options opt;
+    opt.deep = true;
+    opt.num_threads = 2;
+    opt.block_size = 50;
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_combine_embeddings(handle, 100, { { "RNA", 10 }, { "ADT", 5 } }, latest, opt), 15);
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "combine_embeddings/results/combined", 15 * 99 + 14, -std::numeric_limits<double>::infinity());
+    }
+
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_combine_embeddings(handle, 100, { { "RNA", 10 }, { "ADT", 5 } }, latest, opt);
+    }, "first in row 99");
+}
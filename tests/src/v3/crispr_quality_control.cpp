@@ -134,3 +134,94 @@ TEST(CrisprQualityControlV3, NotInUse) {
         EXPECT_EQ(out, -1);
     }
 }
+
+TEST(CrisprQualityControlV3, DeepFailed) {
+    const std::string path = "TEST_crispr_quality_control.h5";
+    kanaval::Options opt;
+    opt.deep = true;
+
+    // First 10 cells fail on the maximum count.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_crispr_quality_control(handle, 100, 1);
+        auto rhandle = handle.openGroup("crispr_quality_control/results");
+        std::vector<double> sums(100, 100), maxprop(100, 0.5);
+        std::fill(maxprop.begin(), maxprop.begin() + 10, 0.1);
+        rhandle.unlink("metrics/sums");
+        quick_write_dataset(rhandle, "metrics/sums", sums);
+        rhandle.unlink("metrics/max_proportion");
+        quick_write_dataset(rhandle, "metrics/max_proportion", maxprop);
+        rhandle.unlink("thresholds/max_count");
+        quick_write_dataset(rhandle, "thresholds/max_count", std::vector<double>{ 20 });
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_crispr_quality_control(handle, 100, 1, true, latest, 6, opt), 90);
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "crispr_quality_control/results/metrics/max_index", 15, 6);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_crispr_quality_control(handle, 100, 1, true, latest, 6, opt);
+    }, "'metrics/max_index' should be finite and lie in [0, 5] (first violation at cell 15)");
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "crispr_quality_control/results/metrics/max_index", 15, 0);
+        quick_set_value(handle, "crispr_quality_control/results/metrics/max_proportion", 60, 0.01);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_crispr_quality_control(handle, 100, 1, true, latest, 6, opt);
+    }, "first mismatch at cell 60");
+}
+
+TEST(CrisprQualityControlV3, DeepRounding) {
+    const std::string path = "TEST_crispr_quality_control.h5";
+    kanaval::Options opt;
+    opt.deep = true;
+
+    // Cell 50 has a maximum count of exactly 2.1, which is not discarded; but 3 * 0.7 is slightly less than 2.1 in double precision.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_crispr_quality_control(handle, 100, 1);
+        auto rhandle = handle.openGroup("crispr_quality_control/results");
+        std::vector<double> sums(100, 100), maxprop(100, 0.5);
+        std::fill(maxprop.begin(), maxprop.begin() + 10, 0.001);
+        sums[50] = 3;
+        maxprop[50] = 0.7;
+        rhandle.unlink("metrics/sums");
+        quick_write_dataset(rhandle, "metrics/sums", sums);
+        rhandle.unlink("metrics/max_proportion");
+        quick_write_dataset(rhandle, "metrics/max_proportion", maxprop);
+        rhandle.unlink("thresholds/max_count");
+        quick_write_dataset(rhandle, "thresholds/max_count", std::vector<double>{ 2.1 });
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_crispr_quality_control(handle, 100, 1, true, latest, 6, opt), 90);
+    }
+
+    // Either decision is accepted at the threshold.
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "crispr_quality_control/results/discards", 50, 1);
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_crispr_quality_control(handle, 100, 1, true, latest, 6, opt), 89);
+    }
+
+    // But not away from the threshold.
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "crispr_quality_control/results/metrics/max_proportion", 50, 0.75);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_crispr_quality_control(handle, 100, 1, true, latest, 6, opt);
+    }, "first mismatch at cell 50");
+}
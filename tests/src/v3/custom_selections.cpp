@@ -198,3 +198,29 @@ TEST(CustomSelectionsV3, NoAucOK) {
     }
     quick_custom_throw(path, 100, 20, "auc");
 }
+
+TEST(CustomSelectionsV3, DeepFailed) {
+    const std::string path = "TEST_custom_selections.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_custom_selections(handle, { { "RNA", 100 }, { "ADT", 20 } });
+    }
+
+    kanaval::Options opt;
+    opt.deep = true;
+    opt.num_threads = 2;
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_NO_THROW(kanaval::v3::validate_custom_selections(handle, 10, { { "RNA", 100 }, { "ADT", 20 } }, latest, opt));
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "custom_selections/results/per_selection/bar/ADT/auc", 3, 2);
+    }
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_custom_selections(handle, 10, { { "RNA", 100 }, { "ADT", 20 } }, latest, opt);
+    }, "selection 'bar' in 'results/per_selection'\n  - failed to retrieve statistics for modality 'ADT'\n  - 'auc' should lie in [0, 1] (first violation at feature 3)");
+}
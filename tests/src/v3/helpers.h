@@ -3,6 +3,7 @@
 
 #include "H5Cpp.h"
 #include <string>
+#include <unordered_map>
 
 namespace v3 {
 
@@ -36,6 +37,8 @@ void add_snn_graph_cluster(H5::H5File& handle, int num_cells, int num_clusters =
 
 H5::Group add__metadata(H5::H5File& handle);
 
+void spawn_full(H5::H5File& handle, int num_blocks = 1);
+
 }
 
 #endif
@@ -457,6 +457,30 @@ TEST(InputsV3, MultiDatasetOK) {
     quick_input_throw(path, "duplicate dataset name");
 }
 
+TEST(InputsV3, LargeOffsets) {
+    const std::string path = "TEST_inputs.h5";
+
+    // Embedded files larger than 2 GB should not overflow.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_single_matrix(handle);
+        auto fhandle = handle.openGroup("inputs/parameters/datasets/0/files");
+        hsize_t size = 3000000000ull;
+        for (int f = 0; f < 2; ++f) {
+            auto curfhandle = fhandle.openGroup(std::to_string(f));
+            curfhandle.unlink("offset");
+            curfhandle.unlink("size");
+            hsize_t offset = f * size;
+            curfhandle.createDataSet("offset", H5::PredType::NATIVE_HSIZE, H5::DataSpace()).write(&offset, H5::PredType::NATIVE_HSIZE);
+            curfhandle.createDataSet("size", H5::PredType::NATIVE_HSIZE, H5::DataSpace()).write(&size, H5::PredType::NATIVE_HSIZE);
+        }
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_NO_THROW(kanaval::v3::validate_inputs(handle, true, latest));
+    }
+}
+
 TEST(InputsV3, SubsettingIndices) {
     const std::string path = "TEST_inputs.h5";
 
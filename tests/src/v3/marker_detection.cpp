@@ -2,6 +2,8 @@
 #include "kanaval/v3/marker_detection.hpp"
 #include "../utils.h"
 #include <iostream>
+#include <numeric>
+#include <limits>
 
 namespace v3 {
 
@@ -31,7 +33,10 @@ void add_marker_detection(H5::H5File& handle, const std::unordered_map<std::stri
                 auto ehandle = xhandle.createGroup(e);
                 quick_write_dataset(ehandle, "mean", std::vector<double>(ngenes));
                 quick_write_dataset(ehandle, "min", std::vector<double>(ngenes));
-                quick_write_dataset(ehandle, "min_rank", std::vector<double>(ngenes));
+
+                std::vector<double> ranks(ngenes);
+                std::iota(ranks.begin(), ranks.end(), 1);
+                quick_write_dataset(ehandle, "min_rank", ranks);
             }
         }
     }
@@ -182,3 +187,109 @@ TEST(MarkerDetectionV3, NoAucOK) {
 }
 
 
+
+TEST(MarkerDetectionV3, DeepOK) {
+    const std::string path = "TEST_marker_detection.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_marker_detection(handle, { { "RNA", 100 }, { "ADT", 20 }, { "CRISPR", 5 } }, 10);
+    }
+
+    kanaval::Options opt;
+    opt.deep = true;
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_NO_THROW(kanaval::v3::validate_marker_detection(handle, 10, { { "RNA", 100 }, { "ADT", 20 }, { "CRISPR", 5 } }, latest, opt));
+    }
+
+    opt.num_threads = 4;
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_NO_THROW(kanaval::v3::validate_marker_detection(handle, 10, { { "RNA", 100 }, { "ADT", 20 }, { "CRISPR", 5 } }, latest, opt));
+    }
+}
+
+static void quick_marker_deep_throw(const std::string& path, std::string msg) {
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::Options opt;
+        opt.deep = true;
+        opt.num_threads = 3;
+        kanaval::v3::validate_marker_detection(handle, 5, { { "RNA", 100 }, { "ADT", 20 } }, latest, opt);
+    }, msg);
+}
+
+TEST(MarkerDetectionV3, DeepFailed) {
+    const std::string path = "TEST_marker_detection.h5";
+
+    auto reset = [&]() -> void {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_marker_detection(handle, { { "RNA", 100 }, { "ADT", 20 } }, 5);
+    };
+
+    reset();
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "marker_detection/results/per_cluster/RNA/3/detected", 10, 1.5);
+    }
+    quick_marker_deep_throw(path, "cluster 3 in 'per_cluster/RNA'\n  - 'detected' should lie in [0, 1] (first violation at feature 10)");
+
+    reset();
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "marker_detection/results/per_cluster/ADT/1/means", 2, std::numeric_limits<double>::quiet_NaN());
+    }
+    quick_marker_deep_throw(path, "'means' should be finite");
+
+    reset();
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "marker_detection/results/per_cluster/ADT/4/auc/mean", 7, -0.1);
+    }
+    quick_marker_deep_throw(path, "'auc/mean' should lie in [0, 1]");
+
+    reset();
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "marker_detection/results/per_cluster/RNA/0/cohen/min", 5, 1);
+    }
+    quick_marker_deep_throw(path, "'cohen/min' should be no greater than 'cohen/mean' (first violation at feature 5)");
+
+    // A feature with the same effect size against all other clusters may have a mean that is slightly less than its minimum.
+    reset();
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        for (double effect : { 0.7, 3.3 }) {
+            int feature = (effect < 1 ? 5 : 6);
+            quick_set_value(handle, "marker_detection/results/per_cluster/RNA/0/cohen/min", feature, effect);
+            quick_set_value(handle, "marker_detection/results/per_cluster/RNA/0/cohen/mean", feature, (effect + effect + effect) / 3);
+        }
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::Options opt;
+        opt.deep = true;
+        EXPECT_NO_THROW(kanaval::v3::validate_marker_detection(handle, 5, { { "RNA", 100 }, { "ADT", 20 } }, latest, opt));
+    }
+
+    reset();
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "marker_detection/results/per_cluster/ADT/2/lfc/min_rank", 0, 21);
+    }
+    quick_marker_deep_throw(path, "'lfc/min_rank' should lie in [1, 20]");
+
+    reset();
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "marker_detection/results/per_cluster/RNA/2/delta_detected/min_rank", 0, 0);
+    }
+    quick_marker_deep_throw(path, "'delta_detected/min_rank'");
+
+    // Not checked in shallow mode.
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_NO_THROW(kanaval::v3::validate_marker_detection(handle, 5, { { "RNA", 100 }, { "ADT", 20 } }, latest));
+    }
+}
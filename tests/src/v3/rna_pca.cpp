@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "kanaval/v3/rna_pca.hpp"
 #include "../utils.h"
+#include <limits>
 #include <iostream>
 
 namespace v3 {
@@ -145,3 +146,112 @@ TEST(RnaPcaV3, NotInUse) {
         EXPECT_EQ(kanaval::v3::validate_rna_pca(handle, 1000, false, latest), -1);
     }
 }
+
+TEST(RnaPcaV3, DeepOK) {
+    const std::string path = "TEST_rna_pca.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_pca(handle, 10, 1000);
+        quick_set_value(handle, "rna_pca/results/var_exp", 0, 5.0);
+        quick_set_value(handle, "rna_pca/results/var_exp", 1, 2.0);
+    }
+
+    kanaval::Options opt;
+    opt.deep = true;
+    opt.num_threads = 3;
+    opt.block_size = 77;
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    EXPECT_EQ(kanaval::v3::validate_rna_pca(handle, 1000, true, latest, opt), 10);
+}
+
+static void quick_rna_pca_deep_throw(const std::string& path, int num_cells, std::string msg) {
+    kanaval::Options opt;
+    opt.deep = true;
+    opt.num_threads = 2;
+    opt.block_size = 100;
+
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::v3::validate_rna_pca(handle, num_cells, true, latest, opt);
+    }, msg);
+}
+
+TEST(RnaPcaV3, DeepFailed) {
+    const std::string path = "TEST_rna_pca.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_pca(handle, 10, 1000);
+        quick_set_value(handle, "rna_pca/results/pcs", 5123, std::numeric_limits<double>::quiet_NaN());
+        quick_set_value(handle, "rna_pca/results/pcs", 8000, std::numeric_limits<double>::infinity());
+    }
+    quick_rna_pca_deep_throw(path, 1000, "first in row 512");
+
+    // Structural validation doesn't care.
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_NO_THROW(kanaval::v3::validate_rna_pca(handle, 1000, true, latest));
+    }
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_pca(handle, 10, 1000);
+        quick_set_value(handle, "rna_pca/results/var_exp", 3, 1.0);
+    }
+    quick_rna_pca_deep_throw(path, 1000, "non-increasing");
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_pca(handle, 10, 1000);
+        quick_set_value(handle, "rna_pca/results/var_exp", 9, -1.0);
+    }
+    quick_rna_pca_deep_throw(path, 1000, "non-negative");
+}
+
+TEST(RnaPcaV3, DeepCompressed) {
+    const std::string path = "TEST_rna_pca.h5";
+
+    // Writing PCs in compressed chunks, with a partial chunk at the end.
+    auto create = [&](hsize_t bad_row) -> void {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_pca(handle, 10, 1000);
+        auto rhandle = handle.openGroup("rna_pca/results");
+        rhandle.unlink("pcs");
+
+        hsize_t dims[2] = { 1000, 10 };
+        H5::DataSpace space(2, dims);
+        H5::DSetCreatPropList plist;
+        hsize_t chunks[2] = { 64, 10 };
+        plist.setChunk(2, chunks);
+        plist.setShuffle();
+        plist.setDeflate(6);
+        auto dhandle = rhandle.createDataSet("pcs", H5::PredType::NATIVE_FLOAT, space, plist);
+
+        std::vector<float> values(10000);
+        for (size_t i = 0; i < values.size(); ++i) {
+            values[i] = static_cast<float>(i % 97) - 48.5f;
+        }
+        if (bad_row < 1000) {
+            values[bad_row * 10 + 3] = std::numeric_limits<float>::quiet_NaN();
+        }
+        dhandle.write(values.data(), H5::PredType::NATIVE_FLOAT);
+    };
+
+    create(1000);
+    {
+        kanaval::Options opt;
+        opt.deep = true;
+        opt.num_threads = 3;
+        opt.block_size = 500;
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_rna_pca(handle, 1000, true, latest, opt), 10);
+    }
+
+    create(130);
+    quick_rna_pca_deep_throw(path, 1000, "first in row 130");
+
+    create(999);
+    quick_rna_pca_deep_throw(path, 1000, "first in row 999");
+}
@@ -2,6 +2,7 @@
 #include "kanaval/v3/rna_quality_control.hpp"
 #include "../utils.h"
 #include <iostream>
+#include <limits>
 
 namespace v3 {
 
@@ -151,3 +152,172 @@ TEST(RnaQualityControlV3, NotInUse) {
         EXPECT_EQ(out, -1);
     }
 }
+
+static void make_rna_qc_consistent(const std::string& path, int num_cells, int lost = 10) {
+    H5::H5File handle(path, H5F_ACC_RDWR);
+    auto rhandle = handle.openGroup("rna_quality_control/results");
+
+    // First 'lost' cells fail on the sums; everyone else passes.
+    std::vector<double> sums(num_cells, 100);
+    std::fill(sums.begin(), sums.begin() + lost, 5);
+    rhandle.unlink("metrics/sums");
+    quick_write_dataset(rhandle, "metrics/sums", sums);
+    rhandle.unlink("thresholds/sums");
+    quick_write_dataset(rhandle, "thresholds/sums", std::vector<double>{ 10 });
+    rhandle.unlink("thresholds/proportion");
+    quick_write_dataset(rhandle, "thresholds/proportion", std::vector<double>{ 0.5 });
+}
+
+static void quick_qc_deep_throw(const std::string& path, int num_cells, int num_blocks, std::string msg) {
+    quick_throw([&]() -> void {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        kanaval::Options opt;
+        opt.deep = true;
+        kanaval::v3::validate_rna_quality_control(handle, num_cells, num_blocks, true, latest, 1000, opt);
+    }, msg);
+}
+
+TEST(RnaQualityControlV3, DeepOK) {
+    const std::string path = "TEST_rna_quality_control.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1);
+    }
+    make_rna_qc_consistent(path, 100);
+
+    kanaval::Options opt;
+    opt.deep = true;
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_rna_quality_control(handle, 100, 1, true, latest, 1000, opt), 90);
+    }
+
+    // Same results with multiple threads and small blocks.
+    opt.num_threads = 3;
+    opt.block_size = 7;
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_rna_quality_control(handle, 100, 1, true, latest, 1000, opt), 90);
+    }
+
+    // Consistency of discards is not checked with multiple blocks.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 200, 2);
+    }
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_rna_quality_control(handle, 200, 2, true, latest, 1000, opt), 190);
+    }
+}
+
+TEST(RnaQualityControlV3, DeepSinglePrecision) {
+    const std::string path = "TEST_rna_quality_control.h5";
+
+    // Discards were computed in double precision, where cell 50 lies just above the sum threshold and cell 60 lies just below the proportion threshold;
+    // but both end up on the wrong side of their thresholds once the metrics are stored in single precision.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1);
+    }
+    make_rna_qc_consistent(path, 100);
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        auto rhandle = handle.openGroup("rna_quality_control/results");
+        rhandle.unlink("thresholds/sums");
+        quick_write_dataset(rhandle, "thresholds/sums", std::vector<double>{ 10.0000001 });
+        rhandle.unlink("thresholds/proportion");
+        quick_write_dataset(rhandle, "thresholds/proportion", std::vector<double>{ 0.49999999 });
+
+        auto replace = [&](const std::string& name, const std::vector<double>& values) -> void {
+            rhandle.unlink(name);
+            hsize_t n = values.size();
+            H5::DataSpace space(1, &n);
+            rhandle.createDataSet(name, H5::PredType::NATIVE_FLOAT, space).write(values.data(), H5::PredType::NATIVE_DOUBLE);
+        };
+
+        std::vector<double> sums(100, 100);
+        std::fill(sums.begin(), sums.begin() + 10, 5);
+        sums[50] = 10.0000002;
+        replace("metrics/sums", sums);
+        std::vector<double> proportion(100);
+        proportion[60] = 0.49999998;
+        replace("metrics/proportion", proportion);
+    }
+
+    kanaval::Options opt;
+    opt.deep = true;
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        EXPECT_EQ(kanaval::v3::validate_rna_quality_control(handle, 100, 1, true, latest, 1000, opt), 90);
+    }
+
+    // Mismatches away from the thresholds are still reported.
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "rna_quality_control/results/discards", 70, 1);
+    }
+    quick_qc_deep_throw(path, 100, 1, "first mismatch at cell 70");
+}
+
+TEST(RnaQualityControlV3, DeepFailed) {
+    const std::string path = "TEST_rna_quality_control.h5";
+
+    // Inconsistent discards, which are fine in shallow mode.
+    // (The metrics are moved away from the thresholds, as cells lying exactly on a threshold could go either way.)
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1);
+        auto rhandle = handle.openGroup("rna_quality_control/results");
+        rhandle.unlink("metrics/sums");
+        quick_write_dataset(rhandle, "metrics/sums", std::vector<double>(100, 100));
+        rhandle.unlink("thresholds/proportion");
+        quick_write_dataset(rhandle, "thresholds/proportion", std::vector<double>{ 0.5 });
+    }
+    quick_qc_deep_throw(path, 100, 1, "first mismatch at cell 0");
+
+    make_rna_qc_consistent(path, 100);
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        quick_set_value(handle, "rna_quality_control/results/discards", 50, 1);
+    }
+    quick_qc_deep_throw(path, 100, 1, "first mismatch at cell 50");
+
+    // Out-of-range metrics.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1);
+        quick_set_value(handle, "rna_quality_control/results/metrics/proportion", 20, 1.5);
+    }
+    quick_qc_deep_throw(path, 100, 1, "'metrics/proportion' should be finite and lie in [0, 1] (first violation at cell 20)");
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1);
+        quick_set_value(handle, "rna_quality_control/results/metrics/sums", 30, -1);
+    }
+    quick_qc_deep_throw(path, 100, 1, "'metrics/sums' should be finite and no less than 0");
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1);
+        quick_set_value(handle, "rna_quality_control/results/metrics/sums", 30, std::numeric_limits<double>::infinity());
+    }
+    quick_qc_deep_throw(path, 100, 1, "'metrics/sums'");
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1);
+        quick_set_value(handle, "rna_quality_control/results/metrics/detected", 40, 1001);
+    }
+    quick_qc_deep_throw(path, 100, 1, "'metrics/detected'");
+
+    // Non-finite thresholds.
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_rna_quality_control(handle, 100, 1);
+        quick_set_value(handle, "rna_quality_control/results/thresholds/sums", 0, std::numeric_limits<double>::quiet_NaN());
+    }
+    quick_qc_deep_throw(path, 100, 1, "'thresholds/sums'");
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "kanaval/v3/state_view.hpp"
+#include "H5Cpp.h"
+#include "../utils.h"
+#include "helpers.h"
+
+TEST(StateViewV3, Accessors) {
+    const std::string path = "TEST_state_view.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto view = kanaval::v3::validate_view(handle, true, latest);
+    const auto& summary = view.summary();
+    EXPECT_EQ(summary.filtered_cells, 15);
+    EXPECT_EQ(summary.num_clusters, 5);
+    EXPECT_EQ(summary.filtering_modalities, (std::vector<std::string>{ "RNA", "ADT" }));
+    EXPECT_EQ(summary.embedding_modalities, (std::vector<std::string>{ "RNA", "ADT" }));
+    EXPECT_FALSE(summary.batch_corrected);
+
+    auto dims = kanaval::utils::load_dataset_dimensions(view.pcs("ADT"));
+    EXPECT_EQ(dims, (std::vector<hsize_t>{ 15, 10 }));
+    EXPECT_ANY_THROW(view.pcs("foo"));
+
+    // Combined embedding, as there's only one block.
+    dims = kanaval::utils::load_dataset_dimensions(view.embedding());
+    EXPECT_EQ(dims, (std::vector<hsize_t>{ 15, 30 }));
+
+    EXPECT_TRUE(view.has_discards());
+    dims = kanaval::utils::load_dataset_dimensions(view.discards());
+    EXPECT_EQ(dims, std::vector<hsize_t>{ 20 });
+    EXPECT_EQ(view.discards().getObjName(), "/cell_filtering/results/discards");
+
+    EXPECT_EQ(view.clusters().getObjName(), "/kmeans_cluster/results/clusters");
+    EXPECT_EQ(view.tsne().first.getObjName(), "/tsne/results/x");
+    EXPECT_EQ(view.umap().second.getObjName(), "/umap/results/y");
+
+    auto mhandle = view.markers("CRISPR", 4);
+    EXPECT_TRUE(mhandle.exists("auc"));
+    EXPECT_ANY_THROW(view.markers("CRISPR", 5));
+
+    auto shandle = view.selection("foo", "ADT");
+    EXPECT_TRUE(shandle.exists("means"));
+
+    // Cached handles are re-used.
+    EXPECT_EQ(&view.results("tsne"), &view.results("tsne"));
+}
+
+TEST(StateViewV3, Blocked) {
+    const std::string path = "TEST_state_view.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle, /* num_blocks = */ 2);
+        auto pihandle = handle.openGroup("inputs/parameters");
+        quick_write_dataset(pihandle, "block_factor", "FOO");
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto view = kanaval::v3::validate_view(handle, true, latest);
+    EXPECT_TRUE(view.summary().batch_corrected);
+    EXPECT_EQ(view.embedding().getObjName(), "/batch_correction/results/corrected");
+}
+
+TEST(StateViewV3, NoParameters) {
+    const std::string path = "TEST_state_view.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::spawn_full(handle, /* num_blocks = */ 2);
+        auto pihandle = handle.openGroup("inputs/parameters");
+        quick_write_dataset(pihandle, "block_factor", "FOO");
+    }
+
+    kanaval::v3::Summary summary;
+    {
+        H5::H5File handle(path, H5F_ACC_RDONLY);
+        summary = kanaval::v3::validate(handle, true, latest);
+    }
+
+    // The view only uses the facts from validation, so it doesn't need to read the parameters again.
+    {
+        H5::H5File handle(path, H5F_ACC_RDWR);
+        handle.unlink("cell_filtering/parameters");
+        handle.unlink("combine_embeddings/parameters");
+        handle.unlink("batch_correction/parameters");
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    kanaval::v3::StateView view(handle, summary);
+    EXPECT_TRUE(view.has_discards());
+    EXPECT_EQ(view.discards().getObjName(), "/cell_filtering/results/discards");
+    EXPECT_EQ(view.embedding().getObjName(), "/batch_correction/results/corrected");
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include "kanaval/v3/top_markers.hpp"
+#include "H5Cpp.h"
+#include "../utils.h"
+#include "helpers.h"
+#include <limits>
+
+TEST(TopMarkersV3, Cluster) {
+    const std::string path = "TEST_top_markers.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_marker_detection(handle, { { "RNA", 100 }, { "ADT", 10 } }, 3);
+
+        // Ranks are initially 1:100; promoting some of the later features.
+        auto ghandle = handle.openGroup("marker_detection/results/per_cluster/RNA/1");
+        quick_set_value(ghandle, "cohen/min_rank", 90, 0.5);
+        quick_set_value(ghandle, "cohen/min_rank", 50, 2);
+        quick_set_value(ghandle, "means", 90, 9.0);
+        quick_set_value(ghandle, "detected", 50, 0.5);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto res = kanaval::v3::top_cluster_markers(handle, "RNA", 1, "cohen", 4, { "means", "detected", "cohen/mean" }, /* block_size = */ 7);
+    EXPECT_EQ(res.features, (std::vector<hsize_t>{ 90, 0, 1, 50 }));
+    EXPECT_EQ(res.scores, (std::vector<double>{ 0.5, 1, 2, 2 }));
+    EXPECT_EQ(res.statistics["means"], (std::vector<double>{ 9, 0, 0, 0 }));
+    EXPECT_EQ(res.statistics["detected"], (std::vector<double>{ 0, 0, 0, 0.5 }));
+    EXPECT_EQ(res.statistics["cohen/mean"].size(), 4);
+
+    // Capped at the number of features.
+    auto capped = kanaval::v3::top_cluster_markers(handle, "ADT", 0, "auc", 20);
+    EXPECT_EQ(capped.features.size(), 10);
+    EXPECT_EQ(capped.features.front(), 0);
+    EXPECT_EQ(capped.features.back(), 9);
+
+    EXPECT_TRUE(kanaval::v3::top_cluster_markers(handle, "ADT", 0, "auc", 0).features.empty());
+    EXPECT_ANY_THROW(kanaval::v3::top_cluster_markers(handle, "CRISPR", 0, "auc", 5));
+
+    // Missing paths are reported as standard exceptions.
+    quick_throw([&]() -> void {
+        kanaval::v3::top_cluster_markers(handle, "RNA", 0, "auc", 5, { "foo" });
+    }, "'foo' dataset does not exist");
+    quick_throw([&]() -> void {
+        kanaval::v3::top_cluster_markers(handle, "RNA", 0, "auc", 5, { "foo/mean" });
+    }, "'foo' group does not exist");
+    quick_throw([&]() -> void {
+        kanaval::v3::top_cluster_markers(handle, "RNA", 0, "whee", 5);
+    }, "unknown effect size 'whee'");
+}
+
+TEST(TopMarkersV3, NoAuc) {
+    const std::string path = "TEST_top_markers.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_marker_detection(handle, { { "RNA", 100 } }, 3, /* has_auc = */ false);
+        v3::add_custom_selections(handle, { { "RNA", 50 } }, 10, /* has_auc = */ false);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    EXPECT_EQ(kanaval::v3::top_cluster_markers(handle, "RNA", 0, "lfc", 5).features.size(), 5);
+    quick_throw([&]() -> void {
+        kanaval::v3::top_cluster_markers(handle, "RNA", 0, "auc", 5);
+    }, "'auc' group does not exist");
+    quick_throw([&]() -> void {
+        kanaval::v3::top_selection_markers(handle, "bar", "RNA", "auc", 5);
+    }, "'auc' dataset does not exist");
+}
+
+TEST(TopMarkersV3, Selection) {
+    const std::string path = "TEST_top_markers.h5";
+
+    {
+        H5::H5File handle(path, H5F_ACC_TRUNC);
+        v3::add_custom_selections(handle, { { "RNA", 50 } });
+        auto ghandle = handle.openGroup("custom_selections/results/per_selection/bar/RNA");
+        quick_set_value(ghandle, "lfc", 10, 2.0);
+        quick_set_value(ghandle, "lfc", 20, 3.0);
+        quick_set_value(ghandle, "lfc", 30, std::numeric_limits<double>::quiet_NaN());
+        quick_set_value(ghandle, "lfc", 40, -1.0);
+    }
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto res = kanaval::v3::top_selection_markers(handle, "bar", "RNA", "lfc", 3, { "means" }, 16);
+    EXPECT_EQ(res.features, (std::vector<hsize_t>{ 20, 10, 0 }));
+    EXPECT_EQ(res.scores, (std::vector<double>{ 3, 2, 0 }));
+    EXPECT_EQ(res.statistics["means"].size(), 3);
+
+    // NaNs and negative values are ranked last.
+    auto all = kanaval::v3::top_selection_markers(handle, "bar", "RNA", "lfc", 50);
+    EXPECT_EQ(all.features[48], 40);
+    EXPECT_EQ(all.features[49], 30);
+}
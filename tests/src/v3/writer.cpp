@@ -0,0 +1,322 @@
+#include <gtest/gtest.h>
+#include "kanaval/v3/writer.hpp"
+#include "H5Cpp.h"
+#include "../utils.h"
+#include <vector>
+#include <string>
+#include <numeric>
+#include <unordered_map>
+
+// Consistent results for a small multi-modal analysis, with enough cells to span several chunks.
+struct Analysis {
+    int num_cells = 1000;
+    int filtered_cells = 0;
+    int num_clusters = 4;
+    std::unordered_map<std::string, int> num_features { { "RNA", 200 }, { "ADT", 5 }, { "CRISPR", 3 } };
+
+    std::vector<double> sums, proportion, zeros, ones;
+    std::vector<int> detected, discards, izeros, clusters;
+    std::vector<double> rna_pcs, adt_pcs, crispr_pcs, combined, coords;
+
+    Analysis() {
+        sums.resize(num_cells);
+        detected.resize(num_cells);
+        discards.resize(num_cells);
+        for (int i = 0; i < num_cells; ++i) {
+            sums[i] = i % 100;
+            detected[i] = i % 3;
+            discards[i] = (sums[i] < 5);
+            filtered_cells += !discards[i];
+        }
+        proportion.resize(num_cells, 0.1);
+        izeros.resize(num_cells);
+        zeros.resize(num_cells);
+        ones.resize(num_cells, 1);
+
+        clusters.resize(filtered_cells);
+        for (int i = 0; i < filtered_cells; ++i) {
+            clusters[i] = i % num_clusters;
+        }
+        rna_pcs.resize(filtered_cells * 10, 0.5);
+        adt_pcs.resize(filtered_cells * 4, -0.5);
+        crispr_pcs.resize(filtered_cells * 2, 0.1);
+        combined.resize(filtered_cells * 14, 1);
+        coords.resize(filtered_cells, 2);
+    }
+};
+
+static void write_until_filtering(kanaval::v3::Writer& writer, const Analysis& ana) {
+    kanaval::v3::Writer::Inputs inputs;
+    inputs.datasets.resize(1);
+    inputs.datasets[0].format = "MatrixMarket";
+    inputs.datasets[0].name = "FOO";
+    inputs.datasets[0].files.push_back({ "mtx", "foo.mtx", 100, "" });
+    inputs.datasets[0].files.push_back({ "genes", "genes.tsv", 20, "" });
+    inputs.datasets[0].options = "{ \"foo\": 1 }";
+    inputs.num_cells = ana.num_cells;
+    for (const auto& mod : ana.num_features) {
+        std::vector<int> ids(mod.second);
+        std::iota(ids.begin(), ids.end(), 0);
+        inputs.feature_identities.emplace_back(mod.first, ids);
+    }
+    inputs.feature_names.emplace_back("ADT", std::vector<std::string>{ "A", "B", "C", "D", "E" });
+    writer.write_inputs(inputs);
+
+    kanaval::v3::Writer::RnaQualityControl rna;
+    rna.sums = ana.sums.data();
+    rna.detected = ana.detected.data();
+    rna.proportion = ana.proportion.data();
+    rna.sums_threshold = { 5 };
+    rna.detected_threshold = { 0 };
+    rna.proportion_threshold = { 0.5 };
+    rna.discards = ana.discards.data();
+    writer.write_rna_quality_control(rna);
+
+    kanaval::v3::Writer::AdtQualityControl adt;
+    adt.sums = ana.sums.data();
+    adt.detected = ana.detected.data();
+    adt.igg_total = ana.zeros.data();
+    adt.detected_threshold = { 0 };
+    adt.igg_total_threshold = { 1 };
+    adt.discards = ana.izeros.data();
+    writer.write_adt_quality_control(adt);
+
+    kanaval::v3::Writer::CrisprQualityControl crispr;
+    crispr.sums = ana.sums.data();
+    crispr.detected = ana.detected.data();
+    crispr.max_index = ana.izeros.data();
+    crispr.max_proportion = ana.ones.data();
+    crispr.max_count_threshold = { 0 };
+    crispr.discards = ana.izeros.data();
+    writer.write_crispr_quality_control(crispr);
+
+    kanaval::v3::Writer::CellFiltering filtering;
+    filtering.discards = ana.discards.data();
+    writer.write_cell_filtering(filtering);
+}
+
+static void write_remaining(kanaval::v3::Writer& writer, const Analysis& ana) {
+    writer.write_rna_normalization();
+    kanaval::v3::Writer::AdtNormalization adtnorm;
+    adtnorm.size_factors = ana.ones.data();
+    writer.write_adt_normalization(adtnorm);
+    writer.write_crispr_normalization();
+
+    kanaval::v3::Writer::FeatureSelection fsel;
+    fsel.means = ana.zeros.data();
+    fsel.vars = ana.zeros.data();
+    fsel.fitted = ana.zeros.data();
+    fsel.resids = ana.zeros.data();
+    writer.write_feature_selection(fsel);
+
+    kanaval::v3::Writer::Pca rpca;
+    rpca.var_exp = { 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+    rpca.pcs = ana.rna_pcs.data();
+    writer.write_rna_pca(rpca);
+
+    kanaval::v3::Writer::Pca apca;
+    apca.num_pcs = 4;
+    apca.var_exp = { 4, 3, 2, 1 };
+    apca.pcs = ana.adt_pcs.data();
+    writer.write_adt_pca(apca);
+
+    kanaval::v3::Writer::Pca cpca;
+    cpca.num_pcs = 2;
+    cpca.var_exp = { 2, 1 };
+    cpca.pcs = ana.crispr_pcs.data();
+    writer.write_crispr_pca(cpca);
+
+    kanaval::v3::Writer::CombineEmbeddings combined;
+    combined.crispr_weight = 0;
+    combined.combined = ana.combined.data();
+    writer.write_combine_embeddings(combined);
+
+    writer.write_batch_correction(kanaval::v3::Writer::BatchCorrection());
+    writer.write_neighbor_index();
+
+    writer.write_choose_clustering("kmeans");
+    kanaval::v3::Writer::SnnGraphCluster snn;
+    writer.write_snn_graph_cluster(snn);
+    kanaval::v3::Writer::KmeansCluster kmeans;
+    kmeans.k = ana.num_clusters;
+    kmeans.clusters = ana.clusters.data();
+    writer.write_kmeans_cluster(kmeans);
+
+    kanaval::v3::Writer::Tsne tsne;
+    tsne.x = ana.coords.data();
+    tsne.y = ana.coords.data();
+    writer.write_tsne(tsne);
+    kanaval::v3::Writer::Umap umap;
+    umap.x = ana.coords.data();
+    umap.y = ana.coords.data();
+    writer.write_umap(umap);
+
+    kanaval::v3::Writer::EffectSummary effect;
+    effect.mean = ana.zeros.data();
+    effect.min = ana.zeros.data();
+    effect.min_rank = ana.ones.data();
+
+    kanaval::v3::Writer::MarkerDetection markers;
+    kanaval::v3::Writer::ClusterMarkers cstats;
+    cstats.means = ana.zeros.data();
+    cstats.detected = ana.zeros.data();
+    cstats.lfc = effect;
+    cstats.delta_detected = effect;
+    cstats.cohen = effect;
+    cstats.auc = effect;
+    for (const auto& mod : ana.num_features) {
+        markers.per_cluster[mod.first] = std::vector<kanaval::v3::Writer::ClusterMarkers>(ana.num_clusters, cstats);
+    }
+    writer.write_marker_detection(markers);
+
+    kanaval::v3::Writer::CustomSelections custom;
+    kanaval::v3::Writer::SelectionMarkers sstats;
+    sstats.means = ana.zeros.data();
+    sstats.detected = ana.zeros.data();
+    sstats.lfc = ana.zeros.data();
+    sstats.delta_detected = ana.zeros.data();
+    sstats.cohen = ana.zeros.data();
+    sstats.auc = ana.zeros.data();
+    for (int s = 0; s < 2; ++s) {
+        kanaval::v3::Writer::Selection sel;
+        sel.name = "selection_" + std::to_string(s);
+        sel.indices.resize(10 + s);
+        std::iota(sel.indices.begin(), sel.indices.end(), s);
+        for (const auto& mod : ana.num_features) {
+            sel.markers[mod.first] = sstats;
+        }
+        custom.selections.push_back(std::move(sel));
+    }
+    writer.write_custom_selections(custom);
+
+    kanaval::v3::Writer::CellLabelling labelling;
+    labelling.human_references = { "BlueprintEncode" };
+    labelling.mouse_references = { "ImmGen" };
+    labelling.per_reference.emplace_back("BlueprintEncode", std::vector<std::string>(ana.num_clusters, "T cell"));
+    labelling.per_reference.emplace_back("ImmGen", std::vector<std::string>(ana.num_clusters, "B cell"));
+    labelling.integrated = std::vector<std::string>(ana.num_clusters, "ImmGen");
+    writer.write_cell_labelling(labelling);
+
+    writer.write__metadata("kanaval", "0.1.0");
+}
+
+TEST(WriterV3, Full) {
+    const std::string path = "TEST_writer.h5";
+    Analysis ana;
+
+    kanaval::writer::Options wopt;
+    wopt.num_threads = 3;
+    wopt.chunk_size = 100;
+    wopt.compact_size = 1024;
+
+    kanaval::Options vopt;
+    vopt.deep = true;
+    vopt.num_threads = 2;
+    vopt.block_size = 250;
+
+    kanaval::v3::Summary written;
+    {
+        kanaval::v3::Writer writer(path, true, wopt, vopt);
+        write_until_filtering(writer, ana);
+        EXPECT_EQ(writer.summary().filtered_cells, ana.filtered_cells);
+        write_remaining(writer, ana);
+        written = writer.summary();
+        writer.close();
+    }
+
+    EXPECT_EQ(written.num_clusters, ana.num_clusters);
+    EXPECT_EQ(written.total_pcs, 14);
+    EXPECT_EQ(written.selections.size(), 2);
+    EXPECT_EQ(written.application_name, "kanaval");
+
+    H5::H5File handle(path, H5F_ACC_RDONLY);
+    auto summary = kanaval::v3::validate(handle, true, 3000000, vopt);
+    EXPECT_EQ(summary.filtered_cells, written.filtered_cells);
+    EXPECT_EQ(summary.cluster_sizes, written.cluster_sizes);
+    EXPECT_EQ(summary.references, written.references);
+
+    // Per-cell datasets are chunked, while parameters are compact.
+    auto discards = handle.openDataSet("rna_quality_control/results/discards");
+    EXPECT_EQ(discards.getCreatePlist().getLayout(), H5D_CHUNKED);
+    auto nmads = handle.openDataSet("rna_quality_control/parameters/nmads");
+    EXPECT_EQ(nmads.getCreatePlist().getLayout(), H5D_COMPACT);
+
+    // Offsets are filled in from the file sizes.
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(handle.openGroup("inputs/parameters/datasets/0/files/1"), "offset"), 100);
+}
+
+TEST(WriterV3, OrderFail) {
+    const std::string path = "TEST_writer.h5";
+    Analysis ana;
+
+    kanaval::v3::Writer writer(path);
+    quick_throw([&]() -> void {
+        writer.write_cell_filtering(kanaval::v3::Writer::CellFiltering());
+    }, "should be written before");
+
+    write_until_filtering(writer, ana);
+    quick_throw([&]() -> void {
+        writer.write_cell_filtering(kanaval::v3::Writer::CellFiltering());
+    }, "already been written");
+}
+
+TEST(WriterV3, ValidationFail) {
+    const std::string path = "TEST_writer.h5";
+    Analysis ana;
+
+    {
+        kanaval::v3::Writer writer(path);
+        write_until_filtering(writer, ana);
+        writer.write_choose_clustering("snn_graph");
+        kanaval::v3::Writer::SnnGraphCluster snn;
+        snn.scheme = "foo";
+        quick_throw([&]() -> void {
+            writer.write_snn_graph_cluster(snn);
+        }, "failed to validate 'snn_graph_cluster'");
+    }
+
+    // Deep validation catches inconsistent contents.
+    {
+        kanaval::Options vopt;
+        vopt.deep = true;
+        kanaval::v3::Writer writer(path, true, kanaval::writer::Options(), vopt);
+
+        kanaval::v3::Writer::Inputs inputs;
+        inputs.datasets.resize(1);
+        inputs.datasets[0].format = "10X";
+        inputs.datasets[0].name = "FOO";
+        inputs.datasets[0].files.push_back({ "h5", "foo.h5", 100, "" });
+        inputs.num_cells = ana.num_cells;
+        inputs.feature_identities.emplace_back("RNA", std::vector<int>{ 0, 1, 2 });
+        writer.write_inputs(inputs);
+
+        kanaval::v3::Writer::RnaQualityControl rna;
+        rna.sums = ana.sums.data();
+        rna.detected = ana.detected.data();
+        rna.proportion = ana.proportion.data();
+        rna.sums_threshold = { 50 };
+        rna.detected_threshold = { 0 };
+        rna.proportion_threshold = { 0.5 };
+        rna.discards = ana.discards.data();
+        quick_throw([&]() -> void {
+            writer.write_rna_quality_control(rna);
+        }, "not consistent with the thresholds");
+
+        // The invalid step doesn't count as written, so its dependents are blocked but the step itself can be written again.
+        quick_throw([&]() -> void {
+            writer.write_cell_filtering(kanaval::v3::Writer::CellFiltering());
+        }, "step 'rna_quality_control' should be written before");
+
+        rna.sums_threshold = { 5 };
+        writer.write_rna_quality_control(rna);
+    }
+
+    // Missing results are reported before validation.
+    {
+        kanaval::v3::Writer writer(path);
+        write_until_filtering(writer, ana);
+        quick_throw([&]() -> void {
+            writer.write_tsne(kanaval::v3::Writer::Tsne());
+        }, "no values supplied for 'x'");
+    }
+}
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include "kanaval/writer.hpp"
+#include "H5Cpp.h"
+#include <vector>
+#include <string>
+#include <random>
+
+static H5D_layout_t get_layout(const H5::DataSet& dhandle) {
+    return dhandle.getCreatePlist().getLayout();
+}
+
+TEST(Writer, Compact) {
+    const std::string path = "TEST_writer.h5";
+    auto handle = kanaval::writer::create_file(path);
+
+    std::vector<double> values { 1.5, 2.5, -3 };
+    auto dhandle = kanaval::writer::write_vector(handle, "foo", values.data(), values.size());
+    EXPECT_EQ(get_layout(dhandle), H5D_COMPACT);
+
+    std::vector<double> observed(values.size());
+    dhandle.read(observed.data(), H5::PredType::NATIVE_DOUBLE);
+    EXPECT_EQ(observed, values);
+
+    kanaval::writer::write_scalar(handle, "bar", 42);
+    EXPECT_EQ(kanaval::utils::load_integer_scalar(handle, "bar"), 42);
+    kanaval::writer::write_scalar(handle, "whee", 0.5);
+    EXPECT_EQ(kanaval::utils::load_float_scalar(handle, "whee"), 0.5);
+
+    kanaval::writer::write_string(handle, "stuff", "kanaval");
+    EXPECT_EQ(kanaval::utils::load_string(handle, "stuff"), "kanaval");
+    kanaval::writer::write_string(handle, "empty", "");
+    EXPECT_EQ(kanaval::utils::load_string(handle, "empty"), "");
+
+    std::vector<std::string> names { "A", "BBB", "", "CC" };
+    kanaval::writer::write_strings(handle, "names", names);
+    EXPECT_EQ(kanaval::utils::load_string_vector(handle, "names"), names);
+}
+
+template<typename T>
+static void check_chunked(int nthreads, int level, bool shuffle, hsize_t ncol) {
+    const std::string path = "TEST_writer.h5";
+    auto handle = kanaval::writer::create_file(path);
+
+    hsize_t nrow = 1001;
+    std::vector<T> values(nrow * (ncol ? ncol : 1));
+    std::mt19937_64 rng(nthreads * 100 + level * 10 + ncol);
+    std::uniform_int_distribution<int> dist(0, 20);
+    for (auto& v : values) {
+        v = dist(rng);
+    }
+
+    kanaval::writer::Options opt;
+    opt.num_threads = nthreads;
+    opt.compression_level = level;
+    opt.shuffle = shuffle;
+    opt.chunk_size = 100;
+    opt.compact_size = 0;
+    auto dhandle = kanaval::writer::write_array(handle, "foo", values.data(), nrow, ncol, opt);
+
+    auto plist = dhandle.getCreatePlist();
+    if (level) {
+        EXPECT_EQ(plist.getLayout(), H5D_CHUNKED);
+        hsize_t cdims[2];
+        int ndims = plist.getChunk(2, cdims);
+        EXPECT_EQ(ndims, (ncol ? 2 : 1));
+        EXPECT_EQ(cdims[0], 100 / (ncol ? ncol : 1));
+        EXPECT_EQ(plist.getNfilters(), (shuffle ? 2 : 1));
+    } else {
+        EXPECT_EQ(plist.getLayout(), H5D_CONTIGUOUS);
+    }
+
+    // Reading through HDF5's filter pipeline.
+    std::vector<T> observed(values.size());
+    dhandle.read(observed.data(), kanaval::utils::native_type<T>());
+    EXPECT_EQ(observed, values);
+
+    // Reading through the raw chunks or the file contents, if available; the latter requires a read-only file.
+    plist.close();
+    dhandle.close();
+    handle.close();
+    H5::H5File rhandle(path, H5F_ACC_RDONLY);
+    auto rdhandle = rhandle.openDataSet("foo");
+    hsize_t stride = (ncol ? ncol : 1);
+    std::vector<T> expected(values.begin() + 123 * stride, values.begin() + 173 * stride);
+
+    kanaval::utils::RowReader<T> reader(rdhandle, stride);
+    typename kanaval::utils::RowReader<T>::Workspace work;
+    std::vector<T> partial(50 * stride);
+    reader.read(123, 50, partial.data(), work);
+    EXPECT_EQ(partial, expected);
+
+    // Also checking that type conversions are handled.
+    kanaval::utils::RowReader<double> converter(rdhandle, stride);
+    typename kanaval::utils::RowReader<double>::Workspace cwork;
+    std::vector<double> converted(50 * stride);
+    converter.read(123, 50, converted.data(), cwork);
+    EXPECT_EQ(converted, std::vector<double>(expected.begin(), expected.end()));
+}
+
+TEST(Writer, Chunked) {
+    check_chunked<double>(1, 6, true, 0);
+    check_chunked<double>(3, 6, true, 0);
+    check_chunked<int>(3, 1, false, 0);
+    check_chunked<float>(2, 9, true, 0);
+
+    check_chunked<double>(1, 6, true, 7);
+    check_chunked<int>(4, 6, true, 7);
+    check_chunked<double>(4, 6, false, 3);
+
+    check_chunked<double>(2, 0, true, 0);
+    check_chunked<int>(2, 0, true, 7);
+}
+
+TEST(Writer, Incompressible) {
+    const std::string path = "TEST_writer.h5";
+    auto handle = kanaval::writer::create_file(path);
+
+    // Random bits in all bytes, so that deflating should not save any space.
+    std::vector<double> values(5000);
+    std::mt19937_64 rng(42);
+    for (auto& v : values) {
+        uint64_t bits = rng();
+        bits &= ~(static_cast<uint64_t>(0x7ff) << 52);
+        std::memcpy(&v, &bits, sizeof(v));
+    }
+
+    kanaval::writer::Options opt;
+    opt.num_threads = 2;
+    opt.chunk_size = 1000;
+    opt.shuffle = false;
+    auto dhandle = kanaval::writer::write_vector(handle, "foo", values.data(), values.size(), opt);
+
+    std::vector<double> observed(values.size());
+    dhandle.read(observed.data(), H5::PredType::NATIVE_DOUBLE);
+    EXPECT_EQ(observed, values);
+}